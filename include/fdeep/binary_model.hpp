@@ -0,0 +1,582 @@
+// Copyright 2016, Tobias Hermann.
+// https://github.com/Dobiasd/frugally-deep
+// Distributed under the MIT License.
+// (See accompanying LICENSE file or at
+//  https://opensource.org/licenses/MIT)
+
+#pragma once
+
+#include "fdeep/common.hpp"
+#include "fdeep/float_buffer.hpp"
+#include "fdeep/half_float.hpp"
+
+#if defined(__GNUC__) || defined(__GNUG__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wctor-dtor-privacy"
+#endif
+#if defined _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4706)
+#pragma warning(disable : 4996)
+#endif
+#include <nlohmann/json.hpp>
+#if defined _MSC_VER
+#pragma warning(pop)
+#endif
+#if defined(__GNUC__) || defined(__GNUG__)
+#pragma GCC diagnostic pop
+#endif
+
+#include <fplus/fplus.hpp>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define FDEEP_HAS_MMAP
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <ostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace fdeep { namespace internal
+{
+
+// Binary model files, as written by convert_model.py with --binary,
+// consist of (all numbers little endian):
+// - the magic bytes "FDEEPBIN"
+// - the format version (uint32)
+// - the blob alignment in bytes (uint32)
+// - the size of the header in bytes (uint64)
+// - the header, i.e., the usual JSON model, but with every float array
+//   replaced by {"blob_offset": ..., "blob_floats": ...}
+//   and an additional "blob_format" ("float16" or "bfloat16")
+//   for arrays stored with 16 bits per value
+// - zero padding up to the next multiple of the blob alignment
+// - the float arrays as raw float32 (or 16-bit) values, each one starting
+//   at blob_offset bytes after the end of the header padding
+//   and padded up to a multiple of the blob alignment.
+// The alignment allows to map the blobs into memory and use them in place.
+// Version 2 added "blob_format", version 1 files are still read.
+static const char binary_model_magic[] = "FDEEPBIN";
+const std::size_t binary_model_magic_size = 8;
+const std::uint32_t binary_model_format_version = 2;
+const std::size_t binary_model_prefix_size = 24;
+
+inline bool is_little_endian()
+{
+    const std::uint32_t one = 1;
+    std::uint8_t first_byte = 0;
+    std::memcpy(&first_byte, &one, 1);
+    return first_byte == 1;
+}
+
+template <typename T>
+T read_little_endian(const std::uint8_t* bytes)
+{
+    T result = 0;
+    for (std::size_t i = 0; i < sizeof(T); ++i)
+    {
+        result = static_cast<T>(result |
+            static_cast<T>(static_cast<T>(bytes[i]) << (8 * i)));
+    }
+    return result;
+}
+
+// Checks the magic bytes without consuming anything from the stream.
+inline bool is_binary_model(std::istream& stream)
+{
+    const auto start = stream.tellg();
+    char magic[binary_model_magic_size];
+    stream.read(magic, static_cast<std::streamsize>(binary_model_magic_size));
+    const bool result = stream.gcount() ==
+            static_cast<std::streamsize>(binary_model_magic_size) &&
+        std::memcmp(magic, binary_model_magic, binary_model_magic_size) == 0;
+    stream.clear();
+    stream.seekg(start);
+    return result;
+}
+
+// References to float arrays have one of the following forms:
+// - {"blob_offset": ..., "blob_floats": ...} in binary models
+// - {"blob_index": ..., "blob_floats": ...} in JSON models,
+//   whose arrays are decoded while parsing (see parse_json_model).
+// Both can have a "blob_format" if the values have 16 bits.
+inline bool json_is_blob_ref(const nlohmann::json& data)
+{
+    return data.is_object() &&
+        (data.find("blob_offset") != data.end() ||
+            data.find("blob_index") != data.end()) &&
+        data.find("blob_floats") != data.end();
+}
+
+inline fplus::maybe<half_float_format> blob_ref_half_float_format(
+    const nlohmann::json& blob_ref)
+{
+    const auto format = blob_ref.find("blob_format");
+    if (format == blob_ref.end())
+    {
+        return fplus::nothing<half_float_format>();
+    }
+    return parse_half_float_format(format->get<std::string>());
+}
+
+// An array decoded while parsing a JSON model,
+// holding either float32 values,
+// or the 16-bit values of an array stored like that.
+// Since they do not depend on the precision of the model,
+// the same arrays (and binary models) can be used for all of them.
+struct decoded_array
+{
+    decoded_array() :
+            floats_(),
+            half_floats_()
+    {
+    }
+    std::vector<float> floats_;
+    half_float_vec half_floats_;
+};
+
+// Moves float32 values into a float_vec,
+// without copying them if no conversion is needed.
+template <typename float_type>
+float_vec<float_type> float32s_to_float_vec(std::vector<float>&& values)
+{
+    return float_vec<float_type>(values.begin(), values.end());
+}
+
+template <>
+inline float_vec<float> float32s_to_float_vec<float>(
+    std::vector<float>&& values)
+{
+    return std::move(values);
+}
+
+// Read-only view of a whole file.
+// Where available, the file is memory-mapped, so its pages
+// are shared by all processes mapping the same file.
+// Otherwise it is read into memory.
+class mapped_file
+{
+public:
+    explicit mapped_file(const std::string& path) :
+        data_(nullptr), size_(0), buffer_()
+    {
+#ifdef FDEEP_HAS_MMAP
+        const int fd = open(path.c_str(), O_RDONLY);
+        assertion(fd >= 0, "Can not open " + path);
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) != 0)
+        {
+            close(fd);
+            raise_error("Can not read size of " + path);
+        }
+        size_ = static_cast<std::size_t>(file_stat.st_size);
+        void* mapping = size_ == 0 ? nullptr :
+            mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        assertion(mapping != MAP_FAILED, "Can not map " + path);
+        data_ = static_cast<const std::uint8_t*>(mapping);
+#else
+        std::ifstream stream(path, std::ios::binary);
+        assertion(stream.good(), "Can not open " + path);
+        buffer_.assign(std::istreambuf_iterator<char>(stream),
+            std::istreambuf_iterator<char>());
+        data_ = reinterpret_cast<const std::uint8_t*>(buffer_.data());
+        size_ = buffer_.size();
+#endif
+    }
+    ~mapped_file()
+    {
+#ifdef FDEEP_HAS_MMAP
+        if (data_ != nullptr)
+        {
+            munmap(const_cast<std::uint8_t*>(data_), size_);
+        }
+#endif
+    }
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+    const std::uint8_t* data() const
+    {
+        return data_;
+    }
+    std::size_t size() const
+    {
+        return size_;
+    }
+private:
+    const std::uint8_t* data_;
+    std::size_t size_;
+    std::vector<char> buffer_;
+};
+
+typedef std::shared_ptr<const mapped_file> mapped_file_ptr;
+
+// Provides the float arrays of a model, either reading them
+// from the stream of a binary model on demand, directly into the memory
+// of the resulting float_vec, from a mapping of a whole binary model file,
+// or by handing out the arrays already decoded while parsing a JSON model.
+// The stream must outlive the reader.
+class weight_blob_reader
+{
+public:
+    explicit weight_blob_reader(std::istream& stream) :
+        stream_(&stream),
+        file_(),
+        decoded_arrays_(),
+        header_(),
+        blobs_start_(0),
+        mutex_()
+    {
+        const auto start = static_cast<std::size_t>(stream.tellg());
+        std::uint8_t prefix[binary_model_prefix_size];
+        read_bytes(prefix, binary_model_prefix_size);
+        const auto header_size = parse_prefix(prefix);
+        std::string header_str(header_size, ' ');
+        read_bytes(&header_str[0], header_size);
+        header_ = nlohmann::json::parse(header_str);
+        blobs_start_ += start;
+    }
+
+    explicit weight_blob_reader(const mapped_file_ptr& file) :
+        stream_(nullptr),
+        file_(file),
+        decoded_arrays_(),
+        header_(),
+        blobs_start_(0),
+        mutex_()
+    {
+        assertion(file->size() >= binary_model_prefix_size,
+            "not a binary model");
+        const auto header_size = parse_prefix(file->data());
+        assertion(file->size() >= blobs_start_ &&
+            binary_model_prefix_size + header_size <= file->size(),
+            "unexpected end of binary model");
+        const char* header_begin = reinterpret_cast<const char*>(
+            file->data() + binary_model_prefix_size);
+        header_ = nlohmann::json::parse(header_begin,
+            header_begin + header_size);
+    }
+
+    // Each one of the arrays can be read only once,
+    // since they are moved out of the reader.
+    explicit weight_blob_reader(std::vector<decoded_array>&& decoded_arrays) :
+        stream_(nullptr),
+        file_(),
+        decoded_arrays_(std::move(decoded_arrays)),
+        header_(),
+        blobs_start_(0),
+        mutex_()
+    {
+    }
+    weight_blob_reader(const weight_blob_reader&) = delete;
+    weight_blob_reader& operator=(const weight_blob_reader&) = delete;
+
+    const nlohmann::json& header() const
+    {
+        return header_;
+    }
+
+    template <typename float_type>
+    float_vec<float_type> read_floats(const nlohmann::json& blob_ref) const
+    {
+        const auto half_format = blob_ref_half_float_format(blob_ref);
+        if (half_format.is_just())
+        {
+            return widen_half_float_buffer<float_type>(
+                read_half_floats(blob_ref));
+        }
+        if (blob_ref.find("blob_index") != blob_ref.end())
+        {
+            return float32s_to_float_vec<float_type>(
+                std::move(take_decoded_array(blob_ref).floats_));
+        }
+        const auto blob = locate_blob(blob_ref, sizeof(float));
+        float_vec<float_type> result(blob.second);
+        if (file_)
+        {
+            copy_floats(file_->data() + blob.first, blob.second,
+                result.data());
+            return result;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        stream_->clear();
+        stream_->seekg(static_cast<std::streamoff>(blob.first));
+        if (std::is_same<float_type, float>::value)
+        {
+            read_bytes(result.data(), blob.second * sizeof(float));
+        }
+        else
+        {
+            std::vector<std::uint8_t> bytes(blob.second * sizeof(float));
+            read_bytes(bytes.data(), bytes.size());
+            copy_floats(bytes.data(), blob.second, result.data());
+        }
+        return result;
+    }
+
+    // Reads an array stored with 16 bits per value without widening it,
+    // viewing the mapped memory if possible.
+    half_float_buffer read_half_floats(const nlohmann::json& blob_ref) const
+    {
+        const auto format = fplus::throw_on_nothing(
+            error("not a 16-bit float array"),
+            blob_ref_half_float_format(blob_ref));
+        if (blob_ref.find("blob_index") != blob_ref.end())
+        {
+            return half_float_buffer(
+                std::move(take_decoded_array(blob_ref).half_floats_), format);
+        }
+        const auto blob = locate_blob(blob_ref, sizeof(std::uint16_t));
+        if (file_)
+        {
+            return half_float_buffer(file_,
+                reinterpret_cast<const std::uint16_t*>(
+                    file_->data() + blob.first), blob.second, format);
+        }
+        half_float_vec result(blob.second);
+        std::lock_guard<std::mutex> lock(mutex_);
+        stream_->clear();
+        stream_->seekg(static_cast<std::streamoff>(blob.first));
+        read_bytes(result.data(), blob.second * sizeof(std::uint16_t));
+        return half_float_buffer(std::move(result), format);
+    }
+
+    // Views the mapped memory if possible, otherwise copies.
+    template <typename float_type>
+    float_buffer<float_type> read_float_buffer(
+        const nlohmann::json& blob_ref) const
+    {
+        if (file_ && std::is_same<float_type, float>::value &&
+            blob_ref_half_float_format(blob_ref).is_nothing())
+        {
+            const auto blob = locate_blob(blob_ref, sizeof(float));
+            return float_buffer<float_type>(file_,
+                reinterpret_cast<const float_type*>(
+                    file_->data() + blob.first), blob.second);
+        }
+        return float_buffer<float_type>(read_floats<float_type>(blob_ref));
+    }
+
+private:
+    // Returns the size of the header and sets blobs_start_
+    // relative to the start of the model.
+    std::size_t parse_prefix(const std::uint8_t* prefix)
+    {
+        assertion(std::numeric_limits<float>::is_iec559 && is_little_endian(),
+            "The floating-point format of your system is not supported.");
+        assertion(std::memcmp(prefix, binary_model_magic,
+            binary_model_magic_size) == 0, "not a binary model");
+        const auto version = read_little_endian<std::uint32_t>(prefix + 8);
+        assertion(version >= 1 && version <= binary_model_format_version,
+            "unsupported binary model format version " + fplus::show(version));
+        const auto alignment = read_little_endian<std::uint32_t>(prefix + 12);
+        assertion(alignment > 0, "invalid blob alignment");
+        const auto header_size = static_cast<std::size_t>(
+            read_little_endian<std::uint64_t>(prefix + 16));
+        const std::size_t header_end = binary_model_prefix_size + header_size;
+        blobs_start_ = (header_end + alignment - 1) / alignment * alignment;
+        return header_size;
+    }
+
+    // Moves the array out of the reader, so every one of them
+    // can be taken only once, even when layers are created concurrently.
+    decoded_array take_decoded_array(const nlohmann::json& blob_ref) const
+    {
+        const std::size_t idx = blob_ref["blob_index"];
+        const std::size_t count = blob_ref["blob_floats"];
+        assertion(idx < decoded_arrays_.size(), "invalid blob reference");
+        std::lock_guard<std::mutex> lock(mutex_);
+        decoded_array& arr = decoded_arrays_[idx];
+        assertion(arr.floats_.size() + arr.half_floats_.size() == count,
+            "float array already read");
+        decoded_array result = std::move(arr);
+        arr = decoded_array();
+        return result;
+    }
+
+    // Absolute byte position and value count of a blob.
+    std::pair<std::size_t, std::size_t> locate_blob(
+        const nlohmann::json& blob_ref, std::size_t value_size) const
+    {
+        assertion(json_is_blob_ref(blob_ref) &&
+            blob_ref.find("blob_offset") != blob_ref.end() &&
+            (stream_ != nullptr || file_), "invalid blob reference");
+        const std::size_t offset = blob_ref["blob_offset"];
+        const std::size_t count = blob_ref["blob_floats"];
+        const std::size_t position = blobs_start_ + offset;
+        assertion(!file_ || position + count * value_size <= file_->size(),
+            "unexpected end of binary model");
+        return {position, count};
+    }
+
+    template <typename float_type>
+    static void copy_floats(const std::uint8_t* src, std::size_t count,
+        float_type* dest)
+    {
+        if (std::is_same<float_type, float>::value)
+        {
+            std::memcpy(dest, src, count * sizeof(float));
+            return;
+        }
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            float value;
+            std::memcpy(&value, src + i * sizeof(float), sizeof(float));
+            dest[i] = static_cast<float_type>(value);
+        }
+    }
+
+    void read_bytes(void* dest, std::size_t size) const
+    {
+        stream_->read(static_cast<char*>(dest),
+            static_cast<std::streamsize>(size));
+        assertion(stream_->gcount() == static_cast<std::streamsize>(size),
+            "unexpected end of binary model");
+    }
+
+    std::istream* stream_;
+    mapped_file_ptr file_;
+    mutable std::vector<decoded_array> decoded_arrays_;
+    nlohmann::json header_;
+    std::size_t blobs_start_;
+    mutable std::mutex mutex_;
+};
+
+const std::size_t binary_model_alignment = 64;
+
+// Replaces the references to decoded arrays (see parse_json_model)
+// by the ones into the blobs of a binary model.
+inline nlohmann::json json_blob_index_refs_to_offsets(
+    const nlohmann::json& data, const std::vector<std::size_t>& offsets)
+{
+    if (json_is_blob_ref(data) && data.find("blob_index") != data.end())
+    {
+        const std::size_t idx = data["blob_index"];
+        assertion(idx < offsets.size(), "invalid blob reference");
+        nlohmann::json result = data;
+        result.erase("blob_index");
+        result["blob_offset"] = offsets[idx];
+        return result;
+    }
+    if (data.is_object() || data.is_array())
+    {
+        nlohmann::json result = data;
+        for (auto& element : result)
+        {
+            element = json_blob_index_refs_to_offsets(element, offsets);
+        }
+        return result;
+    }
+    return data;
+}
+
+// Writes a model in the binary format,
+// with its float arrays referring to decoded_arrays
+// (as returned by parse_json_model).
+inline void write_binary_model(std::ostream& stream,
+    const nlohmann::json& json_data,
+    const std::vector<decoded_array>& decoded_arrays)
+{
+    assertion(std::numeric_limits<float>::is_iec559 && is_little_endian(),
+        "The floating-point format of your system is not supported.");
+    const auto padding_size = [](std::size_t size) -> std::size_t
+    {
+        return (binary_model_alignment - size % binary_model_alignment) %
+            binary_model_alignment;
+    };
+    std::vector<std::size_t> offsets;
+    offsets.reserve(decoded_arrays.size());
+    std::size_t blobs_size = 0;
+    const auto byte_size = [](const decoded_array& arr) -> std::size_t
+    {
+        return arr.floats_.size() * sizeof(float) +
+            arr.half_floats_.size() * sizeof(std::uint16_t);
+    };
+    for (const auto& arr : decoded_arrays)
+    {
+        offsets.push_back(blobs_size);
+        const std::size_t size = byte_size(arr);
+        blobs_size += size + padding_size(size);
+    }
+    const std::string header =
+        json_blob_index_refs_to_offsets(json_data, offsets).dump();
+
+    const auto write_little_endian = [&stream](std::uint64_t value,
+        std::size_t bytes)
+    {
+        for (std::size_t i = 0; i < bytes; ++i)
+        {
+            stream.put(static_cast<char>((value >> (8 * i)) & 0xff));
+        }
+    };
+    const std::string zeros(binary_model_alignment, '\0');
+    stream.write(binary_model_magic,
+        static_cast<std::streamsize>(binary_model_magic_size));
+    write_little_endian(binary_model_format_version, 4);
+    write_little_endian(binary_model_alignment, 4);
+    write_little_endian(header.size(), 8);
+    stream.write(header.data(), static_cast<std::streamsize>(header.size()));
+    stream.write(zeros.data(), static_cast<std::streamsize>(
+        padding_size(binary_model_prefix_size + header.size())));
+    for (const auto& arr : decoded_arrays)
+    {
+        const std::size_t size = byte_size(arr);
+        if (!arr.half_floats_.empty())
+        {
+            stream.write(reinterpret_cast<const char*>(arr.half_floats_.data()),
+                static_cast<std::streamsize>(size));
+        }
+        else
+        {
+            stream.write(reinterpret_cast<const char*>(arr.floats_.data()),
+                static_cast<std::streamsize>(size));
+        }
+        stream.write(zeros.data(),
+            static_cast<std::streamsize>(padding_size(size)));
+    }
+    assertion(stream.good(), "Can not write binary model");
+}
+
+// The blobs decode_floats resolves blob references with
+// while a binary model is being loaded on the current thread.
+inline const weight_blob_reader*& current_weight_blob_reader()
+{
+    static thread_local const weight_blob_reader* reader = nullptr;
+    return reader;
+}
+
+// Sets current_weight_blob_reader for the lifetime of the scope object.
+class weight_blob_reader_scope
+{
+public:
+    explicit weight_blob_reader_scope(const weight_blob_reader* reader) :
+        previous_(current_weight_blob_reader())
+    {
+        current_weight_blob_reader() = reader;
+    }
+    ~weight_blob_reader_scope()
+    {
+        current_weight_blob_reader() = previous_;
+    }
+    weight_blob_reader_scope(const weight_blob_reader_scope&) = delete;
+    weight_blob_reader_scope& operator=(
+        const weight_blob_reader_scope&) = delete;
+private:
+    const weight_blob_reader* previous_;
+};
+
+} } // namespace fdeep, namespace internal
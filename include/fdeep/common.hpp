@@ -65,10 +65,12 @@ inline void assertion(bool cond, const std::string& error)
     }
 }
 
+// Precision of fdeep::model, fdeep::tensor5 etc.,
+// i.e., the one used if none is chosen explicitly.
 #ifdef FDEEP_FLOAT_TYPE
-    typedef FDEEP_FLOAT_TYPE float_type;
+    typedef FDEEP_FLOAT_TYPE default_float_type;
 #else
-    typedef float float_type;
+    typedef float default_float_type;
 #endif
 
 #if EIGEN_VERSION_AT_LEAST(3,3,0)
@@ -77,10 +79,23 @@ inline void assertion(bool cond, const std::string& error)
     typedef Eigen::DenseIndex EigenIndex;
 #endif
 
-typedef std::vector<float_type> float_vec;
-typedef fplus::shared_ref<float_vec> shared_float_vec;
+// Keeps a function parameter from taking part in template argument deduction.
+template <typename T>
+struct non_deduced
+{
+    typedef T type;
+};
+
+template <typename float_type>
+using float_vec = std::vector<float_type>;
+template <typename float_type>
+using shared_float_vec = fplus::shared_ref<float_vec<float_type>>;
 
+template <typename float_type>
 using ColMajorMatrixXf = Eigen::Matrix<float_type, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor>;
+template <typename float_type>
 using RowMajorMatrixXf = Eigen::Matrix<float_type, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+template <typename float_type>
+using ColVectorXf = Eigen::Matrix<float_type, Eigen::Dynamic, 1>;
 
 } } // namespace fdeep, namespace internal
@@ -9,124 +9,64 @@
 #include "fdeep/common.hpp"
 
 #include "fdeep/filter.hpp"
+#include "fdeep/float_buffer.hpp"
+#include "fdeep/thread_pool.hpp"
 
 #include <algorithm>
 #include <cassert>
 #include <cstddef>
+#include <utility>
 #include <vector>
 
 namespace fdeep { namespace internal
 {
 
+// The weights hold the filters one after another,
+// i.e., they form a row-major (filter_count_ x filter volume) matrix,
+// with the values of each filter in the order of an im2col column.
+// Dilated filters are not inflated with zeros,
+// instead their positions are applied dilation_rate_ apart.
+template <typename float_type>
 struct im2col_filter_matrix
 {
-    ColMajorMatrixXf mat_;
+    float_buffer<float_type> weights_;
+    ColVectorXf<float_type> bias_;
     shape5 filter_shape_;
+    shape2 dilation_rate_;
     std::size_t filter_count_;
 };
 
-inline im2col_filter_matrix generate_im2col_filter_matrix(
-    const std::vector<filter>& filters)
+// The area of the input covered by a dilated filter.
+inline shape2 dilated_filter_shape(const shape5& filter_shape,
+    const shape2& dilation_rate)
 {
-    assertion(fplus::all_the_same_on(
-        fplus_c_mem_fn_t(filter, shape, shape5), filters),
-        "all filters must have the same shape");
-
-    const std::size_t fy = filters.front().shape().height_;
-    const std::size_t fx = filters.front().shape().width_;
-    const std::size_t fz = filters.front().shape().depth_;
-    ColMajorMatrixXf b(filters.size(), fy * fx * fz + 1);
-    EigenIndex b_y = 0;
-    EigenIndex b_x = 0;
-    for (std::size_t f = 0; f < filters.size(); ++f)
-    {
-        b_x = 0;
-        const filter& filter = filters[f];
-        for (std::size_t yf = 0; yf < fy; ++yf)
-        {
-            for (std::size_t xf = 0; xf < fx; ++xf)
-            {
-                for (std::size_t zf = 0; zf < fz; ++zf)
-                {
-                    b(b_y, b_x++) = filter.get(yf, xf, zf);
-                }
-            }
-        }
-        b(b_y, b_x++) = filter.get_bias();
-        ++b_y;
-    }
-    return {b, filters.front().shape(), filters.size()};
+    return dilate_shape5(dilation_rate, filter_shape).without_depth();
 }
 
-inline im2col_filter_matrix generate_im2col_single_filter_matrix(
-    const filter& filter)
+template <typename float_type>
+Eigen::Map<const RowMajorMatrixXf<float_type>, Eigen::Unaligned>
+im2col_filter_weights(const im2col_filter_matrix<float_type>& filter_mat)
 {
-    return generate_im2col_filter_matrix(filter_vec(1, filter));
+    return Eigen::Map<const RowMajorMatrixXf<float_type>, Eigen::Unaligned>(
+        filter_mat.weights_.data(),
+        static_cast<EigenIndex>(filter_mat.filter_count_),
+        static_cast<EigenIndex>(filter_mat.filter_shape_.volume()));
 }
 
-// GEMM convolution, faster but uses more RAM
-// https://stackoverflow.com/questions/16798888/2-d-convolution-as-a-matrix-matrix-multiplication
-// https://github.com/tensorflow/tensorflow/blob/a0d784bdd31b27e013a7eac58a86ba62e86db299/tensorflow/core/kernels/conv_ops_using_gemm.cc
-// http://www.youtube.com/watch?v=pA4BsUK3oP4&t=36m22s
-inline tensor5 convolve_im2col(
-    std::size_t out_height,
-    std::size_t out_width,
-    std::size_t strides_y,
-    std::size_t strides_x,
-    std::size_t offset_y,
-    std::size_t offset_x,
-    const im2col_filter_matrix& filter_mat,
-    const tensor5& in_padded)
+// Uses the weights in place, so they can also be
+// a view into a memory-mapped model file.
+template <typename float_type>
+im2col_filter_matrix<float_type> im2col_filter_matrix_from_weights(
+    const shape5& filter_shape, const shape2& dilation_rate, std::size_t k,
+    const float_buffer<float_type>& weights, const float_vec<float_type>& bias)
 {
-    const auto fy = filter_mat.filter_shape_.height_;
-    const auto fx = filter_mat.filter_shape_.width_;
-    const auto fz = filter_mat.filter_shape_.depth_;
-    ColMajorMatrixXf a(fy * fx * fz + 1, out_height * out_width);
-    EigenIndex a_x = 0;
-    for (std::size_t y = 0; y < out_height; ++y)
-    {
-        for (std::size_t x = 0; x < out_width; ++x)
-        {
-            EigenIndex a_y = 0;
-            for (std::size_t yf = 0; yf < fy; ++yf)
-            {
-                for (std::size_t xf = 0; xf < fx; ++xf)
-                {
-                    for (std::size_t zf = 0; zf < fz; ++zf)
-                    {
-                        a(a_y++, a_x) = in_padded.get(0, 0,
-                                offset_y + strides_y * y + yf,
-                                offset_x + strides_x * x + xf,
-                                zf);
-                    }
-                }
-                a(a_y, a_x) = static_cast<float_type>(1);
-            }
-            ++a_x;
-        }
-    }
-
-    const std::size_t val_cnt =
-        static_cast<std::size_t>(filter_mat.mat_.rows() * a.cols());
-    assertion(val_cnt % (out_height * out_width) == 0,
-        "Can not calculate out_depth");
-
-    const std::size_t out_depth = val_cnt / (out_height * out_width);
-    assertion(val_cnt == out_depth * out_height * out_width,
-        "Invalid target size");
-
-    shared_float_vec res_vec = fplus::make_shared_ref<float_vec>();
-    res_vec->resize(static_cast<std::size_t>(out_depth * out_height * out_width));
-
-    Eigen::Map<ColMajorMatrixXf, Eigen::Unaligned> out_mat_map(
-        res_vec->data(),
-        static_cast<EigenIndex>(filter_mat.mat_.rows()),
-        static_cast<EigenIndex>(a.cols()));
-
-    // https://stackoverflow.com/questions/48644724/multiply-two-eigen-matrices-directly-into-memory-of-target-matrix
-    out_mat_map.noalias() = filter_mat.mat_ * a;
-
-    return tensor5(shape5(1, 1, out_height, out_width, out_depth), res_vec);
+    assertion(weights.size() == k * filter_shape.volume(),
+        "invalid weight size");
+    assertion(bias.size() == k, "invalid bias size");
+    assertion(dilation_rate.area() > 0, "invalid dilation rate");
+    return {weights, Eigen::Map<const ColVectorXf<float_type>, Eigen::Unaligned>(
+        bias.data(), static_cast<EigenIndex>(bias.size())),
+        filter_shape, dilation_rate, k};
 }
 
 enum class padding { valid, same, causal };
@@ -230,34 +170,565 @@ inline convolution_config preprocess_convolution(
         out_height_size_t, out_width_size_t};
 }
 
-inline tensor5 convolve(
+// Returns the range [begin, end) of filter positions
+// hitting the input for an output position,
+// which starts at position pos of the padded input.
+inline std::pair<std::size_t, std::size_t> valid_filter_range(
+    std::size_t pos, std::size_t pad_before, std::size_t input_size,
+    std::size_t filter_size, std::size_t dilation)
+{
+    const auto div_ceil = [dilation](std::size_t x) -> std::size_t
+    {
+        return (x + dilation - 1) / dilation;
+    };
+    const std::size_t begin = pad_before > pos
+        ? div_ceil(pad_before - pos) : 0;
+    const std::size_t end = input_size + pad_before > pos
+        ? std::min(filter_size, div_ceil(input_size + pad_before - pos)) : 0;
+    return {begin, std::max(begin, end)};
+}
+
+// Fills the columns [col_begin, col_end) of the im2col matrix,
+// one column per output position (row-major over y and x),
+// the positions of all input tensors following each other.
+// The values of one filter position are consecutive in the input,
+// so they are copied at once, or set to zero if in the padding.
+template <typename float_type>
+void fill_im2col_columns(
+    ColMajorMatrixXf<float_type>& a,
+    std::size_t col_begin,
+    std::size_t col_end,
+    const convolution_config& conv_cfg,
+    const shape2& strides,
+    const shape5& filter_shape,
+    const shape2& dilation_rate,
+    const tensor5s<float_type>& inputs)
+{
+    const auto fy = filter_shape.height_;
+    const auto fx = filter_shape.width_;
+    const auto fz = filter_shape.depth_;
+    const shape5& input_shape = inputs.front().shape();
+    const std::size_t out_width = conv_cfg.out_width_;
+    const std::size_t positions = conv_cfg.out_height_ * out_width;
+    for (std::size_t col = col_begin; col < col_end; ++col)
+    {
+        const float_type* in = inputs[col / positions].as_vector()->data();
+        const std::size_t py = conv_cfg.offset_y_ +
+            strides.height_ * ((col % positions) / out_width);
+        const std::size_t px = conv_cfg.offset_x_ +
+            strides.width_ * (col % out_width);
+        const auto range_y = valid_filter_range(py, conv_cfg.pad_top_,
+            input_shape.height_, fy, dilation_rate.height_);
+        const auto range_x = valid_filter_range(px, conv_cfg.pad_left_,
+            input_shape.width_, fx, dilation_rate.width_);
+        float_type* dest = a.data() + col * fy * fx * fz;
+        for (std::size_t yf = 0; yf < fy; ++yf)
+        {
+            const bool row_valid = yf >= range_y.first && yf < range_y.second;
+            for (std::size_t xf = 0; xf < fx; ++xf, dest += fz)
+            {
+                if (row_valid && xf >= range_x.first && xf < range_x.second)
+                {
+                    const float_type* src = in +
+                        ((py + yf * dilation_rate.height_ - conv_cfg.pad_top_) *
+                            input_shape.width_ +
+                        px + xf * dilation_rate.width_ - conv_cfg.pad_left_) *
+                        fz;
+                    std::copy(src, src + fz, dest);
+                }
+                else
+                {
+                    std::fill(dest, dest + fz, static_cast<float_type>(0));
+                }
+            }
+        }
+    }
+}
+
+// Splits the results of convolving a batch of samples,
+// stored one after another, into one tensor per sample.
+template <typename float_type>
+tensor5s<float_type> split_convolution_results(const shared_float_vec<float_type>& res_vec,
+    const shape5& out_shape, std::size_t sample_count)
+{
+    if (sample_count == 1)
+    {
+        return {tensor5<float_type>(out_shape, res_vec)};
+    }
+    const std::size_t out_volume = out_shape.volume();
+    return fplus::transform([&res_vec, &out_shape, out_volume]
+        (std::size_t sample) -> tensor5<float_type>
+    {
+        const auto begin = res_vec->begin() +
+            static_cast<std::ptrdiff_t>(sample * out_volume);
+        return tensor5<float_type>(out_shape,
+            float_vec<float_type>(begin, begin + static_cast<std::ptrdiff_t>(out_volume)));
+    }, fplus::numbers<std::size_t>(0, sample_count));
+}
+
+// Below this number of multiply-adds a convolution is not split
+// into column blocks, since the threading overhead would dominate.
+const std::size_t parallel_convolution_min_madds = 1 << 18;
+const std::size_t parallel_convolution_min_block_cols = 32;
+
+// GEMM convolution, faster but uses more RAM
+// https://stackoverflow.com/questions/16798888/2-d-convolution-as-a-matrix-matrix-multiplication
+// https://github.com/tensorflow/tensorflow/blob/a0d784bdd31b27e013a7eac58a86ba62e86db299/tensorflow/core/kernels/conv_ops_using_gemm.cc
+// http://www.youtube.com/watch?v=pA4BsUK3oP4&t=36m22s
+// All input tensors (samples of a batch) share one im2col matrix,
+// so the filters are multiplied with all of them in one go.
+// When the forward pass runs on a thread pool, the output columns
+// are split into blocks, each one gathered and multiplied by its own task.
+// The padding is not copied, but filled in while gathering.
+template <typename float_type>
+tensor5s<float_type> convolve_im2col_batch(
+    const convolution_config& conv_cfg,
+    const shape2& strides,
+    const im2col_filter_matrix<float_type>& filter_mat,
+    const tensor5s<float_type>& inputs)
+{
+    const auto fy = filter_mat.filter_shape_.height_;
+    const auto fx = filter_mat.filter_shape_.width_;
+    const auto fz = filter_mat.filter_shape_.depth_;
+    const std::size_t out_height = conv_cfg.out_height_;
+    const std::size_t out_width = conv_cfg.out_width_;
+    const std::size_t positions = out_height * out_width;
+    const std::size_t col_count = positions * inputs.size();
+    ColMajorMatrixXf<float_type> a(fy * fx * fz, col_count);
+
+    const std::size_t out_depth = filter_mat.filter_count_;
+    const auto weights = im2col_filter_weights(filter_mat);
+
+    shared_float_vec<float_type> res_vec = fplus::make_shared_ref<float_vec<float_type>>();
+    res_vec->resize(out_depth * col_count);
+
+    Eigen::Map<ColMajorMatrixXf<float_type>, Eigen::Unaligned> out_mat_map(
+        res_vec->data(),
+        static_cast<EigenIndex>(out_depth),
+        static_cast<EigenIndex>(col_count));
+
+    const auto process_columns = [&](std::size_t col_begin, std::size_t col_end)
+    {
+        fill_im2col_columns(a, col_begin, col_end, conv_cfg, strides,
+            filter_mat.filter_shape_, filter_mat.dilation_rate_, inputs);
+        const EigenIndex begin = static_cast<EigenIndex>(col_begin);
+        const EigenIndex size = static_cast<EigenIndex>(col_end - col_begin);
+        // https://stackoverflow.com/questions/48644724/multiply-two-eigen-matrices-directly-into-memory-of-target-matrix
+        out_mat_map.middleCols(begin, size).noalias() =
+            weights * a.middleCols(begin, size);
+        out_mat_map.middleCols(begin, size).colwise() += filter_mat.bias_;
+    };
+
+    thread_pool* pool = current_thread_pool();
+    const std::size_t madds = static_cast<std::size_t>(a.size()) * out_depth;
+    const std::size_t block_count = pool == nullptr ||
+        madds < parallel_convolution_min_madds ? 1 :
+        std::min(pool->thread_count(),
+            col_count / parallel_convolution_min_block_cols);
+
+    if (block_count <= 1)
+    {
+        process_columns(0, col_count);
+    }
+    else
+    {
+        pool->parallel_for(block_count, [&](std::size_t block)
+        {
+            process_columns(block * col_count / block_count,
+                (block + 1) * col_count / block_count);
+        });
+    }
+
+    return split_convolution_results(res_vec,
+        shape5(1, 1, out_height, out_width, out_depth), inputs.size());
+}
+
+// A 1x1 convolution with stride 1 needs neither padding nor im2col,
+// since the NHWC values of an input already form
+// a column-major (depth x positions) matrix.
+// It is multiplied with the filters in place,
+// and the results are written directly into the output.
+template <typename float_type>
+tensor5s<float_type> convolve_pointwise_batch(
+    const im2col_filter_matrix<float_type>& filter_mat,
+    const tensor5s<float_type>& inputs)
+{
+    const shape5& input_shape = inputs.front().shape();
+    const std::size_t depth = input_shape.depth_;
+    const std::size_t positions = input_shape.height_ * input_shape.width_;
+    const std::size_t col_count = positions * inputs.size();
+    const std::size_t out_depth = filter_mat.filter_count_;
+    const auto weights = im2col_filter_weights(filter_mat);
+
+    shared_float_vec<float_type> res_vec = fplus::make_shared_ref<float_vec<float_type>>();
+    res_vec->resize(out_depth * col_count);
+
+    Eigen::Map<ColMajorMatrixXf<float_type>, Eigen::Unaligned> out_mat_map(
+        res_vec->data(),
+        static_cast<EigenIndex>(out_depth),
+        static_cast<EigenIndex>(col_count));
+
+    const auto process_columns = [&](std::size_t col_begin, std::size_t col_end)
+    {
+        for (std::size_t col = col_begin; col < col_end;)
+        {
+            const std::size_t sample = col / positions;
+            const std::size_t end = std::min(col_end, (sample + 1) * positions);
+            const EigenIndex size = static_cast<EigenIndex>(end - col);
+            const Eigen::Map<const ColMajorMatrixXf<float_type>, Eigen::Unaligned>
+                in_mat(inputs[sample].as_vector()->data() +
+                    (col - sample * positions) * depth,
+                    static_cast<EigenIndex>(depth), size);
+            auto out_cols = out_mat_map.middleCols(
+                static_cast<EigenIndex>(col), size);
+            out_cols.noalias() = weights * in_mat;
+            out_cols.colwise() += filter_mat.bias_;
+            col = end;
+        }
+    };
+
+    thread_pool* pool = current_thread_pool();
+    const std::size_t madds = col_count * depth * out_depth;
+    const std::size_t block_count = pool == nullptr ||
+        madds < parallel_convolution_min_madds ? 1 :
+        std::min(pool->thread_count(),
+            col_count / parallel_convolution_min_block_cols);
+
+    if (block_count <= 1)
+    {
+        process_columns(0, col_count);
+    }
+    else
+    {
+        pool->parallel_for(block_count, [&](std::size_t block)
+        {
+            process_columns(block * col_count / block_count,
+                (block + 1) * col_count / block_count);
+        });
+    }
+
+    return split_convolution_results(res_vec,
+        shape5(1, 1, input_shape.height_, input_shape.width_, out_depth),
+        inputs.size());
+}
+
+// Convolves all inputs, which must share the same shape,
+// with one matrix multiplication.
+template <typename float_type>
+tensor5s<float_type> convolve_batch(
     const shape2& strides,
     const padding& pad_type,
     bool use_offset,
-    const im2col_filter_matrix& filter_mat,
-    const tensor5& input)
+    const im2col_filter_matrix<float_type>& filter_mat,
+    const tensor5s<float_type>& inputs)
 {
-    assertion(filter_mat.filter_shape_.depth_ == input.shape().depth_,
+    assertion(!inputs.empty(), "no input tensors");
+    const auto input_shape = inputs.front().shape();
+    assertion(fplus::all_the_same_on(
+        fplus_c_mem_fn_t(tensor5<float_type>, shape, shape5), inputs),
+        "all inputs must have the same shape");
+    assertion(filter_mat.filter_shape_.depth_ == input_shape.depth_,
         "invalid filter depth");
 
+    if (filter_mat.filter_shape_.without_depth() == shape2(1, 1) &&
+        strides == shape2(1, 1))
+    {
+        return convolve_pointwise_batch(filter_mat, inputs);
+    }
+
     const auto conv_cfg = preprocess_convolution(
-        filter_mat.filter_shape_.without_depth(),
-        strides, pad_type, use_offset, input.shape().height_, input.shape().width_);
+        dilated_filter_shape(filter_mat.filter_shape_, filter_mat.dilation_rate_),
+        strides, pad_type, use_offset, input_shape.height_, input_shape.width_);
+
+    return convolve_im2col_batch(conv_cfg, strides, filter_mat, inputs);
+}
+
+template <typename float_type>
+tensor5<float_type> convolve(
+    const shape2& strides,
+    const padding& pad_type,
+    bool use_offset,
+    const im2col_filter_matrix<float_type>& filter_mat,
+    const tensor5<float_type>& input)
+{
+    return convolve_batch(strides, pad_type, use_offset, filter_mat,
+        {input}).front();
+}
+
+// Depthwise filters, stored as the weights of all channels
+// for one filter position after another,
+// i.e., interleaved like the values of an NHWC tensor.
+template <typename float_type>
+struct depthwise_filter_matrix
+{
+    depthwise_filter_matrix() :
+            weights_(),
+            bias_(),
+            filter_height_(0),
+            filter_width_(0),
+            dilation_height_(1),
+            dilation_width_(1)
+    {
+    }
+    depthwise_filter_matrix(const float_vec<float_type>& weights,
+        const float_vec<float_type>& bias,
+        std::size_t filter_height,
+        std::size_t filter_width,
+        std::size_t dilation_height,
+        std::size_t dilation_width) :
+            weights_(weights),
+            bias_(bias),
+            filter_height_(filter_height),
+            filter_width_(filter_width),
+            dilation_height_(dilation_height),
+            dilation_width_(dilation_width)
+    {
+    }
+    float_vec<float_type> weights_;
+    float_vec<float_type> bias_;
+    std::size_t filter_height_;
+    std::size_t filter_width_;
+    std::size_t dilation_height_;
+    std::size_t dilation_width_;
+};
 
-    const std::size_t offset_y = conv_cfg.offset_y_;
-    const std::size_t offset_x = conv_cfg.offset_x_;
+// Takes one single-channel filter per channel.
+template <typename float_type>
+depthwise_filter_matrix<float_type> generate_depthwise_filter_matrix(
+    const filter_vec<float_type>& filters, const shape2& dilation_rate)
+{
+    assertion(dilation_rate.area() > 0, "invalid dilation rate");
+    assertion(!filters.empty(), "no filters");
+    assertion(fplus::all_the_same_on(
+        fplus_c_mem_fn_t(filter<float_type>, shape, shape5), filters),
+        "all filters must have the same shape");
+    const shape5& filter_shape = filters.front().shape();
+    assertion(filter_shape.depth_ == 1, "invalid depthwise filter depth");
+    const std::size_t channels = filters.size();
+    float_vec<float_type> weights(filter_shape.volume() * channels);
+    float_vec<float_type> bias;
+    bias.reserve(channels);
+    for (std::size_t c = 0; c < channels; ++c)
+    {
+        for (std::size_t yf = 0; yf < filter_shape.height_; ++yf)
+        {
+            for (std::size_t xf = 0; xf < filter_shape.width_; ++xf)
+            {
+                weights[(yf * filter_shape.width_ + xf) * channels + c] =
+                    filters[c].get(yf, xf, 0);
+            }
+        }
+        bias.push_back(filters[c].get_bias());
+    }
+    return {weights, bias, filter_shape.height_, filter_shape.width_,
+        dilation_rate.height_, dilation_rate.width_};
+}
+
+// Writes the depthwise convolution of the output positions
+// [pos_begin, pos_end), row-major over y and x, to out,
+// directly on the interleaved NHWC values,
+// so every filter position is applied to all channels at once.
+// The padding is skipped instead of being read.
+template <typename float_type>
+void depthwise_convolve_positions(
+    const shape2& strides,
+    const convolution_config& conv_cfg,
+    const depthwise_filter_matrix<float_type>& filter_mat,
+    const tensor5<float_type>& input,
+    std::size_t pos_begin,
+    std::size_t pos_end,
+    float_type* out)
+{
+    typedef Eigen::Array<float_type, Eigen::Dynamic, 1> channel_array;
+    const shape5& input_shape = input.shape();
+    const std::size_t channels = filter_mat.bias_.size();
+    const std::size_t filter_width = filter_mat.filter_width_;
+    const std::size_t dilation_y = filter_mat.dilation_height_;
+    const std::size_t dilation_x = filter_mat.dilation_width_;
+    const auto size = static_cast<EigenIndex>(channels);
+    const Eigen::Map<const channel_array, Eigen::Unaligned> bias(
+        filter_mat.bias_.data(), size);
+    const float_type* in = input.as_vector()->data();
+    for (std::size_t pos = pos_begin; pos < pos_end; ++pos)
+    {
+        const std::size_t py = conv_cfg.offset_y_ +
+            strides.height_ * (pos / conv_cfg.out_width_);
+        const std::size_t px = conv_cfg.offset_x_ +
+            strides.width_ * (pos % conv_cfg.out_width_);
+        const auto range_y = valid_filter_range(py, conv_cfg.pad_top_,
+            input_shape.height_, filter_mat.filter_height_, dilation_y);
+        const auto range_x = valid_filter_range(px, conv_cfg.pad_left_,
+            input_shape.width_, filter_width, dilation_x);
+        Eigen::Map<channel_array, Eigen::Unaligned> acc(
+            out + (pos - pos_begin) * channels, size);
+        acc = bias;
+        for (std::size_t yf = range_y.first; yf < range_y.second; ++yf)
+        {
+            const std::size_t iy = py + yf * dilation_y - conv_cfg.pad_top_;
+            for (std::size_t xf = range_x.first; xf < range_x.second; ++xf)
+            {
+                const std::size_t ix = px + xf * dilation_x - conv_cfg.pad_left_;
+                acc += Eigen::Map<const channel_array, Eigen::Unaligned>(
+                    in + (iy * input_shape.width_ + ix) * channels, size) *
+                    Eigen::Map<const channel_array, Eigen::Unaligned>(
+                        filter_mat.weights_.data() +
+                        (yf * filter_width + xf) * channels, size);
+            }
+        }
+    }
+}
+
+template <typename float_type>
+convolution_config preprocess_depthwise_convolution(
+    const shape2& strides,
+    const padding& pad_type,
+    bool use_offset,
+    const depthwise_filter_matrix<float_type>& filter_mat,
+    const shape5& input_shape)
+{
+    assertion(input_shape.depth_ == filter_mat.bias_.size(),
+        "invalid input depth");
+    return preprocess_convolution(
+        dilated_filter_shape(shape5(1, 1,
+            filter_mat.filter_height_, filter_mat.filter_width_, 1),
+            shape2(filter_mat.dilation_height_, filter_mat.dilation_width_)),
+        strides, pad_type, use_offset, input_shape.height_, input_shape.width_);
+}
+
+// Convolves every channel of the input with its own filter.
+// When the forward pass runs on a thread pool,
+// the output rows are split into blocks.
+template <typename float_type>
+tensor5<float_type> depthwise_convolve(
+    const shape2& strides,
+    const padding& pad_type,
+    bool use_offset,
+    const depthwise_filter_matrix<float_type>& filter_mat,
+    const tensor5<float_type>& input)
+{
+    const auto conv_cfg = preprocess_depthwise_convolution(
+        strides, pad_type, use_offset, filter_mat, input.shape());
+    const std::size_t channels = filter_mat.bias_.size();
     const std::size_t out_height = conv_cfg.out_height_;
     const std::size_t out_width = conv_cfg.out_width_;
 
-    const auto in_padded = pad_tensor5(0,
-        conv_cfg.pad_top_, conv_cfg.pad_bottom_, conv_cfg.pad_left_, conv_cfg.pad_right_,
-        input);
+    shared_float_vec<float_type> res_vec = fplus::make_shared_ref<float_vec<float_type>>();
+    res_vec->resize(out_height * out_width * channels);
+
+    const auto process_rows = [&](std::size_t row_begin, std::size_t row_end)
+    {
+        depthwise_convolve_positions(strides, conv_cfg, filter_mat, input,
+            row_begin * out_width, row_end * out_width,
+            res_vec->data() + row_begin * out_width * channels);
+    };
+
+    thread_pool* pool = current_thread_pool();
+    const std::size_t madds = res_vec->size() *
+        filter_mat.filter_height_ * filter_mat.filter_width_;
+    const std::size_t block_count = pool == nullptr ||
+        madds < parallel_convolution_min_madds ? 1 :
+        std::min(pool->thread_count(), out_height);
+
+    if (block_count <= 1)
+    {
+        process_rows(0, out_height);
+    }
+    else
+    {
+        pool->parallel_for(block_count, [&](std::size_t block)
+        {
+            process_rows(block * out_height / block_count,
+                (block + 1) * out_height / block_count);
+        });
+    }
+
+    return tensor5<float_type>(
+        shape5(1, 1, out_height, out_width, channels), res_vec);
+}
+
+// Number of depthwise results a separable convolution
+// keeps in its scratch buffer before passing them on to the GEMM.
+const std::size_t separable_convolution_tile_values = 1 << 14;
+
+// A depthwise convolution followed by a pointwise (1x1) convolution.
+// The output positions are processed in tiles,
+// whose depthwise results are multiplied with the pointwise filters
+// while they are still in the cache,
+// so the intermediate tensor is never allocated as a whole.
+template <typename float_type>
+tensor5<float_type> separable_convolve(
+    const shape2& strides,
+    const padding& pad_type,
+    bool use_offset,
+    const depthwise_filter_matrix<float_type>& depthwise_filter_mat,
+    const im2col_filter_matrix<float_type>& pointwise_filter_mat,
+    const tensor5<float_type>& input)
+{
+    const auto conv_cfg = preprocess_depthwise_convolution(
+        strides, pad_type, use_offset, depthwise_filter_mat, input.shape());
+    const std::size_t channels = depthwise_filter_mat.bias_.size();
+    assertion(pointwise_filter_mat.filter_shape_ ==
+        shape5(1, 1, 1, 1, channels), "invalid pointwise filter shape");
+    const std::size_t out_depth = pointwise_filter_mat.filter_count_;
+    const std::size_t positions = conv_cfg.out_height_ * conv_cfg.out_width_;
+    const auto weights = im2col_filter_weights(pointwise_filter_mat);
+
+    shared_float_vec<float_type> res_vec = fplus::make_shared_ref<float_vec<float_type>>();
+    res_vec->resize(out_depth * positions);
+
+    Eigen::Map<ColMajorMatrixXf<float_type>, Eigen::Unaligned> out_mat_map(
+        res_vec->data(),
+        static_cast<EigenIndex>(out_depth),
+        static_cast<EigenIndex>(positions));
+
+    const std::size_t tile_positions = std::max<std::size_t>(1,
+        separable_convolution_tile_values / channels);
+
+    const auto process_positions = [&](std::size_t pos_begin, std::size_t pos_end)
+    {
+        ColMajorMatrixXf<float_type> temp(channels,
+            std::min(tile_positions, pos_end - pos_begin));
+        for (std::size_t tile_begin = pos_begin; tile_begin < pos_end;
+            tile_begin += tile_positions)
+        {
+            const std::size_t tile_end =
+                std::min(tile_begin + tile_positions, pos_end);
+            depthwise_convolve_positions(strides, conv_cfg,
+                depthwise_filter_mat, input, tile_begin, tile_end, temp.data());
+            const EigenIndex begin = static_cast<EigenIndex>(tile_begin);
+            const EigenIndex size = static_cast<EigenIndex>(tile_end - tile_begin);
+            out_mat_map.middleCols(begin, size).noalias() =
+                weights * temp.leftCols(size);
+            out_mat_map.middleCols(begin, size).colwise() +=
+                pointwise_filter_mat.bias_;
+        }
+    };
+
+    thread_pool* pool = current_thread_pool();
+    const std::size_t madds = positions * channels *
+        (depthwise_filter_mat.filter_height_ *
+            depthwise_filter_mat.filter_width_ + out_depth);
+    const std::size_t block_count = pool == nullptr ||
+        madds < parallel_convolution_min_madds ? 1 :
+        std::min(pool->thread_count(),
+            positions / parallel_convolution_min_block_cols);
+
+    if (block_count <= 1)
+    {
+        process_positions(0, positions);
+    }
+    else
+    {
+        pool->parallel_for(block_count, [&](std::size_t block)
+        {
+            process_positions(block * positions / block_count,
+                (block + 1) * positions / block_count);
+        });
+    }
 
-    return convolve_im2col(
-        out_height, out_width,
-        strides.height_, strides.width_,
-        offset_y, offset_x,
-        filter_mat, in_padded);
+    return tensor5<float_type>(
+        shape5(1, 1, conv_cfg.out_height_, conv_cfg.out_width_, out_depth),
+        res_vec);
 }
 
 } } // namespace fdeep, namespace internal
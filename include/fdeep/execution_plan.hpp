@@ -0,0 +1,608 @@
+// Copyright 2016, Tobias Hermann.
+// https://github.com/Dobiasd/frugally-deep
+// Distributed under the MIT License.
+// (See accompanying LICENSE file or at
+//  https://opensource.org/licenses/MIT)
+
+#pragma once
+
+#include "fdeep/common.hpp"
+
+#include "fdeep/tensor5.hpp"
+
+#include "fdeep/node.hpp"
+#include "fdeep/thread_pool.hpp"
+#include "fdeep/layers/layer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fdeep { namespace internal
+{
+
+// Location of a single tensor in the slot storage of an execution plan.
+struct tensor_slot
+{
+    std::size_t slot_idx_;
+    std::size_t tensor_idx_;
+};
+using tensor_slots = std::vector<tensor_slot>;
+
+// Application of one layer node with already resolved input locations.
+// released_slots_ lists the slots no later step or model output reads,
+// so their tensors can be dropped as soon as this step has run.
+// consumers_ holds the indices of the steps reading this step's output,
+// dependency_count_ the number of steps whose output this step reads.
+// donatable_inputs_ flags the inputs whose memory the layer may overwrite.
+template <typename float_type>
+struct execution_step
+{
+    layer_ptr<float_type> layer_;
+    tensor_slots inputs_;
+    std::vector<std::size_t> released_slots_;
+    std::vector<std::size_t> consumers_;
+    std::size_t dependency_count_;
+    std::vector<bool> donatable_inputs_;
+};
+template <typename float_type>
+using execution_steps = std::vector<execution_step<float_type>>;
+
+// Flat, topologically sorted form of a model graph.
+// Slot i < input_count_ holds the i-th model input,
+// slot input_count_ + j holds the output tensors of steps_[j].
+template <typename float_type>
+struct execution_plan
+{
+    explicit execution_plan(std::size_t input_count = 0) :
+            input_count_(input_count),
+            steps_(),
+            outputs_(),
+            slot_reader_counts_()
+    {
+    }
+    std::size_t input_count_;
+    execution_steps<float_type> steps_;
+    tensor_slots outputs_;
+    // Number of step inputs referring to every slot.
+    std::vector<std::size_t> slot_reader_counts_;
+    std::size_t slot_count() const
+    {
+        return input_count_ + steps_.size();
+    }
+};
+
+// Assigns every slot to the step that is its last consumer.
+// Slots read by the model outputs are never released.
+template <typename float_type>
+void add_slot_releases(execution_plan<float_type>& plan)
+{
+    const std::size_t never = plan.steps_.size();
+    std::vector<std::size_t> last_use(plan.slot_count(), 0);
+    for (std::size_t i = 0; i < plan.steps_.size(); ++i)
+    {
+        for (const auto& input : plan.steps_[i].inputs_)
+        {
+            last_use[input.slot_idx_] = i;
+        }
+        // Unused outputs can be released right away.
+        last_use[plan.input_count_ + i] = i;
+    }
+    for (const auto& output : plan.outputs_)
+    {
+        last_use[output.slot_idx_] = never;
+    }
+    for (auto& step : plan.steps_)
+    {
+        step.released_slots_.clear();
+    }
+    for (std::size_t slot_idx = 0; slot_idx < last_use.size(); ++slot_idx)
+    {
+        if (last_use[slot_idx] != never)
+        {
+            plan.steps_[last_use[slot_idx]].released_slots_.push_back(
+                slot_idx);
+        }
+    }
+}
+
+// Fills in the information needed to run independent steps concurrently.
+template <typename float_type>
+void add_step_dependencies(execution_plan<float_type>& plan)
+{
+    plan.slot_reader_counts_ = std::vector<std::size_t>(plan.slot_count(), 0);
+    for (std::size_t i = 0; i < plan.steps_.size(); ++i)
+    {
+        auto& step = plan.steps_[i];
+        std::vector<std::size_t> producers;
+        for (const auto& input : step.inputs_)
+        {
+            ++plan.slot_reader_counts_[input.slot_idx_];
+            if (input.slot_idx_ >= plan.input_count_)
+            {
+                producers.push_back(input.slot_idx_ - plan.input_count_);
+            }
+        }
+        producers = fplus::nub(producers);
+        step.dependency_count_ = producers.size();
+        for (const auto producer : producers)
+        {
+            plan.steps_[producer].consumers_.push_back(i);
+        }
+    }
+}
+
+// Decides which step inputs can be overwritten by the layers reading them.
+// Since tensors do not track how many of them share the same memory,
+// this is derived from the plan:
+// Every slot is assigned the set of buffers its tensors might use.
+// Layers creating new buffers produce a buffer of their own,
+// all other layers might return (parts of) their inputs
+// or memory held by the layer itself.
+// An input is donatable if its buffer is used only by this one input
+// of the step, is not visible outside of the plan,
+// and all other steps reading it are guaranteed to have run before,
+// also when independent steps are executed concurrently.
+template <typename float_type>
+void add_donatable_inputs(execution_plan<float_type>& plan)
+{
+    const std::size_t step_count = plan.steps_.size();
+
+    // Buffer 0 stands for all memory not owned by the plan,
+    // like the model inputs or tensors held by layers.
+    const std::size_t foreign_buffer = 0;
+    std::size_t buffer_count = 1;
+    std::vector<std::vector<std::size_t>> slot_buffers(
+        plan.slot_count(), {foreign_buffer});
+    for (std::size_t i = 0; i < step_count; ++i)
+    {
+        const auto& step = plan.steps_[i];
+        auto& buffers = slot_buffers[plan.input_count_ + i];
+        if (step.layer_->creates_new_buffers())
+        {
+            buffers = {buffer_count++};
+        }
+        else
+        {
+            for (const auto& input : step.inputs_)
+            {
+                buffers = fplus::append(buffers,
+                    slot_buffers[input.slot_idx_]);
+            }
+            buffers = fplus::nub(buffers);
+        }
+    }
+
+    std::vector<bool> pinned(buffer_count, false);
+    pinned[foreign_buffer] = true;
+    for (const auto& output : plan.outputs_)
+    {
+        for (const auto buffer : slot_buffers[output.slot_idx_])
+        {
+            pinned[buffer] = true;
+        }
+    }
+
+    std::vector<std::vector<std::size_t>> buffer_readers(buffer_count);
+    std::vector<std::vector<bool>> ancestors(step_count,
+        std::vector<bool>(step_count, false));
+    for (std::size_t i = 0; i < step_count; ++i)
+    {
+        for (const auto& input : plan.steps_[i].inputs_)
+        {
+            for (const auto buffer : slot_buffers[input.slot_idx_])
+            {
+                buffer_readers[buffer].push_back(i);
+            }
+            if (input.slot_idx_ >= plan.input_count_)
+            {
+                const std::size_t producer =
+                    input.slot_idx_ - plan.input_count_;
+                ancestors[i][producer] = true;
+                for (std::size_t j = 0; j < producer; ++j)
+                {
+                    if (ancestors[producer][j])
+                    {
+                        ancestors[i][j] = true;
+                    }
+                }
+            }
+        }
+    }
+
+    for (std::size_t i = 0; i < step_count; ++i)
+    {
+        auto& step = plan.steps_[i];
+        step.donatable_inputs_ = std::vector<bool>(step.inputs_.size(), false);
+        for (std::size_t j = 0; j < step.inputs_.size(); ++j)
+        {
+            const auto& buffers = slot_buffers[step.inputs_[j].slot_idx_];
+            if (buffers.size() != 1 || pinned[buffers.front()])
+            {
+                continue;
+            }
+            const std::size_t buffer = buffers.front();
+            bool exclusive = true;
+            for (std::size_t k = 0; k < step.inputs_.size(); ++k)
+            {
+                if (k != j && fplus::is_elem_of(buffer,
+                    slot_buffers[step.inputs_[k].slot_idx_]))
+                {
+                    exclusive = false;
+                }
+            }
+            for (const auto reader : buffer_readers[buffer])
+            {
+                if (reader != i && !ancestors[i][reader])
+                {
+                    exclusive = false;
+                }
+            }
+            step.donatable_inputs_[j] = exclusive;
+        }
+    }
+}
+
+// All name and node lookups happen here, once at load time.
+// Only the nodes the outputs depend on become steps,
+// every node is scheduled after all of its inputs.
+template <typename float_type>
+execution_plan<float_type> compile_execution_plan(const layer_ptrs<float_type>& layers,
+    const node_connections& input_connections,
+    const node_connections& output_connections)
+{
+    using node_key = std::pair<std::string, std::size_t>;
+
+    std::map<std::string, layer_ptr<float_type>> layers_by_name;
+    for (const auto& ptr : layers)
+    {
+        layers_by_name[ptr->name_] = ptr;
+    }
+
+    execution_plan<float_type> plan(input_connections.size());
+
+    std::map<node_key, std::size_t> slot_indices;
+    for (std::size_t i = 0; i < input_connections.size(); ++i)
+    {
+        slot_indices[input_connections[i].without_tensor_idx()] = i;
+    }
+
+    std::function<tensor_slot(const node_connection&)> resolve;
+    resolve = [&](const node_connection& conn) -> tensor_slot
+    {
+        const auto key = conn.without_tensor_idx();
+        if (!fplus::map_contains(slot_indices, key))
+        {
+            assertion(fplus::map_contains(layers_by_name, conn.layer_id_),
+                "dangling layer reference: " + conn.layer_id_);
+            const auto& ptr =
+                fplus::get_from_map_unsafe(layers_by_name, conn.layer_id_);
+            const auto& inbound = ptr->nodes_[
+                ptr->resolve_node_idx(conn.node_idx_)]
+                    .inbound_connections();
+            execution_step<float_type> step = {ptr,
+                fplus::transform(resolve, inbound), {}, {}, 0, {}};
+            slot_indices[key] = plan.slot_count();
+            plan.steps_.push_back(step);
+        }
+        return {fplus::get_from_map_unsafe(slot_indices, key),
+            conn.tensor_idx_};
+    };
+
+    plan.outputs_ = fplus::transform(resolve, output_connections);
+    add_slot_releases(plan);
+    add_step_dependencies(plan);
+    add_donatable_inputs(plan);
+    return plan;
+}
+
+template <typename float_type>
+tensor5s<float_type> execute_plan(const execution_plan<float_type>& plan,
+    const tensor5s<float_type>& inputs)
+{
+    assertion(inputs.size() == plan.input_count_,
+        "invalid number of input tensors for this model: " +
+        fplus::show(plan.input_count_) + " required but " +
+        fplus::show(inputs.size()) + " provided");
+
+    std::vector<tensor5s<float_type>> slots(plan.slot_count());
+    for (std::size_t i = 0; i < inputs.size(); ++i)
+    {
+        slots[i] = {inputs[i]};
+    }
+
+    const auto get_tensor = [&slots](const tensor_slot& slot) -> tensor5<float_type>
+    {
+        const auto& outputs = slots[slot.slot_idx_];
+        assertion(slot.tensor_idx_ < outputs.size(), "invalid tensor index");
+        return outputs[slot.tensor_idx_];
+    };
+
+    for (std::size_t i = 0; i < plan.steps_.size(); ++i)
+    {
+        const auto& step = plan.steps_[i];
+        slots[plan.input_count_ + i] = step.layer_->apply_donating(
+            fplus::transform(get_tensor, step.inputs_),
+            step.donatable_inputs_);
+        for (const auto slot_idx : step.released_slots_)
+        {
+            slots[slot_idx] = tensor5s<float_type>();
+        }
+    }
+
+    return fplus::transform(get_tensor, plan.outputs_);
+}
+
+// Like execute_plan, but every slot holds the tensors of all samples,
+// so each layer is applied to the whole batch at once.
+template <typename float_type>
+tensor5s_vec<float_type> execute_plan_batch(const execution_plan<float_type>& plan,
+    const tensor5s_vec<float_type>& inputs_vec)
+{
+    for (const auto& inputs : inputs_vec)
+    {
+        assertion(inputs.size() == plan.input_count_,
+            "invalid number of input tensors for this model: " +
+            fplus::show(plan.input_count_) + " required but " +
+            fplus::show(inputs.size()) + " provided");
+    }
+    const std::size_t sample_count = inputs_vec.size();
+
+    std::vector<tensor5s_vec<float_type>> slots(plan.slot_count());
+    for (std::size_t i = 0; i < plan.input_count_; ++i)
+    {
+        slots[i] = fplus::transform([i](const tensor5s<float_type>& inputs) -> tensor5s<float_type>
+        {
+            return {inputs[i]};
+        }, inputs_vec);
+    }
+
+    const auto get_tensors = [&slots, sample_count]
+        (const tensor_slots& slot_refs) -> tensor5s_vec<float_type>
+    {
+        tensor5s_vec<float_type> result(sample_count);
+        for (std::size_t sample = 0; sample < sample_count; ++sample)
+        {
+            result[sample] = fplus::transform(
+                [&slots, sample](const tensor_slot& slot) -> tensor5<float_type>
+                {
+                    const auto& outputs = slots[slot.slot_idx_][sample];
+                    assertion(slot.tensor_idx_ < outputs.size(),
+                        "invalid tensor index");
+                    return outputs[slot.tensor_idx_];
+                }, slot_refs);
+        }
+        return result;
+    };
+
+    for (std::size_t i = 0; i < plan.steps_.size(); ++i)
+    {
+        const auto& step = plan.steps_[i];
+        slots[plan.input_count_ + i] =
+            step.layer_->apply_batch(get_tensors(step.inputs_));
+        assertion(slots[plan.input_count_ + i].size() == sample_count,
+            "invalid number of samples");
+        for (const auto slot_idx : step.released_slots_)
+        {
+            slots[slot_idx] = tensor5s_vec<float_type>();
+        }
+    }
+
+    return get_tensors(plan.outputs_);
+}
+
+// State of one forward pass running on a thread pool.
+// It is shared by all tasks, so it outlives the last one of them,
+// even if the waiting thread has already returned.
+template <typename float_type>
+struct parallel_execution
+{
+    parallel_execution(const execution_plan<float_type>& plan, thread_pool& pool) :
+        plan_(plan),
+        pool_(pool),
+        slots_(plan.slot_count()),
+        pending_dependencies_(plan.steps_.size()),
+        remaining_readers_(plan.slot_count()),
+        remaining_steps_(plan.steps_.size()),
+        failed_(false),
+        error_mutex_(),
+        error_()
+    {
+        for (std::size_t i = 0; i < plan.steps_.size(); ++i)
+        {
+            pending_dependencies_[i] = plan.steps_[i].dependency_count_;
+        }
+        for (std::size_t i = 0; i < plan.slot_count(); ++i)
+        {
+            remaining_readers_[i] = plan.slot_reader_counts_[i];
+        }
+        // Model outputs must stay alive.
+        for (const auto& output : plan.outputs_)
+        {
+            ++remaining_readers_[output.slot_idx_];
+        }
+    }
+    const execution_plan<float_type>& plan_;
+    thread_pool& pool_;
+    std::vector<tensor5s<float_type>> slots_;
+    std::vector<std::atomic<std::size_t>> pending_dependencies_;
+    std::vector<std::atomic<std::size_t>> remaining_readers_;
+    std::atomic<std::size_t> remaining_steps_;
+    std::atomic<bool> failed_;
+    std::mutex error_mutex_;
+    std::exception_ptr error_;
+};
+
+template <typename float_type>
+void run_parallel_step(const std::shared_ptr<parallel_execution<float_type>>& exec,
+    std::size_t step_idx)
+{
+    const auto& plan = exec->plan_;
+    const auto& step = plan.steps_[step_idx];
+    if (!exec->failed_)
+    {
+        try
+        {
+            const auto inputs = fplus::transform(
+                [&exec](const tensor_slot& slot) -> tensor5<float_type>
+                {
+                    const auto& outputs = exec->slots_[slot.slot_idx_];
+                    assertion(slot.tensor_idx_ < outputs.size(),
+                        "invalid tensor index");
+                    return outputs[slot.tensor_idx_];
+                }, step.inputs_);
+            const std::size_t output_slot = plan.input_count_ + step_idx;
+            if (exec->remaining_readers_[output_slot] != 0)
+            {
+                exec->slots_[output_slot] = step.layer_->apply_donating(
+                    inputs, step.donatable_inputs_);
+            }
+            else
+            {
+                step.layer_->apply_donating(inputs, step.donatable_inputs_);
+            }
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(exec->error_mutex_);
+            if (!exec->error_)
+            {
+                exec->error_ = std::current_exception();
+            }
+            exec->failed_ = true;
+        }
+    }
+    for (const auto& input : step.inputs_)
+    {
+        if (--exec->remaining_readers_[input.slot_idx_] == 0)
+        {
+            exec->slots_[input.slot_idx_] = tensor5s<float_type>();
+        }
+    }
+    for (const auto consumer : step.consumers_)
+    {
+        if (--exec->pending_dependencies_[consumer] == 0)
+        {
+            exec->pool_.submit([exec, consumer]()
+            {
+                run_parallel_step(exec, consumer);
+            });
+        }
+    }
+    if (--exec->remaining_steps_ == 0)
+    {
+        exec->pool_.notify_waiters();
+    }
+}
+
+// Runs every step as soon as all its inputs are available.
+// Independent branches of the graph are thus processed concurrently.
+template <typename float_type>
+tensor5s<float_type> execute_plan_parallelly(const execution_plan<float_type>& plan,
+    const tensor5s<float_type>& inputs, thread_pool& pool)
+{
+    assertion(inputs.size() == plan.input_count_,
+        "invalid number of input tensors for this model: " +
+        fplus::show(plan.input_count_) + " required but " +
+        fplus::show(inputs.size()) + " provided");
+
+    const auto exec = std::make_shared<parallel_execution<float_type>>(plan, pool);
+    for (std::size_t i = 0; i < inputs.size(); ++i)
+    {
+        exec->slots_[i] = {inputs[i]};
+    }
+
+    for (std::size_t i = 0; i < plan.steps_.size(); ++i)
+    {
+        if (plan.steps_[i].dependency_count_ == 0)
+        {
+            pool.submit([exec, i]() { run_parallel_step(exec, i); });
+        }
+    }
+    pool.wait_until([&exec]() { return exec->remaining_steps_ == 0; });
+
+    if (exec->error_)
+    {
+        std::rethrow_exception(exec->error_);
+    }
+
+    return fplus::transform([&exec](const tensor_slot& slot) -> tensor5<float_type>
+    {
+        const auto& outputs = exec->slots_[slot.slot_idx_];
+        assertion(slot.tensor_idx_ < outputs.size(), "invalid tensor index");
+        return outputs[slot.tensor_idx_];
+    }, plan.outputs_);
+}
+
+struct activation_memory_stats
+{
+    // Maximum number of bytes held by the tensors of the plan's slots
+    // at any point in time, with tensors released after their last use.
+    std::size_t peak_bytes_;
+    // Number of bytes needed when all tensors are kept
+    // until the forward pass is finished.
+    std::size_t total_bytes_;
+};
+
+// Runs the plan and reports the memory occupied by its slots.
+// Tensors produced inside nested models are not taken into account.
+template <typename float_type>
+activation_memory_stats measure_activation_memory(
+    const execution_plan<float_type>& plan, const tensor5s<float_type>& inputs)
+{
+    assertion(inputs.size() == plan.input_count_,
+        "invalid number of input tensors for this model");
+
+    const auto tensors_bytes = [](const tensor5s<float_type>& tensors) -> std::size_t
+    {
+        return fplus::sum(fplus::transform([](const tensor5<float_type>& t)
+        {
+            return t.shape().volume() * sizeof(float_type);
+        }, tensors));
+    };
+
+    std::vector<tensor5s<float_type>> slots(plan.slot_count());
+    for (std::size_t i = 0; i < inputs.size(); ++i)
+    {
+        slots[i] = {inputs[i]};
+    }
+
+    std::size_t live_bytes = tensors_bytes(inputs);
+    std::size_t total_bytes = live_bytes;
+    std::size_t peak_bytes = live_bytes;
+    for (std::size_t i = 0; i < plan.steps_.size(); ++i)
+    {
+        const auto& step = plan.steps_[i];
+        const auto step_inputs = fplus::transform(
+            [&slots](const tensor_slot& slot) -> tensor5<float_type>
+            {
+                return slots[slot.slot_idx_][slot.tensor_idx_];
+            }, step.inputs_);
+        slots[plan.input_count_ + i] = step.layer_->apply(step_inputs);
+        const std::size_t output_bytes =
+            tensors_bytes(slots[plan.input_count_ + i]);
+        live_bytes += output_bytes;
+        total_bytes += output_bytes;
+        peak_bytes = std::max(peak_bytes, live_bytes);
+        for (const auto slot_idx : step.released_slots_)
+        {
+            live_bytes -= tensors_bytes(slots[slot_idx]);
+            slots[slot_idx] = tensor5s<float_type>();
+        }
+    }
+    return {peak_bytes, total_bytes};
+}
+
+} // namespace internal
+
+using activation_memory_stats = internal::activation_memory_stats;
+
+} // namespace fdeep
@@ -12,7 +12,10 @@
 #include "fdeep/filter.hpp"
 #include "fdeep/tensor5.hpp"
 #include "fdeep/tensor5_pos.hpp"
+#include "fdeep/thread_pool.hpp"
 #include "fdeep/node.hpp"
+#include "fdeep/execution_plan.hpp"
+#include "fdeep/graph_optimizer.hpp"
 #include "fdeep/shape2.hpp"
 #include "fdeep/shape2_variable.hpp"
 #include "fdeep/shape5.hpp"
@@ -59,6 +62,7 @@
 #include "fdeep/layers/bidirectional_layer.hpp"
 #include "fdeep/layers/time_distributed_layer.hpp"
 
+#include "fdeep/binary_model.hpp"
 #include "fdeep/import_model.hpp"
 
 #include "fdeep/model.hpp"
@@ -18,10 +18,11 @@
 namespace fdeep { namespace internal
 {
 
+template <typename float_type>
 class filter
 {
 public:
-    filter(const tensor5& m, float_type bias) : m_(m), bias_(bias)
+    filter(const tensor5<float_type>& m, float_type bias) : m_(m), bias_(bias)
     {
     }
     const shape5& shape() const
@@ -32,7 +33,7 @@ public:
     {
         return m_.shape().volume();
     }
-    const tensor5& get_tensor5() const
+    const tensor5<float_type>& get_tensor5() const
     {
         return m_;
     }
@@ -44,36 +45,31 @@ public:
     {
         return bias_;
     }
-    void set_params(const float_vec& weights, float_type bias)
+    void set_params(const float_vec<float_type>& weights, float_type bias)
     {
         assertion(weights.size() == m_.shape().volume(),
             "invalid parameter count");
-        m_ = tensor5(m_.shape(), float_vec(weights));
+        m_ = tensor5<float_type>(m_.shape(), float_vec<float_type>(weights));
         bias_ = bias;
     }
 private:
-    tensor5 m_;
+    tensor5<float_type> m_;
     float_type bias_;
 };
 
-typedef std::vector<filter> filter_vec;
+template <typename float_type>
+using filter_vec = std::vector<filter<float_type>>;
 
-inline filter dilate_filter(const shape2& dilation_rate, const filter& undilated)
-{
-    return filter(dilate_tensor5(dilation_rate, undilated.get_tensor5()),
-        undilated.get_bias());
-}
-
-inline filter_vec generate_filters(
-    const shape2& dilation_rate,
+template <typename float_type>
+filter_vec<float_type> generate_filters(
     const shape5& filter_shape, std::size_t k,
-    const float_vec& weights, const float_vec& bias)
+    const float_vec<float_type>& weights, const float_vec<float_type>& bias)
 {
-    filter_vec filters(k, filter(tensor5(filter_shape, 0), 0));
+    filter_vec<float_type> filters(k, filter<float_type>(tensor5<float_type>(filter_shape, 0), 0));
 
     assertion(!filters.empty(), "at least one filter needed");
     const std::size_t param_count = fplus::sum(fplus::transform(
-        fplus_c_mem_fn_t(filter, volume, std::size_t), filters));
+        fplus_c_mem_fn_t(filter<float_type>, volume, std::size_t), filters));
 
     assertion(static_cast<std::size_t>(weights.size()) == param_count,
         "invalid weight size");
@@ -89,7 +85,6 @@ inline filter_vec generate_filters(
     for (auto& filt : filters)
     {
         filt.set_params(*it_filter_val, *it_filter_bias);
-        filt = dilate_filter(dilation_rate, filt);
         ++it_filter_val;
         ++it_filter_bias;
     }
@@ -0,0 +1,70 @@
+// Copyright 2016, Tobias Hermann.
+// https://github.com/Dobiasd/frugally-deep
+// Distributed under the MIT License.
+// (See accompanying LICENSE file or at
+//  https://opensource.org/licenses/MIT)
+
+#pragma once
+
+#include "fdeep/common.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace fdeep { namespace internal
+{
+
+// Read-only float array, which either owns its values
+// or views memory kept alive by some other owner,
+// e.g., the read-only memory mapping of a binary model file,
+// whose pages are shared by all processes mapping the same file.
+template <typename float_type>
+class float_buffer
+{
+public:
+    float_buffer() : owner_(), data_(nullptr), size_(0), view_(false)
+    {
+    }
+    explicit float_buffer(float_vec<float_type>&& values) :
+        owner_(), data_(nullptr), size_(values.size()), view_(false)
+    {
+        const auto owned = std::make_shared<const float_vec<float_type>>(
+            std::move(values));
+        data_ = owned->data();
+        owner_ = owned;
+    }
+    float_buffer(const std::shared_ptr<const void>& owner,
+        const float_type* data, std::size_t size) :
+        owner_(owner), data_(data), size_(size), view_(true)
+    {
+    }
+    // Copies share the values with the original.
+    float_buffer(const float_buffer&) = default;
+    float_buffer(float_buffer&&) = default;
+    float_buffer& operator=(const float_buffer&) = default;
+    float_buffer& operator=(float_buffer&&) = default;
+    const float_type* data() const
+    {
+        return data_;
+    }
+    std::size_t size() const
+    {
+        return size_;
+    }
+    bool is_view() const
+    {
+        return view_;
+    }
+    float_vec<float_type> to_vector() const
+    {
+        return float_vec<float_type>(data_, data_ + size_);
+    }
+private:
+    std::shared_ptr<const void> owner_;
+    const float_type* data_;
+    std::size_t size_;
+    bool view_;
+};
+
+} } // namespace fdeep, namespace internal
@@ -0,0 +1,287 @@
+// Copyright 2016, Tobias Hermann.
+// https://github.com/Dobiasd/frugally-deep
+// Distributed under the MIT License.
+// (See accompanying LICENSE file or at
+//  https://opensource.org/licenses/MIT)
+
+#pragma once
+
+#include "fdeep/common.hpp"
+
+#include "fdeep/node.hpp"
+#include "fdeep/layers/activation_layer.hpp"
+#include "fdeep/layers/flatten_layer.hpp"
+#include "fdeep/layers/input_layer.hpp"
+#include "fdeep/layers/layer.hpp"
+#include "fdeep/layers/linear_layer.hpp"
+#include "fdeep/layers/model_layer.hpp"
+#include "fdeep/layers/reshape_layer.hpp"
+
+#include <fplus/fplus.hpp>
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+
+namespace fdeep { namespace internal
+{
+
+// A graph pass rewrites a model graph in place at load time,
+// without changing the results of the model.
+// It returns true if it changed something.
+// Passes are run repeatedly until none of them changes the graph anymore.
+template <typename float_type>
+using graph_pass = std::function<bool(model_graph<float_type>&)>;
+template <typename float_type>
+using graph_passes = std::map<std::string, graph_pass<float_type>>;
+
+// Replaces every node connection in the graph,
+// i.e., the inbound connections of all nodes and the model outputs, by f.
+template <typename float_type>
+void transform_connections(model_graph<float_type>& graph,
+    const std::function<node_connection(const node_connection&)>& f)
+{
+    for (const auto& ptr : graph.layers_)
+    {
+        ptr->set_nodes(fplus::transform([&f](const node& n) -> node
+        {
+            return node(fplus::transform(f, n.inbound_connections()));
+        }, ptr->nodes_));
+    }
+    graph.output_connections_ = fplus::transform(f,
+        graph.output_connections_);
+}
+
+// Number of connections reading any output of the layer.
+template <typename float_type>
+std::size_t count_layer_references(const model_graph<float_type>& graph,
+    const std::string& layer_name)
+{
+    const auto refers_to_layer = [&layer_name](const node_connection& conn)
+    {
+        return conn.layer_id_ == layer_name;
+    };
+    std::size_t result = fplus::count_if(refers_to_layer,
+        graph.output_connections_);
+    for (const auto& ptr : graph.layers_)
+    {
+        for (const auto& n : ptr->nodes_)
+        {
+            result += fplus::count_if(refers_to_layer,
+                n.inbound_connections());
+        }
+    }
+    return result;
+}
+
+template <typename float_type>
+fplus::maybe<layer_ptr<float_type>> find_layer(const model_graph<float_type>& graph,
+    const std::string& layer_name)
+{
+    return fplus::find_first_by([&layer_name](const layer_ptr<float_type>& ptr)
+    {
+        return ptr->name_ == layer_name;
+    }, graph.layers_);
+}
+
+template <typename float_type>
+void remove_layer(model_graph<float_type>& graph, const std::string& layer_name)
+{
+    graph.layers_ = fplus::drop_if([&layer_name](const layer_ptr<float_type>& ptr)
+    {
+        return ptr->name_ == layer_name;
+    }, graph.layers_);
+}
+
+// Single-node layer reading exactly one tensor.
+template <typename float_type>
+bool has_single_input(const layer_ptr<float_type>& ptr)
+{
+    return ptr->nodes_.size() == 1 &&
+        ptr->nodes_.front().inbound_connections().size() == 1;
+}
+
+// Removes layers just passing through their input,
+// like Dropout or GaussianNoise.
+template <typename float_type>
+bool remove_identity_layers(model_graph<float_type>& graph)
+{
+    const auto is_identity = [](const layer_ptr<float_type>& ptr) -> bool
+    {
+        return std::dynamic_pointer_cast<linear_layer<float_type>>(ptr) != nullptr &&
+            ptr->get_activation() == nullptr &&
+            fplus::all_by([](const node& n)
+            {
+                return n.inbound_connections().size() == 1;
+            }, ptr->nodes_);
+    };
+    const auto maybe_identity = fplus::find_first_by(is_identity,
+        graph.layers_);
+    if (fplus::is_nothing(maybe_identity))
+    {
+        return false;
+    }
+    const std::string identity_name = maybe_identity.unsafe_get_just()->name_;
+    const nodes identity_nodes = maybe_identity.unsafe_get_just()->nodes_;
+    remove_layer(graph, identity_name);
+    transform_connections(graph,
+        [&](const node_connection& conn) -> node_connection
+    {
+        if (conn.layer_id_ != identity_name)
+        {
+            return conn;
+        }
+        assertion(conn.node_idx_ < identity_nodes.size(),
+            "invalid node index");
+        assertion(conn.tensor_idx_ == 0, "invalid tensor index");
+        return identity_nodes[conn.node_idx_].inbound_connections().front();
+    });
+    return true;
+}
+
+// Turns an activation layer into the activation function of the layer
+// producing its input, if nothing else reads the output of the latter.
+// This also merges chains of consecutive activation layers.
+template <typename float_type>
+bool merge_activation_layers(model_graph<float_type>& graph)
+{
+    for (const auto& ptr : graph.layers_)
+    {
+        const auto activation =
+            std::dynamic_pointer_cast<activation_layer<float_type>>(ptr);
+        if (activation == nullptr || ptr->get_activation() != nullptr ||
+            !has_single_input(ptr))
+        {
+            continue;
+        }
+        const auto input_conn =
+            ptr->nodes_.front().inbound_connections().front();
+        const auto maybe_producer = find_layer(graph, input_conn.layer_id_);
+        if (fplus::is_nothing(maybe_producer))
+        {
+            continue;
+        }
+        const auto producer = maybe_producer.unsafe_get_just();
+        const bool producer_activation_is_identity =
+            producer->get_activation() == nullptr ||
+            std::dynamic_pointer_cast<linear_layer<float_type>>(
+                producer->get_activation()) != nullptr;
+        if (std::dynamic_pointer_cast<input_layer<float_type>>(producer) != nullptr ||
+            producer->nodes_.size() != 1 ||
+            !producer_activation_is_identity ||
+            count_layer_references(graph, producer->name_) != 1)
+        {
+            continue;
+        }
+        producer->set_activation(activation);
+        const std::string activation_name = ptr->name_;
+        remove_layer(graph, activation_name);
+        transform_connections(graph,
+            [&](const node_connection& conn) -> node_connection
+        {
+            return conn.layer_id_ == activation_name ? input_conn : conn;
+        });
+        return true;
+    }
+    return false;
+}
+
+// Reshape and Flatten only change the shape, not the order of the values.
+// So one of them directly following another one makes the first one
+// superfluous, if nothing else reads the output of it.
+template <typename float_type>
+bool collapse_reshape_chains(model_graph<float_type>& graph)
+{
+    const auto is_reshape = [](const layer_ptr<float_type>& ptr) -> bool
+    {
+        return (std::dynamic_pointer_cast<reshape_layer<float_type>>(ptr) != nullptr ||
+            std::dynamic_pointer_cast<flatten_layer<float_type>>(ptr) != nullptr) &&
+            ptr->get_activation() == nullptr &&
+            has_single_input(ptr);
+    };
+    for (const auto& ptr : graph.layers_)
+    {
+        if (!is_reshape(ptr))
+        {
+            continue;
+        }
+        const auto input_conn =
+            ptr->nodes_.front().inbound_connections().front();
+        const auto maybe_producer = find_layer(graph, input_conn.layer_id_);
+        if (fplus::is_nothing(maybe_producer))
+        {
+            continue;
+        }
+        const auto producer = maybe_producer.unsafe_get_just();
+        if (!is_reshape(producer) ||
+            count_layer_references(graph, producer->name_) != 1)
+        {
+            continue;
+        }
+        ptr->set_nodes({node(producer->nodes_.front().inbound_connections())});
+        remove_layer(graph, producer->name_);
+        return true;
+    }
+    return false;
+}
+
+// Switches the layers knowing the range of their input values
+// to their int8 path.
+// This changes the results, so it is not one of the default passes,
+// see load_model_quantized.
+template <typename float_type>
+bool quantize_layers_int8(model_graph<float_type>& graph)
+{
+    bool changed = false;
+    for (const auto& ptr : graph.layers_)
+    {
+        if (ptr->quantize_int8())
+        {
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+template <typename float_type>
+graph_passes<float_type> default_graph_passes()
+{
+    return {
+        {"remove_identity_layers", remove_identity_layers<float_type>},
+        {"merge_activation_layers", merge_activation_layers<float_type>},
+        {"collapse_reshape_chains", collapse_reshape_chains<float_type>}
+    };
+}
+
+// Runs the passes on the graph of a model layer, including nested models.
+template <typename float_type>
+void optimize_graph(const layer_ptr<float_type>& ptr, const graph_passes<float_type>& passes)
+{
+    const auto model = std::dynamic_pointer_cast<model_layer<float_type>>(ptr);
+    if (model == nullptr)
+    {
+        return;
+    }
+    auto graph = model->get_graph();
+    for (const auto& inner_layer : graph.layers_)
+    {
+        optimize_graph(inner_layer, passes);
+    }
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (const auto& pass : passes)
+        {
+            if (pass.second(graph))
+            {
+                changed = true;
+            }
+        }
+    }
+    model->set_graph(graph);
+}
+
+} } // namespace fdeep, namespace internal
@@ -0,0 +1,517 @@
+// Copyright 2016, Tobias Hermann.
+// https://github.com/Dobiasd/frugally-deep
+// Distributed under the MIT License.
+// (See accompanying LICENSE file or at
+//  https://opensource.org/licenses/MIT)
+
+#pragma once
+
+#include "fdeep/common.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__F16C__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace fdeep { namespace internal
+{
+
+// Weights can be stored with 16 bits per value (see convert_model.py),
+// either as IEEE 754 half precision (float16)
+// or as the upper half of a float32 (bfloat16),
+// which keeps its range but only 8 bits of precision.
+// They are widened to float_type for computation.
+enum class half_float_format { float16, bfloat16 };
+
+typedef std::vector<std::uint16_t> half_float_vec;
+
+inline half_float_format parse_half_float_format(const std::string& name)
+{
+    if (name == "float16")
+        return half_float_format::float16;
+    if (name == "bfloat16")
+        return half_float_format::bfloat16;
+    raise_error("unknown half float format " + name);
+    return half_float_format::float16;
+}
+
+inline std::string show_half_float_format(half_float_format format)
+{
+    return format == half_float_format::float16 ? "float16" : "bfloat16";
+}
+
+inline float bits_to_float(std::uint32_t bits)
+{
+    float result;
+    std::memcpy(&result, &bits, sizeof(float));
+    return result;
+}
+
+inline float half_float_to_float(std::uint16_t value, half_float_format format)
+{
+    if (format == half_float_format::bfloat16)
+    {
+        return bits_to_float(static_cast<std::uint32_t>(value) << 16);
+    }
+    const std::uint32_t sign = static_cast<std::uint32_t>(value & 0x8000) << 16;
+    const std::uint32_t exponent = (value >> 10) & 0x1f;
+    const std::uint32_t mantissa = value & 0x3ffu;
+    if (exponent == 0x1f)
+    {
+        return bits_to_float(sign | 0x7f800000u | (mantissa << 13));
+    }
+    if (exponent != 0)
+    {
+        return bits_to_float(sign | ((exponent + 112) << 23) | (mantissa << 13));
+    }
+    // Zero or subnormal, i.e., mantissa * 2^-24.
+    const float magnitude = static_cast<float>(mantissa) * 5.9604645e-8f;
+    return sign != 0 ? -magnitude : magnitude;
+}
+
+// Thin wrappers around the SIMD instructions the kernel below needs,
+// so it can be written only once for SSE2 and AVX2.
+#if defined(__AVX2__)
+typedef __m256 float_pack;
+typedef __m256i int_pack;
+const std::size_t float_pack_size = 8;
+
+inline float_pack float_pack_load(const float* src)
+{
+    return _mm256_loadu_ps(src);
+}
+
+inline void float_pack_store(float* dest, float_pack values)
+{
+    _mm256_storeu_ps(dest, values);
+}
+
+inline float_pack float_pack_broadcast(float value)
+{
+    return _mm256_set1_ps(value);
+}
+
+// acc + a * b
+inline float_pack float_pack_madd(float_pack acc, float_pack a, float_pack b)
+{
+#if defined(__FMA__)
+    return _mm256_fmadd_ps(a, b, acc);
+#else
+    return _mm256_add_ps(acc, _mm256_mul_ps(a, b));
+#endif
+}
+
+// The 16-bit values, zero-extended to 32 bits.
+inline int_pack load_half_float_bits(const std::uint16_t* src)
+{
+    return _mm256_cvtepu16_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src)));
+}
+
+inline int_pack int_pack_broadcast(std::int32_t value)
+{
+    return _mm256_set1_epi32(value);
+}
+
+inline int_pack int_pack_and(int_pack a, int_pack b)
+{
+    return _mm256_and_si256(a, b);
+}
+
+inline int_pack int_pack_or(int_pack a, int_pack b)
+{
+    return _mm256_or_si256(a, b);
+}
+
+inline int_pack int_pack_xor(int_pack a, int_pack b)
+{
+    return _mm256_xor_si256(a, b);
+}
+
+inline int_pack int_pack_greater(int_pack a, int_pack b)
+{
+    return _mm256_cmpgt_epi32(a, b);
+}
+
+template <int Bits>
+int_pack int_pack_shift_left(int_pack a)
+{
+    return _mm256_slli_epi32(a, Bits);
+}
+
+inline float_pack int_pack_as_floats(int_pack a)
+{
+    return _mm256_castsi256_ps(a);
+}
+
+inline int_pack float_pack_as_ints(float_pack a)
+{
+    return _mm256_castps_si256(a);
+}
+
+inline float_pack float_pack_sub(float_pack a, float_pack b)
+{
+    return _mm256_sub_ps(a, b);
+}
+
+inline int_pack int_pack_add(int_pack a, int_pack b)
+{
+    return _mm256_add_epi32(a, b);
+}
+
+// b & ~a
+inline int_pack int_pack_and_not(int_pack a, int_pack b)
+{
+    return _mm256_andnot_si256(a, b);
+}
+#elif defined(__SSE2__)
+typedef __m128 float_pack;
+typedef __m128i int_pack;
+const std::size_t float_pack_size = 4;
+
+inline float_pack float_pack_load(const float* src)
+{
+    return _mm_loadu_ps(src);
+}
+
+inline void float_pack_store(float* dest, float_pack values)
+{
+    _mm_storeu_ps(dest, values);
+}
+
+inline float_pack float_pack_broadcast(float value)
+{
+    return _mm_set1_ps(value);
+}
+
+inline float_pack float_pack_madd(float_pack acc, float_pack a, float_pack b)
+{
+    return _mm_add_ps(acc, _mm_mul_ps(a, b));
+}
+
+inline int_pack load_half_float_bits(const std::uint16_t* src)
+{
+    return _mm_unpacklo_epi16(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src)),
+        _mm_setzero_si128());
+}
+
+inline int_pack int_pack_broadcast(std::int32_t value)
+{
+    return _mm_set1_epi32(value);
+}
+
+inline int_pack int_pack_and(int_pack a, int_pack b)
+{
+    return _mm_and_si128(a, b);
+}
+
+inline int_pack int_pack_or(int_pack a, int_pack b)
+{
+    return _mm_or_si128(a, b);
+}
+
+inline int_pack int_pack_xor(int_pack a, int_pack b)
+{
+    return _mm_xor_si128(a, b);
+}
+
+inline int_pack int_pack_greater(int_pack a, int_pack b)
+{
+    return _mm_cmpgt_epi32(a, b);
+}
+
+template <int Bits>
+int_pack int_pack_shift_left(int_pack a)
+{
+    return _mm_slli_epi32(a, Bits);
+}
+
+inline float_pack int_pack_as_floats(int_pack a)
+{
+    return _mm_castsi128_ps(a);
+}
+
+inline int_pack float_pack_as_ints(float_pack a)
+{
+    return _mm_castps_si128(a);
+}
+
+inline float_pack float_pack_sub(float_pack a, float_pack b)
+{
+    return _mm_sub_ps(a, b);
+}
+
+inline int_pack int_pack_add(int_pack a, int_pack b)
+{
+    return _mm_add_epi32(a, b);
+}
+
+inline int_pack int_pack_and_not(int_pack a, int_pack b)
+{
+    return _mm_andnot_si128(a, b);
+}
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+template <half_float_format Format>
+float_pack load_half_floats(const std::uint16_t* src);
+
+template <>
+inline float_pack load_half_floats<half_float_format::bfloat16>(
+    const std::uint16_t* src)
+{
+    return int_pack_as_floats(
+        int_pack_shift_left<16>(load_half_float_bits(src)));
+}
+
+template <>
+inline float_pack load_half_floats<half_float_format::float16>(
+    const std::uint16_t* src)
+{
+#if defined(__AVX2__) && defined(__F16C__)
+    return _mm256_cvtph_ps(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src)));
+#else
+    // Exponent and mantissa are moved into place
+    // and the exponent bias is corrected. Infinity and NaN
+    // get the maximum exponent. Zero and subnormal values are computed
+    // as 2^-14 * (1 + mantissa / 2^10) - 2^-14 instead,
+    // which, unlike scaling the subnormal float bits, does not involve
+    // denormal floats, whose arithmetic is very slow on many CPUs.
+    const int_pack bits = load_half_float_bits(src);
+    const int_pack exp_mantissa = int_pack_and(bits, int_pack_broadcast(0x7fff));
+    const int_pack shifted = int_pack_shift_left<13>(exp_mantissa);
+    const int_pack is_inf_nan =
+        int_pack_greater(exp_mantissa, int_pack_broadcast(0x7bff));
+    const int_pack normal = int_pack_add(
+        int_pack_add(shifted, int_pack_broadcast(112 << 23)),
+        int_pack_and(is_inf_nan, int_pack_broadcast(112 << 23)));
+    const int_pack is_subnormal =
+        int_pack_greater(int_pack_broadcast(0x0400), exp_mantissa);
+    const float_pack min_normal = int_pack_as_floats(
+        int_pack_broadcast(113 << 23));
+    const int_pack subnormal = float_pack_as_ints(float_pack_sub(
+        int_pack_as_floats(int_pack_add(shifted, int_pack_broadcast(113 << 23))),
+        min_normal));
+    const int_pack sign = int_pack_shift_left<16>(int_pack_xor(bits, exp_mantissa));
+    return int_pack_as_floats(int_pack_or(sign, int_pack_or(
+        int_pack_and(is_subnormal, subnormal),
+        int_pack_and_not(is_subnormal, normal))));
+#endif
+}
+#endif
+
+template <half_float_format Format, typename float_type>
+void widen_half_floats(const std::uint16_t* src, std::size_t n,
+    float_type* dest)
+{
+    std::size_t i = 0;
+#if defined(__AVX2__) || defined(__SSE2__)
+    if (std::is_same<float_type, float>::value)
+    {
+        float* dest_f = reinterpret_cast<float*>(dest);
+        for (; i + float_pack_size <= n; i += float_pack_size)
+        {
+            float_pack_store(dest_f + i, load_half_floats<Format>(src + i));
+        }
+    }
+#endif
+    for (; i < n; ++i)
+    {
+        dest[i] = static_cast<float_type>(half_float_to_float(src[i], Format));
+    }
+}
+
+// Converts n values to float_type.
+template <typename float_type>
+void widen_half_floats(const std::uint16_t* src, std::size_t n,
+    half_float_format format, float_type* dest)
+{
+    if (format == half_float_format::float16)
+    {
+        widen_half_floats<half_float_format::float16>(src, n, dest);
+    }
+    else
+    {
+        widen_half_floats<half_float_format::bfloat16>(src, n, dest);
+    }
+}
+
+// Read-only array of 16-bit floats, like float_buffer,
+// i.e., either owning its values or viewing memory kept alive by
+// some other owner, e.g., the mapping of a binary model file.
+class half_float_buffer
+{
+public:
+    half_float_buffer() :
+        owner_(), data_(nullptr), size_(0),
+        format_(half_float_format::float16)
+    {
+    }
+    half_float_buffer(half_float_vec&& values, half_float_format format) :
+        owner_(), data_(nullptr), size_(values.size()), format_(format)
+    {
+        const auto owned = std::make_shared<const half_float_vec>(
+            std::move(values));
+        data_ = owned->data();
+        owner_ = owned;
+    }
+    half_float_buffer(const std::shared_ptr<const void>& owner,
+        const std::uint16_t* data, std::size_t size,
+        half_float_format format) :
+        owner_(owner), data_(data), size_(size), format_(format)
+    {
+    }
+    // Copies share the values with the original.
+    half_float_buffer(const half_float_buffer&) = default;
+    half_float_buffer(half_float_buffer&&) = default;
+    half_float_buffer& operator=(const half_float_buffer&) = default;
+    half_float_buffer& operator=(half_float_buffer&&) = default;
+    const std::uint16_t* data() const
+    {
+        return data_;
+    }
+    std::size_t size() const
+    {
+        return size_;
+    }
+    half_float_format format() const
+    {
+        return format_;
+    }
+private:
+    std::shared_ptr<const void> owner_;
+    const std::uint16_t* data_;
+    std::size_t size_;
+    half_float_format format_;
+};
+
+template <typename float_type>
+float_vec<float_type> widen_half_float_buffer(const half_float_buffer& buffer)
+{
+    float_vec<float_type> result(buffer.size());
+    widen_half_floats(buffer.data(), buffer.size(), buffer.format(),
+        result.data());
+    return result;
+}
+
+// Adds the products of the rows of a (positions x n_in) matrix with the
+// row-major (n_in x n_out) weights to output, which must be zeroed.
+// Four weight rows at a time are widened in registers
+// and used for all positions, so the weights are read from memory
+// only once and with 16 bits per value, which is what limits the speed
+// of large dense layers.
+template <half_float_format Format, typename float_type>
+void multiply_half_float_weights_add(const float_type* input,
+    std::size_t positions, std::size_t n_in,
+    const std::uint16_t* weights, std::size_t n_out,
+    float_type* output)
+{
+    const auto widen = [](std::uint16_t value) -> float_type
+    {
+        return static_cast<float_type>(half_float_to_float(value, Format));
+    };
+    const std::size_t row_block = 4;
+    for (std::size_t i = 0; i < n_in; i += row_block)
+    {
+        const std::size_t rows = std::min(row_block, n_in - i);
+        const std::uint16_t* w = weights + i * n_out;
+        for (std::size_t p = 0; p < positions; ++p)
+        {
+            const float_type* x = input + p * n_in + i;
+            float_type* out = output + p * n_out;
+            std::size_t j = 0;
+#if defined(__AVX2__) || defined(__SSE2__)
+            if (std::is_same<float_type, float>::value && rows == row_block)
+            {
+                float* out_f = reinterpret_cast<float*>(out);
+                const float_pack x0 = float_pack_broadcast(
+                    static_cast<float>(x[0]));
+                const float_pack x1 = float_pack_broadcast(
+                    static_cast<float>(x[1]));
+                const float_pack x2 = float_pack_broadcast(
+                    static_cast<float>(x[2]));
+                const float_pack x3 = float_pack_broadcast(
+                    static_cast<float>(x[3]));
+                for (; j + float_pack_size <= n_out; j += float_pack_size)
+                {
+                    float_pack acc = float_pack_load(out_f + j);
+                    acc = float_pack_madd(acc, x0,
+                        load_half_floats<Format>(w + j));
+                    acc = float_pack_madd(acc, x1,
+                        load_half_floats<Format>(w + n_out + j));
+                    acc = float_pack_madd(acc, x2,
+                        load_half_floats<Format>(w + 2 * n_out + j));
+                    acc = float_pack_madd(acc, x3,
+                        load_half_floats<Format>(w + 3 * n_out + j));
+                    float_pack_store(out_f + j, acc);
+                }
+            }
+#endif
+            for (; j < n_out; ++j)
+            {
+                for (std::size_t r = 0; r < rows; ++r)
+                {
+                    out[j] += x[r] * widen(w[r * n_out + j]);
+                }
+            }
+        }
+    }
+}
+
+// Whether multiply_half_float_weights is faster than multiplying
+// with the widened weights in this build.
+// Widening float16 values without the F16C instructions is too slow.
+template <typename float_type>
+bool half_float_weights_used_directly(half_float_format format)
+{
+#if defined(__AVX2__) && defined(__F16C__)
+    const bool float16_supported = true;
+#else
+    const bool float16_supported = false;
+#endif
+#if defined(__AVX2__) || defined(__SSE2__)
+    const bool bfloat16_supported = true;
+#else
+    const bool bfloat16_supported = false;
+#endif
+    return std::is_same<float_type, float>::value &&
+        (format == half_float_format::float16
+            ? float16_supported : bfloat16_supported);
+}
+
+// Multiplies the rows of a (positions x n_in) matrix with the
+// row-major (n_in x n_out) weights.
+template <typename float_type>
+void multiply_half_float_weights(const float_type* input,
+    std::size_t positions, std::size_t n_in,
+    const half_float_buffer& weights, std::size_t n_out,
+    float_type* output)
+{
+    assertion(weights.size() == n_in * n_out, "invalid weight count");
+    std::fill(output, output + positions * n_out, static_cast<float_type>(0));
+    if (weights.format() == half_float_format::float16)
+    {
+        multiply_half_float_weights_add<half_float_format::float16>(
+            input, positions, n_in, weights.data(), n_out, output);
+    }
+    else
+    {
+        multiply_half_float_weights_add<half_float_format::bfloat16>(
+            input, positions, n_in, weights.data(), n_out, output);
+    }
+}
+
+} } // namespace fdeep, namespace internal
@@ -7,6 +7,7 @@
 #pragma once
 
 #include "fdeep/base64.hpp"
+#include "fdeep/binary_model.hpp"
 
 #if defined(__GNUC__) || defined(__GNUG__)
 #pragma GCC diagnostic push
@@ -73,15 +74,19 @@
 #include "fdeep/shape5.hpp"
 #include "fdeep/shape5_variable.hpp"
 #include "fdeep/tensor5.hpp"
+#include "fdeep/thread_pool.hpp"
 
 #include <fplus/fplus.hpp>
 
 #include <algorithm>
+#include <cstring>
+#include <future>
 #include <iostream>
 #include <limits>
 #include <memory>
 #include <string>
 #include <map>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
@@ -99,6 +104,21 @@ ValueT json_object_get(const nlohmann::json& data, KeyT&& key, ValueT&& default_
         return std::forward<ValueT>(default_value);
 }
 
+// Member of a json object, or null if it does not exist.
+// In contrast to the non-const operator[], this never changes data,
+// so it can be used by multiple threads at once.
+inline const nlohmann::json& json_member_or_null(const nlohmann::json& data,
+    const std::string& member_name)
+{
+    static const nlohmann::json null_json;
+    if (!data.is_object())
+    {
+        return null_json;
+    }
+    const auto it = data.find(member_name);
+    return it != data.end() ? *it : null_json;
+}
+
 inline bool json_obj_has_member(const nlohmann::json& data,
     const std::string& member_name)
 {
@@ -220,37 +240,277 @@ inline int create_int(const nlohmann::json& int_data)
     return val;
 }
 
-inline float_vec decode_floats(const nlohmann::json& data)
+// Decodes base64-encoded float32 values directly into the result.
+template <typename float_type>
+float_vec<float_type> decode_base64_floats(const nlohmann::json& data)
+{
+    assertion(std::numeric_limits<float>::is_iec559,
+        "The floating-point format of your system is not supported.");
+
+    const std::size_t byte_count = Base64_decoded_size(data);
+    assertion(byte_count % sizeof(float) == 0, "invalid float vector data");
+    float_vec<float_type> out(byte_count / sizeof(float));
+    if (std::is_same<float_type, float>::value)
+    {
+        assertion(Base64_decode_into(data,
+            reinterpret_cast<std::uint8_t*>(out.data()), byte_count) ==
+                byte_count, "invalid float vector data");
+        return out;
+    }
+    std::vector<std::uint8_t> bytes(byte_count);
+    assertion(Base64_decode_into(data, bytes.data(), byte_count) ==
+        byte_count, "invalid float vector data");
+    for (std::size_t i = 0; i < out.size(); ++i)
+    {
+        float val;
+        std::memcpy(&val, &bytes[i * sizeof(float)], sizeof(float));
+        out[i] = static_cast<float_type>(val);
+    }
+    return out;
+}
+
+// Decodes base64-encoded 16-bit floats (see half_float.hpp).
+inline half_float_vec decode_base64_half_floats(const nlohmann::json& data)
+{
+    assertion(is_little_endian(),
+        "The byte order of your system is not supported.");
+    const std::size_t byte_count = Base64_decoded_size(data);
+    assertion(byte_count % sizeof(std::uint16_t) == 0,
+        "invalid float vector data");
+    half_float_vec out(byte_count / sizeof(std::uint16_t));
+    assertion(Base64_decode_into(data,
+        reinterpret_cast<std::uint8_t*>(out.data()), byte_count) ==
+            byte_count, "invalid float vector data");
+    return out;
+}
+
+// Arrays stored with 16 bits per value (convert_model.py --weight-format)
+// are written as {"float16": ...} or {"bfloat16": ...}.
+inline fplus::maybe<half_float_format> json_half_float_array_format(
+    const nlohmann::json& data)
+{
+    if (!data.is_object() || data.size() != 1)
+    {
+        return fplus::nothing<half_float_format>();
+    }
+    const std::string key = data.begin().key();
+    if (key != "float16" && key != "bfloat16")
+    {
+        return fplus::nothing<half_float_format>();
+    }
+    return parse_half_float_format(key);
+}
+
+// The format of a float array, if it is stored with 16 bits per value.
+inline fplus::maybe<half_float_format> float_array_half_float_format(
+    const nlohmann::json& data)
+{
+    return json_is_blob_ref(data)
+        ? blob_ref_half_float_format(data)
+        : json_half_float_array_format(data);
+}
+
+template <typename float_type>
+float_vec<float_type> decode_floats(const nlohmann::json& data)
 {
+    if (json_is_blob_ref(data))
+    {
+        assertion(current_weight_blob_reader() != nullptr,
+            "blob reference outside of a model being loaded");
+        return current_weight_blob_reader()->template read_floats<float_type>(data);
+    }
+
+    const auto half_format = json_half_float_array_format(data);
+    if (half_format.is_just())
+    {
+        return widen_half_float_buffer<float_type>(half_float_buffer(
+            decode_base64_half_floats(data.begin().value()),
+            half_format.unsafe_get_just()));
+    }
+
     assertion(data.is_array() || data.is_string(),
         "invalid float array format");
 
     if (data.is_array() && !data.empty() && data[0].is_number())
     {
-        const float_vec result = data;
+        const float_vec<float_type> result = data;
         return result;
     }
 
-    assertion(std::numeric_limits<float>::is_iec559,
-        "The floating-point format of your system is not supported.");
+    return decode_base64_floats<float_type>(data);
+}
 
-    const auto res = Base64_decode(json_data_strs_char_prodiver(data, '='));
-    float_vec out;
-    assertion(res.size() % 4 == 0, "invalid float vector data");
-    out.reserve(res.size() / 4);
-    for (std::size_t i = 0; i < res.size(); i+=4)
+// Like decode_floats<float_type>, but the arrays of a memory-mapped binary model
+// are used in place instead of being copied.
+template <typename float_type>
+float_buffer<float_type> decode_float_buffer(const nlohmann::json& data)
+{
+    if (json_is_blob_ref(data) && current_weight_blob_reader() != nullptr)
     {
-        float_type val = static_cast<float_type>(
-            *(reinterpret_cast<const float*>(&(res[i]))));
-        out.push_back(val);
+        return current_weight_blob_reader()->template read_float_buffer<float_type>(
+            data);
     }
-    return out;
+    return float_buffer<float_type>(decode_floats<float_type>(data));
 }
 
-inline tensor5 create_tensor5(const nlohmann::json& data)
+// Decodes an array stored with 16 bits per value without widening it.
+inline half_float_buffer decode_half_float_buffer(const nlohmann::json& data)
+{
+    if (json_is_blob_ref(data))
+    {
+        assertion(current_weight_blob_reader() != nullptr,
+            "blob reference outside of a model being loaded");
+        return current_weight_blob_reader()->read_half_floats(data);
+    }
+    const auto half_format = fplus::throw_on_nothing(
+        error("not a 16-bit float array"), json_half_float_array_format(data));
+    return half_float_buffer(decode_base64_half_floats(data.begin().value()),
+        half_format);
+}
+
+// Parses a JSON model in a single pass over the stream.
+// Every base64-encoded float array of the trainable params
+// and of the test cases is replaced by a reference into decoded_arrays
+// as soon as it is complete, and decoded by the pool (if not null)
+// while parsing goes on,
+// so the encoded strings of the whole model never exist at once.
+// Arrays stored with 16 bits per value are kept like that.
+// The test cases are skipped if keep_tests is false.
+inline nlohmann::json parse_json_model(std::istream& stream,
+    bool keep_tests, thread_pool* pool,
+    std::vector<decoded_array>& decoded_arrays)
+{
+    std::vector<std::shared_ptr<decoded_array>> results;
+    task_group decoding(pool);
+    // Last key seen on each depth, i.e., the path to the current value.
+    std::vector<std::string> keys;
+    const auto is_test_cases = [&keys](std::size_t depth) -> bool
+    {
+        return depth == 1 && keys.size() > 1 && keys[1] == "tests";
+    };
+    const auto is_encoded_float_array = [&keys](std::size_t depth,
+        const nlohmann::json& arr) -> bool
+    {
+        if (depth < 2 || keys.size() <= depth || arr.empty() ||
+            !fplus::all_by([](const nlohmann::json& x)
+            {
+                return x.is_string();
+            }, arr))
+        {
+            return false;
+        }
+        return (keys[1] == "trainable_params" && depth == 3) ||
+            (keys[1] == "trainable_params" && depth == 4 &&
+                (keys[4] == "float16" || keys[4] == "bfloat16")) ||
+            (keys[1] == "tests" && keys[depth] == "values");
+    };
+    const nlohmann::json::parser_callback_t callback =
+        [&](int depth_int, nlohmann::json::parse_event_t event,
+            nlohmann::json& parsed) -> bool
+    {
+        const auto depth = static_cast<std::size_t>(depth_int);
+        if (event == nlohmann::json::parse_event_t::key)
+        {
+            keys.resize(depth + 1);
+            keys[depth] = parsed.get<std::string>();
+            return keep_tests || !is_test_cases(depth);
+        }
+        if (event == nlohmann::json::parse_event_t::array_start ||
+            event == nlohmann::json::parse_event_t::object_start)
+        {
+            return keep_tests || !is_test_cases(depth);
+        }
+        if (event == nlohmann::json::parse_event_t::array_end &&
+            is_encoded_float_array(depth, parsed))
+        {
+            const auto encoded =
+                std::make_shared<const nlohmann::json>(std::move(parsed));
+            const auto result = std::make_shared<decoded_array>();
+            const bool is_half = depth == 4;
+            decoding.run([encoded, result, is_half]()
+            {
+                if (is_half)
+                    result->half_floats_ = decode_base64_half_floats(*encoded);
+                else
+                    result->floats_ = decode_base64_floats<float>(*encoded);
+            });
+            results.push_back(result);
+            parsed = {
+                {"blob_index", results.size() - 1},
+                {"blob_floats", Base64_decoded_size(*encoded) /
+                    (is_half ? sizeof(std::uint16_t) : sizeof(float))}
+            };
+            if (is_half)
+            {
+                parsed["blob_format"] = keys[4];
+            }
+        }
+        // The reference replaces the {"float16": ...} object around it.
+        if (event == nlohmann::json::parse_event_t::object_end &&
+            depth == 3 && keys.size() > 1 && keys[1] == "trainable_params" &&
+            json_half_float_array_format(parsed).is_just() &&
+            json_is_blob_ref(parsed.begin().value()))
+        {
+            nlohmann::json blob_ref = parsed.begin().value();
+            parsed = std::move(blob_ref);
+        }
+        return true;
+    };
+    auto json_data = nlohmann::json::parse(stream, callback);
+    decoding.wait();
+    decoded_arrays = fplus::transform(
+        [](const std::shared_ptr<decoded_array>& result) -> decoded_array
+    {
+        return std::move(*result);
+    }, results);
+    return json_data;
+}
+
+// Reads the hash of a JSON model, without parsing any further,
+// i.e., without reaching the weights,
+// which convert_model.py writes after it.
+// Returns an empty string if the model has no hash.
+inline std::string read_json_model_hash(std::istream& stream)
+{
+    struct hash_found {};
+    std::string hash;
+    std::string key;
+    const nlohmann::json::parser_callback_t callback =
+        [&](int depth, nlohmann::json::parse_event_t event,
+            nlohmann::json& parsed) -> bool
+    {
+        if (depth != 1)
+        {
+            return depth == 0;
+        }
+        if (event == nlohmann::json::parse_event_t::key)
+        {
+            key = parsed.get<std::string>();
+        }
+        else if (event == nlohmann::json::parse_event_t::value &&
+            key == "hash" && parsed.is_string())
+        {
+            hash = parsed.get<std::string>();
+            throw hash_found();
+        }
+        return key == "hash";
+    };
+    try
+    {
+        // Only reached if there is no hash.
+        const nlohmann::json rest = nlohmann::json::parse(stream, callback);
+    }
+    catch (const hash_found&)
+    {
+    }
+    return hash;
+}
+
+template <typename float_type>
+tensor5<float_type> create_tensor5(const nlohmann::json& data)
 {
     const shape5 shape = create_shape5(data["shape"]);
-    return tensor5(shape, decode_floats(data["values"]));
+    return tensor5<float_type>(shape, decode_floats<float_type>(data["values"]));
 }
 
 template <typename T, typename F>
@@ -280,41 +540,64 @@ using get_param_f =
     std::function<nlohmann::json(const std::string&, const std::string&)>;
 using get_global_param_f = std::function<nlohmann::json(const std::string&)>;
 
+template <typename float_type>
 using layer_creators =
     std::map<
         std::string,
-        std::function<layer_ptr(
+        std::function<layer_ptr<float_type>(
             const get_param_f&,
             const get_global_param_f&,
             const nlohmann::json&,
             const std::string&)>>;
 
+template <typename float_type>
 using wrapper_layer_creators =
     std::map<
         std::string,
-        std::function<layer_ptr(
+        std::function<layer_ptr<float_type>(
             const get_param_f&,
             const get_global_param_f&,
             const nlohmann::json&,
             const std::string&,
-            const layer_creators&)>>;
+            const layer_creators<float_type>&)>>;
 
-layer_ptr create_layer(const get_param_f&, const get_global_param_f&,
+template <typename float_type>
+layer_ptr<float_type> create_layer(const get_param_f&, const get_global_param_f&,
     const nlohmann::json&,
-    const layer_creators& custom_layer_creators);
+    const layer_creators<float_type>& custom_layer_creators);
 
-inline layer_ptr create_model_layer(const get_param_f& get_param,
+template <typename float_type>
+layer_ptr<float_type> create_model_layer(const get_param_f& get_param,
     const get_global_param_f& get_global_param, const nlohmann::json& data,
-    const std::string& name, const layer_creators& custom_layer_creators)
+    const std::string& name, const layer_creators<float_type>& custom_layer_creators)
 {
     assertion(data["config"]["layers"].is_array(), "missing layers array");
 
-    const auto make_layer = [&](const nlohmann::json& json)
+    // The layers (including the preprocessing of their weights)
+    // are created in parallel if a thread pool is available.
+    // Their order does not depend on it.
+    // Custom layer creators need not be thread-safe,
+    // so they prevent the parallel creation.
+    const nlohmann::json& layers_data = data["config"]["layers"];
+    std::vector<layer_ptr<float_type>> layers(layers_data.size());
+    const weight_blob_reader* blob_reader = current_weight_blob_reader();
+    const auto make_layer = [&](std::size_t i)
     {
-        return create_layer(get_param, get_global_param, json, custom_layer_creators);
+        const weight_blob_reader_scope blob_reader_scope(blob_reader);
+        layers[i] = create_layer(get_param, get_global_param, layers_data[i],
+            custom_layer_creators);
     };
-    const auto layers = create_vector<layer_ptr>(make_layer,
-        data["config"]["layers"]);
+    if (current_thread_pool() != nullptr && custom_layer_creators.empty())
+    {
+        current_thread_pool()->parallel_for(layers.size(), make_layer);
+    }
+    else
+    {
+        for (std::size_t i = 0; i < layers.size(); ++i)
+        {
+            make_layer(i);
+        }
+    }
 
     assertion(data["config"]["input_layers"].is_array(), "no input layers");
 
@@ -324,10 +607,11 @@ inline layer_ptr create_model_layer(const get_param_f& get_param,
     const auto outputs = create_vector<node_connection>(
         create_node_connection, data["config"]["output_layers"]);
 
-    return std::make_shared<model_layer>(name, layers, inputs, outputs);
+    return std::make_shared<model_layer<float_type>>(name, layers, inputs, outputs);
 }
 
-inline void fill_with_zeros(float_vec& xs)
+template <typename float_type>
+void fill_with_zeros(float_vec<float_type>& xs)
 {
     std::fill(std::begin(xs), std::end(xs), static_cast<float_type>(0));
 }
@@ -342,7 +626,20 @@ inline padding create_padding(const std::string& padding_str)
     }, padding_str));
 }
 
-inline layer_ptr create_conv_2d_layer(const get_param_f& get_param,
+// Maximum absolute input value of the layer while calibrating the model
+// (see convert_model.py --calibrate), 0 if unknown.
+template <typename float_type>
+float_type get_input_max_abs(const get_global_param_f& get_global_param,
+    const std::string& name)
+{
+    const nlohmann::json ranges = get_global_param("activation_ranges");
+    return ranges.is_object()
+        ? json_object_get(ranges, name, static_cast<float_type>(0))
+        : static_cast<float_type>(0);
+}
+
+template <typename float_type>
+layer_ptr<float_type> create_conv_2d_layer(const get_param_f& get_param,
     const get_global_param_f& get_global_param, const nlohmann::json& data,
     const std::string& name)
 {
@@ -353,13 +650,14 @@ inline layer_ptr create_conv_2d_layer(const get_param_f& get_param,
     const shape2 dilation_rate = create_shape2(data["config"]["dilation_rate"]);
 
     const auto filter_count = create_size_t(data["config"]["filters"]);
-    float_vec bias(filter_count, 0);
+    float_vec<float_type> bias(filter_count, 0);
     const bool use_bias = data["config"]["use_bias"];
     if (use_bias)
-        bias = decode_floats(get_param(name, "bias"));
+        bias = decode_floats<float_type>(get_param(name, "bias"));
     assertion(bias.size() == filter_count, "size of bias does not match");
 
-    const float_vec weights = decode_floats(get_param(name, "weights"));
+    const float_buffer<float_type> weights = decode_float_buffer<float_type>(
+        get_param(name, "weights"));
     const shape2 kernel_size = create_shape2(data["config"]["kernel_size"]);
     assertion(weights.size() % kernel_size.area() == 0,
         "invalid number of weights");
@@ -376,14 +674,25 @@ inline layer_ptr create_conv_2d_layer(const get_param_f& get_param,
         get_global_param("conv2d_valid_offset_depth_2");
     const bool padding_same_uses_offset_depth_2 =
         get_global_param("conv2d_same_offset_depth_2");
-    return std::make_shared<conv_2d_layer>(name,
+
+    // Only present in the files written by load_model_cached.
+    const nlohmann::json winograd_weights_data =
+        get_param(name, "winograd_weights");
+    const float_buffer<float_type> winograd_weights =
+        json_is_blob_ref(winograd_weights_data)
+            ? decode_float_buffer<float_type>(winograd_weights_data)
+            : float_buffer<float_type>();
+    return std::make_shared<conv_2d_layer<float_type>>(name,
         filter_shape, filter_count, strides, pad_type,
         padding_valid_uses_offset_depth_1, padding_same_uses_offset_depth_1,
         padding_valid_uses_offset_depth_2, padding_same_uses_offset_depth_2,
-        dilation_rate, weights, bias);
+        dilation_rate, weights, bias,
+        get_input_max_abs<float_type>(get_global_param, name),
+        winograd_weights);
 }
 
-inline layer_ptr create_separable_conv_2D_layer(const get_param_f& get_param,
+template <typename float_type>
+layer_ptr<float_type> create_separable_conv_2D_layer(const get_param_f& get_param,
     const get_global_param_f& get_global_param, const nlohmann::json& data,
     const std::string& name)
 {
@@ -394,15 +703,15 @@ inline layer_ptr create_separable_conv_2D_layer(const get_param_f& get_param,
     const shape2 dilation_rate = create_shape2(data["config"]["dilation_rate"]);
 
     const auto filter_count = create_size_t(data["config"]["filters"]);
-    float_vec bias(filter_count, 0);
+    float_vec<float_type> bias(filter_count, 0);
     const bool use_bias = data["config"]["use_bias"];
     if (use_bias)
-        bias = decode_floats(get_param(name, "bias"));
+        bias = decode_floats<float_type>(get_param(name, "bias"));
     assertion(bias.size() == filter_count, "size of bias does not match");
 
-    const float_vec slice_weights = decode_floats(
+    const float_vec<float_type> slice_weights = decode_floats<float_type>(
         get_param(name, "slice_weights"));
-    const float_vec stack_weights = decode_floats(
+    const float_buffer<float_type> stack_weights = decode_float_buffer<float_type>(
         get_param(name, "stack_weights"));
     const shape2 kernel_size = create_shape2(data["config"]["kernel_size"]);
     assertion(slice_weights.size() % kernel_size.area() == 0,
@@ -414,7 +723,7 @@ inline layer_ptr create_separable_conv_2D_layer(const get_param_f& get_param,
         stack_weights.size() / input_depth;
     assertion(stack_output_depths_1 == filter_count, "invalid weights sizes");
     const shape5 filter_shape(1, 1, kernel_size.height_, kernel_size.width_, 1);
-    float_vec bias_0(input_depth, 0);
+    float_vec<float_type> bias_0(input_depth, 0);
     const bool padding_valid_uses_offset_depth_1 =
         get_global_param("separable_conv2d_valid_offset_depth_1");
     const bool padding_same_uses_offset_depth_1 =
@@ -423,14 +732,16 @@ inline layer_ptr create_separable_conv_2D_layer(const get_param_f& get_param,
         get_global_param("separable_conv2d_valid_offset_depth_2");
     const bool padding_same_uses_offset_depth_2 =
         get_global_param("separable_conv2d_same_offset_depth_2");
-    return std::make_shared<separable_conv_2d_layer>(name, input_depth,
+    return std::make_shared<separable_conv_2d_layer<float_type>>(name, input_depth,
         filter_shape, filter_count, strides, pad_type,
         padding_valid_uses_offset_depth_1, padding_same_uses_offset_depth_1,
         padding_valid_uses_offset_depth_2, padding_same_uses_offset_depth_2,
-        dilation_rate, slice_weights, stack_weights, bias_0, bias);
+        dilation_rate, slice_weights, stack_weights, bias_0, bias,
+        get_input_max_abs<float_type>(get_global_param, name));
 }
 
-inline layer_ptr create_depthwise_conv_2D_layer(const get_param_f& get_param,
+template <typename float_type>
+layer_ptr<float_type> create_depthwise_conv_2D_layer(const get_param_f& get_param,
     const get_global_param_f& get_global_param, const nlohmann::json& data,
     const std::string& name)
 {
@@ -440,7 +751,7 @@ inline layer_ptr create_depthwise_conv_2D_layer(const get_param_f& get_param,
     const shape2 strides = create_shape2(data["config"]["strides"]);
     const shape2 dilation_rate = create_shape2(data["config"]["dilation_rate"]);
 
-    const float_vec slice_weights = decode_floats(
+    const float_vec<float_type> slice_weights = decode_floats<float_type>(
         get_param(name, "slice_weights"));
     const shape2 kernel_size = create_shape2(data["config"]["kernel_size"]);
     assertion(slice_weights.size() % kernel_size.area() == 0,
@@ -448,10 +759,10 @@ inline layer_ptr create_depthwise_conv_2D_layer(const get_param_f& get_param,
     const std::size_t input_depth = slice_weights.size() / kernel_size.area();
     const shape5 filter_shape(1, 1, kernel_size.height_, kernel_size.width_, 1);
     const std::size_t filter_count = input_depth;
-    float_vec bias(filter_count, 0);
+    float_vec<float_type> bias(filter_count, 0);
     const bool use_bias = data["config"]["use_bias"];
     if (use_bias)
-        bias = decode_floats(get_param(name, "bias"));
+        bias = decode_floats<float_type>(get_param(name, "bias"));
     assertion(bias.size() == filter_count, "size of bias does not match");
     const bool padding_valid_uses_offset_depth_1 =
         get_global_param("separable_conv2d_valid_offset_depth_1");
@@ -461,50 +772,55 @@ inline layer_ptr create_depthwise_conv_2D_layer(const get_param_f& get_param,
         get_global_param("separable_conv2d_valid_offset_depth_2");
     const bool padding_same_uses_offset_depth_2 =
         get_global_param("separable_conv2d_same_offset_depth_2");
-    return std::make_shared<depthwise_conv_2d_layer>(name, input_depth,
+    return std::make_shared<depthwise_conv_2d_layer<float_type>>(name, input_depth,
         filter_shape, filter_count, strides, pad_type,
         padding_valid_uses_offset_depth_1, padding_same_uses_offset_depth_1,
         padding_valid_uses_offset_depth_2, padding_same_uses_offset_depth_2,
-        dilation_rate, slice_weights, bias);
+        dilation_rate, slice_weights, bias,
+        get_input_max_abs<float_type>(get_global_param, name));
 }
 
-inline layer_ptr create_input_layer(
+template <typename float_type>
+layer_ptr<float_type> create_input_layer(
     const get_param_f&, const get_global_param_f&, const nlohmann::json& data,
     const std::string& name)
 {
     assertion(data["inbound_nodes"].empty(),
         "input layer is not allowed to have inbound nodes");
     const auto input_shape = create_shape5_variable(data["config"]["batch_input_shape"]);
-    return std::make_shared<input_layer>(name, input_shape);
+    return std::make_shared<input_layer<float_type>>(name, input_shape);
 }
 
-inline layer_ptr create_batch_normalization_layer(const get_param_f& get_param,
+template <typename float_type>
+layer_ptr<float_type> create_batch_normalization_layer(const get_param_f& get_param,
     const get_global_param_f&, const nlohmann::json& data,
     const std::string& name)
 {
-    const float_vec moving_mean = decode_floats(get_param(name, "moving_mean"));
-    const float_vec moving_variance =
-        decode_floats(get_param(name, "moving_variance"));
+    const float_vec<float_type> moving_mean = decode_floats<float_type>(get_param(name, "moving_mean"));
+    const float_vec<float_type> moving_variance =
+        decode_floats<float_type>(get_param(name, "moving_variance"));
     const bool center = data["config"]["center"];
     const bool scale = data["config"]["scale"];
     const float_type epsilon = data["config"]["epsilon"];
-    float_vec gamma;
-    float_vec beta;
-    if (scale) gamma = decode_floats(get_param(name, "gamma"));
-    if (center) beta = decode_floats(get_param(name, "beta"));
-    return std::make_shared<batch_normalization_layer>(
+    float_vec<float_type> gamma;
+    float_vec<float_type> beta;
+    if (scale) gamma = decode_floats<float_type>(get_param(name, "gamma"));
+    if (center) beta = decode_floats<float_type>(get_param(name, "beta"));
+    return std::make_shared<batch_normalization_layer<float_type>>(
         name, moving_mean, moving_variance, beta, gamma, epsilon);
 }
 
-inline layer_ptr create_identity_layer(
+template <typename float_type>
+layer_ptr<float_type> create_identity_layer(
     const get_param_f&, const get_global_param_f&, const nlohmann::json&,
     const std::string& name)
 {
     // Dropout and noise layers are identity functions during prediction.
-    return std::make_shared<linear_layer>(name);
+    return std::make_shared<linear_layer<float_type>>(name);
 }
 
-inline layer_ptr create_max_pooling_2d_layer(
+template <typename float_type>
+layer_ptr<float_type> create_max_pooling_2d_layer(
     const get_param_f&, const get_global_param_f& get_global_param,
     const nlohmann::json& data, const std::string& name)
 {
@@ -517,13 +833,14 @@ inline layer_ptr create_max_pooling_2d_layer(
         get_global_param("max_pooling_2d_valid_offset");
     const bool padding_same_uses_offset =
         get_global_param("max_pooling_2d_same_offset");
-    return std::make_shared<max_pooling_2d_layer>(name,
+    return std::make_shared<max_pooling_2d_layer<float_type>>(name,
         pool_size, strides, channels_first, pad_type,
         padding_valid_uses_offset,
         padding_same_uses_offset);
 }
 
-inline layer_ptr create_average_pooling_2d_layer(
+template <typename float_type>
+layer_ptr<float_type> create_average_pooling_2d_layer(
     const get_param_f&, const get_global_param_f& get_global_param,
     const nlohmann::json& data, const std::string& name)
 {
@@ -537,138 +854,162 @@ inline layer_ptr create_average_pooling_2d_layer(
         get_global_param("average_pooling_2d_valid_offset");
     const bool padding_same_uses_offset =
         get_global_param("average_pooling_2d_same_offset");
-    return std::make_shared<average_pooling_2d_layer>(name,
+    return std::make_shared<average_pooling_2d_layer<float_type>>(name,
         pool_size, strides, channels_first, pad_type,
         padding_valid_uses_offset,
         padding_same_uses_offset);
 }
 
-inline layer_ptr create_global_max_pooling_1d_layer(
+template <typename float_type>
+layer_ptr<float_type> create_global_max_pooling_1d_layer(
     const get_param_f&, const get_global_param_f&, const nlohmann::json& data,
     const std::string& name)
 {
     const bool channels_first = json_obj_has_member(data, "config")
         && json_object_get(data["config"], "data_format", std::string("channels_last")) == "channels_first";
 
-    return std::make_shared<global_max_pooling_1d_layer>(name, channels_first);
+    return std::make_shared<global_max_pooling_1d_layer<float_type>>(name, channels_first);
 }
 
-inline layer_ptr create_global_max_pooling_2d_layer(
+template <typename float_type>
+layer_ptr<float_type> create_global_max_pooling_2d_layer(
     const get_param_f&, const get_global_param_f&, const nlohmann::json& data,
     const std::string& name)
 {
     const bool channels_first = json_obj_has_member(data, "config")
         && json_object_get(data["config"], "data_format", std::string("channels_last")) == "channels_first";
 
-    return std::make_shared<global_max_pooling_2d_layer>(name, channels_first);
+    return std::make_shared<global_max_pooling_2d_layer<float_type>>(name, channels_first);
 }
 
-inline layer_ptr create_global_average_pooling_1d_layer(
+template <typename float_type>
+layer_ptr<float_type> create_global_average_pooling_1d_layer(
     const get_param_f&, const get_global_param_f&, const nlohmann::json& data,
     const std::string& name)
 {
     const bool channels_first = json_obj_has_member(data, "config")
         && json_object_get(data["config"], "data_format", std::string("channels_last")) == "channels_first";
 
-    return std::make_shared<global_average_pooling_1d_layer>(name, channels_first);
+    return std::make_shared<global_average_pooling_1d_layer<float_type>>(name, channels_first);
 }
 
-inline layer_ptr create_global_average_pooling_2d_layer(
+template <typename float_type>
+layer_ptr<float_type> create_global_average_pooling_2d_layer(
     const get_param_f&, const get_global_param_f&, const nlohmann::json& data,
     const std::string& name)
 {
     const bool channels_first = json_obj_has_member(data, "config")
         && json_object_get(data["config"], "data_format", std::string("channels_last")) == "channels_first";
 
-    return std::make_shared<global_average_pooling_2d_layer>(name, channels_first);
+    return std::make_shared<global_average_pooling_2d_layer<float_type>>(name, channels_first);
 }
 
-inline layer_ptr create_upsampling_1d_layer(
+template <typename float_type>
+layer_ptr<float_type> create_upsampling_1d_layer(
     const get_param_f&, const get_global_param_f&, const nlohmann::json& data,
     const std::string& name)
 {
     const std::size_t size = data["config"]["size"];
-    return std::make_shared<upsampling_1d_layer>(name, size);
+    return std::make_shared<upsampling_1d_layer<float_type>>(name, size);
 }
 
-inline layer_ptr create_upsampling_2d_layer(
+template <typename float_type>
+layer_ptr<float_type> create_upsampling_2d_layer(
     const get_param_f&, const get_global_param_f&, const nlohmann::json& data,
     const std::string& name)
 {
     const auto scale_factor = create_shape2(data["config"]["size"]);
     const std::string interpolation = data["config"]["interpolation"];
-    return std::make_shared<upsampling_2d_layer>(
+    return std::make_shared<upsampling_2d_layer<float_type>>(
         name, scale_factor, interpolation);
 }
 
-inline layer_ptr create_dense_layer(const get_param_f& get_param,
-    const get_global_param_f&, const nlohmann::json& data,
+template <typename float_type>
+layer_ptr<float_type> create_dense_layer(const get_param_f& get_param,
+    const get_global_param_f& get_global_param, const nlohmann::json& data,
     const std::string& name)
 {
-    const float_vec weights = decode_floats(get_param(name, "weights"));
+    const nlohmann::json& weights_data = get_param(name, "weights");
 
     std::size_t units = data["config"]["units"];
-    float_vec bias(units, 0);
+    float_vec<float_type> bias(units, 0);
     const bool use_bias = data["config"]["use_bias"];
     if (use_bias)
-        bias = decode_floats(get_param(name, "bias"));
+        bias = decode_floats<float_type>(get_param(name, "bias"));
     assertion(bias.size() == units, "size of bias does not match");
 
-    return std::make_shared<dense_layer>(
-        name, units, weights, bias);
+    const auto half_format = float_array_half_float_format(weights_data);
+    if (half_format.is_just() &&
+        half_float_weights_used_directly<float_type>(half_format.unsafe_get_just()))
+    {
+        return std::make_shared<dense_layer<float_type>>(
+            name, units, decode_half_float_buffer(weights_data), bias,
+            get_input_max_abs<float_type>(get_global_param, name));
+    }
+    return std::make_shared<dense_layer<float_type>>(
+        name, units, decode_float_buffer<float_type>(weights_data), bias,
+        get_input_max_abs<float_type>(get_global_param, name));
 }
 
-inline layer_ptr create_concatenate_layer(
+template <typename float_type>
+layer_ptr<float_type> create_concatenate_layer(
     const get_param_f&, const get_global_param_f&, const nlohmann::json& data,
     const std::string& name)
 {
     const std::int32_t keras_axis = data["config"]["axis"];
-    return std::make_shared<concatenate_layer>(name, keras_axis);
+    return std::make_shared<concatenate_layer<float_type>>(name, keras_axis);
 }
 
-inline layer_ptr create_add_layer(
+template <typename float_type>
+layer_ptr<float_type> create_add_layer(
     const get_param_f&, const get_global_param_f&, const nlohmann::json&,
     const std::string& name)
 {
-    return std::make_shared<add_layer>(name);
+    return std::make_shared<add_layer<float_type>>(name);
 }
 
-inline layer_ptr create_maximum_layer(
+template <typename float_type>
+layer_ptr<float_type> create_maximum_layer(
     const get_param_f&, const get_global_param_f&, const nlohmann::json&,
     const std::string& name)
 {
-    return std::make_shared<maximum_layer>(name);
+    return std::make_shared<maximum_layer<float_type>>(name);
 }
 
-inline layer_ptr create_multiply_layer(
+template <typename float_type>
+layer_ptr<float_type> create_multiply_layer(
     const get_param_f&, const get_global_param_f&, const nlohmann::json&,
     const std::string& name)
 {
-    return std::make_shared<multiply_layer>(name);
+    return std::make_shared<multiply_layer<float_type>>(name);
 }
 
-inline layer_ptr create_average_layer(
+template <typename float_type>
+layer_ptr<float_type> create_average_layer(
     const get_param_f&, const get_global_param_f&, const nlohmann::json&,
     const std::string& name)
 {
-    return std::make_shared<average_layer>(name);
+    return std::make_shared<average_layer<float_type>>(name);
 }
 
-inline layer_ptr create_subtract_layer(
+template <typename float_type>
+layer_ptr<float_type> create_subtract_layer(
     const get_param_f&, const get_global_param_f&, const nlohmann::json&,
     const std::string& name)
 {
-    return std::make_shared<subtract_layer>(name);
+    return std::make_shared<subtract_layer<float_type>>(name);
 }
 
-inline layer_ptr create_flatten_layer(
+template <typename float_type>
+layer_ptr<float_type> create_flatten_layer(
     const get_param_f&, const get_global_param_f&, const nlohmann::json&,
     const std::string& name)
 {
-    return std::make_shared<flatten_layer>(name);
+    return std::make_shared<flatten_layer<float_type>>(name);
 }
 
-inline layer_ptr create_zero_padding_2d_layer(
+template <typename float_type>
+layer_ptr<float_type> create_zero_padding_2d_layer(
     const get_param_f&, const get_global_param_f&, const nlohmann::json& data,
     const std::string& name)
 {
@@ -686,7 +1027,7 @@ inline layer_ptr create_zero_padding_2d_layer(
         const std::size_t bottom_pad = 0;
         const std::size_t left_pad = padding[0][0];
         const std::size_t right_pad = padding[1][0];
-        return std::make_shared<zero_padding_2d_layer>(name,
+        return std::make_shared<zero_padding_2d_layer<float_type>>(name,
             top_pad, bottom_pad, left_pad, right_pad);
     }
     else
@@ -695,12 +1036,13 @@ inline layer_ptr create_zero_padding_2d_layer(
         const std::size_t bottom_pad = padding[0][1];
         const std::size_t left_pad = padding[1][0];
         const std::size_t right_pad = padding[1][1];
-        return std::make_shared<zero_padding_2d_layer>(name,
+        return std::make_shared<zero_padding_2d_layer<float_type>>(name,
             top_pad, bottom_pad, left_pad, right_pad);
     }
 }
 
-inline layer_ptr create_cropping_2d_layer(
+template <typename float_type>
+layer_ptr<float_type> create_cropping_2d_layer(
     const get_param_f&, const get_global_param_f&, const nlohmann::json& data,
     const std::string& name)
 {
@@ -718,7 +1060,7 @@ inline layer_ptr create_cropping_2d_layer(
         const std::size_t bottom_crop = 0;
         const std::size_t left_crop = cropping[0][0];
         const std::size_t right_crop = cropping[1][0];
-        return std::make_shared<cropping_2d_layer>(name,
+        return std::make_shared<cropping_2d_layer<float_type>>(name,
             top_crop, bottom_crop, left_crop, right_crop);
     }
     else
@@ -727,12 +1069,13 @@ inline layer_ptr create_cropping_2d_layer(
         const std::size_t bottom_crop = cropping[0][1];
         const std::size_t left_crop = cropping[1][0];
         const std::size_t right_crop = cropping[1][1];
-        return std::make_shared<cropping_2d_layer>(name,
+        return std::make_shared<cropping_2d_layer<float_type>>(name,
             top_crop, bottom_crop, left_crop, right_crop);
     }
 }
 
-inline layer_ptr create_reshape_layer(
+template <typename float_type>
+layer_ptr<float_type> create_reshape_layer(
     const get_param_f&, const get_global_param_f&, const nlohmann::json& data,
     const std::string& name)
 {
@@ -742,52 +1085,59 @@ inline layer_ptr create_reshape_layer(
     const auto filled_shape =
         fplus::fill_left(1, 3, target_shape);
 
-    return std::make_shared<reshape_layer>(name, filled_shape);
+    return std::make_shared<reshape_layer<float_type>>(name, filled_shape);
 }
 
-inline activation_layer_ptr create_linear_layer(
+template <typename float_type>
+activation_layer_ptr<float_type> create_linear_layer(
     const get_param_f&, const get_global_param_f&, const nlohmann::json&,
     const std::string& name)
 {
-    return std::make_shared<linear_layer>(name);
+    return std::make_shared<linear_layer<float_type>>(name);
 }
 
-inline activation_layer_ptr create_softmax_layer(
+template <typename float_type>
+activation_layer_ptr<float_type> create_softmax_layer(
     const get_param_f&, const get_global_param_f&, const nlohmann::json&,
     const std::string& name)
 {
-    return std::make_shared<softmax_layer>(name);
+    return std::make_shared<softmax_layer<float_type>>(name);
 }
 
-inline activation_layer_ptr create_softplus_layer(
+template <typename float_type>
+activation_layer_ptr<float_type> create_softplus_layer(
     const get_param_f&, const get_global_param_f&, const nlohmann::json&,
     const std::string& name)
 {
-    return std::make_shared<softplus_layer>(name);
+    return std::make_shared<softplus_layer<float_type>>(name);
 }
 
-inline activation_layer_ptr create_tanh_layer(
+template <typename float_type>
+activation_layer_ptr<float_type> create_tanh_layer(
     const get_param_f&, const get_global_param_f&, const nlohmann::json&,
     const std::string& name)
 {
-    return std::make_shared<tanh_layer>(name);
+    return std::make_shared<tanh_layer<float_type>>(name);
 }
 
-inline activation_layer_ptr create_sigmoid_layer(
+template <typename float_type>
+activation_layer_ptr<float_type> create_sigmoid_layer(
     const get_param_f&, const get_global_param_f&, const nlohmann::json&,
     const std::string& name)
 {
-    return std::make_shared<sigmoid_layer>(name);
+    return std::make_shared<sigmoid_layer<float_type>>(name);
 }
 
-inline activation_layer_ptr create_hard_sigmoid_layer(
+template <typename float_type>
+activation_layer_ptr<float_type> create_hard_sigmoid_layer(
     const get_param_f&, const get_global_param_f&, const nlohmann::json&,
     const std::string& name)
 {
-    return std::make_shared<hard_sigmoid_layer>(name);
+    return std::make_shared<hard_sigmoid_layer<float_type>>(name);
 }
 
-inline activation_layer_ptr create_relu_layer(
+template <typename float_type>
+activation_layer_ptr<float_type> create_relu_layer(
     const get_param_f&, const get_global_param_f&, const nlohmann::json& data,
     const std::string& name)
 {
@@ -798,17 +1148,19 @@ inline activation_layer_ptr create_relu_layer(
     {
         max_value = data["config"]["max_value"];
     }
-    return std::make_shared<relu_layer>(name, max_value);
+    return std::make_shared<relu_layer<float_type>>(name, max_value);
 }
 
-inline activation_layer_ptr create_selu_layer(
+template <typename float_type>
+activation_layer_ptr<float_type> create_selu_layer(
     const get_param_f&, const get_global_param_f&, const nlohmann::json&,
     const std::string& name)
 {
-    return std::make_shared<selu_layer>(name);
+    return std::make_shared<selu_layer<float_type>>(name);
 }
 
-inline activation_layer_ptr create_leaky_relu_layer(
+template <typename float_type>
+activation_layer_ptr<float_type> create_leaky_relu_layer(
     const get_param_f&, const get_global_param_f&, const nlohmann::json& data,
     const std::string& name)
 {
@@ -818,17 +1170,19 @@ inline activation_layer_ptr create_leaky_relu_layer(
     {
         alpha = data["config"]["alpha"];
     }
-    return std::make_shared<leaky_relu_layer>(name, alpha);
+    return std::make_shared<leaky_relu_layer<float_type>>(name, alpha);
 }
 
-inline layer_ptr create_leaky_relu_layer_isolated(
+template <typename float_type>
+layer_ptr<float_type> create_leaky_relu_layer_isolated(
     const get_param_f& get_param, const get_global_param_f& get_global_param,
     const nlohmann::json& data, const std::string& name)
 {
-    return create_leaky_relu_layer(get_param, get_global_param, data, name);
+    return create_leaky_relu_layer<float_type>(get_param, get_global_param, data, name);
 }
 
-inline layer_ptr create_prelu_layer(
+template <typename float_type>
+layer_ptr<float_type> create_prelu_layer(
     const get_param_f& get_param, const get_global_param_f&,
     const nlohmann::json& data, const std::string& name)
 {
@@ -840,11 +1194,12 @@ inline layer_ptr create_prelu_layer(
         shared_axes = create_vector<std::size_t>(create_size_t,
             data["config"]["shared_axes"]);
     }
-    const float_vec alpha = decode_floats(get_param(name, "alpha"));
-    return std::make_shared<prelu_layer>(name, alpha, shared_axes);
+    const float_vec<float_type> alpha = decode_floats<float_type>(get_param(name, "alpha"));
+    return std::make_shared<prelu_layer<float_type>>(name, alpha, shared_axes);
 }
 
-inline activation_layer_ptr create_elu_layer(
+template <typename float_type>
+activation_layer_ptr<float_type> create_elu_layer(
     const get_param_f&, const get_global_param_f&, const nlohmann::json& data,
     const std::string& name)
 {
@@ -854,42 +1209,45 @@ inline activation_layer_ptr create_elu_layer(
     {
         alpha = data["config"]["alpha"];
     }
-    return std::make_shared<elu_layer>(name, alpha);
+    return std::make_shared<elu_layer<float_type>>(name, alpha);
 }
 
-inline layer_ptr create_elu_layer_isolated(
+template <typename float_type>
+layer_ptr<float_type> create_elu_layer_isolated(
     const get_param_f& get_param, const get_global_param_f& get_global_param,
     const nlohmann::json& data, const std::string& name)
 {
-    return create_elu_layer(get_param, get_global_param, data, name);
+    return create_elu_layer<float_type>(get_param, get_global_param, data, name);
 }
 
-inline layer_ptr create_relu_layer_isolated(
+template <typename float_type>
+layer_ptr<float_type> create_relu_layer_isolated(
     const get_param_f& get_param, const get_global_param_f& get_global_param,
     const nlohmann::json& data, const std::string& name)
 {
-    return create_relu_layer(get_param, get_global_param, data, name);
+    return create_relu_layer<float_type>(get_param, get_global_param, data, name);
 }
 
-inline activation_layer_ptr create_activation_layer_type_name(
+template <typename float_type>
+activation_layer_ptr<float_type> create_activation_layer_type_name(
     const get_param_f& get_param, const get_global_param_f& get_global_param,
     const nlohmann::json& data,
     const std::string& type, const std::string& name)
 {
     const std::map<std::string,
-            std::function<activation_layer_ptr(const get_param_f&,
+            std::function<activation_layer_ptr<float_type>(const get_param_f&,
                 const get_global_param_f&, const nlohmann::json&,
                 const std::string&)>>
     creators = {
-        {"linear", create_linear_layer},
-        {"softmax", create_softmax_layer},
-        {"softplus", create_softplus_layer},
-        {"tanh", create_tanh_layer},
-        {"sigmoid", create_sigmoid_layer},
-        {"hard_sigmoid", create_hard_sigmoid_layer},
-        {"relu", create_relu_layer},
-        {"selu", create_selu_layer},
-        {"elu", create_elu_layer}
+        {"linear", create_linear_layer<float_type>},
+        {"softmax", create_softmax_layer<float_type>},
+        {"softplus", create_softplus_layer<float_type>},
+        {"tanh", create_tanh_layer<float_type>},
+        {"sigmoid", create_sigmoid_layer<float_type>},
+        {"hard_sigmoid", create_hard_sigmoid_layer<float_type>},
+        {"relu", create_relu_layer<float_type>},
+        {"selu", create_selu_layer<float_type>},
+        {"elu", create_elu_layer<float_type>}
     };
 
     return fplus::throw_on_nothing(
@@ -898,22 +1256,24 @@ inline activation_layer_ptr create_activation_layer_type_name(
             get_param, get_global_param, data, name);
 }
 
-inline layer_ptr create_activation_layer(
+template <typename float_type>
+layer_ptr<float_type> create_activation_layer(
     const get_param_f& get_param, const get_global_param_f& get_global_param,
     const nlohmann::json& data, const std::string& name)
 {
     const std::string type = data["config"]["activation"];
-    return create_activation_layer_type_name(get_param, get_global_param,
+    return create_activation_layer_type_name<float_type>(get_param, get_global_param,
         data, type, name);
 }
 
-inline layer_ptr create_permute_layer(
+template <typename float_type>
+layer_ptr<float_type> create_permute_layer(
     const get_param_f&, const get_global_param_f&,
     const nlohmann::json& data, const std::string& name)
 {
     const auto dims = create_vector<std::size_t>(create_size_t,
         data["config"]["dims"]);
-    return std::make_shared<permute_layer>(name, dims);
+    return std::make_shared<permute_layer<float_type>>(name, dims);
 }
 
 inline node create_node(const nlohmann::json& inbound_nodes_data)
@@ -931,19 +1291,21 @@ inline nodes create_nodes(const nlohmann::json& data)
     return fplus::transform(create_node, inbound_nodes_data);
 }
 
-inline layer_ptr create_embedding_layer(const get_param_f &get_param,
+template <typename float_type>
+layer_ptr<float_type> create_embedding_layer(const get_param_f &get_param,
                                         const get_global_param_f &,
                                         const nlohmann::json &data,
                                         const std::string &name)
 {
     const std::size_t input_dim = data["config"]["input_dim"];
     const std::size_t output_dim = data["config"]["output_dim"];
-    const float_vec weights = decode_floats(get_param(name, "weights"));
+    const float_vec<float_type> weights = decode_floats<float_type>(get_param(name, "weights"));
 
-    return std::make_shared<embedding_layer>(name, input_dim, output_dim, weights);
+    return std::make_shared<embedding_layer<float_type>>(name, input_dim, output_dim, weights);
 }
 
-inline layer_ptr create_lstm_layer(const get_param_f &get_param,
+template <typename float_type>
+layer_ptr<float_type> create_lstm_layer(const get_param_f &get_param,
                                    const get_global_param_f &,
                                    const nlohmann::json &data,
                                    const std::string &name)
@@ -959,23 +1321,24 @@ inline layer_ptr create_lstm_layer(const get_param_f &get_param,
     );
     const bool use_bias = json_object_get(config, "use_bias", true);
 
-    float_vec bias;
+    float_vec<float_type> bias;
     if (use_bias)
-        bias = decode_floats(get_param(name, "bias"));
+        bias = decode_floats<float_type>(get_param(name, "bias"));
 
-    const float_vec weights = decode_floats(get_param(name, "weights"));
-    const float_vec recurrent_weights = decode_floats(get_param(name, "recurrent_weights"));
+    const float_vec<float_type> weights = decode_floats<float_type>(get_param(name, "weights"));
+    const float_vec<float_type> recurrent_weights = decode_floats<float_type>(get_param(name, "recurrent_weights"));
     const bool return_sequences = json_object_get(config, "return_sequences", false);
     const bool return_state = json_object_get(config, "return_state", false);
     const bool stateful = json_object_get(config, "stateful", false);
 
-    return std::make_shared<lstm_layer>(name, units, unit_activation,
+    return std::make_shared<lstm_layer<float_type>>(name, units, unit_activation,
                                         recurrent_activation, use_bias,
                                         return_sequences, return_state, stateful,
                                         weights, recurrent_weights, bias);
 }
 
-inline layer_ptr create_gru_layer(const get_param_f &get_param,
+template <typename float_type>
+layer_ptr<float_type> create_gru_layer(const get_param_f &get_param,
                                   const get_global_param_f &,
                                   const nlohmann::json &data,
                                   const std::string &name)
@@ -995,25 +1358,26 @@ inline layer_ptr create_gru_layer(const get_param_f &get_param,
     const bool return_state = json_object_get(config, "return_state", false);
     const bool stateful = json_object_get(config, "stateful", false);
 
-    float_vec bias;
+    float_vec<float_type> bias;
     if (use_bias)
-        bias = decode_floats(get_param(name, "bias"));
+        bias = decode_floats<float_type>(get_param(name, "bias"));
 
-    const float_vec weights = decode_floats(get_param(name, "weights"));
-    const float_vec recurrent_weights = decode_floats(get_param(name, "recurrent_weights"));
+    const float_vec<float_type> weights = decode_floats<float_type>(get_param(name, "weights"));
+    const float_vec<float_type> recurrent_weights = decode_floats<float_type>(get_param(name, "recurrent_weights"));
 
     bool reset_after = json_object_get(config,
         "reset_after",
         data["class_name"] == "CuDNNGRU"
     );
 
-    return std::make_shared<gru_layer>(name, units, unit_activation,
+    return std::make_shared<gru_layer<float_type>>(name, units, unit_activation,
                                        recurrent_activation, use_bias, reset_after, 
                                        return_sequences, return_state, stateful,
                                        weights, recurrent_weights, bias);
 }
 
-inline layer_ptr create_bidirectional_layer(const get_param_f& get_param,
+template <typename float_type>
+layer_ptr<float_type> create_bidirectional_layer(const get_param_f& get_param,
                                             const get_global_param_f&,
                                             const nlohmann::json& data,
                                             const std::string& name)
@@ -1032,20 +1396,20 @@ inline layer_ptr create_bidirectional_layer(const get_param_f& get_param,
     );
     const bool use_bias = json_object_get(layer_config, "use_bias", true);
 
-    float_vec forward_bias;
-    float_vec backward_bias;
+    float_vec<float_type> forward_bias;
+    float_vec<float_type> backward_bias;
 
     if (use_bias)
     {
-        forward_bias = decode_floats(get_param(name, "forward_bias"));
-        backward_bias = decode_floats(get_param(name, "backward_bias"));
+        forward_bias = decode_floats<float_type>(get_param(name, "forward_bias"));
+        backward_bias = decode_floats<float_type>(get_param(name, "backward_bias"));
     }
 
-    const float_vec forward_weights = decode_floats(get_param(name, "forward_weights"));
-    const float_vec backward_weights = decode_floats(get_param(name, "backward_weights"));
+    const float_vec<float_type> forward_weights = decode_floats<float_type>(get_param(name, "forward_weights"));
+    const float_vec<float_type> backward_weights = decode_floats<float_type>(get_param(name, "backward_weights"));
 
-    const float_vec forward_recurrent_weights = decode_floats(get_param(name, "forward_recurrent_weights"));
-    const float_vec backward_recurrent_weights = decode_floats(get_param(name, "backward_recurrent_weights"));
+    const float_vec<float_type> forward_recurrent_weights = decode_floats<float_type>(get_param(name, "forward_recurrent_weights"));
+    const float_vec<float_type> backward_recurrent_weights = decode_floats<float_type>(get_param(name, "backward_recurrent_weights"));
 
     const bool reset_after = json_object_get(layer_config,
         "reset_after",
@@ -1053,93 +1417,95 @@ inline layer_ptr create_bidirectional_layer(const get_param_f& get_param,
     );
     const bool return_sequences = json_object_get(layer_config, "return_sequences", false);
 
-    return std::make_shared<bidirectional_layer>(name, merge_mode, units, unit_activation,
+    return std::make_shared<bidirectional_layer<float_type>>(name, merge_mode, units, unit_activation,
                                                  recurrent_activation, wrapped_layer_type,
                                                  use_bias, reset_after, return_sequences,
                                                  forward_weights, forward_recurrent_weights, forward_bias,
                                                  backward_weights, backward_recurrent_weights, backward_bias);
 }
 
-inline layer_ptr create_time_distributed_layer(const get_param_f& get_param,
+template <typename float_type>
+layer_ptr<float_type> create_time_distributed_layer(const get_param_f& get_param,
                                    const get_global_param_f& get_global_param,
                                    const nlohmann::json& data,
                                    const std::string& name,
-                                   const layer_creators& custom_layer_creators)
+                                   const layer_creators<float_type>& custom_layer_creators)
 {
     const std::string wrapped_layer_type = data["config"]["layer"]["class_name"];
     nlohmann::json data_inner_layer = data["config"]["layer"];
     data_inner_layer["name"] = data["name"];
     data_inner_layer["inbound_nodes"] = data["inbound_nodes"];
-    const std::size_t td_input_len = std::size_t(decode_floats(get_param(name, "td_input_len")).front());
-    const std::size_t td_output_len = std::size_t(decode_floats(get_param(name, "td_output_len")).front());
+    const std::size_t td_input_len = std::size_t(decode_floats<float_type>(get_param(name, "td_input_len")).front());
+    const std::size_t td_output_len = std::size_t(decode_floats<float_type>(get_param(name, "td_output_len")).front());
 
-    layer_ptr inner_layer = create_layer(get_param, get_global_param, data_inner_layer, custom_layer_creators);
+    layer_ptr<float_type> inner_layer = create_layer(get_param, get_global_param, data_inner_layer, custom_layer_creators);
 
-    return std::make_shared<time_distributed_layer>(name, inner_layer, td_input_len, td_output_len);
+    return std::make_shared<time_distributed_layer<float_type>>(name, inner_layer, td_input_len, td_output_len);
 }
 
-inline layer_ptr create_layer(const get_param_f& get_param,
+template <typename float_type>
+layer_ptr<float_type> create_layer(const get_param_f& get_param,
     const get_global_param_f& get_global_param, const nlohmann::json& data,
-    const layer_creators& custom_layer_creators)
+    const layer_creators<float_type>& custom_layer_creators)
 {
     const std::string name = data["name"];
 
-    const layer_creators default_creators = {
-            {"Conv1D", create_conv_2d_layer},
-            {"Conv2D", create_conv_2d_layer},
-            {"SeparableConv1D", create_separable_conv_2D_layer},
-            {"SeparableConv2D", create_separable_conv_2D_layer},
-            {"DepthwiseConv2D", create_depthwise_conv_2D_layer},
-            {"InputLayer", create_input_layer},
-            {"BatchNormalization", create_batch_normalization_layer},
-            {"Dropout", create_identity_layer},
-            {"AlphaDropout", create_identity_layer},
-            {"GaussianDropout", create_identity_layer},
-            {"GaussianNoise", create_identity_layer},
-            {"SpatialDropout1D", create_identity_layer},
-            {"SpatialDropout2D", create_identity_layer},
-            {"SpatialDropout3D", create_identity_layer},
-            {"LeakyReLU", create_leaky_relu_layer_isolated},
-            {"Permute", create_permute_layer },
-            {"PReLU", create_prelu_layer },
-            {"ELU", create_elu_layer_isolated},
-            {"ReLU", create_relu_layer_isolated},
-            {"MaxPooling1D", create_max_pooling_2d_layer},
-            {"MaxPooling2D", create_max_pooling_2d_layer},
-            {"AveragePooling1D", create_average_pooling_2d_layer},
-            {"AveragePooling2D", create_average_pooling_2d_layer},
-            {"GlobalMaxPooling1D", create_global_max_pooling_1d_layer},
-            {"GlobalMaxPooling2D", create_global_max_pooling_2d_layer},
-            {"GlobalAveragePooling1D", create_global_average_pooling_1d_layer},
-            {"GlobalAveragePooling2D", create_global_average_pooling_2d_layer},
-            {"UpSampling1D", create_upsampling_1d_layer},
-            {"UpSampling2D", create_upsampling_2d_layer},
-            {"Dense", create_dense_layer},
-            {"Add", create_add_layer},
-            {"Maximum", create_maximum_layer},
-            {"Concatenate", create_concatenate_layer},
-            {"Multiply", create_multiply_layer},
-            {"Average", create_average_layer},
-            {"Subtract", create_subtract_layer},
-            {"Flatten", create_flatten_layer},
-            {"ZeroPadding1D", create_zero_padding_2d_layer},
-            {"ZeroPadding2D", create_zero_padding_2d_layer},
-            {"Cropping1D", create_cropping_2d_layer},
-            {"Cropping2D", create_cropping_2d_layer},
-            {"Activation", create_activation_layer},
-            {"Reshape", create_reshape_layer},
-            {"Embedding", create_embedding_layer},
-            {"LSTM", create_lstm_layer},
-            {"CuDNNLSTM", create_lstm_layer},
-            {"GRU", create_gru_layer},
-            {"CuDNNGRU", create_gru_layer},
-            {"Bidirectional", create_bidirectional_layer},
-            {"Softmax", create_softmax_layer},
+    const layer_creators<float_type> default_creators = {
+            {"Conv1D", create_conv_2d_layer<float_type>},
+            {"Conv2D", create_conv_2d_layer<float_type>},
+            {"SeparableConv1D", create_separable_conv_2D_layer<float_type>},
+            {"SeparableConv2D", create_separable_conv_2D_layer<float_type>},
+            {"DepthwiseConv2D", create_depthwise_conv_2D_layer<float_type>},
+            {"InputLayer", create_input_layer<float_type>},
+            {"BatchNormalization", create_batch_normalization_layer<float_type>},
+            {"Dropout", create_identity_layer<float_type>},
+            {"AlphaDropout", create_identity_layer<float_type>},
+            {"GaussianDropout", create_identity_layer<float_type>},
+            {"GaussianNoise", create_identity_layer<float_type>},
+            {"SpatialDropout1D", create_identity_layer<float_type>},
+            {"SpatialDropout2D", create_identity_layer<float_type>},
+            {"SpatialDropout3D", create_identity_layer<float_type>},
+            {"LeakyReLU", create_leaky_relu_layer_isolated<float_type>},
+            {"Permute", create_permute_layer<float_type> },
+            {"PReLU", create_prelu_layer<float_type> },
+            {"ELU", create_elu_layer_isolated<float_type>},
+            {"ReLU", create_relu_layer_isolated<float_type>},
+            {"MaxPooling1D", create_max_pooling_2d_layer<float_type>},
+            {"MaxPooling2D", create_max_pooling_2d_layer<float_type>},
+            {"AveragePooling1D", create_average_pooling_2d_layer<float_type>},
+            {"AveragePooling2D", create_average_pooling_2d_layer<float_type>},
+            {"GlobalMaxPooling1D", create_global_max_pooling_1d_layer<float_type>},
+            {"GlobalMaxPooling2D", create_global_max_pooling_2d_layer<float_type>},
+            {"GlobalAveragePooling1D", create_global_average_pooling_1d_layer<float_type>},
+            {"GlobalAveragePooling2D", create_global_average_pooling_2d_layer<float_type>},
+            {"UpSampling1D", create_upsampling_1d_layer<float_type>},
+            {"UpSampling2D", create_upsampling_2d_layer<float_type>},
+            {"Dense", create_dense_layer<float_type>},
+            {"Add", create_add_layer<float_type>},
+            {"Maximum", create_maximum_layer<float_type>},
+            {"Concatenate", create_concatenate_layer<float_type>},
+            {"Multiply", create_multiply_layer<float_type>},
+            {"Average", create_average_layer<float_type>},
+            {"Subtract", create_subtract_layer<float_type>},
+            {"Flatten", create_flatten_layer<float_type>},
+            {"ZeroPadding1D", create_zero_padding_2d_layer<float_type>},
+            {"ZeroPadding2D", create_zero_padding_2d_layer<float_type>},
+            {"Cropping1D", create_cropping_2d_layer<float_type>},
+            {"Cropping2D", create_cropping_2d_layer<float_type>},
+            {"Activation", create_activation_layer<float_type>},
+            {"Reshape", create_reshape_layer<float_type>},
+            {"Embedding", create_embedding_layer<float_type>},
+            {"LSTM", create_lstm_layer<float_type>},
+            {"CuDNNLSTM", create_lstm_layer<float_type>},
+            {"GRU", create_gru_layer<float_type>},
+            {"CuDNNGRU", create_gru_layer<float_type>},
+            {"Bidirectional", create_bidirectional_layer<float_type>},
+            {"Softmax", create_softmax_layer<float_type>},
         };
 
-    const wrapper_layer_creators wrapper_creators = {
-            {"Model", create_model_layer},
-            {"TimeDistributed", create_time_distributed_layer},
+    const wrapper_layer_creators<float_type> wrapper_creators = {
+            {"Model", create_model_layer<float_type>},
+            {"TimeDistributed", create_time_distributed_layer<float_type>},
     };
 
     const std::string type = data["class_name"];
@@ -1153,7 +1519,7 @@ inline layer_ptr create_layer(const get_param_f& get_param,
     }
     else
     {
-        const layer_creators creators = fplus::map_union(custom_layer_creators,
+        const layer_creators<float_type> creators = fplus::map_union(custom_layer_creators,
             default_creators);
 
         auto result = fplus::throw_on_nothing(
@@ -1168,7 +1534,7 @@ inline layer_ptr create_layer(const get_param_f& get_param,
             && type != "Bidirectional")
         {
             result->set_activation(
-                create_activation_layer_type_name(get_param, get_global_param, data,
+                create_activation_layer_type_name<float_type>(get_param, get_global_param, data,
                     data["config"]["activation"], ""));
         }
         result->set_nodes(create_nodes(data));
@@ -1176,33 +1542,79 @@ inline layer_ptr create_layer(const get_param_f& get_param,
     }
 }
 
+template <typename float_type>
 struct test_case
 {
-    tensor5s input_;
-    tensor5s output_;
+    tensor5s<float_type> input_;
+    tensor5s<float_type> output_;
 };
 
-using test_cases = std::vector<test_case>;
+template <typename float_type>
+using test_cases = std::vector<test_case<float_type>>;
 
-inline test_case load_test_case(const nlohmann::json& data)
+template <typename float_type>
+test_case<float_type> load_test_case(const nlohmann::json& data)
 {
     assertion(data["inputs"].is_array(), "test needs inputs");
     assertion(data["outputs"].is_array(), "test needs outputs");
     return {
-        create_vector<tensor5>(create_tensor5, data["inputs"]),
-        create_vector<tensor5>(create_tensor5, data["outputs"])
+        create_vector<tensor5<float_type>>(create_tensor5<float_type>, data["inputs"]),
+        create_vector<tensor5<float_type>>(create_tensor5<float_type>, data["outputs"])
     };
 }
 
-inline test_cases load_test_cases(const nlohmann::json& data)
+template <typename float_type>
+test_cases<float_type> load_test_cases(const nlohmann::json& data)
 {
-    return create_vector<test_case>(load_test_case, data);
+    return create_vector<test_case<float_type>>(load_test_case<float_type>, data);
+}
+
+// Largest deviations of the values of an output from their targets.
+// The relative error is measured against the magnitude of the target.
+template <typename float_type>
+struct test_output_error
+{
+    float_type max_abs_error_;
+    float_type max_rel_error_;
+};
+
+// Output errors of every test case.
+template <typename float_type>
+using test_report = std::vector<std::vector<test_output_error<float_type>>>;
+
+template <typename float_type>
+std::shared_future<test_report<float_type>> make_ready_test_report(
+    const test_report<float_type>& report)
+{
+    std::promise<test_report<float_type>> result;
+    result.set_value(report);
+    return result.get_future().share();
+}
+
+template <typename float_type>
+std::string show_test_output_errors(
+    const std::vector<test_output_error<float_type>>& errors)
+{
+    return fplus::join(std::string(", "), fplus::transform(
+        [](const test_output_error<float_type>& error) -> std::string
+    {
+        return fplus::show(error.max_abs_error_) + "/" +
+            fplus::show(error.max_rel_error_);
+    }, errors));
 }
 
-inline void check_test_outputs(float_type epsilon,
-    const tensor5s& outputs, const tensor5s& targets)
+// Compares all values of the outputs (in all five dimensions)
+// with the ones of the targets.
+// Throws if a value deviates by more than epsilon.
+template <typename float_type>
+std::vector<test_output_error<float_type>> check_test_outputs(float_type epsilon,
+    const tensor5s<float_type>& outputs, const tensor5s<float_type>& targets)
 {
+    using array_map = Eigen::Map<const Eigen::Array<
+        float_type, Eigen::Dynamic, 1>, Eigen::Unaligned>;
     assertion(outputs.size() == targets.size(), "invalid output count");
+    std::vector<test_output_error<float_type>> errors;
+    errors.reserve(outputs.size());
     for (std::size_t i = 0; i < outputs.size(); ++i)
     {
         const auto& output = outputs[i];
@@ -1210,30 +1622,48 @@ inline void check_test_outputs(float_type epsilon,
         assertion(output.shape() == target.shape(),
             "Wrong output size. Is " + show_shape5(output.shape()) +
             ", should be " + show_shape5(target.shape()) + ".");
-        for (std::size_t y = 0; y < output.shape().height_; ++y)
+        const auto size = static_cast<EigenIndex>(output.shape().volume());
+        const array_map output_values(output.as_vector()->data(), size);
+        const array_map target_values(target.as_vector()->data(), size);
+        const auto abs_errors = (output_values - target_values).abs().eval();
+        const auto rel_errors = (abs_errors / target_values.abs().max(
+            std::numeric_limits<float_type>::min())).eval();
+        // NaN values never pass the comparison.
+        if (!(abs_errors <= epsilon).all())
         {
-            for (std::size_t x = 0; x < output.shape().width_; ++x)
+            EigenIndex idx = 0;
+            while (abs_errors[idx] <= epsilon)
             {
-                for (std::size_t z = 0; z < output.shape().depth_; ++z)
-                {
-                    if (!fplus::is_in_closed_interval_around(epsilon,
-                        target.get(0, 0, y, x, z), output.get(0, 0, y, x, z)))
-                    {
-                        const std::string msg =
-                            std::string("test failed: ") +
-                            "output=" + fplus::show(i) + " " +
-                            "pos=" +
-                            fplus::show(y) + "," +
-                            fplus::show(x) + "," +
-                            fplus::show(z) + " " +
-                            "value=" + fplus::show(output.get(0, 0, y, x, z)) + " "
-                            "target=" + fplus::show(target.get(0, 0, y, x, z));
-                        internal::raise_error(msg);
-                    }
-                }
+                ++idx;
             }
+            const auto& shape = output.shape();
+            std::size_t rest = static_cast<std::size_t>(idx);
+            const std::size_t z = rest % shape.depth_;
+            rest /= shape.depth_;
+            const std::size_t x = rest % shape.width_;
+            rest /= shape.width_;
+            const std::size_t y = rest % shape.height_;
+            rest /= shape.height_;
+            const std::size_t pos_dim_4 = rest % shape.size_dim_4_;
+            const std::size_t pos_dim_5 = rest / shape.size_dim_4_;
+            const std::string msg =
+                std::string("test failed: ") +
+                "output=" + fplus::show(i) + " " +
+                "pos=" +
+                fplus::show(pos_dim_5) + "," +
+                fplus::show(pos_dim_4) + "," +
+                fplus::show(y) + "," +
+                fplus::show(x) + "," +
+                fplus::show(z) + " " +
+                "value=" + fplus::show(output_values[idx]) + " "
+                "target=" + fplus::show(target_values[idx]);
+            internal::raise_error(msg);
         }
+        errors.push_back({
+            size == 0 ? 0 : abs_errors.maxCoeff(),
+            size == 0 ? 0 : rel_errors.maxCoeff()});
     }
+    return errors;
 }
 
 } } // namespace fdeep, namespace internal
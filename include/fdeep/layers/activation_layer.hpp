@@ -21,31 +21,109 @@ namespace fdeep { namespace internal
 
 // Abstract base class for actication layers
 // https://en.wikipedia.org/wiki/Activation_function
-class activation_layer : public layer
+template <typename float_type>
+class activation_layer : public layer<float_type>
 {
 public:
     explicit activation_layer(const std::string& name) :
-        layer(name)
+        layer<float_type>(name)
     {
     }
-    tensor5s apply_impl(const tensor5s& inputs) const override
+    tensor5s<float_type> apply_impl(const tensor5s<float_type>& inputs) const override
     {
-        const auto f = [this](const tensor5& t) -> tensor5
+        const auto f = [this](const tensor5<float_type>& t) -> tensor5<float_type>
         {
             return transform_input(t);
         };
         return fplus::transform(f, inputs);
     }
 
+    // Only to be used on tensors not sharing their memory
+    // with any other tensor still needed.
+    void apply_in_place(tensor5s<float_type>& inputs) const
+    {
+        for (auto& t : inputs)
+        {
+            transform_input_in_place(t);
+        }
+        apply_activation_layer_in_place(this->activation_, inputs);
+    }
+
+    bool accepts_donated_inputs() const override
+    {
+        return true;
+    }
+
+protected:
+    tensor5s<float_type> apply_donating_impl(const tensor5s<float_type>& inputs,
+        const std::vector<bool>& donated) const override
+    {
+        tensor5s<float_type> result;
+        result.reserve(inputs.size());
+        for (std::size_t i = 0; i < inputs.size(); ++i)
+        {
+            if (donated[i])
+            {
+                result.push_back(inputs[i]);
+                transform_input_in_place(result.back());
+            }
+            else
+            {
+                result.push_back(transform_input(inputs[i]));
+            }
+        }
+        return result;
+    }
+
+    virtual tensor5<float_type> transform_input(const tensor5<float_type>& input) const = 0;
+
+    // Falls back to a copy.
+    // Layers able to overwrite their input should override this.
+    virtual void transform_input_in_place(tensor5<float_type>& input) const
+    {
+        input = transform_input(input);
+    }
+};
+
+// Base class for activation layers transforming every value on its own,
+// which only need to implement the in-place transformation.
+template <typename float_type>
+class elementwise_activation_layer : public activation_layer<float_type>
+{
+public:
+    explicit elementwise_activation_layer(const std::string& name) :
+        activation_layer<float_type>(name)
+    {
+    }
+
 protected:
-    virtual tensor5 transform_input(const tensor5& input) const = 0;
+    tensor5<float_type> transform_input(const tensor5<float_type>& input) const override
+    {
+        tensor5<float_type> result(input.shape(), float_vec<float_type>(*input.as_vector()));
+        transform_input_in_place(result);
+        return result;
+    }
+
+    void transform_input_in_place(tensor5<float_type>& input) const override = 0;
 };
 
-inline tensor5s apply_activation_layer(
-    const activation_layer_ptr& ptr,
-    const tensor5s& input)
+template <typename float_type>
+tensor5s<float_type> apply_activation_layer(
+    const activation_layer_ptr<float_type>& ptr,
+    const tensor5s<float_type>& input)
 {
     return ptr == nullptr ? input : ptr->apply(input);
 }
 
+template <typename float_type>
+void apply_activation_layer_in_place(
+    const activation_layer_ptr<float_type>& ptr,
+    tensor5s<float_type>& inputs)
+{
+    if (ptr != nullptr)
+    {
+        ptr->apply_in_place(inputs);
+    }
+}
+
 } } // namespace fdeep, namespace internal
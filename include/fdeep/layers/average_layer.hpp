@@ -13,15 +13,16 @@
 namespace fdeep { namespace internal
 {
 
-class average_layer : public layer
+template <typename float_type>
+class average_layer : public layer<float_type>
 {
 public:
     explicit average_layer(const std::string& name)
-        : layer(name)
+        : layer<float_type>(name)
     {
     }
 protected:
-    tensor5s apply_impl(const tensor5s& input) const override
+    tensor5s<float_type> apply_impl(const tensor5s<float_type>& input) const override
     {
         return {average_tensor5s(input)};
     }
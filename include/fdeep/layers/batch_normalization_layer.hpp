@@ -9,22 +9,24 @@
 #include "fdeep/layers/layer.hpp"
 
 #include <string>
+#include <vector>
 
 namespace fdeep { namespace internal
 {
 
 // https://kratzert.github.io/2016/02/12/understanding-the-gradient-flow-through-the-batch-normalization-layer.html
 // https://stackoverflow.com/a/46444452/1866775
-class batch_normalization_layer : public layer
+template <typename float_type>
+class batch_normalization_layer : public layer<float_type>
 {
 public:
     explicit batch_normalization_layer(const std::string& name,
-        const float_vec& moving_mean,
-        const float_vec& moving_variance,
-        const float_vec& beta,
-        const float_vec& gamma,
+        const float_vec<float_type>& moving_mean,
+        const float_vec<float_type>& moving_variance,
+        const float_vec<float_type>& beta,
+        const float_vec<float_type>& gamma,
         float_type epsilon)
-        : layer(name),
+        : layer<float_type>(name),
         moving_mean_(moving_mean),
         moving_variance_(moving_variance),
         beta_(beta),
@@ -32,14 +34,23 @@ public:
         epsilon_(epsilon)
     {
     }
+    bool accepts_donated_inputs() const override
+    {
+        return true;
+    }
+    bool creates_new_buffers() const override
+    {
+        return true;
+    }
 protected:
-    float_vec moving_mean_;
-    float_vec moving_variance_;
-    float_vec beta_;
-    float_vec gamma_;
+    float_vec<float_type> moving_mean_;
+    float_vec<float_type> moving_variance_;
+    float_vec<float_type> beta_;
+    float_vec<float_type> gamma_;
     float_type epsilon_;
 
-    tensor5 apply_to_slices(const tensor5& input) const
+    // Output may share its memory with input.
+    void apply_to_slices(const tensor5<float_type>& input, tensor5<float_type>& output) const
     {
         assertion(moving_mean_.size() == input.shape().depth_,
             "invalid beta");
@@ -58,7 +69,6 @@ protected:
             assertion(beta_.size() == input.shape().depth_, "invalid beta");
         }
 
-        tensor5 output(input.shape(), 0);
         for (std::size_t z = 0; z < output.shape().depth_; ++z)
         {
             const float_type denom = std::sqrt(moving_variance_[z] + epsilon_);
@@ -77,14 +87,32 @@ protected:
                 }
             }
         }
-        return output;
     }
 
-    tensor5s apply_impl(const tensor5s& inputs) const override
+    tensor5s<float_type> apply_impl(const tensor5s<float_type>& inputs) const override
     {
         assertion(inputs.size() == 1, "invalid number of tensors");
         const auto& input = inputs.front();
-        return {apply_to_slices(input)};
+        tensor5<float_type> output(input.shape(), 0);
+        apply_to_slices(input, output);
+        return {output};
+    }
+
+    tensor5s<float_type> apply_donating_impl(const tensor5s<float_type>& inputs,
+        const std::vector<bool>& donated) const override
+    {
+        assertion(inputs.size() == 1, "invalid number of tensors");
+        // Only the first 3D slice is written,
+        // so all others would need to be zeroed.
+        if (inputs.front().shape().size_dim_5_ != 1 ||
+            inputs.front().shape().size_dim_4_ != 1)
+        {
+            return apply_impl(inputs);
+        }
+        assertion(donated.front(), "input not donated");
+        tensor5<float_type> output = inputs.front();
+        apply_to_slices(output, output);
+        return {output};
     }
 };
 
@@ -17,7 +17,8 @@ namespace fdeep
 namespace internal
 {
 
-class bidirectional_layer : public layer
+template <typename float_type>
+class bidirectional_layer : public layer<float_type>
 {
 public:
     explicit bidirectional_layer(const std::string& name,
@@ -29,14 +30,14 @@ public:
                         const bool use_bias,
                         const bool reset_after,
                         const bool return_sequences,
-                        const float_vec& forward_weights,
-                        const float_vec& forward_recurrent_weights,
-                        const float_vec& bias_forward,
-                        const float_vec& backward_weights,
-                        const float_vec& backward_recurrent_weights,
-                        const float_vec& bias_backward
+                        const float_vec<float_type>& forward_weights,
+                        const float_vec<float_type>& forward_recurrent_weights,
+                        const float_vec<float_type>& bias_forward,
+                        const float_vec<float_type>& backward_weights,
+                        const float_vec<float_type>& backward_recurrent_weights,
+                        const float_vec<float_type>& bias_backward
                         )
-        : layer(name),
+        : layer<float_type>(name),
         merge_mode_(merge_mode),
         n_units_(n_units),
         activation_(activation),
@@ -67,9 +68,9 @@ protected:
         return false;
     }
 
-    tensor5s apply_impl(const tensor5s& inputs) const override final
+    tensor5s<float_type> apply_impl(const tensor5s<float_type>& inputs) const override final
     {
-        const auto input_shapes = fplus::transform(fplus_c_mem_fn_t(tensor5, shape, shape5), inputs);
+        const auto input_shapes = fplus::transform(fplus_c_mem_fn_t(tensor5<float_type>, shape, shape5), inputs);
 
         // ensure that tensor5 shape is (1, 1, 1, seq_len, n_features)
         assertion(inputs.front().shape().size_dim_5_ == 1
@@ -79,21 +80,21 @@ protected:
 
         const auto input = inputs.front();
 
-        tensor5s result_forward = {};
-        tensor5s result_backward = {};
-        tensor5s bidirectional_result = {};
+        tensor5s<float_type> result_forward = {};
+        tensor5s<float_type> result_backward = {};
+        tensor5s<float_type> bidirectional_result = {};
 
-        const tensor5 input_reversed = reverse_time_series_in_tensor5(input);
+        const tensor5<float_type> input_reversed = reverse_time_series_in_tensor5(input);
 
         if (wrapped_layer_type_ == "LSTM" || wrapped_layer_type_ == "CuDNNLSTM")
         {
             assertion(inputs.size() == 1 || inputs.size() == 5,
                 "Invalid number of input tensors.");
                 
-            tensor5 forward_state_h = inputs.size() == 5 ? inputs[1] : tensor5(shape5(1, 1, 1, 1, n_units_), static_cast<float_type>(0));
-            tensor5 forward_state_c = inputs.size() == 5 ? inputs[2] : tensor5(shape5(1, 1, 1, 1, n_units_), static_cast<float_type>(0));
-            tensor5 backward_state_h = inputs.size() == 5 ? inputs[3] : tensor5(shape5(1, 1, 1, 1, n_units_), static_cast<float_type>(0));
-            tensor5 backward_state_c = inputs.size() == 5 ? inputs[4] : tensor5(shape5(1, 1, 1, 1, n_units_), static_cast<float_type>(0));        
+            tensor5<float_type> forward_state_h = inputs.size() == 5 ? inputs[1] : tensor5<float_type>(shape5(1, 1, 1, 1, n_units_), static_cast<float_type>(0));
+            tensor5<float_type> forward_state_c = inputs.size() == 5 ? inputs[2] : tensor5<float_type>(shape5(1, 1, 1, 1, n_units_), static_cast<float_type>(0));
+            tensor5<float_type> backward_state_h = inputs.size() == 5 ? inputs[3] : tensor5<float_type>(shape5(1, 1, 1, 1, n_units_), static_cast<float_type>(0));
+            tensor5<float_type> backward_state_c = inputs.size() == 5 ? inputs[4] : tensor5<float_type>(shape5(1, 1, 1, 1, n_units_), static_cast<float_type>(0));        
             result_forward = lstm_impl(input, forward_state_h, forward_state_c,
                                        n_units_, use_bias_, return_sequences_, false,
                                        forward_weights_, forward_recurrent_weights_,
@@ -107,8 +108,8 @@ protected:
         {
             assertion(inputs.size() == 1 || inputs.size() == 3,
                 "Invalid number of input tensors.");
-            tensor5 forward_state_h = inputs.size() == 3 ? inputs[1] : tensor5(shape5(1, 1, 1, 1, n_units_), static_cast<float_type>(0));
-            tensor5 backward_state_h = inputs.size() == 3 ? inputs[2] : tensor5(shape5(1, 1, 1, 1, n_units_), static_cast<float_type>(0));
+            tensor5<float_type> forward_state_h = inputs.size() == 3 ? inputs[1] : tensor5<float_type>(shape5(1, 1, 1, 1, n_units_), static_cast<float_type>(0));
+            tensor5<float_type> backward_state_h = inputs.size() == 3 ? inputs[2] : tensor5<float_type>(shape5(1, 1, 1, 1, n_units_), static_cast<float_type>(0));
             result_forward = gru_impl(input, forward_state_h, n_units_, use_bias_, reset_after_, return_sequences_, false,
                                       forward_weights_, forward_recurrent_weights_,
                                       bias_forward_, activation_, recurrent_activation_);
@@ -119,23 +120,23 @@ protected:
         else
             raise_error("layer '" + wrapped_layer_type_ + "' not yet implemented");
 
-        const tensor5 result_backward_reversed = reverse_time_series_in_tensor5(result_backward.front());
+        const tensor5<float_type> result_backward_reversed = reverse_time_series_in_tensor5(result_backward.front());
 
         if (merge_mode_ == "concat")
         {
-            bidirectional_result = {concatenate_tensor5s_depth({result_forward.front(), result_backward_reversed})};
+            bidirectional_result = {concatenate_tensor5s_depth<float_type>({result_forward.front(), result_backward_reversed})};
         }
         else if (merge_mode_ == "sum")
         {
-            bidirectional_result = {sum_tensor5s({result_forward.front(), result_backward_reversed})};
+            bidirectional_result = {sum_tensor5s<float_type>({result_forward.front(), result_backward_reversed})};
         }
         else if (merge_mode_ == "mul")
         {
-            bidirectional_result = {multiply_tensor5s({result_forward.front(), result_backward_reversed})};
+            bidirectional_result = {multiply_tensor5s<float_type>({result_forward.front(), result_backward_reversed})};
         }
         else if (merge_mode_ == "ave")
         {
-            bidirectional_result = {average_tensor5s({result_forward.front(), result_backward_reversed})};
+            bidirectional_result = {average_tensor5s<float_type>({result_forward.front(), result_backward_reversed})};
         }
         else
             raise_error("merge mode '" + merge_mode_ + "' not valid");
@@ -151,12 +152,12 @@ protected:
     const bool use_bias_;
     const bool reset_after_;
     const bool return_sequences_;
-    const float_vec forward_weights_;
-    const float_vec forward_recurrent_weights_;
-    const float_vec bias_forward_;
-    const float_vec backward_weights_;
-    const float_vec backward_recurrent_weights_;
-    const float_vec bias_backward_;
+    const float_vec<float_type> forward_weights_;
+    const float_vec<float_type> forward_recurrent_weights_;
+    const float_vec<float_type> bias_forward_;
+    const float_vec<float_type> backward_weights_;
+    const float_vec<float_type> backward_recurrent_weights_;
+    const float_vec<float_type> bias_backward_;
 };
 
 } // namespace internal
@@ -13,11 +13,12 @@
 namespace fdeep { namespace internal
 {
 
-class concatenate_layer : public layer
+template <typename float_type>
+class concatenate_layer : public layer<float_type>
 {
 public:
     explicit concatenate_layer(const std::string& name, std::int32_t axis)
-        : layer(name), axis_(axis)
+        : layer<float_type>(name), axis_(axis)
     {
     }
 protected:
@@ -35,7 +36,7 @@ protected:
             ") for concatenate layer.");
         return 0;
     }
-    tensor5s apply_impl(const tensor5s& input) const override
+    tensor5s<float_type> apply_impl(const tensor5s<float_type>& input) const override
     {
         return {concatenate_tensor5s(input, axis_)};
     }
@@ -8,8 +8,10 @@
 
 #include "fdeep/convolution.hpp"
 #include "fdeep/filter.hpp"
+#include "fdeep/quantization.hpp"
 #include "fdeep/shape2.hpp"
 #include "fdeep/shape5.hpp"
+#include "fdeep/winograd.hpp"
 #include "fdeep/layers/layer.hpp"
 
 #include <fplus/fplus.hpp>
@@ -21,7 +23,8 @@
 namespace fdeep { namespace internal
 {
 
-class conv_2d_layer : public layer
+template <typename float_type>
+class conv_2d_layer : public layer<float_type>
 {
 public:
     explicit conv_2d_layer(
@@ -32,40 +35,139 @@ public:
             bool padding_valid_offset_depth_2,
             bool padding_same_offset_depth_2,
             const shape2& dilation_rate,
-            const float_vec& weights, const float_vec& bias)
-        : layer(name),
-        filters_(generate_im2col_filter_matrix(
-            generate_filters(dilation_rate, filter_shape, k, weights, bias))),
+            const float_buffer<float_type>& weights, const float_vec<float_type>& bias,
+            float_type input_max_abs = 0,
+            const float_buffer<float_type>& winograd_weights =
+                float_buffer<float_type>())
+        : layer<float_type>(name),
+        filters_(im2col_filter_matrix_from_weights(
+            filter_shape, dilation_rate, k, weights, bias)),
         strides_(strides),
         padding_(p),
         padding_valid_offset_depth_1_(padding_valid_offset_depth_1),
         padding_same_offset_depth_1_(padding_same_offset_depth_1),
         padding_valid_offset_depth_2_(padding_valid_offset_depth_2),
-        padding_same_offset_depth_2_(padding_same_offset_depth_2)
+        padding_same_offset_depth_2_(padding_same_offset_depth_2),
+        input_max_abs_(input_max_abs),
+        quantized_(false),
+        quantized_filters_(),
+        winograd_(winograd_applicable(filter_shape, k, strides, dilation_rate) &&
+            (!weights.is_view() || winograd_weights.size() > 0)),
+        winograd_filters_()
     {
         assertion(k > 0, "needs at least one filter");
         assertion(filter_shape.volume() > 0, "filter must have volume");
         assertion(strides.area() > 0, "invalid strides");
+        if (winograd_)
+        {
+            // Transformed filters stored in the model (see load_model_cached)
+            // are used in place. Transforming mapped weights
+            // would give every process its own copy of them.
+            winograd_filters_ = winograd_weights.size() > 0
+                ? winograd_filter_matrices<float_type>(winograd_weights, bias,
+                    filter_shape.depth_, k)
+                : generate_winograd_filter_matrices(filters_);
+            // The im2col weights are only needed again by quantize_int8.
+            if (input_max_abs_ <= 0)
+            {
+                filters_.weights_ = float_buffer<float_type>();
+            }
+        }
+    }
+    bool creates_new_buffers() const override
+    {
+        return true;
+    }
+    bool quantize_int8() override
+    {
+        if (quantized_ || input_max_abs_ <= 0)
+        {
+            return false;
+        }
+        quantized_filters_ = quantize_im2col_filter_matrix(filters_);
+        // Only the quantized weights are used from now on.
+        filters_.weights_ = float_buffer<float_type>();
+        winograd_filters_ = winograd_filter_matrices<float_type>();
+        winograd_ = false;
+        quantized_ = true;
+        return true;
     }
 protected:
-    tensor5s apply_impl(const tensor5s& inputs) const override
+    bool use_offset(const shape5& input_shape) const
     {
-        assertion(inputs.size() == 1, "only one input tensor allowed");
-        const bool use_offset = inputs.front().shape().depth_ == 1 ?
+        return input_shape.depth_ == 1 ?
             ((padding_ == padding::valid && padding_valid_offset_depth_1_) ||
             (padding_ == padding::same && padding_same_offset_depth_1_)) :
             ((padding_ == padding::valid && padding_valid_offset_depth_2_) ||
             (padding_ == padding::same && padding_same_offset_depth_2_));
-        return {convolve(strides_, padding_, use_offset,
+    }
+    tensor5s<float_type> apply_impl(const tensor5s<float_type>& inputs) const override
+    {
+        assertion(inputs.size() == 1, "only one input tensor allowed");
+        if (quantized_)
+        {
+            return {convolve_int8(strides_, padding_,
+                use_offset(inputs.front().shape()),
+                filters_.filter_shape_, filters_.dilation_rate_,
+                quantized_filters_,
+                int8_scale(input_max_abs_), inputs.front())};
+        }
+        if (winograd_)
+        {
+            return {winograd_convolve(padding_,
+                use_offset(inputs.front().shape()),
+                winograd_filters_, inputs.front())};
+        }
+        return {convolve(strides_, padding_,
+            use_offset(inputs.front().shape()),
             filters_, inputs.front())};
     }
-    im2col_filter_matrix filters_;
+    tensor5s_vec<float_type> apply_batch_impl(const tensor5s_vec<float_type>& inputs) const override
+    {
+        const auto input_tensors = fplus::transform([](const tensor5s<float_type>& input)
+        {
+            assertion(input.size() == 1, "only one input tensor allowed");
+            return input.front();
+        }, inputs);
+        if (input_tensors.empty() || !fplus::all_the_same_on(
+            fplus_c_mem_fn_t(tensor5<float_type>, shape, shape5), input_tensors))
+        {
+            return layer<float_type>::apply_batch_impl(inputs);
+        }
+        const auto results = quantized_
+            ? convolve_int8_batch(strides_, padding_,
+                use_offset(input_tensors.front().shape()),
+                filters_.filter_shape_, filters_.dilation_rate_,
+                quantized_filters_,
+                int8_scale(input_max_abs_), input_tensors)
+            : winograd_
+            ? winograd_convolve_batch(padding_,
+                use_offset(input_tensors.front().shape()),
+                winograd_filters_, input_tensors)
+            : convolve_batch(strides_, padding_,
+                use_offset(input_tensors.front().shape()),
+                filters_, input_tensors);
+        return fplus::transform([](const tensor5<float_type>& result) -> tensor5s<float_type>
+        {
+            return {result};
+        }, results);
+    }
+    im2col_filter_matrix<float_type> filters_;
     shape2 strides_;
     padding padding_;
     bool padding_valid_offset_depth_1_;
     bool padding_same_offset_depth_1_;
     bool padding_valid_offset_depth_2_;
     bool padding_same_offset_depth_2_;
+    float_type input_max_abs_;
+    bool quantized_;
+    int8_weight_matrix<float_type> quantized_filters_;
+    // 3x3 filters with stride 1 are kept transformed
+    // for the Winograd convolution, see winograd.hpp.
+    // Weights mapped from a binary model file are used as they are,
+    // so their pages stay shared between processes.
+    bool winograd_;
+    winograd_filter_matrices<float_type> winograd_filters_;
 };
 
 } } // namespace fdeep, namespace internal
@@ -13,7 +13,8 @@
 namespace fdeep { namespace internal
 {
 
-class cropping_2d_layer : public layer
+template <typename float_type>
+class cropping_2d_layer : public layer<float_type>
 {
 public:
     explicit cropping_2d_layer(const std::string& name,
@@ -21,7 +22,7 @@ public:
         std::size_t bottom_crop,
         std::size_t left_crop,
         std::size_t right_crop) :
-            layer(name),
+            layer<float_type>(name),
             top_crop_(top_crop),
             bottom_crop_(bottom_crop),
             left_crop_(left_crop),
@@ -29,7 +30,7 @@ public:
     {
     }
 protected:
-    tensor5s apply_impl(const tensor5s& inputs) const override
+    tensor5s<float_type> apply_impl(const tensor5s<float_type>& inputs) const override
     {
         assertion(inputs.size() == 1, "invalid number of input tensors");
         const auto& input = inputs.front();
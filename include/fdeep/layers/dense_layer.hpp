@@ -6,40 +6,86 @@
 
 #pragma once
 
+#include "fdeep/float_buffer.hpp"
+#include "fdeep/half_float.hpp"
 #include "fdeep/layers/layer.hpp"
+#include "fdeep/quantization.hpp"
 #include "fdeep/tensor5.hpp"
 
 #include <fplus/fplus.hpp>
 
+#include <cstddef>
 #include <string>
 
 namespace fdeep { namespace internal
 {
 
 // Takes a single stack volume (shape5(1, 1, 1, 1, n)) as input.
-class dense_layer : public layer
+template <typename float_type>
+class dense_layer : public layer<float_type>
 {
 public:
-    static RowMajorMatrixXf generate_params(std::size_t n_in,
-        const float_vec& weights, const float_vec& bias)
-    {
-        assertion(weights.size() % bias.size() == 0, "invalid params");
-        return eigen_row_major_mat_from_values(n_in + 1, bias.size(),
-            fplus::append(weights, bias));
-    }
+    typedef Eigen::Matrix<float_type, 1, Eigen::Dynamic> bias_vec;
+    // The weights form a row-major (n_in x units) matrix.
+    // They are used in place, so they can also be
+    // a view into a memory-mapped model file.
     dense_layer(const std::string& name, std::size_t units,
-            const float_vec& weights,
-            const float_vec& bias) :
-        layer(name),
+            const float_buffer<float_type>& weights,
+            const float_vec<float_type>& bias,
+            float_type input_max_abs = 0) :
+        layer<float_type>(name),
         n_in_(weights.size() / bias.size()),
         n_out_(units),
-        params_(generate_params(n_in_, weights, bias))
+        weights_(weights),
+        bias_(Eigen::Map<const bias_vec, Eigen::Unaligned>(
+            bias.data(), static_cast<EigenIndex>(bias.size()))),
+        half_weights_(),
+        input_max_abs_(input_max_abs),
+        quantized_(false),
+        quantized_weights_()
     {
         assertion(bias.size() == units, "invalid bias count");
         assertion(weights.size() % units == 0, "invalid weight count");
     }
+    // Keeps the weights with 16 bits per value,
+    // widening them only while multiplying.
+    dense_layer(const std::string& name, std::size_t units,
+            const half_float_buffer& weights,
+            const float_vec<float_type>& bias,
+            float_type input_max_abs = 0) :
+        dense_layer(name, units, float_buffer<float_type>(), bias, input_max_abs)
+    {
+        assertion(weights.size() % units == 0, "invalid weight count");
+        n_in_ = weights.size() / units;
+        half_weights_ = weights;
+    }
+    bool creates_new_buffers() const override
+    {
+        return true;
+    }
+    bool quantize_int8() override
+    {
+        if (quantized_ || input_max_abs_ <= 0)
+        {
+            return false;
+        }
+        if (half_weights_.size() > 0)
+        {
+            weights_ = float_buffer<float_type>(
+                widen_half_float_buffer<float_type>(half_weights_));
+        }
+        // Each row of the quantized matrix is one column of the weights.
+        quantized_weights_ = quantize_weight_matrix(weights_.data(),
+            n_out_, n_in_, 1, n_out_,
+            float_vec<float_type>(bias_.data(), bias_.data() + bias_.size()));
+        // Only the quantized weights are used from now on.
+        weights_ = float_buffer<float_type>();
+        half_weights_ = half_float_buffer();
+        quantized_ = true;
+        return true;
+    }
 protected:
-    tensor5s apply_impl(const tensor5s& inputs) const override
+    tensor5s<float_type> apply_impl(const tensor5s<float_type>& inputs) const override
     {
         assertion(inputs.size() == 1, "invalid number of input tensors");
         auto input = inputs.front();
@@ -54,46 +100,118 @@ protected:
         // {
         //     input = flatten_tensor5(input);
         // }
-        const auto input_parts = fplus::split_every(
-            input.shape().depth_, *input.as_vector());
+        assertion(input.shape().depth_ == n_in_,
+            "Invalid input value count.");
+        const std::size_t positions = input.shape().volume() / n_in_;
 
-        const auto result_value_vectors = fplus::transform(
-            [this](const auto& input_part) -> float_vec
-            {
-                assertion(input_part.size() == n_in_,
-                    "Invalid input value count.");
-                const auto bias_padded_input = bias_pad_input(input_part);
-                const auto result = bias_padded_input * params_;
-                assertion(result.rows() == 1, "invalid result size.");
-                return *eigen_row_major_mat_to_values(result);
-            },
-            input_parts);
+        shared_float_vec<float_type> result_values = fplus::make_shared_ref<float_vec<float_type>>();
+        result_values->resize(positions * n_out_);
+        multiply(input.as_vector()->data(), positions,
+            result_values->data());
+
+        return {tensor5<float_type>(output_shape(input.shape()), result_values)};
+    }
+    // The positions of all samples are stacked into the rows of one matrix,
+    // so the weights only need to be streamed once for the whole batch.
+    tensor5s_vec<float_type> apply_batch_impl(const tensor5s_vec<float_type>& inputs) const override
+    {
+        const auto input_tensors = fplus::transform([](const tensor5s<float_type>& input)
+        {
+            assertion(input.size() == 1, "invalid number of input tensors");
+            return input.front();
+        }, inputs);
 
-        const auto result_values = fplus::concat(result_value_vectors);
-        assertion(result_values.size() % n_out_ == 0,
-            "Invalid number of output values.");
+        std::size_t positions = 0;
+        for (const auto& input : input_tensors)
+        {
+            assertion(input.shape().depth_ == n_in_,
+                "Invalid input value count.");
+            positions += input.shape().volume() / n_in_;
+        }
 
-        return {tensor5(shape5(
-            input.shape().size_dim_5_,
-            input.shape().size_dim_4_,
-            input.shape().height_,
-            input.shape().width_,
-            n_out_),
-            fplus::make_shared_ref<fdeep::float_vec>(result_values))};
+        float_vec<float_type> stacked_inputs;
+        stacked_inputs.reserve(positions * n_in_);
+        for (const auto& input : input_tensors)
+        {
+            stacked_inputs.insert(std::end(stacked_inputs),
+                std::begin(*input.as_vector()), std::end(*input.as_vector()));
+        }
+
+        float_vec<float_type> results(positions * n_out_);
+        multiply(stacked_inputs.data(), positions, results.data());
+
+        tensor5s_vec<float_type> outputs;
+        outputs.reserve(input_tensors.size());
+        const float_type* result_values = results.data();
+        for (const auto& input : input_tensors)
+        {
+            const shape5 out_shape = output_shape(input.shape());
+            const std::size_t out_volume = out_shape.volume();
+            outputs.push_back({tensor5<float_type>(out_shape,
+                float_vec<float_type>(result_values, result_values + out_volume))});
+            result_values += out_volume;
+        }
+        return outputs;
+    }
+    shape5 output_shape(const shape5& input_shape) const
+    {
+        return shape5(
+            input_shape.size_dim_5_,
+            input_shape.size_dim_4_,
+            input_shape.height_,
+            input_shape.width_,
+            n_out_);
     }
-    static RowMajorMatrixXf bias_pad_input(const float_vec& input)
+    // Multiplies all positions, i.e., the rows of a (positions x n_in) matrix,
+    // with the weights in one go and adds the bias to every resulting row.
+    void multiply(const float_type* input, std::size_t positions,
+        float_type* output) const
     {
-        RowMajorMatrixXf m(1, input.size() + 1);
-        for (std::size_t z = 0; z < input.size(); ++z)
+        if (quantized_)
+        {
+            const std::size_t depth = quantized_weights_.padded_depth_;
+            const float_type input_scale = int8_scale(input_max_abs_);
+            int16_vec quantized_input(positions * depth, 0);
+            for (std::size_t i = 0; i < positions; ++i)
+            {
+                quantize_values(input + i * n_in_, n_in_, input_scale,
+                    quantized_input.data() + i * depth);
+            }
+            int8_multiply(quantized_weights_, quantized_input.data(),
+                input_scale, 0, positions, output);
+            return;
+        }
+        const Eigen::Map<const RowMajorMatrixXf<float_type>, Eigen::Unaligned> in_mat(
+            input,
+            static_cast<EigenIndex>(positions),
+            static_cast<EigenIndex>(n_in_));
+        Eigen::Map<RowMajorMatrixXf<float_type>, Eigen::Unaligned> out_mat(
+            output,
+            static_cast<EigenIndex>(positions),
+            static_cast<EigenIndex>(n_out_));
+        if (half_weights_.size() > 0)
+        {
+            multiply_half_float_weights(input, positions, n_in_,
+                half_weights_, n_out_, output);
+        }
+        else
         {
-            m(0, static_cast<EigenIndex>(z)) = input[z];
+            const Eigen::Map<const RowMajorMatrixXf<float_type>, Eigen::Unaligned>
+                weights(weights_.data(),
+                    static_cast<EigenIndex>(n_in_),
+                    static_cast<EigenIndex>(n_out_));
+            out_mat.noalias() = in_mat * weights;
         }
-        m(0, static_cast<EigenIndex>(input.size())) = 1;
-        return m;
+        out_mat.rowwise() += bias_;
     }
     std::size_t n_in_;
     std::size_t n_out_;
-    RowMajorMatrixXf params_;
+    float_buffer<float_type> weights_;
+    bias_vec bias_;
+    half_float_buffer half_weights_;
+    float_type input_max_abs_;
+    bool quantized_;
+    int8_weight_matrix<float_type> quantized_weights_;
 };
 
 } } // namespace fdeep, namespace internal
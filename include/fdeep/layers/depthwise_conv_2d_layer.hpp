@@ -8,6 +8,7 @@
 
 #include "fdeep/convolution.hpp"
 #include "fdeep/filter.hpp"
+#include "fdeep/quantization.hpp"
 #include "fdeep/shape2.hpp"
 #include "fdeep/shape5.hpp"
 #include "fdeep/layers/layer.hpp"
@@ -23,7 +24,8 @@ namespace fdeep { namespace internal
 {
 
 // Convolve depth slices separately.
-class depthwise_conv_2d_layer : public layer
+template <typename float_type>
+class depthwise_conv_2d_layer : public layer<float_type>
 {
 public:
     explicit depthwise_conv_2d_layer(
@@ -35,64 +37,77 @@ public:
             bool padding_valid_offset_depth_2,
             bool padding_same_offset_depth_2,
             const shape2& dilation_rate,
-            const float_vec& depthwise_weights,
-            const float_vec& bias)
-        : layer(name),
-        filters_depthwise_(fplus::transform(generate_im2col_single_filter_matrix,
-            generate_filters(dilation_rate, filter_shape,
-                input_depth, depthwise_weights, bias))),
+            const float_vec<float_type>& depthwise_weights,
+            const float_vec<float_type>& bias,
+            float_type input_max_abs = 0)
+        : layer<float_type>(name),
+        filters_depthwise_(generate_depthwise_filter_matrix(
+            generate_filters(filter_shape,
+                input_depth, depthwise_weights, bias), dilation_rate)),
         strides_(strides),
         padding_(p),
         padding_valid_offset_depth_1_(padding_valid_offset_depth_1),
         padding_same_offset_depth_1_(padding_same_offset_depth_1),
         padding_valid_offset_depth_2_(padding_valid_offset_depth_2),
-        padding_same_offset_depth_2_(padding_same_offset_depth_2)
+        padding_same_offset_depth_2_(padding_same_offset_depth_2),
+        input_max_abs_(input_max_abs),
+        quantized_(false),
+        quantized_filters_()
     {
         assertion(k > 0, "needs at least one filter");
         assertion(filter_shape.volume() > 0, "filter must have volume");
         assertion(strides.area() > 0, "invalid strides");
-        assertion(filters_depthwise_.size() == input_depth,
+        assertion(filters_depthwise_.bias_.size() == input_depth,
             "invalid number of filters");
     }
+    bool quantize_int8() override
+    {
+        if (quantized_ || input_max_abs_ <= 0)
+        {
+            return false;
+        }
+        quantized_filters_ = quantize_depthwise_filters(filters_depthwise_);
+        // Only the quantized weights are used from now on.
+        filters_depthwise_ = depthwise_filter_matrix<float_type>();
+        quantized_ = true;
+        return true;
+    }
 protected:
-    tensor5s apply_impl(const tensor5s& inputs) const override
+    bool use_offset(const shape5& input_shape) const
     {
-        assertion(inputs.size() == 1, "only one input tensor allowed");
-
-        const auto input_slices = tensor5_to_depth_slices(inputs.front());
-
-        assertion(input_slices.size() == filters_depthwise_.size(),
-            "invalid input depth");
-
-        const bool use_offset = input_slices.size() == 1 ?
+        return input_shape.depth_ == 1 ?
             ((padding_ == padding::valid && padding_valid_offset_depth_1_) ||
             (padding_ == padding::same && padding_same_offset_depth_1_)) :
             ((padding_ == padding::valid && padding_valid_offset_depth_2_) ||
             (padding_ == padding::same && padding_same_offset_depth_2_));
+    }
+    tensor5s<float_type> apply_impl(const tensor5s<float_type>& inputs) const override
+    {
+        assertion(inputs.size() == 1, "only one input tensor allowed");
 
-        const auto convolve_slice =
-            [&](const tensor5& slice, const im2col_filter_matrix& f) -> tensor5
+        if (quantized_)
         {
-            assertion(f.filter_shape_.depth_ == 1, "invalid filter depth");
-            const auto result = convolve(strides_, padding_,
-                use_offset, f, slice);
-            assertion(result.shape().depth_ == 1, "invalid conv output");
-            return result;
-        };
+            return {depthwise_convolve_int8(strides_, padding_,
+                use_offset(inputs.front().shape()),
+                quantized_filters_, int8_scale(input_max_abs_),
+                inputs.front())};
+        }
 
-        assertion(input_slices.size() == filters_depthwise_.size(),
-            "invalid depthwise filter count");
-        return {concatenate_tensor5s_depth(fplus::zip_with(
-            convolve_slice, input_slices, filters_depthwise_))};
+        return {depthwise_convolve(strides_, padding_,
+            use_offset(inputs.front().shape()),
+            filters_depthwise_, inputs.front())};
     }
 
-    std::vector<im2col_filter_matrix> filters_depthwise_;
+    depthwise_filter_matrix<float_type> filters_depthwise_;
     shape2 strides_;
     padding padding_;
     bool padding_valid_offset_depth_1_;
     bool padding_same_offset_depth_1_;
     bool padding_valid_offset_depth_2_;
     bool padding_same_offset_depth_2_;
+    float_type input_max_abs_;
+    bool quantized_;
+    int8_depthwise_filters<float_type> quantized_filters_;
 };
 
 } } // namespace fdeep, namespace internal
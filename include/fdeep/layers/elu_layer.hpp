@@ -13,22 +13,27 @@
 namespace fdeep { namespace internal
 {
 
-class elu_layer : public activation_layer
+template <typename float_type>
+class elu_layer : public elementwise_activation_layer<float_type>
 {
 public:
     explicit elu_layer(const std::string& name, float_type alpha)
-        : activation_layer(name), alpha_(alpha)
+        : elementwise_activation_layer<float_type>(name), alpha_(alpha)
     {
     }
+    bool creates_new_buffers() const override
+    {
+        return true;
+    }
 protected:
     float_type alpha_;
     static float_type activation_function(float_type alpha, float_type x)
     {
         return x >= 0 ? x : alpha * (std::exp(x) - 1);
     }
-    tensor5 transform_input(const tensor5& in_vol) const override
+    void transform_input_in_place(tensor5<float_type>& in_vol) const override
     {
-        return transform_tensor5(
+        transform_tensor5_in_place(
             fplus::bind_1st_of_2(activation_function, alpha_),
             in_vol);
     }
@@ -16,23 +16,24 @@ namespace fdeep
 namespace internal
 {
 
-class embedding_layer : public layer
+template <typename float_type>
+class embedding_layer : public layer<float_type>
 {
   public:
     explicit embedding_layer(const std::string& name,
                              std::size_t input_dim,
                              std::size_t output_dim,
-                             const float_vec& weights)
-        : layer(name)
+                             const float_vec<float_type>& weights)
+        : layer<float_type>(name)
         , input_dim_(input_dim)
         , output_dim_(output_dim)
         , weights_(weights)
     {}
 
   protected:
-    tensor5s apply_impl(const tensor5s &inputs) const override final
+    tensor5s<float_type> apply_impl(const tensor5s<float_type> &inputs) const override final
     {
-        const auto input_shapes = fplus::transform(fplus_c_mem_fn_t(tensor5, shape, shape5), inputs);
+        const auto input_shapes = fplus::transform(fplus_c_mem_fn_t(tensor5<float_type>, shape, shape5), inputs);
 
         // ensure that tensor5 shape is (1, 1, 1, 1, seq_len)
         assertion(inputs.front().shape().size_dim_5_ == 1
@@ -41,28 +42,28 @@ class embedding_layer : public layer
                   && inputs.front().shape().width_ == 1,
                   "size_dim_5, size_dim_4, height and width dimension must be 1, but shape is '" + show_shape5s(input_shapes) + "'");
 
-        tensor5s results;
+        tensor5s<float_type> results;
         for (auto&& input : inputs)
         {
             const std::size_t sequence_len = input.shape().depth_;
-            float_vec output_vec(sequence_len * output_dim_);
+            float_vec<float_type> output_vec(sequence_len * output_dim_);
             auto&& it = output_vec.begin();
 
             for (std::size_t i = 0; i < sequence_len; ++i)
             {
                 std::size_t index = static_cast<std::size_t>(input.get(0, 0, 0, 0, i));
                 assertion(index < input_dim_, "vocabulary item indices must all be strictly less than the value of input_dim");
-                it = std::copy_n(weights_.cbegin() + static_cast<float_vec::const_iterator::difference_type>(index * output_dim_), output_dim_, it);
+                it = std::copy_n(weights_.cbegin() + static_cast<typename float_vec<float_type>::const_iterator::difference_type>(index * output_dim_), output_dim_, it);
             }
 
-            results.push_back(tensor5(shape5(1, 1, 1, sequence_len, output_dim_), std::move(output_vec)));
+            results.push_back(tensor5<float_type>(shape5(1, 1, 1, sequence_len, output_dim_), std::move(output_vec)));
         }
         return results;
     }
 
     const std::size_t input_dim_;
     const std::size_t output_dim_;
-    const float_vec weights_;
+    const float_vec<float_type> weights_;
 };
 
 } // namespace internal
@@ -14,15 +14,16 @@ namespace fdeep { namespace internal
 {
 
 // Converts a volume into single column volume (shape5(1, 1, 1, 1, n)).
-class flatten_layer : public layer
+template <typename float_type>
+class flatten_layer : public layer<float_type>
 {
 public:
     explicit flatten_layer(const std::string& name) :
-            layer(name)
+            layer<float_type>(name)
     {
     }
 protected:
-    tensor5s apply_impl(const tensor5s& inputs) const override
+    tensor5s<float_type> apply_impl(const tensor5s<float_type>& inputs) const override
     {
         assertion(inputs.size() == 1, "invalid number of input tensors");
         const auto& input = inputs.front();
@@ -13,33 +13,34 @@
 namespace fdeep { namespace internal
 {
 
-class global_average_pooling_1d_layer : public global_pooling_layer
+template <typename float_type>
+class global_average_pooling_1d_layer : public global_pooling_layer<float_type>
 {
 public:
     explicit global_average_pooling_1d_layer(const std::string& name, bool channels_first) :
-    global_pooling_layer(name, channels_first)
+    global_pooling_layer<float_type>(name, channels_first)
     {
     }
 protected:
-    tensor5 pool(const tensor5& in) const override
+    tensor5<float_type> pool(const tensor5<float_type>& in) const override
     {
-        const std::size_t feature_count = channels_first_
+        const std::size_t feature_count = this->channels_first_
             ? in.shape().width_
             : in.shape().depth_
             ;
 
-        const std::size_t step_count = channels_first_
+        const std::size_t step_count = this->channels_first_
             ? in.shape().depth_
             : in.shape().width_
             ;
 
-        tensor5 out(shape5(1, 1, 1, 1, feature_count), 0);
+        tensor5<float_type> out(shape5(1, 1, 1, 1, feature_count), 0);
         for (std::size_t z = 0; z < feature_count; ++z)
         {
             float_type val = 0;
             for (std::size_t x = 0; x < step_count; ++x)
             {
-                if (channels_first_)
+                if (this->channels_first_)
                     val += in.get(0, 0, 0, z, x);
                 else
                     val += in.get(0, 0, 0, x, z);
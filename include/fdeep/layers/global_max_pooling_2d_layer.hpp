@@ -15,32 +15,33 @@
 namespace fdeep { namespace internal
 {
 
-class global_max_pooling_2d_layer : public global_pooling_layer
+template <typename float_type>
+class global_max_pooling_2d_layer : public global_pooling_layer<float_type>
 {
 public:
     explicit global_max_pooling_2d_layer(const std::string& name, bool channels_first) :
-    global_pooling_layer(name, channels_first)
+    global_pooling_layer<float_type>(name, channels_first)
     {
     }
 protected:
-    tensor5 pool(const tensor5& in) const override
+    tensor5<float_type> pool(const tensor5<float_type>& in) const override
     {
-        const std::size_t feature_count = channels_first_
+        const std::size_t feature_count = this->channels_first_
             ? in.shape().height_
             : in.shape().depth_
             ;
 
-        const std::size_t in_height = channels_first_
+        const std::size_t in_height = this->channels_first_
             ? in.shape().width_
             : in.shape().height_
             ;
 
-        const std::size_t in_width = channels_first_
+        const std::size_t in_width = this->channels_first_
             ? in.shape().depth_
             : in.shape().width_
             ;
 
-        tensor5 out(shape5(1, 1, 1, 1, feature_count), 0);
+        tensor5<float_type> out(shape5(1, 1, 1, 1, feature_count), 0);
         for (std::size_t z = 0; z < feature_count; ++z)
         {
             float_type val = std::numeric_limits<float_type>::lowest();
@@ -48,7 +49,7 @@ protected:
             {
                 for (std::size_t x = 0; x < in_width; ++x)
                 {
-                    if (channels_first_)
+                    if (this->channels_first_)
                         val = std::max(val, in.get(0, 0, z, y, x));
                     else
                         val = std::max(val, in.get(0, 0, y, x, z));
@@ -19,22 +19,23 @@ namespace fdeep { namespace internal
 {
 
 // Abstract base class for global pooling layers
-class global_pooling_layer : public layer
+template <typename float_type>
+class global_pooling_layer : public layer<float_type>
 {
 public:
     explicit global_pooling_layer(const std::string& name, bool channels_first) :
-        layer(name),
+        layer<float_type>(name),
         channels_first_(channels_first)
     {
     }
 protected:
-    tensor5s apply_impl(const tensor5s& inputs) const override final
+    tensor5s<float_type> apply_impl(const tensor5s<float_type>& inputs) const override final
     {
         assertion(inputs.size() == 1, "invalid number of input tensors");
         const auto& input = inputs.front();
         return {pool(input)};
     }
-    virtual tensor5 pool(const tensor5& input) const = 0;
+    virtual tensor5<float_type> pool(const tensor5<float_type>& input) const = 0;
 
     bool channels_first_;
 };
@@ -17,7 +17,8 @@ namespace fdeep
 namespace internal
 {
 
-class gru_layer : public layer
+template <typename float_type>
+class gru_layer : public layer<float_type>
 {
   public:
     explicit gru_layer(const std::string& name,
@@ -29,10 +30,10 @@ class gru_layer : public layer
                         const bool return_sequences,
                         const bool return_state,
                         const bool stateful,
-                        const float_vec& weights,
-                        const float_vec& recurrent_weights,
-                        const float_vec& bias)
-        : layer(name),
+                        const float_vec<float_type>& weights,
+                        const float_vec<float_type>& recurrent_weights,
+                        const float_vec<float_type>& bias)
+        : layer<float_type>(name),
           n_units_(n_units),
           activation_(activation),
           recurrent_activation_(recurrent_activation),
@@ -44,7 +45,7 @@ class gru_layer : public layer
           weights_(weights),
           recurrent_weights_(recurrent_weights),
           bias_(bias),
-          state_h_(stateful ? tensor5(shape5(1, 1, 1, 1, n_units), static_cast<float_type>(0)) : fplus::nothing<tensor5>())
+          state_h_(stateful ? tensor5<float_type>(shape5(1, 1, 1, 1, n_units), static_cast<float_type>(0)) : fplus::nothing<tensor5<float_type>>())
 
     {
     }
@@ -52,7 +53,7 @@ class gru_layer : public layer
     void reset_states() override
     {
         if (is_stateful()) {
-            state_h_ = tensor5(shape5(1, 1, 1, 1, n_units_), static_cast<float_type>(0));
+            state_h_ = tensor5<float_type>(shape5(1, 1, 1, 1, n_units_), static_cast<float_type>(0));
         }
     }
 
@@ -62,9 +63,9 @@ class gru_layer : public layer
     }
 
   protected:
-    tensor5s apply_impl(const tensor5s &inputs) const override final
+    tensor5s<float_type> apply_impl(const tensor5s<float_type> &inputs) const override final
     {
-        const auto input_shapes = fplus::transform(fplus_c_mem_fn_t(tensor5, shape, shape5), inputs);
+        const auto input_shapes = fplus::transform(fplus_c_mem_fn_t(tensor5<float_type>, shape, shape5), inputs);
 
         // ensure that tensor5 shape is (1, 1, 1, seq_len, n_features)
         assertion(inputs.front().shape().size_dim_5_ == 1
@@ -77,11 +78,11 @@ class gru_layer : public layer
         assertion(inputs.size() == 1 || inputs.size() == 2,
                 "Invalid number of input tensors.");
 
-        tensor5 state_h = inputs.size() == 2
+        tensor5<float_type> state_h = inputs.size() == 2
             ? inputs[1]
             : is_stateful()
                 ? state_h_.unsafe_get_just()
-                : tensor5(shape5(1, 1, 1, 1, n_units_), static_cast<float_type>(0));
+                : tensor5<float_type>(shape5(1, 1, 1, 1, n_units_), static_cast<float_type>(0));
 
         const auto result = gru_impl(input, state_h, n_units_, use_bias_,
             reset_after_, return_sequences_, return_state_, weights_, recurrent_weights_,
@@ -100,10 +101,10 @@ class gru_layer : public layer
     const bool return_sequences_;
     const bool return_state_;
     const bool stateful_;
-    const float_vec weights_;
-    const float_vec recurrent_weights_;
-    const float_vec bias_;
-    mutable fplus::maybe<tensor5> state_h_;
+    const float_vec<float_type> weights_;
+    const float_vec<float_type> recurrent_weights_;
+    const float_vec<float_type> bias_;
+    mutable fplus::maybe<tensor5<float_type>> state_h_;
 };
 
 } // namespace internal
@@ -13,15 +13,16 @@
 namespace fdeep { namespace internal
 {
 
-class input_layer : public layer
+template <typename float_type>
+class input_layer : public layer<float_type>
 {
 public:
     explicit input_layer(const std::string& name, const shape5_variable& input_shape)
-        : layer(name), input_shape_(input_shape), output_()
+        : layer<float_type>(name), input_shape_(input_shape), output_()
     {
     }
 protected:
-    tensor5s apply_impl(const tensor5s& inputs) const override
+    tensor5s<float_type> apply_impl(const tensor5s<float_type>& inputs) const override
     {
         assertion(inputs.size() == 1, "need exactly one input");
         assertion(inputs.front().shape() == input_shape_, "invalid input size");
@@ -30,7 +31,7 @@ protected:
     shape5_variable input_shape_;
 
     // provide initial tensor for computation
-    mutable fplus::maybe<tensor5> output_;
+    mutable fplus::maybe<tensor5<float_type>> output_;
 };
 
 } } // namespace fdeep, namespace internal
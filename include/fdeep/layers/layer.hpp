@@ -20,15 +20,25 @@
 namespace fdeep { namespace internal
 {
 
+template <typename float_type>
 class layer;
-typedef std::shared_ptr<layer> layer_ptr;
-typedef std::vector<layer_ptr> layer_ptrs;
+template <typename float_type>
+using layer_ptr = std::shared_ptr<layer<float_type>>;
+template <typename float_type>
+using layer_ptrs = std::vector<layer_ptr<float_type>>;
 
+template <typename float_type>
 class activation_layer;
-typedef std::shared_ptr<activation_layer> activation_layer_ptr;
-tensor5s apply_activation_layer(const activation_layer_ptr& ptr,
-    const tensor5s& input);
-
+template <typename float_type>
+using activation_layer_ptr = std::shared_ptr<activation_layer<float_type>>;
+template <typename float_type>
+tensor5s<float_type> apply_activation_layer(const activation_layer_ptr<float_type>& ptr,
+    const tensor5s<float_type>& input);
+template <typename float_type>
+void apply_activation_layer_in_place(const activation_layer_ptr<float_type>& ptr,
+    tensor5s<float_type>& inputs);
+
+template <typename float_type>
 class layer
 {
 public:
@@ -36,48 +46,98 @@ public:
         : name_(name), nodes_(), activation_(nullptr)
     {
     }
-    virtual ~layer()
+    virtual ~layer<float_type>()
     {
     }
 
-    void set_activation(const activation_layer_ptr& activation)
+    void set_activation(const activation_layer_ptr<float_type>& activation)
     {
         activation_ = activation;
     }
 
+    const activation_layer_ptr<float_type>& get_activation() const
+    {
+        return activation_;
+    }
+
     void set_nodes(const nodes& layer_nodes)
     {
         nodes_ = layer_nodes;
     }
 
-    virtual tensor5s apply(const tensor5s& input) const final
+    virtual tensor5s<float_type> apply(const tensor5s<float_type>& input) const final
     {
-        const auto result = apply_impl(input);
+        auto result = apply_impl(input);
         if (activation_ == nullptr)
             return result;
+        else if (creates_new_buffers())
+        {
+            apply_activation_layer_in_place(activation_, result);
+            return result;
+        }
         else
             return apply_activation_layer(activation_, result);
     }
 
-    virtual tensor5 get_output(const layer_ptrs& layers,
-        output_dict& output_cache,
-        std::size_t node_idx, std::size_t tensor_idx) const
+    // Like apply, but the layer may overwrite the inputs flagged in donated
+    // and reuse their memory for its outputs.
+    // An input must only be donated if no other tensor still needed
+    // shares its memory.
+    virtual tensor5s<float_type> apply_donating(const tensor5s<float_type>& input,
+        const std::vector<bool>& donated) const final
     {
-        const node_connection conn(name_, node_idx, tensor_idx);
-
-        if (!fplus::map_contains(output_cache, conn.without_tensor_idx()))
+        assertion(donated.size() == input.size(), "invalid donation flags");
+        if (!accepts_donated_inputs() || !fplus::is_elem_of(true, donated))
+        {
+            return apply(input);
+        }
+        auto result = apply_donating_impl(input, donated);
+        if (activation_ == nullptr)
+            return result;
+        else if (creates_new_buffers())
         {
-            assertion(node_idx < nodes_.size(), "invalid node index");
-            output_cache[conn.without_tensor_idx()] =
-                nodes_[node_idx].get_output(layers, output_cache, *this);
+            apply_activation_layer_in_place(activation_, result);
+            return result;
         }
+        else
+            return apply_activation_layer(activation_, result);
+    }
+
+    // Layers overriding apply_donating_impl should return true here.
+    virtual bool accepts_donated_inputs() const
+    {
+        return false;
+    }
+
+    // Layers only returning tensors with newly allocated memory,
+    // i.e., not shared with their inputs or with members,
+    // should override this with true.
+    // This allows their activation functions and following layers
+    // to work in place.
+    virtual bool creates_new_buffers() const
+    {
+        return false;
+    }
 
-        const auto& outputs = fplus::get_from_map_unsafe(
-            output_cache, conn.without_tensor_idx());
+    // Applies the layer to multiple independent samples at once.
+    virtual tensor5s_vec<float_type> apply_batch(const tensor5s_vec<float_type>& inputs) const final
+    {
+        const auto results = apply_batch_impl(inputs);
+        if (activation_ == nullptr)
+            return results;
+        else
+            return fplus::transform([this](const tensor5s<float_type>& result)
+            {
+                return apply_activation_layer(activation_, result);
+            }, results);
+    }
 
-        assertion(tensor_idx < outputs.size(),
-            "invalid tensor index");
-        return outputs[tensor_idx];
+    // Maps a node index, as used in inbound node connections,
+    // to the matching position in nodes_.
+    virtual std::size_t resolve_node_idx(std::size_t node_idx) const
+    {
+        assertion(node_idx < nodes_.size(), "invalid node index");
+        return node_idx;
     }
 
     virtual void reset_states()
@@ -92,31 +152,44 @@ public:
         // Stateful layers should override that function, with return true.
     }
 
+    // Layers having an int8 path (see quantization.hpp) should override this
+    // to switch to it, if they know the range of their input values
+    // and are not quantized yet, and return true then.
+    virtual bool quantize_int8()
+    {
+        return false;
+    }
+
     std::string name_;
     nodes nodes_;
 
 protected:
-    virtual tensor5s apply_impl(const tensor5s& input) const = 0;
-    activation_layer_ptr activation_;
+    virtual tensor5s<float_type> apply_impl(const tensor5s<float_type>& input) const = 0;
+    // Elementwise layers should override this to write their results
+    // into the memory of the donated inputs.
+    // The returned tensors must be new or donated ones.
+    virtual tensor5s<float_type> apply_donating_impl(const tensor5s<float_type>& input,
+        const std::vector<bool>&) const
+    {
+        return apply_impl(input);
+    }
+    // Layers able to process all samples together,
+    // e.g., with one matrix multiplication, should override this.
+    virtual tensor5s_vec<float_type> apply_batch_impl(const tensor5s_vec<float_type>& inputs) const
+    {
+        return fplus::transform([this](const tensor5s<float_type>& input)
+        {
+            return apply_impl(input);
+        }, inputs);
+    }
+    activation_layer_ptr<float_type> activation_;
 };
 
-inline tensor5 get_layer_output(const layer_ptrs& layers,
-    output_dict& output_cache,
-    const layer_ptr& layer,
-    std::size_t node_idx, std::size_t tensor_idx)
-{
-    return layer->get_output(layers, output_cache, node_idx, tensor_idx);
-}
-
-inline tensor5s apply_layer(const layer& layer, const tensor5s& inputs)
-{
-    return layer.apply(inputs);
-}
-
-inline layer_ptr get_layer(const layer_ptrs& layers,
+template <typename float_type>
+layer_ptr<float_type> get_layer(const layer_ptrs<float_type>& layers,
     const std::string& layer_id)
 {
-    const auto is_matching_layer = [layer_id](const layer_ptr& ptr) -> bool
+    const auto is_matching_layer = [layer_id](const layer_ptr<float_type>& ptr) -> bool
     {
         return ptr->name_ == layer_id;
     };
@@ -13,22 +13,27 @@
 namespace fdeep { namespace internal
 {
 
-class leaky_relu_layer : public activation_layer
+template <typename float_type>
+class leaky_relu_layer : public elementwise_activation_layer<float_type>
 {
 public:
     explicit leaky_relu_layer(const std::string& name, float_type alpha) :
-        activation_layer(name), alpha_(alpha)
+        elementwise_activation_layer<float_type>(name), alpha_(alpha)
     {
     }
+    bool creates_new_buffers() const override
+    {
+        return true;
+    }
 protected:
     float_type alpha_;
-    tensor5 transform_input(const tensor5& in_vol) const override
+    void transform_input_in_place(tensor5<float_type>& in_vol) const override
     {
         auto activation_function = [this](float_type x) -> float_type
         {
             return x > 0 ? x : alpha_ * x;
         };
-        return transform_tensor5(activation_function, in_vol);
+        transform_tensor5_in_place(activation_function, in_vol);
     }
 };
 
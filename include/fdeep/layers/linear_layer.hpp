@@ -13,15 +13,16 @@
 namespace fdeep { namespace internal
 {
 
-class linear_layer : public activation_layer
+template <typename float_type>
+class linear_layer : public activation_layer<float_type>
 {
 public:
     explicit linear_layer(const std::string& name)
-        : activation_layer(name)
+        : activation_layer<float_type>(name)
     {
     }
 protected:
-    tensor5 transform_input(const tensor5& in_vol) const override
+    tensor5<float_type> transform_input(const tensor5<float_type>& in_vol) const override
     {
         return in_vol;
     }
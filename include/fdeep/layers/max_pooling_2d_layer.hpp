@@ -15,16 +15,15 @@
 namespace fdeep { namespace internal
 {
 
-FDEEP_FORCE_INLINE tensor5 max_pool_2d(
+template <typename float_type>
+FDEEP_FORCE_INLINE tensor5<float_type> max_pool_2d(
     std::size_t pool_height, std::size_t pool_width,
     std::size_t strides_y, std::size_t strides_x,
     bool channels_first,
     padding pad_type,
     bool use_offset,
-    const tensor5& in)
+    const tensor5<float_type>& in)
 {
-    const float_type invalid = std::numeric_limits<float_type>::lowest();
-
     const std::size_t feature_count = channels_first
         ? in.shape().height_
         : in.shape().depth_
@@ -45,35 +44,52 @@ FDEEP_FORCE_INLINE tensor5 max_pool_2d(
         shape2(strides_y, strides_x),
         pad_type, use_offset, in_height, in_width);
 
-    int pad_top_int = static_cast<int>(conv_cfg.pad_top_);
-    int pad_left_int = static_cast<int>(conv_cfg.pad_left_);
-    const std::size_t offset_y = conv_cfg.offset_y_;
-    const std::size_t offset_x = conv_cfg.offset_x_;
     const std::size_t out_height = conv_cfg.out_height_;
     const std::size_t out_width = conv_cfg.out_width_;
 
+    // The pool only covers the positions inside of the input,
+    // the padding is never read.
+    const auto pool_range_y = [&](std::size_t y)
+    {
+        return valid_filter_range(conv_cfg.offset_y_ + strides_y * y,
+            conv_cfg.pad_top_, in_height, pool_height, 1);
+    };
+    const auto pool_range_x = [&](std::size_t x)
+    {
+        return valid_filter_range(conv_cfg.offset_x_ + strides_x * x,
+            conv_cfg.pad_left_, in_width, pool_width, 1);
+    };
+    const auto in_y = [&](std::size_t y, std::size_t yf) -> std::size_t
+    {
+        return conv_cfg.offset_y_ + strides_y * y + yf - conv_cfg.pad_top_;
+    };
+    const auto in_x = [&](std::size_t x, std::size_t xf) -> std::size_t
+    {
+        return conv_cfg.offset_x_ + strides_x * x + xf - conv_cfg.pad_left_;
+    };
+
     if (channels_first)
     {
-        tensor5 out(shape5(1, 1, feature_count, out_height, out_width), 0);
+        tensor5<float_type> out(shape5(1, 1, feature_count, out_height, out_width), 0);
 
         for (std::size_t z = 0; z < feature_count; ++z)
         {
             for (std::size_t y = 0; y < out_height; ++y)
             {
+                const auto range_y = pool_range_y(y);
                 for (std::size_t x = 0; x < out_width; ++x)
                 {
+                    const auto range_x = pool_range_x(x);
                     float_type val = std::numeric_limits<float_type>::lowest();
-                    for (std::size_t yf = 0; yf < pool_height; ++yf)
+                    for (std::size_t yf = range_y.first; yf < range_y.second; ++yf)
                     {
-                        int in_get_y = static_cast<int>(offset_y + strides_y * y + yf) - pad_top_int;
-                        for (std::size_t xf = 0; xf < pool_width; ++xf)
+                        const std::size_t iy = in_y(y, yf);
+                        for (std::size_t xf = range_x.first; xf < range_x.second; ++xf)
                         {
-                            int in_get_x = static_cast<int>(offset_x + strides_x * x + xf) - pad_left_int;
-                            const auto current = in.get_x_z_padded(invalid, z, in_get_y, in_get_x);
-                            val = std::max(val, current);
+                            const std::size_t ix = in_x(x, xf);
+                            val = std::max(val, in.get(0, 0, z, iy, ix));
                         }
                     }
-
                     out.set(0, 0, z, y, x, val);
                 }
             }
@@ -82,56 +98,63 @@ FDEEP_FORCE_INLINE tensor5 max_pool_2d(
     }
     else
     {
-        tensor5 out(shape5(1, 1, out_height, out_width, feature_count), 0);
+        // All channels of a position are pooled at once.
+        typedef Eigen::Array<float_type, Eigen::Dynamic, 1> channel_array;
+        const auto size = static_cast<EigenIndex>(feature_count);
+        const float_type* in_values = in.as_vector()->data();
+        shared_float_vec<float_type> res_vec = fplus::make_shared_ref<float_vec<float_type>>();
+        res_vec->resize(out_height * out_width * feature_count);
 
         for (std::size_t y = 0; y < out_height; ++y)
         {
+            const auto range_y = pool_range_y(y);
             for (std::size_t x = 0; x < out_width; ++x)
             {
-                for (std::size_t z = 0; z < feature_count; ++z)
+                const auto range_x = pool_range_x(x);
+                Eigen::Map<channel_array, Eigen::Unaligned> val(
+                    res_vec->data() + (y * out_width + x) * feature_count, size);
+                val.setConstant(std::numeric_limits<float_type>::lowest());
+                for (std::size_t yf = range_y.first; yf < range_y.second; ++yf)
                 {
-                    float_type val = std::numeric_limits<float_type>::lowest();
-                    for (std::size_t yf = 0; yf < pool_height; ++yf)
+                    const std::size_t iy = in_y(y, yf);
+                    for (std::size_t xf = range_x.first; xf < range_x.second; ++xf)
                     {
-                        int in_get_y = static_cast<int>(offset_y + strides_y * y + yf) - pad_top_int;
-                        for (std::size_t xf = 0; xf < pool_width; ++xf)
-                        {
-                            int in_get_x = static_cast<int>(offset_x + strides_x * x + xf) - pad_left_int;
-                            const auto current = in.get_y_x_padded(invalid, in_get_y, in_get_x, z);
-                            val = std::max(val, current);
-                        }
+                        const std::size_t ix = in_x(x, xf);
+                        val = val.max(Eigen::Map<const channel_array, Eigen::Unaligned>(
+                            in_values + (iy * in_width + ix) * feature_count,
+                            size));
                     }
-
-                    out.set(0, 0, y, x, z, val);
                 }
             }
         }
-        return out;
+        return tensor5<float_type>(
+            shape5(1, 1, out_height, out_width, feature_count), res_vec);
     }
 }
 
-class max_pooling_2d_layer : public pooling_2d_layer
+template <typename float_type>
+class max_pooling_2d_layer : public pooling_2d_layer<float_type>
 {
 public:
     explicit max_pooling_2d_layer(const std::string& name,
         const shape2& pool_size, const shape2& strides, bool channels_first, padding p,
         bool padding_valid_uses_offset, bool padding_same_uses_offset) :
-        pooling_2d_layer(name, pool_size, strides, channels_first, p,
+        pooling_2d_layer<float_type>(name, pool_size, strides, channels_first, p,
             padding_valid_uses_offset, padding_same_uses_offset)
     {
     }
 protected:
-    tensor5 pool(const tensor5& in) const override
+    tensor5<float_type> pool(const tensor5<float_type>& in) const override
     {
-        if (pool_size_ == shape2(2, 2) && strides_ == shape2(2, 2))
-            return max_pool_2d(2, 2, 2, 2, channels_first_, padding_, use_offset(), in);
-        else if (pool_size_ == shape2(4, 4) && strides_ == shape2(4, 4))
-            return max_pool_2d(4, 4, 4, 4, channels_first_, padding_, use_offset(), in);
+        if (this->pool_size_ == shape2(2, 2) && this->strides_ == shape2(2, 2))
+            return max_pool_2d(2, 2, 2, 2, this->channels_first_, this->padding_, this->use_offset(), in);
+        else if (this->pool_size_ == shape2(4, 4) && this->strides_ == shape2(4, 4))
+            return max_pool_2d(4, 4, 4, 4, this->channels_first_, this->padding_, this->use_offset(), in);
         else
             return max_pool_2d(
-                pool_size_.height_, pool_size_.width_,
-                strides_.height_, strides_.width_,
-                channels_first_, padding_, use_offset(), in);
+                this->pool_size_.height_, this->pool_size_.width_,
+                this->strides_.height_, this->strides_.width_,
+                this->channels_first_, this->padding_, this->use_offset(), in);
     }
 };
 
@@ -13,15 +13,16 @@
 namespace fdeep { namespace internal
 {
 
-class maximum_layer : public layer
+template <typename float_type>
+class maximum_layer : public layer<float_type>
 {
 public:
     explicit maximum_layer(const std::string& name)
-        : layer(name)
+        : layer<float_type>(name)
     {
     }
 protected:
-    tensor5s apply_impl(const tensor5s& input) const override
+    tensor5s<float_type> apply_impl(const tensor5s<float_type>& input) const override
     {
         return {max_tensor5s(input)};
     }
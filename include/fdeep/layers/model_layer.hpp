@@ -10,6 +10,7 @@
 
 #include "fdeep/tensor5.hpp"
 
+#include "fdeep/execution_plan.hpp"
 #include "fdeep/layers/layer.hpp"
 
 #include <algorithm>
@@ -20,30 +21,59 @@
 namespace fdeep { namespace internal
 {
 
-class model_layer : public layer
+// The layers of a model and how they are connected to its inputs and outputs.
+template <typename float_type>
+struct model_graph
+{
+    layer_ptrs<float_type> layers_;
+    node_connections input_connections_;
+    node_connections output_connections_;
+};
+
+template <typename float_type>
+class model_layer : public layer<float_type>
 {
 public:
     explicit model_layer(const std::string& name,
-        const layer_ptrs& layers,
+        const layer_ptrs<float_type>& layers,
         const node_connections& input_connections,
         const node_connections& output_connections)
-            : layer(name),
+            : layer<float_type>(name),
             layers_(layers),
             input_connections_(input_connections),
-            output_connections_(output_connections)
+            output_connections_(output_connections),
+            plan_()
     {
         assertion(fplus::all_unique(
             fplus::transform(fplus_get_ptr_mem(name_), layers)),
             "layer names must be unique");
+        plan_ = compile_execution_plan(
+            layers_, input_connections_, output_connections_);
     }
 
-    tensor5 get_output(const layer_ptrs& layers, output_dict& output_cache,
-        std::size_t node_idx, std::size_t tensor_idx) const override
+    model_graph<float_type> get_graph() const
+    {
+        return {layers_, input_connections_, output_connections_};
+    }
+
+    // Replaces the layers, e.g., with an optimized version of the graph.
+    void set_graph(const model_graph<float_type>& graph)
+    {
+        assertion(fplus::all_unique(
+            fplus::transform(fplus_get_ptr_mem(name_), graph.layers_)),
+            "layer names must be unique");
+        layers_ = graph.layers_;
+        input_connections_ = graph.input_connections_;
+        output_connections_ = graph.output_connections_;
+        plan_ = compile_execution_plan(
+            layers_, input_connections_, output_connections_);
+    }
+
+    std::size_t resolve_node_idx(std::size_t node_idx) const override
     {
         // https://stackoverflow.com/questions/46011749/understanding-keras-model-architecture-node-index-of-nested-model
-        node_idx = node_idx - 1;
-        assertion(node_idx < nodes_.size(), "invalid node index");
-        return layer::get_output(layers, output_cache, node_idx, tensor_idx);
+        assertion(node_idx > 0, "invalid node index");
+        return layer<float_type>::resolve_node_idx(node_idx - 1);
     }
     void reset_states() override
     {
@@ -58,34 +88,29 @@ public:
             return single_layer->is_stateful();
         }, layers_);
     }
+    activation_memory_stats activation_memory(const tensor5s<float_type>& inputs) const
+    {
+        return measure_activation_memory(plan_, inputs);
+    }
 
 protected:
-    tensor5s apply_impl(const tensor5s& inputs) const override
+    tensor5s<float_type> apply_impl(const tensor5s<float_type>& inputs) const override
     {
-        output_dict output_cache;
-
-        assertion(inputs.size() == input_connections_.size(),
-            "invalid number of input tensors for this model: " +
-            fplus::show(input_connections_.size()) + " required but " +
-            fplus::show(inputs.size()) + " provided");
-
-        for (std::size_t i = 0; i < inputs.size(); ++i)
+        thread_pool* pool = current_thread_pool();
+        if (pool != nullptr && !is_stateful())
         {
-            output_cache[input_connections_[i].without_tensor_idx()] =
-                {inputs[i]};
+            return execute_plan_parallelly(plan_, inputs, *pool);
         }
-
-        const auto get_output = [this, &output_cache]
-            (const node_connection& conn) -> tensor5
-        {
-            return get_layer(layers_, conn.layer_id_)->get_output(
-                layers_, output_cache, conn.node_idx_, conn.tensor_idx_);
-        };
-        return fplus::transform(get_output, output_connections_);
+        return execute_plan(plan_, inputs);
+    }
+    tensor5s_vec<float_type> apply_batch_impl(const tensor5s_vec<float_type>& inputs) const override
+    {
+        return execute_plan_batch(plan_, inputs);
     }
-    layer_ptrs layers_;
+    layer_ptrs<float_type> layers_;
     node_connections input_connections_;
     node_connections output_connections_;
+    execution_plan<float_type> plan_;
 };
 
 } } // namespace fdeep, namespace internal
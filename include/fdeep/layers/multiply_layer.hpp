@@ -8,23 +8,49 @@
 
 #include "fdeep/layers/layer.hpp"
 
+#include <cstddef>
+#include <functional>
 #include <string>
+#include <vector>
 
 namespace fdeep { namespace internal
 {
 
-class multiply_layer : public layer
+template <typename float_type>
+class multiply_layer : public layer<float_type>
 {
 public:
     explicit multiply_layer(const std::string& name)
-        : layer(name)
+        : layer<float_type>(name)
     {
     }
+    bool accepts_donated_inputs() const override
+    {
+        return true;
+    }
+    bool creates_new_buffers() const override
+    {
+        return true;
+    }
 protected:
-    tensor5s apply_impl(const tensor5s& input) const override
+    tensor5s<float_type> apply_impl(const tensor5s<float_type>& input) const override
     {
         return {multiply_tensor5s(input)};
     }
+    tensor5s<float_type> apply_donating_impl(const tensor5s<float_type>& input,
+        const std::vector<bool>& donated) const override
+    {
+        // Singleton factors are broadcasted, so the output shape
+        // might differ from the one of the donated input.
+        if (fplus::any_by(is_singleton_value<float_type>, input))
+        {
+            return apply_impl(input);
+        }
+        const std::size_t dest_idx =
+            fplus::find_first_idx(true, donated).unsafe_get_just();
+        return {fold_tensor5s_into(std::multiplies<float_type>(),
+            static_cast<float_type>(1), input, dest_idx)};
+    }
 };
 
 } } // namespace fdeep, namespace internal
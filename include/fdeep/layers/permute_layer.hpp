@@ -13,17 +13,18 @@
 namespace fdeep { namespace internal
 {
 
-class permute_layer : public layer
+template <typename float_type>
+class permute_layer : public layer<float_type>
 {
 public:
     explicit permute_layer(const std::string& name,
         const std::vector<std::size_t>& dims) :
-            layer(name), dims_(dims)
+            layer<float_type>(name), dims_(dims)
     {
         check_permute_tensor5_dims(dims);
     }
 protected:
-    tensor5s apply_impl(const tensor5s& inputs) const override
+    tensor5s<float_type> apply_impl(const tensor5s<float_type>& inputs) const override
     {
         assertion(inputs.size() == 1, "invalid number of input tensors");
         const auto& input = inputs.front();
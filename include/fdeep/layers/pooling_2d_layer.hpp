@@ -20,13 +20,14 @@ namespace fdeep { namespace internal
 {
 
 // Abstract base class for pooling layers
-class pooling_2d_layer : public layer
+template <typename float_type>
+class pooling_2d_layer : public layer<float_type>
 {
 public:
     explicit pooling_2d_layer(const std::string& name,
         const shape2& pool_size, const shape2& strides, bool channels_first, padding p,
         bool padding_valid_uses_offset, bool padding_same_uses_offset) :
-        layer(name),
+        layer<float_type>(name),
         pool_size_(pool_size),
         strides_(strides),
         channels_first_(channels_first),
@@ -36,7 +37,7 @@ public:
     {
     }
 protected:
-    tensor5s apply_impl(const tensor5s& inputs) const override final
+    tensor5s<float_type> apply_impl(const tensor5s<float_type>& inputs) const override final
     {
         assertion(inputs.size() == 1, "invalid number of input tensors");
         const auto& input = inputs.front();
@@ -50,7 +51,7 @@ protected:
             (padding_ == padding::same && padding_same_uses_offset_);
     }
 
-    virtual tensor5 pool(const tensor5& input) const = 0;
+    virtual tensor5<float_type> pool(const tensor5<float_type>& input) const = 0;
 
     shape2 pool_size_;
     shape2 strides_;
@@ -9,24 +9,56 @@
 #include "fdeep/layers/layer.hpp"
 
 #include <string>
+#include <vector>
 
 namespace fdeep { namespace internal
 {
 
-class prelu_layer : public layer
+template <typename float_type>
+class prelu_layer : public layer<float_type>
 {
 public:
-    explicit prelu_layer(const std::string& name, const float_vec& alpha,
+    explicit prelu_layer(const std::string& name, const float_vec<float_type>& alpha,
             std::vector<std::size_t> shared_axes)
-        : layer(name),
-        alpha_(fplus::make_shared_ref<float_vec>(alpha)),
+        : layer<float_type>(name),
+        alpha_(fplus::make_shared_ref<float_vec<float_type>>(alpha)),
         shared_axes_(shared_axes)
     {
     }
+    bool accepts_donated_inputs() const override
+    {
+        return true;
+    }
+    bool creates_new_buffers() const override
+    {
+        return true;
+    }
 protected:
-    fdeep::shared_float_vec alpha_;
+    shared_float_vec<float_type> alpha_;
     std::vector<std::size_t> shared_axes_;
-    tensor5s apply_impl(const tensor5s& input) const override
+    tensor5s<float_type> apply_impl(const tensor5s<float_type>& input) const override
+    {
+        tensor5<float_type> out(input[0].shape(), 1.0f);
+        apply_to(input[0], out);
+        return { out };
+    }
+    tensor5s<float_type> apply_donating_impl(const tensor5s<float_type>& input,
+        const std::vector<bool>& donated) const override
+    {
+        // Only the first 3D slice is written,
+        // so all others would need to be set to 1.
+        if (input[0].shape().size_dim_5_ != 1 ||
+            input[0].shape().size_dim_4_ != 1)
+        {
+            return apply_impl(input);
+        }
+        assertion(donated.front(), "input not donated");
+        tensor5<float_type> out = input[0];
+        apply_to(out, out);
+        return { out };
+    }
+    // out may share its memory with in.
+    void apply_to(const tensor5<float_type>& in, tensor5<float_type>& out) const
     {
         // We need to shift shared_axes if the original Keras tensor
         // was one or two dimensional.
@@ -38,8 +70,8 @@ protected:
         std::size_t shift = 0;
         for (std::size_t i = 0; i < shared_axes_.size(); ++i)
         {
-            if ((shared_axes_[i] == 1 && input[0].shape().height_ == 1) ||
-                (shared_axes_[i] == 2 && input[0].shape().width_ == 1))
+            if ((shared_axes_[i] == 1 && in.shape().height_ == 1) ||
+                (shared_axes_[i] == 2 && in.shape().width_ == 1))
             {
                 shift++;
             }
@@ -49,19 +81,18 @@ protected:
         const bool height_shared = fplus::is_elem_of(1, shared_axes_shifted);
         const bool width_shared = fplus::is_elem_of(2, shared_axes_shifted);
         const bool channels_shared = fplus::is_elem_of(3, shared_axes_shifted);
-        const size_t width = width_shared ? 1 : input[0].shape().width_;
-        const size_t depth = channels_shared ? 1 : input[0].shape().depth_;
+        const size_t width = width_shared ? 1 : in.shape().width_;
+        const size_t depth = channels_shared ? 1 : in.shape().depth_;
 
-        fdeep::tensor5 out(input[0].shape(), 1.0f);
         for (std::size_t y = 0; y < out.shape().height_; ++y)
         {
             for (std::size_t x = 0; x < out.shape().width_; ++x)
             {
                 for (std::size_t z = 0; z < out.shape().depth_; ++z)
                 {
-                    if (input[0].get(0, 0, y, x, z) > 0)
+                    if (in.get(0, 0, y, x, z) > 0)
                     {
-                        out.set(0, 0, y, x, z, input[0].get(0, 0, y, x, z));
+                        out.set(0, 0, y, x, z, in.get(0, 0, y, x, z));
                     }
                     else
                     {
@@ -73,12 +104,11 @@ protected:
                             x_temp * depth +
                             z_temp;
                         out.set(0, 0, y, x, z, (*alpha_)[pos] *
-                            input[0].get(0, 0, y, x, z));
+                            in.get(0, 0, y, x, z));
                     }
                 }
             }
         }
-        return { out };
     }
 };
 
@@ -14,21 +14,26 @@
 namespace fdeep { namespace internal
 {
 
-class relu_layer : public activation_layer
+template <typename float_type>
+class relu_layer : public elementwise_activation_layer<float_type>
 {
 public:
     explicit relu_layer(const std::string& name, const float_type max_value)
-        : activation_layer(name), max_value_(max_value)
+        : elementwise_activation_layer<float_type>(name), max_value_(max_value)
     {
     }
+    bool creates_new_buffers() const override
+    {
+        return true;
+    }
 protected:
-    tensor5 transform_input(const tensor5& in_vol) const override
+    void transform_input_in_place(tensor5<float_type>& in_vol) const override
     {
         auto activation_function = [&](float_type x) -> float_type
         {
             return std::min<float_type>(std::max<float_type>(x, 0), max_value_);
         };
-        return transform_tensor5(activation_function, in_vol);
+        transform_tensor5_in_place(activation_function, in_vol);
     }
     float_type max_value_;
 };
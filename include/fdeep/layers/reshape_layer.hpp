@@ -14,17 +14,18 @@
 namespace fdeep { namespace internal
 {
 
-class reshape_layer : public layer
+template <typename float_type>
+class reshape_layer : public layer<float_type>
 {
 public:
     explicit reshape_layer(const std::string& name,
         const std::vector<int>& target_shape)
-        : layer(name),
+        : layer<float_type>(name),
         target_shape_(target_shape)
     {
     }
 protected:
-    tensor5s apply_impl(const tensor5s& input) const override
+    tensor5s<float_type> apply_impl(const tensor5s<float_type>& input) const override
     {
         assertion(input.size() == 1,
             "reshape layer needs exactly one input tensor");
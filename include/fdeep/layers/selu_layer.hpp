@@ -15,21 +15,26 @@ namespace fdeep { namespace internal
 {
 
 // https://arxiv.org/pdf/1706.02515.pdf
-class selu_layer : public activation_layer
+template <typename float_type>
+class selu_layer : public elementwise_activation_layer<float_type>
 {
 public:
     explicit selu_layer(const std::string& name)
-        : activation_layer(name)
+        : elementwise_activation_layer<float_type>(name)
     {
     }
+    bool creates_new_buffers() const override
+    {
+        return true;
+    }
 protected:
     const float_type alpha_ =
         static_cast<float_type>(1.6732632423543772848170429916717);
     const float_type scale_ =
         static_cast<float_type>(1.0507009873554804934193349852946);
-    tensor5 transform_input(const tensor5& in_vol) const override
+    void transform_input_in_place(tensor5<float_type>& in_vol) const override
     {
-        return transform_tensor5(selu_activation, in_vol);
+        transform_tensor5_in_place(selu_activation<float_type>, in_vol);
     }
 };
 
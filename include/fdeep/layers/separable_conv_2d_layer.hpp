@@ -8,6 +8,7 @@
 
 #include "fdeep/convolution.hpp"
 #include "fdeep/filter.hpp"
+#include "fdeep/quantization.hpp"
 #include "fdeep/shape2.hpp"
 #include "fdeep/shape5.hpp"
 #include "fdeep/layers/layer.hpp"
@@ -22,7 +23,9 @@ namespace fdeep { namespace internal
 
 // Convolve depth slices separately first.
 // Then convolve normally with kernel_size = (1, 1)
-class separable_conv_2d_layer : public layer
+// Both steps run tile by tile, see separable_convolve.
+template <typename float_type>
+class separable_conv_2d_layer : public layer<float_type>
 {
 public:
     explicit separable_conv_2d_layer(
@@ -34,73 +37,98 @@ public:
             bool padding_valid_offset_depth_2,
             bool padding_same_offset_depth_2,
             const shape2& dilation_rate,
-            const float_vec& depthwise_weights,
-            const float_vec& pointwise_weights,
-            const float_vec& bias_0,
-            const float_vec& bias)
-        : layer(name),
-        filters_depthwise_(fplus::transform(generate_im2col_single_filter_matrix,
-            generate_filters(dilation_rate, filter_shape,
-                input_depth, depthwise_weights, bias_0))),
-        filters_pointwise_(generate_im2col_filter_matrix(
-            generate_filters(shape2(1, 1),
-                shape5(1, 1, 1, 1, input_depth), k, pointwise_weights, bias))),
+            const float_vec<float_type>& depthwise_weights,
+            const float_buffer<float_type>& pointwise_weights,
+            const float_vec<float_type>& bias_0,
+            const float_vec<float_type>& bias,
+            float_type input_max_abs = 0)
+        : layer<float_type>(name),
+        filters_depthwise_(generate_depthwise_filter_matrix(
+            generate_filters(filter_shape,
+                input_depth, depthwise_weights, bias_0), dilation_rate)),
+        filters_pointwise_(im2col_filter_matrix_from_weights(
+            shape5(1, 1, 1, 1, input_depth), shape2(1, 1), k, pointwise_weights, bias)),
         strides_(strides),
         padding_(p),
         padding_valid_offset_depth_1_(padding_valid_offset_depth_1),
         padding_same_offset_depth_1_(padding_same_offset_depth_1),
         padding_valid_offset_depth_2_(padding_valid_offset_depth_2),
-        padding_same_offset_depth_2_(padding_same_offset_depth_2)
+        padding_same_offset_depth_2_(padding_same_offset_depth_2),
+        input_max_abs_(input_max_abs),
+        quantized_(false),
+        quantized_filters_depthwise_(),
+        quantized_filters_pointwise_()
     {
         assertion(k > 0, "needs at least one filter");
         assertion(filter_shape.volume() > 0, "filter must have volume");
         assertion(strides.area() > 0, "invalid strides");
-        assertion(filters_depthwise_.size() == input_depth,
+        assertion(filters_depthwise_.bias_.size() == input_depth,
             "invalid number of filters");
     }
+    bool creates_new_buffers() const override
+    {
+        return true;
+    }
+    // The range of the intermediate values is not calibrated,
+    // so they are quantized based on their actual maximum.
+    bool quantize_int8() override
+    {
+        if (quantized_ || input_max_abs_ <= 0)
+        {
+            return false;
+        }
+        quantized_filters_depthwise_ =
+            quantize_depthwise_filters(filters_depthwise_);
+        quantized_filters_pointwise_ =
+            quantize_im2col_filter_matrix(filters_pointwise_);
+        // Only the quantized weights are used from now on.
+        filters_depthwise_ = depthwise_filter_matrix<float_type>();
+        filters_pointwise_.weights_ = float_buffer<float_type>();
+        quantized_ = true;
+        return true;
+    }
 protected:
-    tensor5s apply_impl(const tensor5s& inputs) const override
+    bool use_offset(const shape5& input_shape) const
     {
-        assertion(inputs.size() == 1, "only one input tensor allowed");
-
-        const auto input_slices = tensor5_to_depth_slices(inputs.front());
-
-        assertion(input_slices.size() == filters_depthwise_.size(),
-            "invalid input depth");
-
-        const bool use_offset = input_slices.size() == 1 ?
+        return input_shape.depth_ == 1 ?
             ((padding_ == padding::valid && padding_valid_offset_depth_1_) ||
             (padding_ == padding::same && padding_same_offset_depth_1_)) :
             ((padding_ == padding::valid && padding_valid_offset_depth_2_) ||
             (padding_ == padding::same && padding_same_offset_depth_2_));
+    }
+    tensor5s<float_type> apply_impl(const tensor5s<float_type>& inputs) const override
+    {
+        assertion(inputs.size() == 1, "only one input tensor allowed");
 
-        const auto convolve_slice =
-            [&](const tensor5& slice, const im2col_filter_matrix& f) -> tensor5
+        if (quantized_)
         {
-            assertion(f.filter_shape_.depth_ == 1, "invalid filter depth");
-            const auto result = convolve(strides_, padding_,
-                use_offset, f, slice);
-            assertion(result.shape().depth_ == 1, "invalid conv output");
-            return result;
-        };
-
-        assertion(input_slices.size() == filters_depthwise_.size(),
-            "invalid depthwise filter count");
-        const auto temp = concatenate_tensor5s_depth(fplus::zip_with(
-            convolve_slice, input_slices, filters_depthwise_));
+            const auto temp_int8 = depthwise_convolve_int8(strides_, padding_,
+                use_offset(inputs.front().shape()),
+                quantized_filters_depthwise_, int8_scale(input_max_abs_),
+                inputs.front());
+            return {convolve_int8(shape2(1, 1), padding::valid, false,
+                filters_pointwise_.filter_shape_,
+                filters_pointwise_.dilation_rate_, quantized_filters_pointwise_,
+                int8_scale(max_abs_value(temp_int8)), temp_int8)};
+        }
 
-        return {convolve(shape2(1, 1), padding::valid, false,
-            filters_pointwise_, temp)};
+        return {separable_convolve(strides_, padding_,
+            use_offset(inputs.front().shape()),
+            filters_depthwise_, filters_pointwise_, inputs.front())};
     }
 
-    std::vector<im2col_filter_matrix> filters_depthwise_;
-    im2col_filter_matrix filters_pointwise_;
+    depthwise_filter_matrix<float_type> filters_depthwise_;
+    im2col_filter_matrix<float_type> filters_pointwise_;
     shape2 strides_;
     padding padding_;
     bool padding_valid_offset_depth_1_;
     bool padding_same_offset_depth_1_;
     bool padding_valid_offset_depth_2_;
     bool padding_same_offset_depth_2_;
+    float_type input_max_abs_;
+    bool quantized_;
+    int8_depthwise_filters<float_type> quantized_filters_depthwise_;
+    int8_weight_matrix<float_type> quantized_filters_pointwise_;
 };
 
 } } // namespace fdeep, namespace internal
@@ -15,17 +15,22 @@
 namespace fdeep { namespace internal
 {
 
-class sigmoid_layer : public activation_layer
+template <typename float_type>
+class sigmoid_layer : public elementwise_activation_layer<float_type>
 {
 public:
     explicit sigmoid_layer(const std::string& name)
-        : activation_layer(name)
+        : elementwise_activation_layer<float_type>(name)
     {
     }
+    bool creates_new_buffers() const override
+    {
+        return true;
+    }
 protected:
-    tensor5 transform_input(const tensor5& in_vol) const override
+    void transform_input_in_place(tensor5<float_type>& in_vol) const override
     {
-        return transform_tensor5(sigmoid_activation, in_vol);
+        transform_tensor5_in_place(sigmoid_activation<float_type>, in_vol);
     }
 };
 
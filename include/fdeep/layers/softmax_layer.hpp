@@ -13,15 +13,20 @@
 namespace fdeep { namespace internal
 {
 
-class softmax_layer : public activation_layer
+template <typename float_type>
+class softmax_layer : public activation_layer<float_type>
 {
 public:
     explicit softmax_layer(const std::string& name)
-        : activation_layer(name)
+        : activation_layer<float_type>(name)
     {
     }
+    bool creates_new_buffers() const override
+    {
+        return true;
+    }
 protected:
-    tensor5 transform_input(const tensor5& input) const override
+    tensor5<float_type> transform_input(const tensor5<float_type>& input) const override
     {
         // Get unnormalized values of exponent function.
         const auto ex = [](float_type x) -> float_type
@@ -29,7 +34,7 @@ protected:
             return std::exp(x);
         };
         const float_type m = input.get(tensor5_max_pos(input));
-        const auto inp_shifted = subtract_tensor5(input, tensor5(input.shape(), m));
+        const auto inp_shifted = subtract_tensor5(input, tensor5<float_type>(input.shape(), m));
         auto output = transform_tensor5(ex, inp_shifted);
 
         // Softmax function is applied along channel dimension.
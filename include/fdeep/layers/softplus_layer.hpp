@@ -14,15 +14,20 @@
 namespace fdeep { namespace internal
 {
 
-class softplus_layer : public activation_layer
+template <typename float_type>
+class softplus_layer : public elementwise_activation_layer<float_type>
 {
 public:
     explicit softplus_layer(const std::string& name)
-        : activation_layer(name)
+        : elementwise_activation_layer<float_type>(name)
     {
     }
+    bool creates_new_buffers() const override
+    {
+        return true;
+    }
 protected:
-    tensor5 transform_input(const tensor5& in_vol) const override
+    void transform_input_in_place(tensor5<float_type>& in_vol) const override
     {
         auto activation_function = [](float_type x) -> float_type
         {
@@ -36,7 +41,7 @@ protected:
             else
                 return std::log1p(std::exp(x));
         };
-        return transform_tensor5(activation_function, in_vol);
+        transform_tensor5_in_place(activation_function, in_vol);
     }
 };
 
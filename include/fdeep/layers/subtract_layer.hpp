@@ -13,15 +13,16 @@
 namespace fdeep { namespace internal
 {
 
-class subtract_layer : public layer
+template <typename float_type>
+class subtract_layer : public layer<float_type>
 {
 public:
     explicit subtract_layer(const std::string& name)
-        : layer(name)
+        : layer<float_type>(name)
     {
     }
 protected:
-    tensor5s apply_impl(const tensor5s& input) const override
+    tensor5s<float_type> apply_impl(const tensor5s<float_type>& input) const override
     {
         assertion(input.size() == 2,
             "subtract layer needs exactly two input tensors");
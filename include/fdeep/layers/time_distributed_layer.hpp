@@ -20,14 +20,15 @@ namespace fdeep
 namespace internal
 {
 
-class time_distributed_layer : public layer
+template <typename float_type>
+class time_distributed_layer : public layer<float_type>
 {
 public:
     explicit time_distributed_layer(const std::string& name,
-                                    const layer_ptr& inner_layer,
+                                    const layer_ptr<float_type>& inner_layer,
                                     const std::size_t td_input_len,
                                     const std::size_t td_output_len)
-        : layer(name),
+        : layer<float_type>(name),
           inner_layer_(inner_layer),
           td_input_len_(td_input_len),
           td_output_len_(td_output_len)
@@ -36,12 +37,12 @@ public:
     }
 
 protected:
-    tensor5s apply_impl(const tensor5s& inputs) const override final
+    tensor5s<float_type> apply_impl(const tensor5s<float_type>& inputs) const override final
     {
-        const tensor5 input = inputs.front();
-        tensor5s result_time_step = {};
+        const tensor5<float_type> input = inputs.front();
+        tensor5s<float_type> result_time_step = {};
         std::size_t len_series = 0;
-        tensor5s slices = {};
+        tensor5s<float_type> slices = {};
         std::int32_t concat_axis;
 
         if (td_input_len_ == 2)
@@ -104,7 +105,7 @@ protected:
         return {};
     }
 
-    const layer_ptr inner_layer_;
+    const layer_ptr<float_type> inner_layer_;
     const std::size_t td_input_len_;
     const std::size_t td_output_len_;
 };
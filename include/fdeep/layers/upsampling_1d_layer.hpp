@@ -18,17 +18,18 @@
 namespace fdeep { namespace internal
 {
 
-class upsampling_1d_layer : public layer
+template <typename float_type>
+class upsampling_1d_layer : public layer<float_type>
 {
 public:
     explicit upsampling_1d_layer(const std::string& name,
         const std::size_t size) :
-    layer(name),
+    layer<float_type>(name),
     size_(size)
     {
     }
 protected:
-    tensor5s apply_impl(const tensor5s& inputs) const override final
+    tensor5s<float_type> apply_impl(const tensor5s<float_type>& inputs) const override final
     {
         assertion(inputs.size() == 1, "invalid number of inputs tensors");
         const auto& input = inputs.front();
@@ -48,9 +49,9 @@ protected:
         }
     }
 
-    tensor5 upsampling_1d_rank_1(const tensor5& input) const
+    tensor5<float_type> upsampling_1d_rank_1(const tensor5<float_type>& input) const
     {
-        tensor5 out_vol(shape5(1, 1,
+        tensor5<float_type> out_vol(shape5(1, 1,
             input.shape().height_,
             input.shape().width_,
             input.shape().depth_ * size_), 0);
@@ -68,9 +69,9 @@ protected:
         return {out_vol};
     }
 
-    tensor5 upsampling_1d_rank_2(const tensor5& input) const
+    tensor5<float_type> upsampling_1d_rank_2(const tensor5<float_type>& input) const
     {
-        tensor5 out_vol(shape5(1, 1,
+        tensor5<float_type> out_vol(shape5(1, 1,
             input.shape().height_,
             input.shape().width_ * size_,
             input.shape().depth_), 0);
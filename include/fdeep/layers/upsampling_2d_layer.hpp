@@ -18,12 +18,13 @@
 namespace fdeep { namespace internal
 {
 
-class upsampling_2d_layer : public layer
+template <typename float_type>
+class upsampling_2d_layer : public layer<float_type>
 {
 public:
     explicit upsampling_2d_layer(const std::string& name,
         const shape2& scale_factor, const std::string& interpolation) :
-    layer(name),
+    layer<float_type>(name),
     scale_factor_(scale_factor),
     interpolation_(interpolation)
     {
@@ -32,7 +33,7 @@ public:
         );
     }
 protected:
-    tensor5s apply_impl(const tensor5s& inputs) const override final
+    tensor5s<float_type> apply_impl(const tensor5s<float_type>& inputs) const override final
     {
         assertion(inputs.size() == 1, "invalid number of inputs tensors");
         const auto& input = inputs.front();
@@ -52,9 +53,9 @@ protected:
     }
     shape2 scale_factor_;
     std::string interpolation_;
-    tensor5 upsampling2d_nearest(const tensor5& in_vol) const
+    tensor5<float_type> upsampling2d_nearest(const tensor5<float_type>& in_vol) const
     {
-        tensor5 out_vol(shape5(1, 1,
+        tensor5<float_type> out_vol(shape5(1, 1,
             in_vol.shape().height_ * scale_factor_.height_,
             in_vol.shape().width_ * scale_factor_.width_,
             in_vol.shape().depth_), 0);
@@ -72,7 +73,7 @@ protected:
         }
         return out_vol;
     }
-    float_type get_interpolated_bilinearly(const tensor5& t,
+    float_type get_interpolated_bilinearly(const tensor5<float_type>& t,
         std::size_t pos_dim_5, std::size_t pos_dim_4,
         float_type y, float_type x, std::size_t z) const
     {
@@ -94,9 +95,9 @@ protected:
             y_factor_bottom * x_factor_left * val_bottom_left +
             y_factor_bottom * x_factor_right * val_bottom_right);
     }
-    tensor5 upsampling2d_bilinear(const tensor5& in_vol) const
+    tensor5<float_type> upsampling2d_bilinear(const tensor5<float_type>& in_vol) const
     {
-        tensor5 out_vol(shape5(1, 1,
+        tensor5<float_type> out_vol(shape5(1, 1,
             in_vol.shape().height_ * scale_factor_.height_,
             in_vol.shape().width_ * scale_factor_.width_,
             in_vol.shape().depth_), 0);
@@ -13,7 +13,8 @@
 namespace fdeep { namespace internal
 {
 
-class zero_padding_2d_layer : public layer
+template <typename float_type>
+class zero_padding_2d_layer : public layer<float_type>
 {
 public:
     explicit zero_padding_2d_layer(const std::string& name,
@@ -21,7 +22,7 @@ public:
         std::size_t bottom_pad,
         std::size_t left_pad,
         std::size_t right_pad) :
-            layer(name),
+            layer<float_type>(name),
             top_pad_(top_pad),
             bottom_pad_(bottom_pad),
             left_pad_(left_pad),
@@ -29,7 +30,7 @@ public:
     {
     }
 protected:
-    tensor5s apply_impl(const tensor5s& inputs) const override
+    tensor5s<float_type> apply_impl(const tensor5s<float_type>& inputs) const override
     {
         assertion(inputs.size() == 1, "invalid number of input tensors");
         const auto& input = inputs.front();
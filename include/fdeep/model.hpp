@@ -7,24 +7,102 @@
 #pragma once
 
 #include "fdeep/import_model.hpp"
+#include "fdeep/graph_optimizer.hpp"
 #include "fdeep/common.hpp"
 #include "fdeep/layers/layer.hpp"
+#include "fdeep/layers/model_layer.hpp"
 #include "fdeep/tensor5.hpp"
+#include "fdeep/thread_pool.hpp"
 
 #include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <limits>
+#include <random>
+#include <memory>
+#include <sstream>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace fdeep
 {
 
-class model
+template <typename float_type>
+class basic_model;
+
+namespace internal
+{
+
+// Logs the steps of loading a model together with their durations.
+class load_logger
+{
+public:
+    explicit load_logger(const std::function<void(std::string)>& logger) :
+        logger_(logger), stopwatch_()
+    {
+    }
+    void log(const std::string& msg)
+    {
+        if (logger_)
+        {
+            logger_(msg + "\n");
+        }
+    }
+    void log_sol(const std::string& msg)
+    {
+        stopwatch_.reset();
+        if (logger_)
+        {
+            logger_(msg + " ... ");
+        }
+    }
+    void log_duration()
+    {
+        if (logger_)
+        {
+            logger_("done. elapsed time: " +
+                fplus::show_float(0, 6, stopwatch_.elapsed()) + " s\n");
+        }
+        stopwatch_.reset();
+    }
+private:
+    std::function<void(std::string)> logger_;
+    fplus::stopwatch stopwatch_;
+};
+
+// How the test cases embedded in a model are run when loading it.
+enum class verification_mode { none, blocking, background };
+
+template <typename float_type>
+basic_model<float_type> construct_model(nlohmann::json& json_data,
+    const weight_blob_reader* blob_reader, thread_pool* pool,
+    load_logger& logger,
+    verification_mode verification, float_type verify_epsilon,
+    const layer_creators<float_type>& custom_layer_creators,
+    const graph_passes<float_type>& custom_graph_passes);
+
+} // namespace internal
+
+using test_output_error = internal::test_output_error<float_type>;
+using test_report = internal::test_report<float_type>;
+
+// A model computing with values of type float_type.
+// Models with different precisions can be used side by side,
+// e.g., fdeep::load_model<double>(...) along with fdeep::load_model(...),
+// which uses the default precision (see fdeep::float_type).
+template <typename float_type>
+class basic_model
 {
 public:
     // A single forward pass (no batches).
     // Will raise an exception when used with a stateful model.
     // For those, use predict_stateful instead.
-    tensor5s predict(const tensor5s& inputs) const
+    basic_tensor5s<float_type> predict(const basic_tensor5s<float_type>& inputs) const
     {
         internal::assertion(!is_stateful(),
             "Prediction on stateful models is not const. Use predict_stateful instead.");
@@ -32,7 +110,7 @@ public:
     }
 
     // A single forward pass, supporting stateful models.
-    tensor5s predict_stateful(const tensor5s& inputs)
+    basic_tensor5s<float_type> predict_stateful(const basic_tensor5s<float_type>& inputs)
     {
         return predict_impl(inputs);
     }
@@ -40,12 +118,14 @@ public:
     // Forward pass multiple data.
     // When parallelly == true, the work is distributed to up to
     // as many CPUs as data entries are provided.
-    std::vector<tensor5s> predict_multi(const std::vector<tensor5s>& inputs_vec,
+    basic_tensor5s_vec<float_type> predict_multi(
+        const basic_tensor5s_vec<float_type>& inputs_vec,
         bool parallelly) const
     {
         internal::assertion(!is_stateful(),
             "Prediction on stateful models is not thread-safe.");
-        const auto f = [this](const tensor5s& inputs) -> tensor5s
+        const auto f = [this](const basic_tensor5s<float_type>& inputs)
+            -> basic_tensor5s<float_type>
         {
             return predict(inputs);
         };
@@ -59,18 +139,44 @@ public:
         }
     }
 
+    // Forward pass of multiple data as one batch.
+    // In contrast to predict_multi, layers like convolutions and dense
+    // process all samples with one matrix multiplication,
+    // so their weights only need to be read once for the whole batch.
+    basic_tensor5s_vec<float_type> predict_batch(
+        const basic_tensor5s_vec<float_type>& inputs_vec) const
+    {
+        internal::assertion(!is_stateful(),
+            "Batch prediction on stateful models is not supported.");
+        for (const auto& inputs : inputs_vec)
+        {
+            check_input_shapes(inputs);
+        }
+        if (inputs_vec.empty())
+        {
+            return {};
+        }
+        const internal::thread_pool_scope pool_scope(thread_pool_.get());
+        const auto outputs_vec = model_layer_->apply_batch(inputs_vec);
+        for (const auto& outputs : outputs_vec)
+        {
+            check_output_shapes(outputs);
+        }
+        return outputs_vec;
+    }
+
     // Convenience wrapper around predict for models with
     // single tensor outputs of shape (1, 1, z).
     // Suitable for classification models with more than one output neuron.
     // Returns the index of the output neuron with the maximum activation.
-    std::size_t predict_class(const tensor5s& inputs) const
+    std::size_t predict_class(const basic_tensor5s<float_type>& inputs) const
     {
         internal::assertion(!is_stateful(),
             "Prediction on stateful models is not const. Use predict_class_stateful instead.");
         return predict_class_with_confidence_impl(inputs).first;
     }
 
-    std::size_t predict_class_stateful(const tensor5s& inputs)
+    std::size_t predict_class_stateful(const basic_tensor5s<float_type>& inputs)
     {
         return predict_class_with_confidence_impl(inputs).first;
     }
@@ -78,7 +184,7 @@ public:
     // Like predict_class,
     // but also returns the value of the maximally activated output neuron.
     std::pair<std::size_t, float_type>
-    predict_class_with_confidence(const tensor5s& inputs) const
+    predict_class_with_confidence(const basic_tensor5s<float_type>& inputs) const
     {
         internal::assertion(!is_stateful(),
             "Prediction on stateful models is not const. Use predict_class_with_confidence_stateful instead.");
@@ -86,7 +192,7 @@ public:
     }
 
     std::pair<std::size_t, float_type>
-    predict_class_with_confidence_stateful(const tensor5s& inputs)
+    predict_class_with_confidence_stateful(const basic_tensor5s<float_type>& inputs)
     {
         return predict_class_with_confidence_impl(inputs);
     }
@@ -95,14 +201,14 @@ public:
     // single tensor outputs of shape (1, 1, 1),
     // typically used for regression or binary classification.
     // Returns this one activation value.
-    float_type predict_single_output(const tensor5s& inputs) const
+    float_type predict_single_output(const basic_tensor5s<float_type>& inputs) const
     {
         internal::assertion(!is_stateful(),
             "Prediction on stateful models is not const. Use predict_single_output_stateful instead.");
         return predict_single_output_impl(inputs);
     }
 
-    float_type predict_single_output_stateful(const tensor5s& inputs)
+    float_type predict_single_output_stateful(const basic_tensor5s<float_type>& inputs)
     {
         return predict_single_output_impl(inputs);
     }
@@ -126,11 +232,11 @@ public:
     }
 
     // Returns zero-filled tensors with the models input shapes.
-    tensor5s generate_dummy_inputs() const
+    basic_tensor5s<float_type> generate_dummy_inputs() const
     {
-        return fplus::transform([](const shape5& shape) -> tensor5
+        return fplus::transform([](const shape5& shape) -> basic_tensor5<float_type>
         {
-            return tensor5(shape, 0);
+            return basic_tensor5<float_type>(shape, 0);
         }, get_dummy_input_shapes());
     }
 
@@ -143,6 +249,37 @@ public:
         return stopwatch.elapsed();
     }
 
+    // Measure the memory held by intermediate tensors
+    // during one forward pass using dummy input data.
+    // peak_bytes_ is what is actually needed, because tensors are released
+    // after their last use, total_bytes_ is what keeping all of them
+    // until the end of the forward pass would cost.
+    activation_memory_stats test_activation_memory() const
+    {
+        const auto model_layer_ptr =
+            std::dynamic_pointer_cast<internal::model_layer<float_type>>(model_layer_);
+        internal::assertion(model_layer_ptr != nullptr, "invalid model layer");
+        return model_layer_ptr->activation_memory(generate_dummy_inputs());
+    }
+
+    // Use up to thread_count threads (including the calling one)
+    // for every single forward pass.
+    // Layers not depending on each other's output are then run concurrently.
+    // A value of 1 (the default) disables parallel processing.
+    // Stateful models always run sequentially.
+    void set_thread_count(std::size_t thread_count)
+    {
+        internal::assertion(thread_count > 0, "invalid thread count");
+        thread_pool_ = thread_count > 1
+            ? std::make_shared<internal::thread_pool>(thread_count)
+            : internal::thread_pool_ptr();
+    }
+
+    std::size_t thread_count() const
+    {
+        return thread_pool_ ? thread_pool_->thread_count() : 1;
+    }
+
     const std::string& name() const
     {
         return model_layer_->name_;
@@ -163,48 +300,74 @@ public:
         return model_layer_->is_stateful();
     }
 
+    // Result of running the test cases embedded in the model file,
+    // i.e., the maximum absolute and relative error of every output
+    // of every test case.
+    // If the model was loaded with load_model_verify_async,
+    // it becomes ready when the tests are done, and get() throws
+    // if one of them failed. Otherwise it is ready right away,
+    // and empty if the tests were not run.
+    std::shared_future<internal::test_report<float_type>> verification() const
+    {
+        return verification_;
+    }
+
 private:
-    model(const internal::layer_ptr& model_layer,
+    basic_model(const internal::layer_ptr<float_type>& model_layer,
         const std::vector<shape5_variable>& input_shapes,
         const std::vector<shape5_variable>& output_shapes,
         const std::string& hash) :
             input_shapes_(input_shapes),
             output_shapes_(output_shapes),
             model_layer_(model_layer),
-            hash_(hash) {}
+            hash_(hash),
+            thread_pool_(),
+            verification_(internal::make_ready_test_report(
+                internal::test_report<float_type>())) {}
 
-    friend model read_model(std::istream&, bool,
-        const std::function<void(std::string)>&, float_type,
-        const internal::layer_creators&);
+    friend basic_model internal::construct_model<float_type>(nlohmann::json&,
+        const internal::weight_blob_reader*, internal::thread_pool*,
+        internal::load_logger&,
+        internal::verification_mode, float_type,
+        const internal::layer_creators<float_type>&,
+        const internal::graph_passes<float_type>&);
 
-    tensor5s predict_impl(const tensor5s& inputs) const {
+    void check_input_shapes(const basic_tensor5s<float_type>& inputs) const
+    {
         const auto input_shapes = fplus::transform(
-            fplus_c_mem_fn_t(tensor5, shape, shape5),
+            fplus_c_mem_fn_t(basic_tensor5<float_type>, shape, shape5),
             inputs);
         internal::assertion(input_shapes
             == get_input_shapes(),
             std::string("Invalid inputs shape.\n") +
                 "The model takes " + show_shape5s_variable(get_input_shapes()) +
                 " but provided was: " + show_shape5s(input_shapes));
+    }
 
-        const auto outputs = model_layer_->apply(inputs);
-
+    void check_output_shapes(const basic_tensor5s<float_type>& outputs) const
+    {
         const auto output_shapes = fplus::transform(
-            fplus_c_mem_fn_t(tensor5, shape, shape5),
+            fplus_c_mem_fn_t(basic_tensor5<float_type>, shape, shape5),
             outputs);
         internal::assertion(output_shapes
             == get_output_shapes(),
             std::string("Invalid outputs shape.\n") +
                 "The model should return " + show_shape5s_variable(get_output_shapes()) +
                 " but actually returned: " + show_shape5s(output_shapes));
+    }
 
+    basic_tensor5s<float_type> predict_impl(const basic_tensor5s<float_type>& inputs) const {
+        check_input_shapes(inputs);
+        const internal::thread_pool_scope pool_scope(thread_pool_.get());
+        const auto outputs = model_layer_->apply(inputs);
+        check_output_shapes(outputs);
         return outputs;
     }
 
     std::pair<std::size_t, float_type>
-    predict_class_with_confidence_impl(const tensor5s& inputs) const
+    predict_class_with_confidence_impl(const basic_tensor5s<float_type>& inputs) const
     {
-        const tensor5s outputs = predict(inputs);
+        const basic_tensor5s<float_type> outputs = predict(inputs);
         internal::assertion(outputs.size() == 1,
             "invalid number of outputs");
         const auto output_shape = outputs.front().shape();
@@ -214,9 +377,9 @@ private:
         return std::make_pair(pos.z_, outputs.front().get(pos));
     }
 
-    float_type predict_single_output_impl(const tensor5s& inputs) const
+    float_type predict_single_output_impl(const basic_tensor5s<float_type>& inputs) const
     {
-        const tensor5s outputs = predict(inputs);
+        const basic_tensor5s<float_type> outputs = predict(inputs);
         internal::assertion(outputs.size() == 1,
             "invalid number of outputs");
         const auto output_shape = outputs.front().shape();
@@ -227,139 +390,641 @@ private:
 
     std::vector<shape5_variable> input_shapes_;
     std::vector<shape5_variable> output_shapes_;
-    internal::layer_ptr model_layer_;
+    internal::layer_ptr<float_type> model_layer_;
     std::string hash_;
+    internal::thread_pool_ptr thread_pool_;
+    std::shared_future<internal::test_report<float_type>> verification_;
 };
 
-// Write an std::string to std::cout.
-inline void cout_logger(const std::string& str)
+// A model using the default precision.
+typedef basic_model<float_type> model;
+
+namespace internal
 {
-    std::cout << str << std::flush;
-}
 
-// Load and construct an fdeep::model from an istream
-// providing the exported json content.
-// Throws an exception if a problem occurs.
-inline model read_model(std::istream& model_file_stream,
-    bool verify = true,
-    const std::function<void(std::string)>& logger = cout_logger,
-    float_type verify_epsilon = static_cast<float_type>(0.0001),
-    const internal::layer_creators& custom_layer_creators = internal::layer_creators())
+// Runs the test cases on the model and compares the outputs with their
+// targets. The ones of stateless models run in parallel on the pool
+// (if not null). Throws if one of them fails.
+template <typename float_type>
+test_report<float_type> run_test_cases(basic_model<float_type>& m,
+    const test_cases<float_type>& tests,
+    float_type epsilon, thread_pool* pool, load_logger& logger)
 {
-    const auto log = [&logger](const std::string& msg)
+    logger.log_sol("Running " + fplus::show(tests.size()) + " tests");
+    tensor5s_vec<float_type> outputs(tests.size());
+    if (m.is_stateful())
     {
-        if (logger)
+        for (std::size_t i = 0; i < tests.size(); ++i)
         {
-            logger(msg + "\n");
+            outputs[i] = m.predict_stateful(tests[i].input_);
         }
-    };
-
-    fplus::stopwatch stopwatch;
-
-    const auto log_sol = [&stopwatch, &logger](const std::string& msg)
+    }
+    else
     {
-        stopwatch.reset();
-        if (logger)
+        const auto run_test = [&](std::size_t i)
         {
-            logger(msg + " ... ");
+            outputs[i] = m.predict(tests[i].input_);
+        };
+        if (pool != nullptr)
+        {
+            pool->parallel_for(tests.size(), run_test);
         }
-    };
-
-    const auto log_duration = [&stopwatch, &logger]()
-    {
-        if (logger)
+        else
         {
-            logger("done. elapsed time: " +
-                fplus::show_float(0, 6, stopwatch.elapsed()) + " s\n");
+            for (std::size_t i = 0; i < tests.size(); ++i)
+            {
+                run_test(i);
+            }
         }
-        stopwatch.reset();
-    };
+    }
+    logger.log_duration();
+    test_report<float_type> report;
+    for (std::size_t i = 0; i < tests.size(); ++i)
+    {
+        report.push_back(
+            check_test_outputs(epsilon, outputs[i], tests[i].output_));
+        logger.log("Test " + fplus::show(i + 1) + " of " +
+            fplus::show(tests.size()) + " passed, " +
+            "max. abs./rel. error per output: " +
+            show_test_output_errors(report.back()));
+    }
+    return report;
+}
 
-    log_sol("Loading json");
-    nlohmann::json json_data;
-    model_file_stream >> json_data;
-    log_duration();
+// Builds the model from its loaded json data,
+// with blob references resolved by blob_reader (if not null).
+// The layers are created using the pool (if not null).
+// Stateful models are always verified blocking.
+// Background verification calls the logger from another thread.
+template <typename float_type>
+basic_model<float_type> construct_model(nlohmann::json& json_data,
+    const weight_blob_reader* blob_reader, thread_pool* pool,
+    load_logger& logger,
+    verification_mode verification, float_type verify_epsilon,
+    const layer_creators<float_type>& custom_layer_creators,
+    const graph_passes<float_type>& custom_graph_passes)
+{
+    const weight_blob_reader_scope blob_reader_scope(blob_reader);
 
     const std::string image_data_format = json_data["image_data_format"];
-    internal::assertion(image_data_format == "channels_last",
+    assertion(image_data_format == "channels_last",
         "only channels_last data format supported");
 
+    // Layers may be created concurrently, so json_data is only read.
     const std::function<nlohmann::json(
             const std::string&, const std::string&)>
         get_param = [&json_data]
         (const std::string& layer_name, const std::string& param_name)
         -> nlohmann::json
     {
-        return json_data["trainable_params"][layer_name][param_name];
+        return json_member_or_null(json_member_or_null(json_member_or_null(
+            json_data, "trainable_params"), layer_name), param_name);
     };
 
     const std::function<nlohmann::json(const std::string&)>
         get_global_param =
             [&json_data](const std::string& param_name) -> nlohmann::json
     {
-        return json_data[param_name];
+        return json_member_or_null(json_data, param_name);
     };
 
-    model full_model(internal::create_model_layer(
-        get_param, get_global_param, json_data["architecture"],
-        json_data["architecture"]["config"]["name"],
-        custom_layer_creators),
-        internal::create_shape5s_variable(json_data["input_shapes"]),
-        internal::create_shape5s_variable(json_data["output_shapes"]),
-        internal::json_object_get<std::string, std::string>(
+    const auto root_layer = [&]() -> layer_ptr<float_type>
+    {
+        const thread_pool_scope pool_scope(pool);
+        return create_model_layer(
+            get_param, get_global_param, json_data["architecture"],
+            json_data["architecture"]["config"]["name"],
+            custom_layer_creators);
+    }();
+
+    optimize_graph(root_layer, fplus::map_union(
+        custom_graph_passes, default_graph_passes<float_type>()));
+
+    basic_model<float_type> full_model(root_layer,
+        create_shape5s_variable(json_data["input_shapes"]),
+        create_shape5s_variable(json_data["output_shapes"]),
+        json_object_get<std::string, std::string>(
             json_data, "hash", ""));
 
-    if (verify)
+    if (verification != verification_mode::none)
     {
         if (!json_data["tests"].is_array())
         {
-            log("No test cases available");
+            logger.log("No test cases available");
         }
         else
         {
-            const auto tests = internal::load_test_cases(json_data["tests"]);
+            auto tests = load_test_cases<float_type>(json_data["tests"]);
             json_data = {}; // free RAM
-            for (std::size_t i = 0; i < tests.size(); ++i)
+            if (verification == verification_mode::background &&
+                !full_model.is_stateful())
             {
-                log_sol("Running test " + fplus::show(i + 1) +
-                    " of " + fplus::show(tests.size()));
-                const auto output = full_model.predict_impl(tests[i].input_);
-                log_duration();
-                check_test_outputs(verify_epsilon, output, tests[i].output_);
+                full_model.verification_ = std::async(std::launch::async,
+                    [full_model, tests, verify_epsilon, logger]() mutable
+                {
+                    const auto test_pool = make_hardware_thread_pool();
+                    return run_test_cases(full_model, tests, verify_epsilon,
+                        test_pool.get(), logger);
+                }).share();
+            }
+            else
+            {
+                full_model.verification_ = make_ready_test_report(
+                    run_test_cases(full_model, tests, verify_epsilon, pool,
+                        logger));
+                full_model.reset_states();
             }
         }
-        full_model.reset_states();
     }
 
     return full_model;
 }
 
-inline model read_model_from_string(const std::string& content,
+} // namespace internal
+
+// Write an std::string to std::cout.
+inline void cout_logger(const std::string& str)
+{
+    std::cout << str << std::flush;
+}
+
+namespace internal
+{
+
+template <typename float_type>
+basic_model<float_type> read_model_with_verification(
+    std::istream& model_file_stream,
+    verification_mode verification,
+    const std::function<void(std::string)>& logger,
+    float_type verify_epsilon,
+    const layer_creators<float_type>& custom_layer_creators,
+    const graph_passes<float_type>& custom_graph_passes)
+{
+    load_logger load_log(logger);
+    const auto load_pool = make_hardware_thread_pool();
+    nlohmann::json json_data;
+    std::unique_ptr<weight_blob_reader> blob_reader;
+    if (is_binary_model(model_file_stream))
+    {
+        load_log.log_sol("Loading binary model header");
+        blob_reader = std::make_unique<weight_blob_reader>(model_file_stream);
+        json_data = blob_reader->header();
+    }
+    else
+    {
+        load_log.log_sol("Loading json");
+        std::vector<decoded_array> decoded_arrays;
+        json_data = parse_json_model(model_file_stream,
+            verification != verification_mode::none,
+            load_pool.get(), decoded_arrays);
+        blob_reader = std::make_unique<weight_blob_reader>(
+            std::move(decoded_arrays));
+    }
+    load_log.log_duration();
+    return construct_model(json_data, blob_reader.get(),
+        load_pool.get(), load_log, verification, verify_epsilon,
+        custom_layer_creators, custom_graph_passes);
+}
+
+} // namespace internal
+
+// Load and construct an fdeep::model from an istream
+// providing the exported json or binary content.
+// Binary models are read lazily from the (seekable) stream.
+// JSON models are parsed in one pass,
+// decoding the weights on the fly.
+// Decoding the weights, creating the layers and running the tests
+// uses all hardware threads.
+// If custom_layer_creators are given, the layers are created sequentially,
+// so the creators do not need to be thread-safe.
+// The test cases are skipped if verify is false.
+// Throws an exception if a problem occurs.
+template <typename float_type = fdeep::float_type>
+basic_model<float_type> read_model(std::istream& model_file_stream,
     bool verify = true,
     const std::function<void(std::string)>& logger = cout_logger,
-    float_type verify_epsilon = static_cast<float_type>(0.0001),
-    const internal::layer_creators& custom_layer_creators =
-        internal::layer_creators())
+    typename internal::non_deduced<float_type>::type verify_epsilon =
+        static_cast<float_type>(0.0001),
+    const internal::layer_creators<float_type>& custom_layer_creators =
+        internal::layer_creators<float_type>(),
+    const internal::graph_passes<float_type>& custom_graph_passes =
+        internal::graph_passes<float_type>())
+{
+    return internal::read_model_with_verification(model_file_stream,
+        verify ? internal::verification_mode::blocking
+            : internal::verification_mode::none,
+        logger, verify_epsilon, custom_layer_creators, custom_graph_passes);
+}
+
+template <typename float_type = fdeep::float_type>
+basic_model<float_type> read_model_from_string(const std::string& content,
+    bool verify = true,
+    const std::function<void(std::string)>& logger = cout_logger,
+    typename internal::non_deduced<float_type>::type verify_epsilon =
+        static_cast<float_type>(0.0001),
+    const internal::layer_creators<float_type>& custom_layer_creators =
+        internal::layer_creators<float_type>(),
+    const internal::graph_passes<float_type>& custom_graph_passes =
+        internal::graph_passes<float_type>())
 {
     std::istringstream content_stream(content);
     return read_model(content_stream, verify, logger, verify_epsilon,
-        custom_layer_creators);
+        custom_layer_creators, custom_graph_passes);
 }
 
 // Load and construct an fdeep::model from file.
+// Like with read_model, custom_layer_creators are never called concurrently.
 // Throws an exception if a problem occurs.
-inline model load_model(const std::string& file_path,
+template <typename float_type = fdeep::float_type>
+basic_model<float_type> load_model(const std::string& file_path,
     bool verify = true,
     const std::function<void(std::string)>& logger = cout_logger,
-    float_type verify_epsilon = static_cast<float_type>(0.0001),
-    const internal::layer_creators& custom_layer_creators =
-        internal::layer_creators())
+    typename internal::non_deduced<float_type>::type verify_epsilon =
+        static_cast<float_type>(0.0001),
+    const internal::layer_creators<float_type>& custom_layer_creators =
+        internal::layer_creators<float_type>(),
+    const internal::graph_passes<float_type>& custom_graph_passes =
+        internal::graph_passes<float_type>())
+{
+    fplus::stopwatch stopwatch;
+    std::ifstream in_stream(file_path, std::ios::binary);
+    internal::assertion(in_stream.good(), "Can not open " + file_path);
+    const auto result = read_model(in_stream, verify, logger, verify_epsilon,
+    custom_layer_creators, custom_graph_passes);
+    if (logger)
+    {
+        const std::string additional_action = verify ? ", testing" : "";
+        logger("Loading, constructing" + additional_action +
+            " of " + file_path + " took " +
+            fplus::show_float(0, 6, stopwatch.elapsed()) + " s overall.\n");
+    }
+    return result;
+}
+
+// Like load_model with verify = true, but the test cases embedded
+// in the model are run in the background (in parallel),
+// so the model can be used right away.
+// model.verification() provides their result, e.g., to gate serving on.
+// A copy of the logger reports the progress of the tests
+// from a background thread, possibly while other threads are logging,
+// so it must be thread-safe. cout_logger is.
+// Stateful models are verified before returning,
+// since running the tests changes their states.
+// Throws an exception if a problem occurs while loading.
+template <typename float_type = fdeep::float_type>
+basic_model<float_type> load_model_verify_async(const std::string& file_path,
+    const std::function<void(std::string)>& logger = cout_logger,
+    typename internal::non_deduced<float_type>::type verify_epsilon =
+        static_cast<float_type>(0.0001),
+    const internal::layer_creators<float_type>& custom_layer_creators =
+        internal::layer_creators<float_type>(),
+    const internal::graph_passes<float_type>& custom_graph_passes =
+        internal::graph_passes<float_type>())
 {
     fplus::stopwatch stopwatch;
-    std::ifstream in_stream(file_path);
+    std::ifstream in_stream(file_path, std::ios::binary);
     internal::assertion(in_stream.good(), "Can not open " + file_path);
-    const auto model = read_model(in_stream, verify, logger, verify_epsilon,
-    custom_layer_creators);
+    const auto result = internal::read_model_with_verification(in_stream,
+        internal::verification_mode::background, logger, verify_epsilon,
+        custom_layer_creators, custom_graph_passes);
+    if (logger)
+    {
+        logger("Loading, constructing of " + file_path + " took " +
+            fplus::show_float(0, 6, stopwatch.elapsed()) + " s overall.\n");
+    }
+    return result;
+}
+
+
+// Load and construct an fdeep::model from a binary model file
+// (see convert_model.py --binary), which is mapped into memory read-only.
+// The weights of convolution and dense layers are used in place,
+// so all processes loading the same file share one copy of them
+// in the page cache, instead of each one holding its own.
+// The file must not be modified while the model is in use.
+// Throws an exception if a problem occurs.
+template <typename float_type = fdeep::float_type>
+basic_model<float_type> load_model_mapped(const std::string& file_path,
+    bool verify = true,
+    const std::function<void(std::string)>& logger = cout_logger,
+    typename internal::non_deduced<float_type>::type verify_epsilon =
+        static_cast<float_type>(0.0001),
+    const internal::layer_creators<float_type>& custom_layer_creators =
+        internal::layer_creators<float_type>(),
+    const internal::graph_passes<float_type>& custom_graph_passes =
+        internal::graph_passes<float_type>())
+{
+    fplus::stopwatch stopwatch;
+    internal::load_logger load_log(logger);
+    const auto load_pool = internal::make_hardware_thread_pool();
+    load_log.log_sol("Mapping binary model");
+    const internal::weight_blob_reader blob_reader(
+        std::make_shared<const internal::mapped_file>(file_path));
+    nlohmann::json json_data = blob_reader.header();
+    load_log.log_duration();
+    const auto result = internal::construct_model(json_data, &blob_reader,
+        load_pool.get(), load_log,
+        verify ? internal::verification_mode::blocking
+            : internal::verification_mode::none,
+        verify_epsilon, custom_layer_creators, custom_graph_passes);
+    if (logger)
+    {
+        const std::string additional_action = verify ? ", testing" : "";
+        logger("Mapping, constructing" + additional_action +
+            " of " + file_path + " took " +
+            fplus::show_float(0, 6, stopwatch.elapsed()) + " s overall.\n");
+    }
+    return result;
+}
+
+// Load and construct an fdeep::model from file (see load_model),
+// running its convolution, depthwise/separable convolution and dense layers
+// with int8 weights and inputs instead of float_type.
+// This needs the ranges of their input values,
+// which convert_model.py stores with --calibrate,
+// the layers without one keep running in float_type.
+// Since quantizing changes the results, the test cases embedded
+// in the model are used to report the resulting error
+// (see model::verification), and only fail
+// if it exceeds verify_epsilon, which is not limited by default.
+// Throws an exception if a problem occurs.
+template <typename float_type = fdeep::float_type>
+basic_model<float_type> load_model_quantized(const std::string& file_path,
+    bool verify = true,
+    const std::function<void(std::string)>& logger = cout_logger,
+    typename internal::non_deduced<float_type>::type verify_epsilon =
+        std::numeric_limits<float_type>::infinity(),
+    const internal::layer_creators<float_type>& custom_layer_creators =
+        internal::layer_creators<float_type>(),
+    const internal::graph_passes<float_type>& custom_graph_passes =
+        internal::graph_passes<float_type>())
+{
+    return load_model(file_path, verify, logger, verify_epsilon,
+        custom_layer_creators, fplus::map_union(custom_graph_passes,
+            internal::graph_passes<float_type>({
+                {"quantize_layers_int8",
+                    internal::quantize_layers_int8<float_type>}})));
+}
+
+namespace internal
+{
+
+// Changes whenever what load_model_cached writes into its cache changes.
+const std::size_t model_cache_version = 2;
+
+// Identifies the build settings the content of a cache file depends on,
+// i.e., the precision of the model
+// and the SIMD instruction sets the kernels are compiled for.
+template <typename float_type>
+std::string model_cache_build_config()
+{
+    std::string simd = Eigen::SimdInstructionSetsInUse();
+#if defined(__FMA__)
+    simd += ", FMA";
+#endif
+#if defined(__F16C__)
+    simd += ", F16C";
+#endif
+    // FNV-1a, to keep the file name short
+    std::uint32_t simd_hash = 2166136261u;
+    for (const char c : simd)
+    {
+        simd_hash = (simd_hash ^ static_cast<std::uint8_t>(c)) * 16777619u;
+    }
+    std::ostringstream result;
+    result << "f" << 8 * sizeof(float_type) << "_"
+        << std::hex << std::setw(8) << std::setfill('0') << simd_hash;
+    return result.str();
+}
+
+// File the binary copy of the model with the given hash is cached in.
+// The name also contains everything it depends on besides the model,
+// so differently built programs can share one cache directory.
+template <typename float_type>
+std::string model_cache_file_path(const std::string& cache_dir,
+    const std::string& hash)
+{
+    return cache_dir + "/" + hash +
+        "_v" + std::to_string(binary_model_format_version) +
+        "_c" + std::to_string(model_cache_version) +
+        "_" + model_cache_build_config<float_type>() + ".fdeep";
+}
+
+// Adds the Winograd-transformed filters (see generate_winograd_filter_matrices)
+// of all 3x3 convolutions using them to the trainable params,
+// referring to additional decoded arrays.
+// Their layers then view them in the mapped cache file
+// instead of every process transforming the filters on its own.
+// data is the architecture of the model or a part of it.
+inline void add_winograd_filter_arrays(const nlohmann::json& data,
+    nlohmann::json& trainable_params,
+    std::vector<decoded_array>& decoded_arrays)
+{
+    if (data.is_array())
+    {
+        for (const auto& element : data)
+        {
+            add_winograd_filter_arrays(element, trainable_params,
+                decoded_arrays);
+        }
+        return;
+    }
+    if (!data.is_object())
+    {
+        return;
+    }
+    for (const auto& element : data)
+    {
+        add_winograd_filter_arrays(element, trainable_params, decoded_arrays);
+    }
+    const nlohmann::json& name_data = json_member_or_null(data, "name");
+    if (json_member_or_null(data, "class_name") != "Conv2D" ||
+        !name_data.is_string())
+    {
+        return;
+    }
+    const std::string name = name_data;
+    const nlohmann::json& weights_ref = json_member_or_null(
+        json_member_or_null(trainable_params, name), "weights");
+    if (!json_is_blob_ref(weights_ref) ||
+        weights_ref.find("blob_index") == weights_ref.end() ||
+        blob_ref_half_float_format(weights_ref).is_just())
+    {
+        return;
+    }
+    const std::size_t idx = weights_ref["blob_index"];
+    assertion(idx < decoded_arrays.size(), "invalid blob reference");
+    const auto& weights = decoded_arrays[idx].floats_;
+    const auto& config = data["config"];
+    const auto filter_count = create_size_t(config["filters"]);
+    const shape2 kernel_size = create_shape2(config["kernel_size"]);
+    const std::size_t filter_depths = filter_count == 0 ? 0 :
+        weights.size() / (kernel_size.area() * filter_count);
+    const shape5 filter_shape(1, 1,
+        kernel_size.height_, kernel_size.width_, filter_depths);
+    if (!winograd_applicable(filter_shape, filter_count,
+        create_shape2(config["strides"]),
+        create_shape2(config["dilation_rate"])))
+    {
+        return;
+    }
+    const auto filter_mats = generate_winograd_filter_matrices(
+        im2col_filter_matrix_from_weights(filter_shape, shape2(1, 1),
+            filter_count,
+            float_buffer<float>(float_vec<float>(weights.begin(), weights.end())),
+            float_vec<float>(filter_count, 0)));
+    decoded_array winograd_weights;
+    winograd_weights.floats_.assign(filter_mats.weights_.data(),
+        filter_mats.weights_.data() + filter_mats.weights_.size());
+    trainable_params[name]["winograd_weights"] = {
+        {"blob_index", decoded_arrays.size()},
+        {"blob_floats", winograd_weights.floats_.size()}};
+    decoded_arrays.push_back(std::move(winograd_weights));
+}
+
+// Writes the file to a temporary one first and renames it afterwards,
+// so concurrent loaders never map a partially written cache file.
+// Returns false if this is not possible, e.g., due to missing permissions.
+inline bool write_model_cache_file(const std::string& file_path,
+    const nlohmann::json& json_data,
+    const std::vector<decoded_array>& decoded_arrays)
+{
+    const std::string temp_file_path = file_path + ".tmp" +
+        std::to_string(std::random_device()());
+    try
+    {
+        {
+            std::ofstream out_stream(temp_file_path,
+                std::ios::binary | std::ios::trunc);
+            if (!out_stream.good())
+            {
+                return false;
+            }
+            write_binary_model(out_stream, json_data, decoded_arrays);
+            out_stream.close();
+            assertion(!out_stream.fail(), "Can not write binary model");
+        }
+        if (std::rename(temp_file_path.c_str(), file_path.c_str()) == 0)
+        {
+            return true;
+        }
+    }
+    catch (const std::exception&)
+    {
+    }
+    std::remove(temp_file_path.c_str());
+    return false;
+}
+
+} // namespace internal
+
+// Load and construct an fdeep::model from a json model file,
+// caching a binary copy of it (see load_model_mapped)
+// in the existing directory cache_dir, keyed by the hash of the model.
+// The first load parses the json file as load_model does and fills the cache,
+// all later ones (of the same model) only map the cached file,
+// skipping parsing the json and decoding the weights.
+// With float precision, the cache also holds the filters of
+// 3x3 convolutions transformed for the Winograd algorithm,
+// so they are shared too.
+// Each precision and SIMD build configuration uses its own cache file.
+// If the cache can not be written, the model is loaded without it.
+// Models without a hash, and binary model files, are not cached.
+// The cache files are never deleted by frugally-deep.
+// Throws an exception if a problem occurs.
+template <typename float_type = fdeep::float_type>
+basic_model<float_type> load_model_cached(const std::string& file_path,
+    const std::string& cache_dir,
+    bool verify = true,
+    const std::function<void(std::string)>& logger = cout_logger,
+    typename internal::non_deduced<float_type>::type verify_epsilon =
+        static_cast<float_type>(0.0001),
+    const internal::layer_creators<float_type>& custom_layer_creators =
+        internal::layer_creators<float_type>(),
+    const internal::graph_passes<float_type>& custom_graph_passes =
+        internal::graph_passes<float_type>())
+{
+    std::string hash;
+    {
+        std::ifstream in_stream(file_path, std::ios::binary);
+        internal::assertion(in_stream.good(), "Can not open " + file_path);
+        if (internal::is_binary_model(in_stream))
+        {
+            in_stream.close();
+            return load_model_mapped(file_path, verify, logger,
+                verify_epsilon, custom_layer_creators, custom_graph_passes);
+        }
+        hash = internal::read_json_model_hash(in_stream);
+    }
+    if (hash.empty())
+    {
+        return load_model(file_path, verify, logger, verify_epsilon,
+            custom_layer_creators, custom_graph_passes);
+    }
+    const std::string cache_file_path =
+        internal::model_cache_file_path<float_type>(cache_dir, hash);
+    const auto load_cached = [&]() -> basic_model<float_type>
+    {
+        auto cached_model = load_model_mapped(cache_file_path, verify,
+            logger, verify_epsilon,
+            custom_layer_creators, custom_graph_passes);
+        internal::assertion(cached_model.hash() == hash,
+            "Invalid model cache file " + cache_file_path);
+        return cached_model;
+    };
+
+    if (std::ifstream(cache_file_path, std::ios::binary).good())
+    {
+        try
+        {
+            return load_cached();
+        }
+        catch (const std::exception& e)
+        {
+            if (logger)
+            {
+                logger(std::string("Rebuilding model cache file: ") +
+                    e.what() + "\n");
+            }
+        }
+    }
+
+    fplus::stopwatch stopwatch;
+    internal::load_logger load_log(logger);
+    const auto load_pool = internal::make_hardware_thread_pool();
+    load_log.log_sol("Loading json");
+    std::vector<internal::decoded_array> decoded_arrays;
+    nlohmann::json json_data;
+    {
+        std::ifstream in_stream(file_path, std::ios::binary);
+        internal::assertion(in_stream.good(), "Can not open " + file_path);
+        json_data = internal::parse_json_model(in_stream, true,
+            load_pool.get(), decoded_arrays);
+    }
+    load_log.log_duration();
+    load_log.log_sol("Writing model cache file " + cache_file_path);
+    // The filters are transformed with float precision.
+    if (std::is_same<float_type, float>::value)
+    {
+        internal::add_winograd_filter_arrays(json_data["architecture"],
+            json_data["trainable_params"], decoded_arrays);
+    }
+    const bool cache_written = internal::write_model_cache_file(
+        cache_file_path, json_data, decoded_arrays);
+    load_log.log_duration();
+    if (cache_written)
+    {
+        json_data = {};
+        decoded_arrays.clear();
+        return load_cached();
+    }
+    load_log.log("Can not write model cache file, loading without it");
+    const internal::weight_blob_reader blob_reader(std::move(decoded_arrays));
+    const auto result = internal::construct_model(json_data, &blob_reader,
+        load_pool.get(), load_log,
+        verify ? internal::verification_mode::blocking
+            : internal::verification_mode::none,
+        verify_epsilon, custom_layer_creators, custom_graph_passes);
     if (logger)
     {
         const std::string additional_action = verify ? ", testing" : "";
@@ -367,7 +1032,7 @@ inline model load_model(const std::string& file_path,
             " of " + file_path + " took " +
             fplus::show_float(0, 6, stopwatch.elapsed()) + " s overall.\n");
     }
-    return model;
+    return result;
 }
 
-} // namespace fdeep
\ No newline at end of file
+} // namespace fdeep
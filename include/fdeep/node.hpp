@@ -8,8 +8,6 @@
 
 #include <algorithm>
 #include <cstddef>
-#include <map>
-#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
@@ -34,16 +32,6 @@ struct node_connection
 };
 using node_connections = std::vector<node_connection>;
 
-using output_dict = std::map<std::pair<std::string, std::size_t>, tensor5s>;
-
-class layer;
-typedef std::shared_ptr<layer> layer_ptr;
-typedef std::vector<layer_ptr> layer_ptrs;
-layer_ptr get_layer(const layer_ptrs& layers, const std::string& layer_id);
-tensor5 get_layer_output(const layer_ptrs& layers, output_dict& output_cache,
-    const layer_ptr& layer, std::size_t node_idx, std::size_t tensor_idx);
-tensor5s apply_layer(const layer& layer, const tensor5s& inputs);
-
 class node
 {
 public:
@@ -51,18 +39,9 @@ public:
             inbound_connections_(inbound_nodes)
     {
     }
-    tensor5s get_output(const layer_ptrs& layers, output_dict& output_cache,
-        const layer& layer) const
+    const node_connections& inbound_connections() const
     {
-        const auto get_input = [&output_cache, &layers]
-            (const node_connection& conn) -> tensor5
-        {
-            return get_layer_output(layers, output_cache,
-                get_layer(layers, conn.layer_id_),
-                conn.node_idx_, conn.tensor_idx_);
-        };
-        return apply_layer(layer,
-            fplus::transform(get_input, inbound_connections_));
+        return inbound_connections_;
     }
 private:
     node_connections inbound_connections_;
@@ -0,0 +1,694 @@
+// Copyright 2016, Tobias Hermann.
+// https://github.com/Dobiasd/frugally-deep
+// Distributed under the MIT License.
+// (See accompanying LICENSE file or at
+//  https://opensource.org/licenses/MIT)
+
+#pragma once
+
+#include "fdeep/common.hpp"
+
+#include "fdeep/convolution.hpp"
+#include "fdeep/tensor5.hpp"
+#include "fdeep/thread_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define FDEEP_INT8_AVX2
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define FDEEP_INT8_SSE2
+#endif
+
+namespace fdeep { namespace internal
+{
+
+// Post-training int8 quantization, see load_model_quantized.
+// The weights are quantized symmetrically per output channel,
+// the input of a layer per tensor, based on the maximum absolute value
+// it had while calibrating the model (see convert_model.py --calibrate).
+// The products are accumulated in int32
+// and converted back to float_type for the output of the layer.
+// Quantized inputs are only used transiently,
+// so they are kept widened to 16 bits,
+// and the kernels only need to widen the weights.
+
+typedef std::vector<std::int8_t> int8_vec;
+typedef std::vector<std::int16_t> int16_vec;
+
+// The dot products process this many values at once,
+// so quantized rows and columns are padded with zeros to a multiple of it.
+const std::size_t int8_block_size = 16;
+
+inline std::size_t int8_padded_size(std::size_t size)
+{
+    return (size + int8_block_size - 1) / int8_block_size * int8_block_size;
+}
+
+// Scale mapping the values in [-max_abs, max_abs] onto [-127, 127].
+template <typename float_type>
+float_type int8_scale(float_type max_abs)
+{
+    return max_abs > 0 ? max_abs / 127 : 1;
+}
+
+// Values outside of the calibrated range are clamped.
+template <typename float_type>
+void quantize_values(const float_type* values, std::size_t n,
+    float_type scale, std::int16_t* dest)
+{
+    const auto size = static_cast<EigenIndex>(n);
+    const Eigen::Map<const Eigen::Array<float_type, Eigen::Dynamic, 1>,
+        Eigen::Unaligned> src(values, size);
+    Eigen::Map<Eigen::Array<std::int16_t, Eigen::Dynamic, 1>,
+        Eigen::Unaligned> dst(dest, size);
+    dst = (src * (1 / scale)).round()
+        .max(static_cast<float_type>(-127))
+        .min(static_cast<float_type>(127))
+        .template cast<std::int16_t>();
+}
+
+template <typename float_type>
+float_type max_abs_value(const tensor5<float_type>& t)
+{
+    const auto& values = *t.as_vector();
+    return values.empty() ? 0 : Eigen::Map<const Eigen::Array<
+        float_type, Eigen::Dynamic, 1>, Eigen::Unaligned>(values.data(),
+            static_cast<EigenIndex>(values.size())).abs().maxCoeff();
+}
+
+// Quantizes the input of a convolution, padding it on the way,
+// i.e., without creating a padded float copy first.
+template <typename float_type>
+int16_vec quantize_tensor5_padded(const convolution_config& conv_cfg,
+    float_type scale, const tensor5<float_type>& input)
+{
+    const shape5& shape = input.shape();
+    const std::size_t padded_width =
+        shape.width_ + conv_cfg.pad_left_ + conv_cfg.pad_right_;
+    const std::size_t padded_height =
+        shape.height_ + conv_cfg.pad_top_ + conv_cfg.pad_bottom_;
+    const std::size_t row_size = shape.width_ * shape.depth_;
+    int16_vec result(padded_height * padded_width * shape.depth_, 0);
+    const float_type* values = input.as_vector()->data();
+    for (std::size_t y = 0; y < shape.height_; ++y)
+    {
+        quantize_values(values + y * row_size, row_size, scale,
+            result.data() + ((conv_cfg.pad_top_ + y) * padded_width +
+                conv_cfg.pad_left_) * shape.depth_);
+    }
+    return result;
+}
+
+// One row of quantized weights per output channel,
+// row r approximating the float weights divided by scales_[r].
+// The rows are padded with zero rows to a multiple of int8_row_block,
+// so the kernels can always process full blocks of rows.
+template <typename float_type>
+struct int8_weight_matrix
+{
+    int8_weight_matrix() :
+            weights_(),
+            scales_(),
+            bias_(),
+            rows_(0),
+            depth_(0),
+            padded_depth_(0)
+    {
+    }
+    int8_weight_matrix(const int8_vec& weights,
+        const float_vec<float_type>& scales,
+        const float_vec<float_type>& bias,
+        std::size_t rows,
+        std::size_t depth,
+        std::size_t padded_depth) :
+            weights_(weights),
+            scales_(scales),
+            bias_(bias),
+            rows_(rows),
+            depth_(depth),
+            padded_depth_(padded_depth)
+    {
+    }
+    int8_vec weights_;
+    float_vec<float_type> scales_;
+    float_vec<float_type> bias_;
+    std::size_t rows_;
+    std::size_t depth_;
+    std::size_t padded_depth_;
+};
+
+const std::size_t int8_row_block = 4;
+
+inline std::size_t int8_padded_rows(std::size_t rows)
+{
+    return (rows + int8_row_block - 1) / int8_row_block * int8_row_block;
+}
+
+// The float weight of row r at position k is
+// values[r * row_stride + k * depth_stride].
+template <typename float_type>
+int8_weight_matrix<float_type> quantize_weight_matrix(const float_type* values,
+    std::size_t rows, std::size_t depth,
+    std::size_t row_stride, std::size_t depth_stride,
+    const float_vec<float_type>& bias)
+{
+    assertion(bias.size() == rows, "invalid bias size");
+    const std::size_t padded_depth = int8_padded_size(depth);
+    int8_vec weights(int8_padded_rows(rows) * padded_depth, 0);
+    float_vec<float_type> scales(rows);
+    for (std::size_t r = 0; r < rows; ++r)
+    {
+        const auto value = [&](std::size_t k) -> float_type
+        {
+            return values[r * row_stride + k * depth_stride];
+        };
+        float_type max_abs = 0;
+        for (std::size_t k = 0; k < depth; ++k)
+        {
+            max_abs = std::max(max_abs, std::abs(value(k)));
+        }
+        scales[r] = int8_scale(max_abs);
+        for (std::size_t k = 0; k < depth; ++k)
+        {
+            weights[r * padded_depth + k] = static_cast<std::int8_t>(
+                std::max(static_cast<float_type>(-127),
+                    std::min(static_cast<float_type>(127),
+                        std::round(value(k) / scales[r]))));
+        }
+    }
+    return {weights, scales, bias, rows, depth, padded_depth};
+}
+
+template <typename float_type>
+int8_weight_matrix<float_type> quantize_im2col_filter_matrix(
+    const im2col_filter_matrix<float_type>& filter_mat)
+{
+    const std::size_t depth = filter_mat.filter_shape_.volume();
+    return quantize_weight_matrix(filter_mat.weights_.data(),
+        filter_mat.filter_count_, depth, depth, 1,
+        float_vec<float_type>(filter_mat.bias_.data(),
+            filter_mat.bias_.data() + filter_mat.bias_.size()));
+}
+
+#if defined(FDEEP_INT8_AVX2)
+typedef __m256i int8_acc;
+
+inline int8_acc int8_load_weights(const std::int8_t* w)
+{
+    return _mm256_cvtepi8_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(w)));
+}
+
+inline int8_acc int8_load_values(const std::int16_t* a)
+{
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a));
+}
+
+inline void int8_madd(int8_acc& acc, int8_acc w, int8_acc a)
+{
+#if defined(__AVXVNNI__)
+    acc = _mm256_dpwssd_avx_epi32(acc, w, a);
+#elif defined(__AVX512VNNI__) && defined(__AVX512VL__)
+    acc = _mm256_dpwssd_epi32(acc, w, a);
+#else
+    acc = _mm256_add_epi32(acc, _mm256_madd_epi16(w, a));
+#endif
+}
+
+inline std::int32_t int8_horizontal_sum(int8_acc v)
+{
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v),
+        _mm256_extracti128_si256(v, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+    return _mm_cvtsi128_si32(s);
+}
+
+inline int8_acc int8_zero()
+{
+    return _mm256_setzero_si256();
+}
+#elif defined(FDEEP_INT8_SSE2)
+// The 16 values of a block are handled as two halves of 8.
+struct int8_acc
+{
+    __m128i lo_;
+    __m128i hi_;
+};
+
+inline int8_acc int8_load_weights(const std::int8_t* w)
+{
+    // Sign extension: Each byte is duplicated into a 16-bit lane
+    // and shifted down arithmetically.
+    const __m128i w8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(w));
+    return {_mm_srai_epi16(_mm_unpacklo_epi8(w8, w8), 8),
+        _mm_srai_epi16(_mm_unpackhi_epi8(w8, w8), 8)};
+}
+
+inline int8_acc int8_load_values(const std::int16_t* a)
+{
+    return {_mm_loadu_si128(reinterpret_cast<const __m128i*>(a)),
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + 8))};
+}
+
+// Only lo_ is used for the accumulated sums.
+inline void int8_madd(int8_acc& acc, const int8_acc& w, const int8_acc& a)
+{
+    acc.lo_ = _mm_add_epi32(acc.lo_, _mm_add_epi32(
+        _mm_madd_epi16(w.lo_, a.lo_), _mm_madd_epi16(w.hi_, a.hi_)));
+}
+
+inline std::int32_t int8_horizontal_sum(const int8_acc& v)
+{
+    __m128i s = v.lo_;
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+    return _mm_cvtsi128_si32(s);
+}
+
+inline int8_acc int8_zero()
+{
+    return {_mm_setzero_si128(), _mm_setzero_si128()};
+}
+#endif
+
+// Dot products of two consecutive weight rows
+// with four consecutive input columns, all of them padded_depth long.
+// The accumulators are spelled out, so they stay in registers,
+// and every loaded weight and input block is used more than once.
+// results[i * 4 + j] is the product of row i and column j.
+inline void int8_dot_products_2x4(const std::int8_t* w,
+    const std::int16_t* a, std::size_t padded_depth, std::int32_t* results)
+{
+#if defined(FDEEP_INT8_AVX2) || defined(FDEEP_INT8_SSE2)
+    const std::int8_t* w0 = w;
+    const std::int8_t* w1 = w + padded_depth;
+    const std::int16_t* a0 = a;
+    const std::int16_t* a1 = a + padded_depth;
+    const std::int16_t* a2 = a + 2 * padded_depth;
+    const std::int16_t* a3 = a + 3 * padded_depth;
+    int8_acc c00 = int8_zero(), c01 = int8_zero(),
+        c02 = int8_zero(), c03 = int8_zero(),
+        c10 = int8_zero(), c11 = int8_zero(),
+        c12 = int8_zero(), c13 = int8_zero();
+    for (std::size_t k = 0; k < padded_depth; k += int8_block_size)
+    {
+        const int8_acc v0 = int8_load_weights(w0 + k);
+        const int8_acc v1 = int8_load_weights(w1 + k);
+        int8_acc x = int8_load_values(a0 + k);
+        int8_madd(c00, v0, x);
+        int8_madd(c10, v1, x);
+        x = int8_load_values(a1 + k);
+        int8_madd(c01, v0, x);
+        int8_madd(c11, v1, x);
+        x = int8_load_values(a2 + k);
+        int8_madd(c02, v0, x);
+        int8_madd(c12, v1, x);
+        x = int8_load_values(a3 + k);
+        int8_madd(c03, v0, x);
+        int8_madd(c13, v1, x);
+    }
+    results[0] = int8_horizontal_sum(c00);
+    results[1] = int8_horizontal_sum(c01);
+    results[2] = int8_horizontal_sum(c02);
+    results[3] = int8_horizontal_sum(c03);
+    results[4] = int8_horizontal_sum(c10);
+    results[5] = int8_horizontal_sum(c11);
+    results[6] = int8_horizontal_sum(c12);
+    results[7] = int8_horizontal_sum(c13);
+#else
+    for (std::size_t i = 0; i < 2; ++i)
+    {
+        for (std::size_t j = 0; j < 4; ++j)
+        {
+            std::int32_t sum = 0;
+            for (std::size_t k = 0; k < padded_depth; ++k)
+            {
+                sum += static_cast<std::int32_t>(w[i * padded_depth + k]) *
+                    static_cast<std::int32_t>(a[j * padded_depth + k]);
+            }
+            results[i * 4 + j] = sum;
+        }
+    }
+#endif
+}
+
+// Dot products of four consecutive weight rows with one input column,
+// e.g., for dense layers applied to a single sample,
+// whose speed is bound by reading the weights.
+inline void int8_dot_products_4x1(const std::int8_t* w,
+    const std::int16_t* a, std::size_t padded_depth, std::int32_t* results)
+{
+#if defined(FDEEP_INT8_AVX2) || defined(FDEEP_INT8_SSE2)
+    const std::int8_t* w0 = w;
+    const std::int8_t* w1 = w + padded_depth;
+    const std::int8_t* w2 = w + 2 * padded_depth;
+    const std::int8_t* w3 = w + 3 * padded_depth;
+    int8_acc c0 = int8_zero(), c1 = int8_zero(),
+        c2 = int8_zero(), c3 = int8_zero();
+    for (std::size_t k = 0; k < padded_depth; k += int8_block_size)
+    {
+        const int8_acc x = int8_load_values(a + k);
+        int8_madd(c0, int8_load_weights(w0 + k), x);
+        int8_madd(c1, int8_load_weights(w1 + k), x);
+        int8_madd(c2, int8_load_weights(w2 + k), x);
+        int8_madd(c3, int8_load_weights(w3 + k), x);
+    }
+    results[0] = int8_horizontal_sum(c0);
+    results[1] = int8_horizontal_sum(c1);
+    results[2] = int8_horizontal_sum(c2);
+    results[3] = int8_horizontal_sum(c3);
+#else
+    for (std::size_t i = 0; i < 4; ++i)
+    {
+        std::int32_t sum = 0;
+        for (std::size_t k = 0; k < padded_depth; ++k)
+        {
+            sum += static_cast<std::int32_t>(w[i * padded_depth + k]) *
+                static_cast<std::int32_t>(a[k]);
+        }
+        results[i] = sum;
+    }
+#endif
+}
+
+// Multiplies the weights with the columns [col_begin, col_end)
+// of the quantized input (padded_depth_ values per column),
+// and writes the results, converted back to float_type and with
+// the bias added, to the same columns of out (rows_ values per column).
+template <typename float_type>
+void int8_multiply(const int8_weight_matrix<float_type>& w,
+    const std::int16_t* a, float_type input_scale,
+    std::size_t col_begin, std::size_t col_end, float_type* out)
+{
+    const std::size_t depth = w.padded_depth_;
+    const std::size_t padded_rows = int8_padded_rows(w.rows_);
+    const auto store = [&](std::size_t r, std::size_t col, std::int32_t sum)
+    {
+        if (r < w.rows_)
+        {
+            out[col * w.rows_ + r] = static_cast<float_type>(sum) *
+                input_scale * w.scales_[r] + w.bias_[r];
+        }
+    };
+    // The weight rows of one block are used for all columns
+    // before moving on, so they stay in the cache.
+    const std::size_t block_rows = int8_padded_rows(std::max<std::size_t>(1,
+        (std::size_t(1) << 16) / depth));
+    std::int32_t sums[8];
+    for (std::size_t row_begin = 0; row_begin < padded_rows;
+        row_begin += block_rows)
+    {
+        const std::size_t row_end =
+            std::min(padded_rows, row_begin + block_rows);
+        std::size_t col = col_begin;
+        for (; col + 4 <= col_end; col += 4)
+        {
+            for (std::size_t r = row_begin; r < row_end; r += 2)
+            {
+                int8_dot_products_2x4(w.weights_.data() + r * depth,
+                    a + col * depth, depth, sums);
+                for (std::size_t j = 0; j < 4; ++j)
+                {
+                    store(r, col + j, sums[j]);
+                    store(r + 1, col + j, sums[4 + j]);
+                }
+            }
+        }
+        for (; col < col_end; ++col)
+        {
+            for (std::size_t r = row_begin; r < row_end; r += 4)
+            {
+                int8_dot_products_4x1(w.weights_.data() + r * depth,
+                    a + col * depth, depth, sums);
+                for (std::size_t i = 0; i < 4; ++i)
+                {
+                    store(r + i, col, sums[i]);
+                }
+            }
+        }
+    }
+}
+
+// Quantized counterpart of convolve_batch.
+template <typename float_type>
+tensor5s<float_type> convolve_int8_batch(
+    const shape2& strides,
+    const padding& pad_type,
+    bool use_offset,
+    const shape5& filter_shape,
+    const shape2& dilation_rate,
+    const int8_weight_matrix<float_type>& filter_mat,
+    float_type input_scale,
+    const tensor5s<float_type>& inputs)
+{
+    assertion(!inputs.empty(), "no input tensors");
+    const auto input_shape = inputs.front().shape();
+    assertion(fplus::all_the_same_on(
+        fplus_c_mem_fn_t(tensor5<float_type>, shape, shape5), inputs),
+        "all inputs must have the same shape");
+    assertion(filter_shape.depth_ == input_shape.depth_,
+        "invalid filter depth");
+
+    const auto conv_cfg = preprocess_convolution(
+        dilated_filter_shape(filter_shape, dilation_rate),
+        strides, pad_type, use_offset, input_shape.height_, input_shape.width_);
+
+    const auto in_padded = fplus::transform([&](const tensor5<float_type>& input)
+    {
+        return quantize_tensor5_padded(conv_cfg, input_scale, input);
+    }, inputs);
+
+    const std::size_t padded_width =
+        input_shape.width_ + conv_cfg.pad_left_ + conv_cfg.pad_right_;
+    const std::size_t out_height = conv_cfg.out_height_;
+    const std::size_t out_width = conv_cfg.out_width_;
+    const std::size_t positions = out_height * out_width;
+    const std::size_t col_count = positions * inputs.size();
+    const std::size_t depth = filter_mat.padded_depth_;
+    const std::size_t row_values = filter_shape.width_ * filter_shape.depth_;
+    // Without horizontal dilation,
+    // each filter row covers consecutive input values.
+    const std::size_t chunk_values = dilation_rate.width_ == 1
+        ? row_values : filter_shape.depth_;
+    const std::size_t chunk_stride = dilation_rate.width_ * filter_shape.depth_;
+    int16_vec a(col_count * depth, 0);
+
+    shared_float_vec<float_type> res_vec = fplus::make_shared_ref<float_vec<float_type>>();
+    res_vec->resize(filter_mat.rows_ * col_count);
+
+    const auto process_columns = [&](std::size_t col_begin, std::size_t col_end)
+    {
+        for (std::size_t col = col_begin; col < col_end; ++col)
+        {
+            const int16_vec& in = in_padded[col / positions];
+            const std::size_t y = (col % positions) / out_width;
+            const std::size_t x = col % out_width;
+            for (std::size_t yf = 0; yf < filter_shape.height_; ++yf)
+            {
+                const std::size_t src = ((conv_cfg.offset_y_ +
+                    strides.height_ * y + yf * dilation_rate.height_) *
+                        padded_width +
+                    conv_cfg.offset_x_ + strides.width_ * x) *
+                    filter_shape.depth_;
+                for (std::size_t chunk = 0; chunk * chunk_values < row_values;
+                    ++chunk)
+                {
+                    const auto begin = in.begin() + static_cast<std::ptrdiff_t>(
+                        src + chunk * chunk_stride);
+                    std::copy(begin,
+                        begin + static_cast<std::ptrdiff_t>(chunk_values),
+                        a.begin() + static_cast<std::ptrdiff_t>(col * depth +
+                            yf * row_values + chunk * chunk_values));
+                }
+            }
+        }
+        int8_multiply(filter_mat, a.data(), input_scale,
+            col_begin, col_end, res_vec->data());
+    };
+
+    thread_pool* pool = current_thread_pool();
+    const std::size_t madds = a.size() * filter_mat.rows_;
+    const std::size_t block_count = pool == nullptr ||
+        madds < parallel_convolution_min_madds ? 1 :
+        std::min(pool->thread_count(),
+            col_count / parallel_convolution_min_block_cols);
+
+    if (block_count <= 1)
+    {
+        process_columns(0, col_count);
+    }
+    else
+    {
+        // Block borders at multiples of four columns
+        // keep the remaining single columns at the very end.
+        const auto border = [&](std::size_t block) -> std::size_t
+        {
+            return block == block_count ? col_count :
+                block * col_count / block_count / 4 * 4;
+        };
+        pool->parallel_for(block_count, [&](std::size_t block)
+        {
+            process_columns(border(block), border(block + 1));
+        });
+    }
+
+    return split_convolution_results(res_vec,
+        shape5(1, 1, out_height, out_width, filter_mat.rows_), inputs.size());
+}
+
+template <typename float_type>
+tensor5<float_type> convolve_int8(
+    const shape2& strides,
+    const padding& pad_type,
+    bool use_offset,
+    const shape5& filter_shape,
+    const shape2& dilation_rate,
+    const int8_weight_matrix<float_type>& filter_mat,
+    float_type input_scale,
+    const tensor5<float_type>& input)
+{
+    return convolve_int8_batch(strides, pad_type, use_offset,
+        filter_shape, dilation_rate, filter_mat, input_scale, {input}).front();
+}
+
+// Depthwise filters quantized per channel, stored as
+// the weights of all channels for one filter position after another.
+template <typename float_type>
+struct int8_depthwise_filters
+{
+    int8_depthwise_filters() :
+            weights_(),
+            scales_(),
+            bias_(),
+            filter_height_(0),
+            filter_width_(0),
+            dilation_height_(1),
+            dilation_width_(1)
+    {
+    }
+    int8_depthwise_filters(const int16_vec& weights,
+        const float_vec<float_type>& scales,
+        const float_vec<float_type>& bias,
+        std::size_t filter_height,
+        std::size_t filter_width,
+        std::size_t dilation_height,
+        std::size_t dilation_width) :
+            weights_(weights),
+            scales_(scales),
+            bias_(bias),
+            filter_height_(filter_height),
+            filter_width_(filter_width),
+            dilation_height_(dilation_height),
+            dilation_width_(dilation_width)
+    {
+    }
+    int16_vec weights_;
+    float_vec<float_type> scales_;
+    float_vec<float_type> bias_;
+    std::size_t filter_height_;
+    std::size_t filter_width_;
+    std::size_t dilation_height_;
+    std::size_t dilation_width_;
+};
+
+// Every channel gets its own scale.
+template <typename float_type>
+int8_depthwise_filters<float_type> quantize_depthwise_filters(
+    const depthwise_filter_matrix<float_type>& filter_mat)
+{
+    const std::size_t channels = filter_mat.bias_.size();
+    const std::size_t area =
+        filter_mat.filter_height_ * filter_mat.filter_width_;
+    assertion(filter_mat.weights_.size() == area * channels,
+        "invalid depthwise filter");
+    int16_vec weights(area * channels);
+    float_vec<float_type> scales;
+    float_vec<float_type> bias;
+    for (std::size_t c = 0; c < channels; ++c)
+    {
+        const auto q = quantize_weight_matrix(filter_mat.weights_.data() + c,
+            1, area, area * channels, channels, {filter_mat.bias_[c]});
+        for (std::size_t i = 0; i < area; ++i)
+        {
+            weights[i * channels + c] = q.weights_[i];
+        }
+        scales.push_back(q.scales_.front());
+        bias.push_back(q.bias_.front());
+    }
+    return {weights, scales, bias,
+        filter_mat.filter_height_, filter_mat.filter_width_,
+        filter_mat.dilation_height_, filter_mat.dilation_width_};
+}
+
+// Convolves every channel of the input with its own filter.
+template <typename float_type>
+tensor5<float_type> depthwise_convolve_int8(
+    const shape2& strides,
+    const padding& pad_type,
+    bool use_offset,
+    const int8_depthwise_filters<float_type>& filters,
+    float_type input_scale,
+    const tensor5<float_type>& input)
+{
+    const shape5& input_shape = input.shape();
+    const std::size_t channels = filters.scales_.size();
+    assertion(input_shape.depth_ == channels, "invalid input depth");
+    const auto conv_cfg = preprocess_convolution(
+        dilated_filter_shape(shape5(1, 1,
+            filters.filter_height_, filters.filter_width_, 1),
+            shape2(filters.dilation_height_, filters.dilation_width_)),
+        strides, pad_type, use_offset, input_shape.height_, input_shape.width_);
+    const int16_vec in = quantize_tensor5_padded(conv_cfg, input_scale, input);
+    const std::size_t padded_width =
+        input_shape.width_ + conv_cfg.pad_left_ + conv_cfg.pad_right_;
+
+    const shape5 out_shape(1, 1,
+        conv_cfg.out_height_, conv_cfg.out_width_, channels);
+    shared_float_vec<float_type> res_vec = fplus::make_shared_ref<float_vec<float_type>>();
+    res_vec->resize(out_shape.volume());
+    float_type* out = res_vec->data();
+    std::vector<std::int32_t> sums(channels);
+    for (std::size_t y = 0; y < conv_cfg.out_height_; ++y)
+    {
+        for (std::size_t x = 0; x < conv_cfg.out_width_; ++x)
+        {
+            std::fill(sums.begin(), sums.end(), 0);
+            for (std::size_t yf = 0; yf < filters.filter_height_; ++yf)
+            {
+                for (std::size_t xf = 0; xf < filters.filter_width_; ++xf)
+                {
+                    const std::int16_t* src = in.data() +
+                        ((conv_cfg.offset_y_ + strides.height_ * y +
+                            yf * filters.dilation_height_) *
+                            padded_width +
+                        conv_cfg.offset_x_ + strides.width_ * x +
+                            xf * filters.dilation_width_) *
+                        channels;
+                    const std::int16_t* w = filters.weights_.data() +
+                        (yf * filters.filter_width_ + xf) * channels;
+                    for (std::size_t c = 0; c < channels; ++c)
+                    {
+                        sums[c] += static_cast<std::int32_t>(src[c]) *
+                            static_cast<std::int32_t>(w[c]);
+                    }
+                }
+            }
+            for (std::size_t c = 0; c < channels; ++c)
+            {
+                *out++ = static_cast<float_type>(sums[c]) *
+                    input_scale * filters.scales_[c] + filters.bias_[c];
+            }
+        }
+    }
+    return tensor5<float_type>(out_shape, res_vec);
+}
+
+} } // namespace fdeep, namespace internal
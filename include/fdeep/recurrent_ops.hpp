@@ -14,44 +14,50 @@ namespace fdeep { namespace internal
 
 using Eigen::Dynamic;
 
-template<int Rows, int Cols>
+template<typename float_type, int Rows, int Cols>
 using ColMajorMatrix = Eigen::Matrix<float_type, Rows, Cols, Eigen::ColMajor>;
 
-template<int Rows, int Cols>
+template<typename float_type, int Rows, int Cols>
 using RowMajorMatrix = Eigen::Matrix<float_type, Rows, Cols, Eigen::RowMajor>;
 
-template<int Count>
+template<typename float_type, int Count>
 using ColVector = Eigen::Matrix<float_type, Count, 1>;
 
-template<int Count>
+template<typename float_type, int Count>
 using RowVector = Eigen::Matrix<float_type, 1, Count>;
 
-inline float_type linear_activation(float_type x)
+template <typename float_type>
+float_type linear_activation(float_type x)
 {
     return x;
 }
 
-inline float_type tanh_activation(float_type x)
+template <typename float_type>
+float_type tanh_activation(float_type x)
 {
     return std::tanh(x);
 }
 
-inline float_type sigmoid_activation(float_type x)
+template <typename float_type>
+float_type sigmoid_activation(float_type x)
 {
     return 1 / (1 + std::exp(-x));
 }
 
-inline float_type hard_sigmoid_activation(float_type x)
+template <typename float_type>
+float_type hard_sigmoid_activation(float_type x)
 {
     return static_cast<float_type>(std::min(1.0, std::max(0.0, (0.2 * x) + 0.5)));
 }
 
-inline float_type relu_activation(float_type x)
+template <typename float_type>
+float_type relu_activation(float_type x)
 {
     return std::max<float_type>(x, 0);
 }
 
-inline float_type selu_activation(float_type x)
+template <typename float_type>
+float_type selu_activation(float_type x)
 {
     const float_type alpha =
     static_cast<float_type>(1.6732632423543772848170429916717);
@@ -60,58 +66,61 @@ inline float_type selu_activation(float_type x)
     return scale * (x >= 0 ? x : alpha * (std::exp(x) - 1));
 }
 
-inline float_type elu_activation(float_type x)
+template <typename float_type>
+float_type elu_activation(float_type x)
 {
     return x >= 0 ? x : std::exp(x) - 1;
 }
 
-inline std::function<float_type(float_type)> get_activation_func(const std::string& activation_func_name)
+template <typename float_type>
+std::function<float_type(float_type)> get_activation_func(const std::string& activation_func_name)
 {
     if (activation_func_name == "linear")
-        return linear_activation;
+        return linear_activation<float_type>;
     else if (activation_func_name == "tanh")
-        return tanh_activation;
+        return tanh_activation<float_type>;
     else if (activation_func_name == "sigmoid")
-        return sigmoid_activation;
+        return sigmoid_activation<float_type>;
     else if (activation_func_name == "hard_sigmoid")
-        return hard_sigmoid_activation;
+        return hard_sigmoid_activation<float_type>;
     else if (activation_func_name == "relu")
-        return relu_activation;
+        return relu_activation<float_type>;
     else if (activation_func_name == "selu")
-        return selu_activation;
+        return selu_activation<float_type>;
     else if (activation_func_name == "elu")
-        return elu_activation;
+        return elu_activation<float_type>;
 
     raise_error("activation function '" + activation_func_name + "' not yet implemented");
     return {}; //should never be called
 }
 
-inline tensor5s lstm_impl(const tensor5& input,
-                          tensor5& initial_state_h,
-                          tensor5& initial_state_c,
+template <typename float_type>
+tensor5s<float_type> lstm_impl(const tensor5<float_type>& input,
+                          tensor5<float_type>& initial_state_h,
+                          tensor5<float_type>& initial_state_c,
                           const std::size_t n_units,
                           const bool use_bias,
                           const bool return_sequences,
                           const bool return_state,
-                          const float_vec& weights,
-                          const float_vec& recurrent_weights,
-                          const float_vec& bias,
+                          const float_vec<float_type>& weights,
+                          const float_vec<float_type>& recurrent_weights,
+                          const float_vec<float_type>& bias,
                           const std::string& activation,
                           const std::string& recurrent_activation)
 {
-    const RowMajorMatrixXf W = eigen_row_major_mat_from_values(weights.size() / (n_units * 4), n_units * 4, weights);
-    const RowMajorMatrixXf U = eigen_row_major_mat_from_values(n_units, n_units * 4, recurrent_weights);
+    const RowMajorMatrixXf<float_type> W = eigen_row_major_mat_from_values(weights.size() / (n_units * 4), n_units * 4, weights);
+    const RowMajorMatrixXf<float_type> U = eigen_row_major_mat_from_values(n_units, n_units * 4, recurrent_weights);
 
     // initialize cell output states h, and cell memory states c for t-1 with initial state values
-    RowMajorMatrixXf h(1, n_units);
-    RowMajorMatrixXf c(1, n_units);
+    RowMajorMatrixXf<float_type> h(1, n_units);
+    RowMajorMatrixXf<float_type> c(1, n_units);
     h = eigen_row_major_mat_from_values(1, n_units, *initial_state_h.as_vector());
     c = eigen_row_major_mat_from_values(1, n_units, *initial_state_c.as_vector());
 
     std::size_t n_timesteps = input.shape().width_;
     std::size_t n_features = input.shape().depth_;
 
-    RowMajorMatrixXf in(n_timesteps, n_features);
+    RowMajorMatrixXf<float_type> in(n_timesteps, n_features);
 
     // write input to eigen matrix
 
@@ -119,7 +128,7 @@ inline tensor5s lstm_impl(const tensor5& input,
         for (std::size_t a_f = 0; a_f < n_features; ++a_f)
             in(EigenIndex(a_t), EigenIndex(a_f)) = input.get(0, 0, 0, a_t, a_f);
 
-    RowMajorMatrixXf X = in * W;
+    RowMajorMatrixXf<float_type> X = in * W;
 
     if (use_bias)
     {
@@ -131,28 +140,28 @@ inline tensor5s lstm_impl(const tensor5& input,
     }
 
     // get activation functions
-    auto act_func = get_activation_func(activation);
-    auto act_func_recurrent = get_activation_func(recurrent_activation);
+    auto act_func = get_activation_func<float_type>(activation);
+    auto act_func_recurrent = get_activation_func<float_type>(recurrent_activation);
 
     // computing LSTM output
     const EigenIndex n = EigenIndex(n_units);
 
-    tensor5s lstm_result;
+    tensor5s<float_type> lstm_result;
 
     if (return_sequences)
-        lstm_result = {tensor5(shape5(1, 1, 1, n_timesteps, n_units), float_type(0))};
+        lstm_result = {tensor5<float_type>(shape5(1, 1, 1, n_timesteps, n_units), float_type(0))};
     else
-        lstm_result = {tensor5(shape5(1, 1, 1, 1, n_units), float_type(0))};
+        lstm_result = {tensor5<float_type>(shape5(1, 1, 1, 1, n_units), float_type(0))};
 
     for (EigenIndex k = 0; k < EigenIndex(n_timesteps); ++k)
     {
-        const RowMajorMatrixXf ifco = h * U;
+        const RowMajorMatrixXf<float_type> ifco = h * U;
 
         // Use of Matrix.block(): Block of size (p,q), starting at (i,j) matrix.block(i,j,p,q);  matrix.block<p,q>(i,j);
-        const RowMajorMatrixXf i = (X.block(k, 0, 1, n) + ifco.block(0, 0, 1, n)).unaryExpr(act_func_recurrent);
-        const RowMajorMatrixXf f = (X.block(k, n, 1, n) + ifco.block(0, n, 1, n)).unaryExpr(act_func_recurrent);
-        const RowMajorMatrixXf c_pre = (X.block(k, n * 2, 1, n) + ifco.block(0, n * 2, 1, n)).unaryExpr(act_func);
-        const RowMajorMatrixXf o = (X.block(k, n * 3, 1, n) + ifco.block(0, n * 3, 1, n)).unaryExpr(act_func_recurrent);
+        const RowMajorMatrixXf<float_type> i = (X.block(k, 0, 1, n) + ifco.block(0, 0, 1, n)).unaryExpr(act_func_recurrent);
+        const RowMajorMatrixXf<float_type> f = (X.block(k, n, 1, n) + ifco.block(0, n, 1, n)).unaryExpr(act_func_recurrent);
+        const RowMajorMatrixXf<float_type> c_pre = (X.block(k, n * 2, 1, n) + ifco.block(0, n * 2, 1, n)).unaryExpr(act_func);
+        const RowMajorMatrixXf<float_type> o = (X.block(k, n * 3, 1, n) + ifco.block(0, n * 3, 1, n)).unaryExpr(act_func_recurrent);
 
         c = f.array() * c.array() + i.array() * c_pre.array();
         h = o.array() * c.unaryExpr(act_func).array();
@@ -166,8 +175,8 @@ inline tensor5s lstm_impl(const tensor5& input,
         }
 
     if (return_state) {
-        auto state_h = tensor5(shape5(1, 1, 1, 1, n_units), float_type(0));
-        auto state_c = tensor5(shape5(1, 1, 1, 1, n_units), float_type(0));
+        auto state_h = tensor5<float_type>(shape5(1, 1, 1, 1, n_units), float_type(0));
+        auto state_c = tensor5<float_type>(shape5(1, 1, 1, 1, n_units), float_type(0));
         for (EigenIndex idx = 0; idx < n; ++idx)
             state_h.set(0, 0, 0, 0, std::size_t(idx), h(idx));
         for (EigenIndex idx = 0; idx < n; ++idx)
@@ -176,21 +185,22 @@ inline tensor5s lstm_impl(const tensor5& input,
         lstm_result.push_back(state_c);
     }
     // Copy the final state back into the initial state in the event of a stateful LSTM call
-    initial_state_h = tensor5(shape5(1, 1, 1, 1, n_units), eigen_row_major_mat_to_values(h));
-    initial_state_c = tensor5(shape5(1, 1, 1, 1, n_units), eigen_row_major_mat_to_values(c));
+    initial_state_h = tensor5<float_type>(shape5(1, 1, 1, 1, n_units), eigen_row_major_mat_to_values(h));
+    initial_state_c = tensor5<float_type>(shape5(1, 1, 1, 1, n_units), eigen_row_major_mat_to_values(c));
     return lstm_result;
 }
 
-inline tensor5s gru_impl(const tensor5& input,
-    tensor5& initial_state_h,
+template <typename float_type>
+tensor5s<float_type> gru_impl(const tensor5<float_type>& input,
+    tensor5<float_type>& initial_state_h,
     const std::size_t n_units,
     const bool use_bias,
     const bool reset_after,
     const bool return_sequences,
     const bool return_state,
-    const float_vec& weights,
-    const float_vec& recurrent_weights,
-    const float_vec& bias,
+    const float_vec<float_type>& weights,
+    const float_vec<float_type>& recurrent_weights,
+    const float_vec<float_type>& bias,
     const std::string& activation,
     const std::string& recurrent_activation)
 {
@@ -199,56 +209,56 @@ inline tensor5s gru_impl(const tensor5& input,
 
     // weight matrices
     const EigenIndex n = EigenIndex(n_units);
-    const RowMajorMatrix<Dynamic, Dynamic> W = eigen_row_major_mat_from_values(n_features, n_units * 3, weights);
-    const RowMajorMatrix<Dynamic, Dynamic> U = eigen_row_major_mat_from_values(n_units, n_units * 3, recurrent_weights);
+    const RowMajorMatrix<float_type, Dynamic, Dynamic> W = eigen_row_major_mat_from_values(n_features, n_units * 3, weights);
+    const RowMajorMatrix<float_type, Dynamic, Dynamic> U = eigen_row_major_mat_from_values(n_units, n_units * 3, recurrent_weights);
 
     // kernel bias
-    RowVector<Dynamic> b_x(n_units * 3);
+    RowVector<float_type, Dynamic> b_x(n_units * 3);
     if (use_bias && bias.size() >= 1 * n_units * 3)
         std::copy_n(bias.cbegin(), n_units * 3, b_x.data());
     else
         b_x.setZero();
 
     // recurrent kernel bias
-    RowVector<Dynamic> b_h(n_units * 3);
+    RowVector<float_type, Dynamic> b_h(n_units * 3);
     if (use_bias && bias.size() >= 2 * n_units * 3)
-        std::copy_n(bias.cbegin() + static_cast<float_vec::const_iterator::difference_type>(n_units * 3), n_units * 3, b_h.data());
+        std::copy_n(bias.cbegin() + static_cast<typename float_vec<float_type>::const_iterator::difference_type>(n_units * 3), n_units * 3, b_h.data());
     else
         b_h.setZero();
 
     // initialize cell output states h
-    // RowVector<Dynamic> h(1, n_units);
-    RowMajorMatrixXf h(1, n_units);
+    // RowVector<float_type, Dynamic> h(1, n_units);
+    RowMajorMatrixXf<float_type> h(1, n_units);
     h = eigen_row_major_mat_from_values(1, n_units, *initial_state_h.as_vector());
 
     // write input to eigen matrix of shape (timesteps, n_features)
-    RowMajorMatrix<Dynamic, Dynamic> x(n_timesteps, n_features);
+    RowMajorMatrix<float_type, Dynamic, Dynamic> x(n_timesteps, n_features);
 
     for (std::size_t a_t = 0; a_t < n_timesteps; ++a_t)
         for (std::size_t a_f = 0; a_f < n_features; ++a_f)
             x(EigenIndex(a_t), EigenIndex(a_f)) = input.get(0, 0, 0, a_t, a_f);
 
     // kernel applied to inputs (with bias), produces shape (timesteps, n_units * 3)
-    RowMajorMatrix<Dynamic, Dynamic> Wx = x * W;
+    RowMajorMatrix<float_type, Dynamic, Dynamic> Wx = x * W;
     Wx.rowwise() += b_x;
 
     // get activation functions
-    auto act_func = get_activation_func(activation);
-    auto act_func_recurrent = get_activation_func(recurrent_activation);
+    auto act_func = get_activation_func<float_type>(activation);
+    auto act_func_recurrent = get_activation_func<float_type>(recurrent_activation);
 
     // computing GRU output
-    tensor5s gru_result;
+    tensor5s<float_type> gru_result;
 
     if (return_sequences)
-        gru_result = { tensor5(shape5(1, 1, 1, n_timesteps, n_units), float_type(0)) };
+        gru_result = { tensor5<float_type>(shape5(1, 1, 1, n_timesteps, n_units), float_type(0)) };
     else
-        gru_result = { tensor5(shape5(1, 1, 1, 1, n_units), float_type(0)) };
+        gru_result = { tensor5<float_type>(shape5(1, 1, 1, 1, n_units), float_type(0)) };
 
     for (EigenIndex k = 0; k < EigenIndex(n_timesteps); ++k)
     {
-        RowVector<Dynamic> r;
-        RowVector<Dynamic> z;
-        RowVector<Dynamic> m;
+        RowVector<float_type, Dynamic> r;
+        RowVector<float_type, Dynamic> z;
+        RowVector<float_type, Dynamic> m;
 
         // in the formulae below, the following notations are used:
         // A b       matrix product
@@ -265,7 +275,7 @@ inline tensor5s gru_impl(const tensor5& input,
         if (reset_after)
         {
             // recurrent kernel applied to timestep (with bias), produces shape (1, n_units * 3)
-            RowMajorMatrix<1, Dynamic> Uh = h * U;
+            RowMajorMatrix<float_type, 1, Dynamic> Uh = h * U;
             Uh += b_h;
 
             // z = sigmoid(W_{x,z} x + b_{i,z} + W_{h,z} h + b_{h,z})
@@ -297,21 +307,22 @@ inline tensor5s gru_impl(const tensor5& input,
 
 
         if (return_state) {
-            auto state_h = tensor5(shape5(1, 1, 1, 1, n_units), float_type(0));
+            auto state_h = tensor5<float_type>(shape5(1, 1, 1, 1, n_units), float_type(0));
             for (EigenIndex idx = 0; idx < n; ++idx)
                 state_h.set(0, 0, 0, 0, std::size_t(idx), h(idx));
             gru_result.push_back(state_h);
         }
         // Copy the final state back into the initial state in the event of a stateful LSTM call
-        initial_state_h = tensor5(shape5(1, 1, 1, 1, n_units), eigen_row_major_mat_to_values(h));
+        initial_state_h = tensor5<float_type>(shape5(1, 1, 1, 1, n_units), eigen_row_major_mat_to_values(h));
     }
 
     return gru_result;
 }
 
-inline tensor5 reverse_time_series_in_tensor5(const tensor5& ts)
+template <typename float_type>
+tensor5<float_type> reverse_time_series_in_tensor5(const tensor5<float_type>& ts)
 {
-    tensor5 reversed = tensor5(ts.shape(), float_type(0.0));
+    tensor5<float_type> reversed = tensor5<float_type>(ts.shape(), float_type(0.0));
     std::size_t n = 0;
     for (std::size_t x = ts.shape().width_; x--> 0;)
     {
@@ -25,25 +25,26 @@
 namespace fdeep { namespace internal
 {
 
+template <typename float_type>
 class tensor5
 {
 public:
-    tensor5(const shape5& shape, const shared_float_vec& values) :
+    tensor5(const shape5& shape, const shared_float_vec<float_type>& values) :
         shape_(shape),
         values_(values)
     {
         assertion(shape.volume() == values->size(), "invalid number of values");
     }
-    tensor5(const shape5& shape, float_vec&& values) :
+    tensor5(const shape5& shape, float_vec<float_type>&& values) :
         shape_(shape),
-        values_(fplus::make_shared_ref<float_vec>(std::move(values)))
+        values_(fplus::make_shared_ref<float_vec<float_type>>(std::move(values)))
     {
         assertion(shape.volume() == values_->size(),
             "invalid number of values");
     }
     tensor5(const shape5& shape, float_type value) :
         shape_(shape),
-        values_(fplus::make_shared_ref<float_vec>(shape.volume(), value))
+        values_(fplus::make_shared_ref<float_vec<float_type>>(shape.volume(), value))
     {
     }
     float_type get(const tensor5_pos& pos) const
@@ -100,10 +101,16 @@ public:
     {
         return shape().width_;
     }
-    const shared_float_vec& as_vector() const
+    const shared_float_vec<float_type>& as_vector() const
     {
         return values_;
     }
+    // Write access to the values.
+    // Their memory might be shared with other tensors.
+    float_vec<float_type>& as_mutable_vector()
+    {
+        return *values_;
+    }
 
 private:
     std::size_t idx(const tensor5_pos& pos) const
@@ -116,39 +123,56 @@ private:
             pos.z_;
     };
     shape5 shape_;
-    shared_float_vec values_;
+    shared_float_vec<float_type> values_;
 };
 
-typedef std::vector<tensor5> tensor5s;
-typedef std::vector<tensor5s> tensor5s_vec;
+template <typename float_type>
+using tensor5s = std::vector<tensor5<float_type>>;
+template <typename float_type>
+using tensor5s_vec = std::vector<tensor5s<float_type>>;
 
-inline bool is_singleton_value(const tensor5& t)
+template <typename float_type>
+bool is_singleton_value(const tensor5<float_type>& t)
 {
     return t.shape() == shape5(1, 1, 1, 1, 1);
 }
 
-inline float_type to_singleton_value(const tensor5& t)
+template <typename float_type>
+float_type to_singleton_value(const tensor5<float_type>& t)
 {
     assertion(is_singleton_value(t), "Tensor must contain exactly one value.");
     return t.get(tensor5_pos(0, 0, 0, 0, 0));
 }
 
-inline tensor5 from_singleton_value(float_type value)
+template <typename float_type>
+tensor5<float_type> from_singleton_value(float_type value)
+{
+    return tensor5<float_type>(shape5(1, 1, 1, 1, 1), value);
+}
+
+template <typename float_type, typename F>
+tensor5<float_type> transform_tensor5(F f, const tensor5<float_type>& m)
 {
-    return tensor5(shape5(1, 1, 1, 1, 1), value);
+    return tensor5<float_type>(m.shape(), fplus::transform(f, *m.as_vector()));
 }
 
-template <typename F>
-tensor5 transform_tensor5(F f, const tensor5& m)
+// Overwrites the values of m, and of all tensors sharing its memory.
+template <typename float_type, typename F>
+void transform_tensor5_in_place(F f, tensor5<float_type>& m)
 {
-    return tensor5(m.shape(), fplus::transform(f, *m.as_vector()));
+    auto& values = m.as_mutable_vector();
+    for (auto& value : values)
+    {
+        value = f(value);
+    }
 }
 
-inline tensor5 tensor5_from_depth_slices(const std::vector<tensor5>& ms)
+template <typename float_type>
+tensor5<float_type> tensor5_from_depth_slices(const std::vector<tensor5<float_type>>& ms)
 {
     assertion(!ms.empty(), "no slices given");
     assertion(
-        fplus::all_the_same_on(fplus_c_mem_fn_t(tensor5, shape, shape5), ms),
+        fplus::all_the_same_on(fplus_c_mem_fn_t(tensor5<float_type>, shape, shape5), ms),
         "all slices must have the same size");
     for (const auto& m : ms)
     {
@@ -156,7 +180,7 @@ inline tensor5 tensor5_from_depth_slices(const std::vector<tensor5>& ms)
     }
     std::size_t height = ms.front().shape().height_;
     std::size_t width = ms.front().shape().width_;
-    tensor5 m(shape5(1, 1, height, width, ms.size()), 0);
+    tensor5<float_type> m(shape5(1, 1, height, width, ms.size()), 0);
     for (std::size_t y = 0; y < m.shape().height_; ++y)
     {
         for (std::size_t x = 0; x < m.shape().width_; ++x)
@@ -170,13 +194,14 @@ inline tensor5 tensor5_from_depth_slices(const std::vector<tensor5>& ms)
     return m;
 }
 
-inline std::vector<tensor5> tensor5_to_depth_slices(const tensor5& m)
+template <typename float_type>
+std::vector<tensor5<float_type>> tensor5_to_depth_slices(const tensor5<float_type>& m)
 {
-    std::vector<tensor5> ms;
+    std::vector<tensor5<float_type>> ms;
     ms.reserve(m.shape().depth_);
     for (std::size_t i = 0; i < m.shape().depth_; ++i)
     {
-        ms.push_back(tensor5(shape5(1, 1,
+        ms.push_back(tensor5<float_type>(shape5(1, 1,
             m.shape().height_, m.shape().width_, 1), 0));
     }
 
@@ -193,13 +218,14 @@ inline std::vector<tensor5> tensor5_to_depth_slices(const tensor5& m)
     return ms;
 }
 
-inline tensor5s tensor5_to_tensor5s_width_slices(const tensor5& m)
+template <typename float_type>
+tensor5s<float_type> tensor5_to_tensor5s_width_slices(const tensor5<float_type>& m)
 {
-    tensor5s ms;
+    tensor5s<float_type> ms;
     ms.reserve(m.shape().width_);
     for (std::size_t i = 0; i < m.shape().width_; ++i)
     {
-        ms.push_back(tensor5(shape5(m.shape().size_dim_5_,
+        ms.push_back(tensor5<float_type>(shape5(m.shape().size_dim_5_,
                                     m.shape().size_dim_4_,
                                     m.shape().height_,
                                     1,
@@ -224,13 +250,14 @@ inline tensor5s tensor5_to_tensor5s_width_slices(const tensor5& m)
     return ms;
 }
 
-inline tensor5s tensor5_to_tensor5s_height_slices(const tensor5& m)
+template <typename float_type>
+tensor5s<float_type> tensor5_to_tensor5s_height_slices(const tensor5<float_type>& m)
 {
-    tensor5s ms;
+    tensor5s<float_type> ms;
     ms.reserve(m.shape().height_);
     for (std::size_t i = 0; i < m.shape().height_; ++i)
     {
-        ms.push_back(tensor5(shape5(m.shape().size_dim_5_,
+        ms.push_back(tensor5<float_type>(shape5(m.shape().size_dim_5_,
                                     m.shape().size_dim_4_,
                                     1,
                                     m.shape().width_,
@@ -255,13 +282,14 @@ inline tensor5s tensor5_to_tensor5s_height_slices(const tensor5& m)
     return ms;
 }
 
-inline tensor5s tensor5_to_tensor5s_dim4_slices(const tensor5& m)
+template <typename float_type>
+tensor5s<float_type> tensor5_to_tensor5s_dim4_slices(const tensor5<float_type>& m)
 {
-    tensor5s ms;
+    tensor5s<float_type> ms;
     ms.reserve(m.shape().size_dim_4_);
     for (std::size_t i = 0; i < m.shape().size_dim_4_; ++i)
     {
-        ms.push_back(tensor5(shape5(m.shape().size_dim_5_,
+        ms.push_back(tensor5<float_type>(shape5(m.shape().size_dim_5_,
                                     1,
                                     m.shape().height_,
                                     m.shape().width_,
@@ -286,13 +314,14 @@ inline tensor5s tensor5_to_tensor5s_dim4_slices(const tensor5& m)
     return ms;
 }
 
-inline tensor5s tensor5_to_tensor5s_dim5_slices(const tensor5& m)
+template <typename float_type>
+tensor5s<float_type> tensor5_to_tensor5s_dim5_slices(const tensor5<float_type>& m)
 {
-    tensor5s ms;
+    tensor5s<float_type> ms;
     ms.reserve(m.shape().size_dim_5_);
     for (std::size_t i = 0; i < m.shape().size_dim_5_; ++i)
     {
-        ms.push_back(tensor5(shape5(1,
+        ms.push_back(tensor5<float_type>(shape5(1,
                                     m.shape().size_dim_4_,
                                     m.shape().height_,
                                     m.shape().width_,
@@ -317,8 +346,9 @@ inline tensor5s tensor5_to_tensor5s_dim5_slices(const tensor5& m)
     return ms;
 }
 
-inline std::pair<tensor5_pos, tensor5_pos> tensor5_min_max_pos(
-    const tensor5& vol)
+template <typename float_type>
+std::pair<tensor5_pos, tensor5_pos> tensor5_min_max_pos(
+    const tensor5<float_type>& vol)
 {
     tensor5_pos result_min(0, 0, 0, 0, 0);
     tensor5_pos result_max(0, 0, 0, 0, 0);
@@ -347,7 +377,8 @@ inline std::pair<tensor5_pos, tensor5_pos> tensor5_min_max_pos(
     return std::make_pair(result_min, result_max);
 }
 
-inline std::vector<std::vector<std::size_t>> get_tensors_shape_sizes(const tensor5s& ts)
+template <typename float_type>
+std::vector<std::vector<std::size_t>> get_tensors_shape_sizes(const tensor5s<float_type>& ts)
 {
     return {
         fplus::transform([](const auto& t) { return t.shape().size_dim_5_; }, ts),
@@ -358,12 +389,14 @@ inline std::vector<std::vector<std::size_t>> get_tensors_shape_sizes(const tenso
     };
 }
 
-inline tensor5_pos tensor5_max_pos(const tensor5& vol)
+template <typename float_type>
+tensor5_pos tensor5_max_pos(const tensor5<float_type>& vol)
 {
     return tensor5_min_max_pos(vol).second;
 }
 
-inline tensor5 concatenate_tensor5s_depth(const tensor5s& in)
+template <typename float_type>
+tensor5<float_type> concatenate_tensor5s_depth(const tensor5s<float_type>& in)
 {
     const auto shape_sizes = get_tensors_shape_sizes(in);
     assertion(
@@ -373,7 +406,7 @@ inline tensor5 concatenate_tensor5s_depth(const tensor5s& in)
         fplus::all_the_same(shape_sizes[3]),
         "Tensor shapes differ on wrong dimension.");
 
-    tensor5 result(shape5(in.front().shape().size_dim_5_,
+    tensor5<float_type> result(shape5(in.front().shape().size_dim_5_,
                           in.front().shape().size_dim_4_,
                           in.front().shape().height_,
                           in.front().shape().width_,
@@ -401,7 +434,8 @@ inline tensor5 concatenate_tensor5s_depth(const tensor5s& in)
     return result;
 }
 
-inline tensor5 concatenate_tensor5s_width(const tensor5s& in)
+template <typename float_type>
+tensor5<float_type> concatenate_tensor5s_width(const tensor5s<float_type>& in)
 {
     const auto shape_sizes = get_tensors_shape_sizes(in);
     assertion(
@@ -411,7 +445,7 @@ inline tensor5 concatenate_tensor5s_width(const tensor5s& in)
         fplus::all_the_same(shape_sizes[4]),
         "Tensor shapes differ on wrong dimension.");
 
-    tensor5 result(shape5(in.front().shape().size_dim_5_,
+    tensor5<float_type> result(shape5(in.front().shape().size_dim_5_,
                           in.front().shape().size_dim_4_,
                           in.front().shape().height_,
                           fplus::sum(shape_sizes[3]),
@@ -439,7 +473,8 @@ inline tensor5 concatenate_tensor5s_width(const tensor5s& in)
     return result;
 }
 
-inline tensor5 concatenate_tensor5s_height(const tensor5s& in)
+template <typename float_type>
+tensor5<float_type> concatenate_tensor5s_height(const tensor5s<float_type>& in)
 {
     const auto shape_sizes = get_tensors_shape_sizes(in);
     assertion(
@@ -449,7 +484,7 @@ inline tensor5 concatenate_tensor5s_height(const tensor5s& in)
         fplus::all_the_same(shape_sizes[4]),
         "Tensor shapes differ on wrong dimension.");
 
-    tensor5 result(shape5(in.front().shape().size_dim_5_,
+    tensor5<float_type> result(shape5(in.front().shape().size_dim_5_,
                           in.front().shape().size_dim_4_,
                           fplus::sum(shape_sizes[2]),
                           in.front().shape().width_,
@@ -477,7 +512,8 @@ inline tensor5 concatenate_tensor5s_height(const tensor5s& in)
     return result;
 }
 
-inline tensor5 concatenate_tensor5s_dim4(const tensor5s& in)
+template <typename float_type>
+tensor5<float_type> concatenate_tensor5s_dim4(const tensor5s<float_type>& in)
 {
     const auto shape_sizes = get_tensors_shape_sizes(in);
     assertion(
@@ -487,7 +523,7 @@ inline tensor5 concatenate_tensor5s_dim4(const tensor5s& in)
         fplus::all_the_same(shape_sizes[4]),
         "Tensor shapes differ on wrong dimension.");
 
-    tensor5 result(shape5(in.front().shape().size_dim_5_,
+    tensor5<float_type> result(shape5(in.front().shape().size_dim_5_,
                           fplus::sum(shape_sizes[1]),
                           in.front().shape().height_,
                           in.front().shape().width_,
@@ -515,7 +551,8 @@ inline tensor5 concatenate_tensor5s_dim4(const tensor5s& in)
     return result;
 }
 
-inline tensor5 concatenate_tensor5s_dim5(const tensor5s& in)
+template <typename float_type>
+tensor5<float_type> concatenate_tensor5s_dim5(const tensor5s<float_type>& in)
 {
     const auto shape_sizes = get_tensors_shape_sizes(in);
     assertion(
@@ -525,7 +562,7 @@ inline tensor5 concatenate_tensor5s_dim5(const tensor5s& in)
         fplus::all_the_same(shape_sizes[4]),
         "Tensor shapes differ on wrong dimension.");
 
-    tensor5 result(shape5(fplus::sum(shape_sizes[0]),
+    tensor5<float_type> result(shape5(fplus::sum(shape_sizes[0]),
                           in.front().shape().size_dim_4_,
                           in.front().shape().height_,
                           in.front().shape().width_,
@@ -553,7 +590,8 @@ inline tensor5 concatenate_tensor5s_dim5(const tensor5s& in)
     return result;
 }
 
-inline tensor5 concatenate_tensor5s(const tensor5s& ts, std::int32_t axis)
+template <typename float_type>
+tensor5<float_type> concatenate_tensor5s(const tensor5s<float_type>& ts, std::int32_t axis)
 {
     const auto rank = ts.front().shape().rank();
     if (axis < 0)
@@ -583,20 +621,22 @@ inline tensor5 concatenate_tensor5s(const tensor5s& ts, std::int32_t axis)
     }
     raise_error("Invalid axis (" + std::to_string(axis) +
         ") for tensor concatenation.");
-    return tensor5(shape5(0, 0, 0, 0, 0), 0);
+    return tensor5<float_type>(shape5(0, 0, 0, 0, 0), 0);
 }
 
-inline tensor5 flatten_tensor5(const tensor5& vol)
+template <typename float_type>
+tensor5<float_type> flatten_tensor5(const tensor5<float_type>& vol)
 {
-    return tensor5(shape5(1, 1, 1, 1, vol.shape().volume()), vol.as_vector());
+    return tensor5<float_type>(shape5(1, 1, 1, 1, vol.shape().volume()), vol.as_vector());
 }
 
-inline tensor5 pad_tensor5(float_type val,
+template <typename float_type>
+tensor5<float_type> pad_tensor5(typename non_deduced<float_type>::type val,
     std::size_t top_pad, std::size_t bottom_pad,
     std::size_t left_pad, std::size_t right_pad,
-    const tensor5& in)
+    const tensor5<float_type>& in)
 {
-    tensor5 result(shape5(1, 1,
+    tensor5<float_type> result(shape5(1, 1,
         in.shape().height_ + top_pad + bottom_pad,
         in.shape().width_ + left_pad + right_pad,
         in.shape().depth_), val);
@@ -622,7 +662,8 @@ inline void check_permute_tensor5_dims(const std::vector<std::size_t>& dims)
         "Invalid dims for permute_tensor5.");
 }
 
-inline tensor5 permute_tensor5(const tensor5& in,
+template <typename float_type>
+tensor5<float_type> permute_tensor5(const tensor5<float_type>& in,
     const std::vector<std::size_t>& dims_raw)
 {
     check_permute_tensor5_dims(dims_raw);
@@ -639,7 +680,7 @@ inline tensor5 permute_tensor5(const tensor5& in,
             get_shape5_dimension_by_index(in.shape(), dims[i]));
     }
 
-    tensor5 out(out_shape, 0);
+    tensor5<float_type> out(out_shape, 0);
 
     for (std::size_t dim5 = 0; dim5 < in.shape().size_dim_5_; ++dim5)
     {
@@ -667,12 +708,13 @@ inline tensor5 permute_tensor5(const tensor5& in,
     return out;
 }
 
-inline tensor5 crop_tensor5(
+template <typename float_type>
+tensor5<float_type> crop_tensor5(
     std::size_t top_crop, std::size_t bottom_crop,
     std::size_t left_crop, std::size_t right_crop,
-    const tensor5& in)
+    const tensor5<float_type>& in)
 {
-    tensor5 result(shape5(1, 1,
+    tensor5<float_type> result(shape5(1, 1,
         in.shape().height_ - (top_crop + bottom_crop),
         in.shape().width_ - (left_crop + right_crop),
         in.shape().depth_), 0);
@@ -689,14 +731,15 @@ inline tensor5 crop_tensor5(
     return result;
 }
 
-inline tensor5 dilate_tensor5(const shape2& dilation_rate, const tensor5& in)
+template <typename float_type>
+tensor5<float_type> dilate_tensor5(const shape2& dilation_rate, const tensor5<float_type>& in)
 {
     if (dilation_rate == shape2(1, 1))
     {
         return in;
     }
 
-    tensor5 result(dilate_shape5(dilation_rate, in.shape()), 0);
+    tensor5<float_type> result(dilate_shape5(dilation_rate, in.shape()), 0);
     for (std::size_t y = 0; y < in.shape().height_; ++y)
     {
         for (std::size_t x = 0; x < in.shape().width_; ++x)
@@ -714,7 +757,8 @@ inline tensor5 dilate_tensor5(const shape2& dilation_rate, const tensor5& in)
     return result;
 }
 
-inline tensor5 reshape_tensor5(const tensor5& in,
+template <typename float_type>
+tensor5<float_type> reshape_tensor5(const tensor5<float_type>& in,
     const std::vector<int>& target_shape)
 {
     const auto shape = target_shape;
@@ -734,22 +778,23 @@ inline tensor5 reshape_tensor5(const tensor5& in,
     assertion(fplus::all_by(fplus::is_positive<int>, deduced_shape),
         "Invalid shape values in reshape");
 
-    return tensor5(shape5(1, 1,
+    return tensor5<float_type>(shape5(1, 1,
         static_cast<std::size_t>(deduced_shape[0]),
         static_cast<std::size_t>(deduced_shape[1]),
         static_cast<std::size_t>(deduced_shape[2])),
         in.as_vector());
 }
 
-inline tensor5 sum_tensor5s(const tensor5s& ts)
+template <typename float_type>
+tensor5<float_type> sum_tensor5s(const tensor5s<float_type>& ts)
 {
     assertion(!ts.empty(), "no tensor5s given");
     assertion(
-        fplus::all_the_same_on(fplus_c_mem_fn_t(tensor5, shape, shape5), ts),
+        fplus::all_the_same_on(fplus_c_mem_fn_t(tensor5<float_type>, shape, shape5), ts),
         "all tensor5s must have the same size");
     const auto ts_values = fplus::transform(
-        fplus_c_mem_fn_t(tensor5, as_vector, shared_float_vec), ts);
-    float_vec result_values;
+        fplus_c_mem_fn_t(tensor5<float_type>, as_vector, shared_float_vec<float_type>), ts);
+    float_vec<float_type> result_values;
     result_values.reserve(ts_values.front()->size());
     for (std::size_t i = 0; i < ts_values.front()->size(); ++i)
     {
@@ -760,24 +805,25 @@ inline tensor5 sum_tensor5s(const tensor5s& ts)
         }
         result_values.push_back(sum_val);
     }
-    return tensor5(ts.front().shape(), std::move(result_values));
+    return tensor5<float_type>(ts.front().shape(), std::move(result_values));
 }
 
-inline tensor5 multiply_tensor5s(const tensor5s& ts_all)
+template <typename float_type>
+tensor5<float_type> multiply_tensor5s(const tensor5s<float_type>& ts_all)
 {
     assertion(!ts_all.empty(), "no tensor5s given");
     const auto factors_and_tensors = fplus::partition(
-        is_singleton_value, ts_all);
+        is_singleton_value<float_type>, ts_all);
     auto ts = factors_and_tensors.second;
     if (ts.empty()) {
         ts.push_back(from_singleton_value(static_cast<float_type>(1)));
     }
     assertion(
-        fplus::all_the_same_on(fplus_c_mem_fn_t(tensor5, shape, shape5), ts),
+        fplus::all_the_same_on(fplus_c_mem_fn_t(tensor5<float_type>, shape, shape5), ts),
         "all tensor5s must have the same size");
     const auto ts_values = fplus::transform(
-        fplus_c_mem_fn_t(tensor5, as_vector, shared_float_vec), ts);
-    float_vec result_values;
+        fplus_c_mem_fn_t(tensor5<float_type>, as_vector, shared_float_vec<float_type>), ts);
+    float_vec<float_type> result_values;
     result_values.reserve(ts_values.front()->size());
     for (std::size_t i = 0; i < ts_values.front()->size(); ++i)
     {
@@ -790,38 +836,67 @@ inline tensor5 multiply_tensor5s(const tensor5s& ts_all)
     }
     if (factors_and_tensors.first.size() > 0) {
         const auto factor = fplus::product(
-            fplus::transform(to_singleton_value, factors_and_tensors.first));
+            fplus::transform(to_singleton_value<float_type>, factors_and_tensors.first));
         result_values = fplus::transform(
             fplus::multiply_with<float_type>(factor), result_values);
     }
-    return tensor5(ts.front().shape(), std::move(result_values));
+    return tensor5<float_type>(ts.front().shape(), std::move(result_values));
 }
 
-inline tensor5 subtract_tensor5(const tensor5& a, const tensor5& b)
+// Folds the values at each position of equally shaped tensors with f,
+// writing the results into the memory of ts[dest_idx].
+// The values are combined in the same order as in sum_tensor5s,
+// so the results are identical.
+template <typename float_type, typename F>
+tensor5<float_type> fold_tensor5s_into(F f, float_type init,
+    const tensor5s<float_type>& ts, std::size_t dest_idx)
+{
+    assertion(dest_idx < ts.size(), "invalid destination index");
+    assertion(
+        fplus::all_the_same_on(fplus_c_mem_fn_t(tensor5<float_type>, shape, shape5), ts),
+        "all tensor5s must have the same size");
+    tensor5<float_type> result = ts[dest_idx];
+    auto& result_values = result.as_mutable_vector();
+    for (std::size_t i = 0; i < result_values.size(); ++i)
+    {
+        float_type acc = init;
+        for (const auto& t : ts)
+        {
+            acc = f(acc, (*t.as_vector())[i]);
+        }
+        result_values[i] = acc;
+    }
+    return result;
+}
+
+template <typename float_type>
+tensor5<float_type> subtract_tensor5(const tensor5<float_type>& a, const tensor5<float_type>& b)
 {
     assertion(a.shape() == b.shape(),
         "both tensor5s must have the same size");
     auto result_values = fplus::zip_with(std::minus<float_type>(),
         *a.as_vector(), *b.as_vector());
-    return tensor5(a.shape(), std::move(result_values));
+    return tensor5<float_type>(a.shape(), std::move(result_values));
 }
 
-inline tensor5 average_tensor5s(const tensor5s& ts)
+template <typename float_type>
+tensor5<float_type> average_tensor5s(const tensor5s<float_type>& ts)
 {
     const auto sum = sum_tensor5s(ts);
     const float_type divisor = static_cast<float_type>(ts.size());
     return transform_tensor5(fplus::multiply_with(1 / divisor), sum);
 }
 
-inline tensor5 max_tensor5s(const tensor5s& ts)
+template <typename float_type>
+tensor5<float_type> max_tensor5s(const tensor5s<float_type>& ts)
 {
     assertion(!ts.empty(), "no tensor5s given");
     assertion(
-        fplus::all_the_same_on(fplus_c_mem_fn_t(tensor5, shape, shape5), ts),
+        fplus::all_the_same_on(fplus_c_mem_fn_t(tensor5<float_type>, shape, shape5), ts),
         "all tensor5s must have the same size");
     const auto ts_values = fplus::transform(
-        fplus_c_mem_fn_t(tensor5, as_vector, shared_float_vec), ts);
-    float_vec result_values;
+        fplus_c_mem_fn_t(tensor5<float_type>, as_vector, shared_float_vec<float_type>), ts);
+    float_vec<float_type> result_values;
     result_values.reserve(ts_values.front()->size());
     for (std::size_t i = 0; i < ts_values.front()->size(); ++i)
     {
@@ -832,21 +907,23 @@ inline tensor5 max_tensor5s(const tensor5s& ts)
         }
         result_values.push_back(max_val);
     }
-    return tensor5(ts.front().shape(), std::move(result_values));
+    return tensor5<float_type>(ts.front().shape(), std::move(result_values));
 }
 
-inline RowMajorMatrixXf eigen_row_major_mat_from_values(std::size_t height,
-    std::size_t width, const float_vec& values)
+template <typename float_type>
+RowMajorMatrixXf<float_type> eigen_row_major_mat_from_values(std::size_t height,
+    std::size_t width, const float_vec<float_type>& values)
 {
     assertion(height * width == values.size(), "invalid shape");
-    RowMajorMatrixXf m(height, width);
+    RowMajorMatrixXf<float_type> m(height, width);
     std::memcpy(m.data(), values.data(), values.size() * sizeof(float_type));
     return m;
 }
 
-inline shared_float_vec eigen_row_major_mat_to_values(const RowMajorMatrixXf& m)
+template <typename float_type>
+shared_float_vec<float_type> eigen_row_major_mat_to_values(const RowMajorMatrixXf<float_type>& m)
 {
-    shared_float_vec result = fplus::make_shared_ref<float_vec>();
+    shared_float_vec<float_type> result = fplus::make_shared_ref<float_vec<float_type>>();
     result->resize(static_cast<std::size_t>(m.rows() * m.cols()));
     std::memcpy(result->data(), m.data(), result->size() * sizeof(float_type));
     return result;
@@ -854,15 +931,23 @@ inline shared_float_vec eigen_row_major_mat_to_values(const RowMajorMatrixXf& m)
 
 } // namespace internal
 
-using float_type = internal::float_type;
-using float_vec = internal::float_vec;
-using shared_float_vec = internal::shared_float_vec;
-using tensor5 = internal::tensor5;
-using tensor5s = internal::tensor5s;
-using tensor5s_vec = internal::tensor5s_vec;
-
-
-inline std::string show_tensor5(const tensor5& t)
+using float_type = internal::default_float_type;
+using float_vec = internal::float_vec<float_type>;
+using shared_float_vec = internal::shared_float_vec<float_type>;
+using tensor5 = internal::tensor5<float_type>;
+using tensor5s = internal::tensor5s<float_type>;
+using tensor5s_vec = internal::tensor5s_vec<float_type>;
+
+// The same with any other precision, e.g., basic_tensor5<double>.
+template <typename float_type>
+using basic_tensor5 = internal::tensor5<float_type>;
+template <typename float_type>
+using basic_tensor5s = internal::tensor5s<float_type>;
+template <typename float_type>
+using basic_tensor5s_vec = internal::tensor5s_vec<float_type>;
+
+template <typename float_type>
+std::string show_tensor5(const basic_tensor5<float_type>& t)
 {
     const auto xs = *t.as_vector();
     const auto test_strs = fplus::transform(
@@ -879,9 +964,10 @@ inline std::string show_tensor5(const tensor5& t)
                         fplus::split_every(t.shape().depth_, strs))))));
 }
 
-inline std::string show_tensor5s(const tensor5s& ts)
+template <typename float_type>
+std::string show_tensor5s(const basic_tensor5s<float_type>& ts)
 {
-    return fplus::show_cont(fplus::transform(show_tensor5, ts));
+    return fplus::show_cont(fplus::transform(show_tensor5<float_type>, ts));
 }
 
 // Converts a memory block holding 8-bit values into a tensor5.
@@ -890,38 +976,42 @@ inline std::string show_tensor5s(const tensor5s& ts)
 // Example:
 //     With low = 0.0 and high = 1.0 every value is essentially divided by 255.
 // May be used to convert an image (bgr, rgba, gray, etc.) to a tensor5.
-inline tensor5 tensor5_from_bytes(const std::uint8_t* value_ptr,
+template <typename float_type = fdeep::float_type>
+basic_tensor5<float_type> tensor5_from_bytes(const std::uint8_t* value_ptr,
     std::size_t height, std::size_t width, std::size_t channels,
-    internal::float_type low = 0.0f, internal::float_type high = 1.0f)
+    typename internal::non_deduced<float_type>::type low = 0.0f,
+    typename internal::non_deduced<float_type>::type high = 1.0f)
 {
     const std::vector<std::uint8_t> bytes(
         value_ptr, value_ptr + height * width * channels);
-    auto values = fplus::transform_convert<float_vec>(
-        [low, high](std::uint8_t b) -> internal::float_type
+    auto values = fplus::transform_convert<internal::float_vec<float_type>>(
+        [low, high](std::uint8_t b) -> float_type
     {
         return fplus::reference_interval(low, high,
             static_cast<float_type>(0.0f),
             static_cast<float_type>(255.0f),
-            static_cast<internal::float_type>(b));
+            static_cast<float_type>(b));
     }, bytes);
-    return tensor5(shape5(1, 1, height, width, channels), std::move(values));
+    return basic_tensor5<float_type>(shape5(1, 1, height, width, channels), std::move(values));
 }
 
 // Converts a tensor5 into a memory block holding 8-bit values.
 // Data will be stored row-wise (and channels_last).
 // Scales the values from range [low, high] into [0, 255].
 // May be used to convert a tensor5 into an image.
-inline void tensor5_into_bytes(const tensor5& t, std::uint8_t* value_ptr,
+template <typename float_type>
+void tensor5_into_bytes(const basic_tensor5<float_type>& t, std::uint8_t* value_ptr,
     std::size_t bytes_available,
-    internal::float_type low = 0.0f, internal::float_type high = 1.0f)
+    typename internal::non_deduced<float_type>::type low = 0.0f,
+    typename internal::non_deduced<float_type>::type high = 1.0f)
 {
     const auto values = t.as_vector();
     internal::assertion(bytes_available == values->size(),
     "invalid buffer size");
     const auto bytes = fplus::transform(
-        [low, high](internal::float_type v) -> std::uint8_t
+        [low, high](float_type v) -> std::uint8_t
     {
-        return fplus::round<internal::float_type, std::uint8_t>(
+        return fplus::round<float_type, std::uint8_t>(
             fplus::reference_interval(
                 static_cast<float_type>(0.0f),
                 static_cast<float_type>(255.0f), low, high, v));
@@ -935,32 +1025,35 @@ inline void tensor5_into_bytes(const tensor5& t, std::uint8_t* value_ptr,
 // Converts a tensor5 into a vector of bytes.
 // Data will be stored row-wise (and channels_last).
 // Scales the values from range [low, high] into [0, 255].
-inline std::vector<std::uint8_t> tensor5_to_bytes(const tensor5& t,
-    internal::float_type low = 0.0f, internal::float_type high = 1.0f)
+template <typename float_type>
+std::vector<std::uint8_t> tensor5_to_bytes(const basic_tensor5<float_type>& t,
+    typename internal::non_deduced<float_type>::type low = 0.0f,
+    typename internal::non_deduced<float_type>::type high = 1.0f)
 {
     std::vector<std::uint8_t> bytes(t.shape().volume(), 0);
     tensor5_into_bytes(t, bytes.data(), bytes.size(), low, high);
     return bytes;
 }
 
-inline tensor5s_vec reshape_tensor5_vectors(
+template <typename float_type>
+basic_tensor5s_vec<float_type> reshape_tensor5_vectors(
     std::size_t vectors_size,
     std::size_t vector_size,
     std::size_t depth,
     std::size_t height,
     std::size_t width,
-    const tensor5s_vec& tss)
+    const basic_tensor5s_vec<float_type>& tss)
 {
     const auto values = fplus::concat(fplus::concat(
         fplus::transform_inner(
-            [](const tensor5& t) -> float_vec {return *t.as_vector();},
+            [](const basic_tensor5<float_type>& t) -> internal::float_vec<float_type> {return *t.as_vector();},
             tss)));
 
     fdeep::internal::assertion(values.size() == vectors_size * vector_size * height * width * depth,
         "Invalid number of values for reshape target.");
 
     const auto ts = fplus::transform(
-        [&](fdeep::float_vec v) -> tensor5 {return tensor5(shape5(1, 1, height, width, depth), std::move(v));},
+        [&](internal::float_vec<float_type> v) -> basic_tensor5<float_type> {return basic_tensor5<float_type>(shape5(1, 1, height, width, depth), std::move(v));},
         fplus::split_every(depth * height * width, values));
 
     return fplus::split_every(vector_size, ts);
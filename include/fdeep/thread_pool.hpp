@@ -0,0 +1,396 @@
+// Copyright 2016, Tobias Hermann.
+// https://github.com/Dobiasd/frugally-deep
+// Distributed under the MIT License.
+// (See accompanying LICENSE file or at
+//  https://opensource.org/licenses/MIT)
+
+#pragma once
+
+#include "fdeep/common.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace fdeep { namespace internal
+{
+
+class thread_pool;
+
+// The pool used by the forward pass running on the current thread,
+// nullptr if it is running sequentially.
+inline thread_pool*& current_thread_pool()
+{
+    static thread_local thread_pool* pool = nullptr;
+    return pool;
+}
+
+// Fixed set of worker threads, each one owning a task queue.
+// Workers take tasks from the back of their own queue
+// and steal from the front of the other queues when it is empty.
+// Threads waiting for a result (wait_until) run pending tasks meanwhile,
+// so tasks may themselves submit tasks and wait for them
+// without exhausting the pool.
+class thread_pool
+{
+public:
+    typedef std::function<void()> task;
+
+    // The calling threads take part in the work when waiting,
+    // so thread_count - 1 additional threads are started.
+    explicit thread_pool(std::size_t thread_count) :
+        queues_(),
+        workers_(),
+        wake_mutex_(),
+        wake_(),
+        pending_(0),
+        next_queue_(0),
+        stop_(false)
+    {
+        assertion(thread_count > 0, "invalid thread count");
+        const std::size_t worker_count = thread_count - 1;
+        for (std::size_t i = 0; i < std::max<std::size_t>(worker_count, 1); ++i)
+        {
+            queues_.push_back(std::make_unique<task_queue>());
+        }
+        for (std::size_t i = 0; i < worker_count; ++i)
+        {
+            workers_.emplace_back([this, i]() { worker_loop(i); });
+        }
+    }
+
+    ~thread_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (auto& worker : workers_)
+        {
+            worker.join();
+        }
+    }
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    std::size_t thread_count() const
+    {
+        return workers_.size() + 1;
+    }
+
+    void submit(task t)
+    {
+        const std::size_t queue_idx = current_worker_pool() == this
+            ? current_worker_idx()
+            : next_queue_++ % queues_.size();
+        {
+            std::lock_guard<std::mutex> lock(queues_[queue_idx]->mutex_);
+            queues_[queue_idx]->tasks_.push_back(std::move(t));
+        }
+        ++pending_;
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex_);
+        }
+        wake_.notify_one();
+    }
+
+    // Must be called after a state change waiting threads might be
+    // interested in, i.e., one that turns their done predicate true.
+    void notify_waiters()
+    {
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex_);
+        }
+        wake_.notify_all();
+    }
+
+    // Runs pending tasks on the calling thread until done() returns true.
+    void wait_until(const std::function<bool()>& done)
+    {
+        while (!done())
+        {
+            task t;
+            if (try_take(t))
+            {
+                t();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(wake_mutex_);
+            wake_.wait(lock, [this, &done]()
+            {
+                return done() || pending_ > 0;
+            });
+        }
+    }
+
+    // Calls f(i) for every i in [0, n), distributed over the pool.
+    // Exceptions thrown by f are rethrown on the calling thread.
+    void parallel_for(std::size_t n, const std::function<void(std::size_t)>& f)
+    {
+        if (n == 0)
+        {
+            return;
+        }
+        struct state
+        {
+            explicit state(std::size_t remaining) :
+                    remaining_(remaining),
+                    error_mutex_(),
+                    error_()
+            {
+            }
+            std::atomic<std::size_t> remaining_;
+            std::mutex error_mutex_;
+            std::exception_ptr error_;
+        };
+        const auto s = std::make_shared<state>(n);
+        for (std::size_t i = 1; i < n; ++i)
+        {
+            submit([this, s, &f, i]()
+            {
+                run_guarded(*s, f, i);
+                if (--s->remaining_ == 0)
+                {
+                    notify_waiters();
+                }
+            });
+        }
+        run_guarded(*s, f, 0);
+        --s->remaining_;
+        wait_until([&s]() { return s->remaining_ == 0; });
+        if (s->error_)
+        {
+            std::rethrow_exception(s->error_);
+        }
+    }
+
+private:
+    struct task_queue
+    {
+        task_queue() :
+                mutex_(),
+                tasks_()
+        {
+        }
+        std::mutex mutex_;
+        std::deque<task> tasks_;
+    };
+
+    template <typename State>
+    static void run_guarded(State& s,
+        const std::function<void(std::size_t)>& f, std::size_t i)
+    {
+        try
+        {
+            f(i);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(s.error_mutex_);
+            if (!s.error_)
+            {
+                s.error_ = std::current_exception();
+            }
+        }
+    }
+
+    static thread_pool*& current_worker_pool()
+    {
+        static thread_local thread_pool* pool = nullptr;
+        return pool;
+    }
+
+    static std::size_t& current_worker_idx()
+    {
+        static thread_local std::size_t idx = 0;
+        return idx;
+    }
+
+    bool try_take(task& t)
+    {
+        const std::size_t own_idx = current_worker_pool() == this
+            ? current_worker_idx() : 0;
+        {
+            auto& own = *queues_[own_idx];
+            std::lock_guard<std::mutex> lock(own.mutex_);
+            if (!own.tasks_.empty())
+            {
+                t = std::move(own.tasks_.back());
+                own.tasks_.pop_back();
+                --pending_;
+                return true;
+            }
+        }
+        for (std::size_t i = 1; i < queues_.size(); ++i)
+        {
+            auto& other = *queues_[(own_idx + i) % queues_.size()];
+            std::lock_guard<std::mutex> lock(other.mutex_);
+            if (!other.tasks_.empty())
+            {
+                t = std::move(other.tasks_.front());
+                other.tasks_.pop_front();
+                --pending_;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void worker_loop(std::size_t idx)
+    {
+        current_worker_pool() = this;
+        current_worker_idx() = idx;
+        current_thread_pool() = this;
+        for (;;)
+        {
+            task t;
+            if (try_take(t))
+            {
+                t();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(wake_mutex_);
+            wake_.wait(lock, [this]() { return stop_ || pending_ > 0; });
+            if (stop_)
+            {
+                return;
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<task_queue>> queues_;
+    std::vector<std::thread> workers_;
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+    std::atomic<std::size_t> pending_;
+    std::atomic<std::size_t> next_queue_;
+    bool stop_;
+};
+
+typedef std::shared_ptr<thread_pool> thread_pool_ptr;
+
+// Pool using all hardware threads, for work like loading a model,
+// nullptr if there is only one.
+inline thread_pool_ptr make_hardware_thread_pool()
+{
+    const std::size_t thread_count = std::thread::hardware_concurrency();
+    return thread_count > 1
+        ? std::make_shared<thread_pool>(thread_count)
+        : thread_pool_ptr();
+}
+
+// Independent tasks, which are run by the pool (if not null)
+// and waited for together.
+// The first exception thrown by any of them is rethrown by wait.
+class task_group
+{
+public:
+    explicit task_group(thread_pool* pool) :
+        pool_(pool), state_(std::make_shared<state>())
+    {
+    }
+
+    ~task_group()
+    {
+        if (pool_)
+        {
+            const auto s = state_;
+            pool_->wait_until([&s]() { return s->remaining_ == 0; });
+        }
+    }
+
+    task_group(const task_group&) = delete;
+    task_group& operator=(const task_group&) = delete;
+
+    void run(const std::function<void()>& f)
+    {
+        if (!pool_)
+        {
+            f();
+            return;
+        }
+        ++state_->remaining_;
+        const auto s = state_;
+        thread_pool* pool = pool_;
+        pool_->submit([s, pool, f]()
+        {
+            try
+            {
+                f();
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(s->error_mutex_);
+                if (!s->error_)
+                {
+                    s->error_ = std::current_exception();
+                }
+            }
+            if (--s->remaining_ == 0)
+            {
+                pool->notify_waiters();
+            }
+        });
+    }
+
+    void wait()
+    {
+        if (!pool_)
+        {
+            return;
+        }
+        const auto s = state_;
+        pool_->wait_until([&s]() { return s->remaining_ == 0; });
+        if (s->error_)
+        {
+            std::rethrow_exception(s->error_);
+        }
+    }
+
+private:
+    struct state
+    {
+        state() :
+                remaining_(0),
+                error_mutex_(),
+                error_()
+        {
+        }
+        std::atomic<std::size_t> remaining_;
+        std::mutex error_mutex_;
+        std::exception_ptr error_;
+    };
+    thread_pool* pool_;
+    std::shared_ptr<state> state_;
+};
+
+// Sets current_thread_pool for the lifetime of the scope object.
+class thread_pool_scope
+{
+public:
+    explicit thread_pool_scope(thread_pool* pool) :
+        previous_(current_thread_pool())
+    {
+        current_thread_pool() = pool;
+    }
+    ~thread_pool_scope()
+    {
+        current_thread_pool() = previous_;
+    }
+    thread_pool_scope(const thread_pool_scope&) = delete;
+    thread_pool_scope& operator=(const thread_pool_scope&) = delete;
+private:
+    thread_pool* previous_;
+};
+
+} } // namespace fdeep, namespace internal
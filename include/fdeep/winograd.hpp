@@ -0,0 +1,384 @@
+// Copyright 2016, Tobias Hermann.
+// https://github.com/Dobiasd/frugally-deep
+// Distributed under the MIT License.
+// (See accompanying LICENSE file or at
+//  https://opensource.org/licenses/MIT)
+
+#pragma once
+
+#include "fdeep/common.hpp"
+
+#include "fdeep/convolution.hpp"
+#include "fdeep/float_buffer.hpp"
+#include "fdeep/tensor5.hpp"
+#include "fdeep/thread_pool.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace fdeep { namespace internal
+{
+
+// Winograd minimal filtering F(2x2, 3x3) for 3x3 convolutions with stride 1.
+// https://arxiv.org/abs/1509.09308
+// Every 2x2 output tile is computed from a 4x4 input tile
+// with 16 instead of 36 multiplications per input and output channel.
+// The input tiles are transformed into the Winograd domain,
+// where the convolution becomes one matrix multiplication
+// per position of the 4x4 tile,
+// whose results are transformed back into the output tiles.
+// Unlike im2col, the input is not inflated by the filter size,
+// and the padding is handled while gathering the input tiles.
+
+const std::size_t winograd_tile_positions = 16;
+
+// Holds 16 row-major (filter_count_ x depth_) matrices,
+// one per position of a transformed 4x4 tile.
+// The weights can also be a view into a memory-mapped model file.
+template <typename float_type>
+struct winograd_filter_matrices
+{
+    winograd_filter_matrices() :
+            weights_(),
+            bias_(),
+            depth_(0),
+            filter_count_(0)
+    {
+    }
+    winograd_filter_matrices(const float_buffer<float_type>& weights,
+        const float_vec<float_type>& bias,
+        std::size_t depth, std::size_t filter_count) :
+            weights_(weights),
+            bias_(bias),
+            depth_(depth),
+            filter_count_(filter_count)
+    {
+        assertion(weights.size() ==
+            winograd_tile_positions * filter_count * depth,
+            "invalid Winograd weight size");
+        assertion(bias.size() == filter_count, "invalid bias size");
+    }
+    float_buffer<float_type> weights_;
+    float_vec<float_type> bias_;
+    std::size_t depth_;
+    std::size_t filter_count_;
+};
+
+// Small channel counts do not amortize the transformations.
+const std::size_t winograd_min_depth = 8;
+const std::size_t winograd_min_filter_count = 8;
+
+inline bool winograd_applicable(const shape5& filter_shape,
+    std::size_t filter_count, const shape2& strides, const shape2& dilation_rate)
+{
+    return filter_shape.height_ == 3 && filter_shape.width_ == 3 &&
+        strides == shape2(1, 1) && dilation_rate == shape2(1, 1) &&
+        filter_shape.depth_ >= winograd_min_depth &&
+        filter_count >= winograd_min_filter_count;
+}
+
+// U = G g G^T for every filter and input channel.
+template <typename float_type>
+winograd_filter_matrices<float_type> generate_winograd_filter_matrices(
+    const im2col_filter_matrix<float_type>& filter_mat)
+{
+    const shape5& filter_shape = filter_mat.filter_shape_;
+    assertion(filter_shape.height_ == 3 && filter_shape.width_ == 3,
+        "Winograd convolution needs 3x3 filters");
+    const std::size_t depth = filter_shape.depth_;
+    const std::size_t filter_count = filter_mat.filter_count_;
+    float_vec<float_type> weights(
+        winograd_tile_positions * filter_count * depth);
+    const float_type* src = filter_mat.weights_.data();
+    for (std::size_t k = 0; k < filter_count; ++k)
+    {
+        for (std::size_t z = 0; z < depth; ++z)
+        {
+            const auto g = [&](std::size_t y, std::size_t x) -> float_type
+            {
+                return src[(k * 9 + y * 3 + x) * depth + z];
+            };
+            float_type gg[4][3];
+            for (std::size_t x = 0; x < 3; ++x)
+            {
+                gg[0][x] = g(0, x);
+                gg[1][x] = (g(0, x) + g(1, x) + g(2, x)) / 2;
+                gg[2][x] = (g(0, x) - g(1, x) + g(2, x)) / 2;
+                gg[3][x] = g(2, x);
+            }
+            for (std::size_t y = 0; y < 4; ++y)
+            {
+                const float_type u[4] = {
+                    gg[y][0],
+                    (gg[y][0] + gg[y][1] + gg[y][2]) / 2,
+                    (gg[y][0] - gg[y][1] + gg[y][2]) / 2,
+                    gg[y][2]};
+                for (std::size_t x = 0; x < 4; ++x)
+                {
+                    weights[((y * 4 + x) * filter_count + k) * depth + z] =
+                        u[x];
+                }
+            }
+        }
+    }
+    const auto& bias = filter_mat.bias_;
+    return {float_buffer<float_type>(std::move(weights)),
+        float_vec<float_type>(bias.data(), bias.data() + bias.size()),
+        depth, filter_count};
+}
+
+template <typename float_type>
+using winograd_channels = Eigen::Map<Eigen::Array<float_type, Eigen::Dynamic, 1>,
+    Eigen::Unaligned>;
+
+template <typename float_type>
+using winograd_const_channels = Eigen::Map<
+    const Eigen::Array<float_type, Eigen::Dynamic, 1>, Eigen::Unaligned>;
+
+// V = B^T d B for all channels of one input tile,
+// with t holding the intermediate B^T d.
+// The values of one position are processed together,
+// so the transformation is vectorized over the channels.
+template <typename float_type>
+void winograd_transform_input_tile(
+    const std::array<const float_type*, winograd_tile_positions>& d,
+    const std::array<float_type*, winograd_tile_positions>& v,
+    std::size_t depth,
+    Eigen::Array<float_type, Eigen::Dynamic, Eigen::Dynamic>& t)
+{
+    const auto size = static_cast<EigenIndex>(depth);
+    const auto in = [&](std::size_t i)
+    {
+        return winograd_const_channels<float_type>(d[i], size);
+    };
+    for (EigenIndex x = 0; x < 4; ++x)
+    {
+        const auto i = static_cast<std::size_t>(x);
+        t.col(x) = in(i) - in(8 + i);
+        t.col(4 + x) = in(4 + i) + in(8 + i);
+        t.col(8 + x) = in(8 + i) - in(4 + i);
+        t.col(12 + x) = in(4 + i) - in(12 + i);
+    }
+    for (std::size_t y = 0; y < 4; ++y)
+    {
+        const auto row = static_cast<EigenIndex>(y * 4);
+        winograd_channels<float_type>(v[y * 4 + 0], size) =
+            t.col(row) - t.col(row + 2);
+        winograd_channels<float_type>(v[y * 4 + 1], size) =
+            t.col(row + 1) + t.col(row + 2);
+        winograd_channels<float_type>(v[y * 4 + 2], size) =
+            t.col(row + 2) - t.col(row + 1);
+        winograd_channels<float_type>(v[y * 4 + 3], size) =
+            t.col(row + 1) - t.col(row + 3);
+    }
+}
+
+// Y = A^T m A plus bias for all filters of one output tile,
+// with t holding the intermediate A^T m.
+template <typename float_type>
+void winograd_transform_output_tile(
+    const std::array<const float_type*, winograd_tile_positions>& m,
+    const std::array<float_type*, 4>& out,
+    const float_vec<float_type>& bias,
+    Eigen::Array<float_type, Eigen::Dynamic, Eigen::Dynamic>& t)
+{
+    const auto size = static_cast<EigenIndex>(bias.size());
+    const auto in = [&](std::size_t i)
+    {
+        return winograd_const_channels<float_type>(m[i], size);
+    };
+    for (EigenIndex x = 0; x < 4; ++x)
+    {
+        const auto i = static_cast<std::size_t>(x);
+        t.col(x) = in(i) + in(4 + i) + in(8 + i);
+        t.col(4 + x) = in(4 + i) - in(8 + i) - in(12 + i);
+    }
+    const winograd_const_channels<float_type> b(bias.data(), size);
+    for (std::size_t y = 0; y < 2; ++y)
+    {
+        const auto row = static_cast<EigenIndex>(y * 4);
+        winograd_channels<float_type>(out[y * 2 + 0], size) =
+            t.col(row) + t.col(row + 1) + t.col(row + 2) + b;
+        winograd_channels<float_type>(out[y * 2 + 1], size) =
+            t.col(row + 1) - t.col(row + 2) - t.col(row + 3) + b;
+    }
+}
+
+// The tiles are processed in chunks,
+// so the transformed tiles of a chunk stay in the cache.
+const std::size_t winograd_chunk_values = 1 << 17;
+
+// Convolves all inputs, which must share the same shape,
+// the output tiles of all of them being split into chunks
+// and, when the forward pass runs on a thread pool, into blocks of chunks.
+template <typename float_type>
+tensor5s<float_type> winograd_convolve_batch(
+    const padding& pad_type,
+    bool use_offset,
+    const winograd_filter_matrices<float_type>& filter_mats,
+    const tensor5s<float_type>& inputs)
+{
+    assertion(!inputs.empty(), "no input tensors");
+    const auto input_shape = inputs.front().shape();
+    assertion(fplus::all_the_same_on(
+        fplus_c_mem_fn_t(tensor5<float_type>, shape, shape5), inputs),
+        "all inputs must have the same shape");
+    const std::size_t depth = filter_mats.depth_;
+    const std::size_t filter_count = filter_mats.filter_count_;
+    assertion(depth == input_shape.depth_, "invalid filter depth");
+
+    const auto conv_cfg = preprocess_convolution(shape2(3, 3), shape2(1, 1),
+        pad_type, use_offset, input_shape.height_, input_shape.width_);
+    const std::size_t out_height = conv_cfg.out_height_;
+    const std::size_t out_width = conv_cfg.out_width_;
+    const std::size_t out_volume = out_height * out_width * filter_count;
+    const std::size_t tiles_y = (out_height + 1) / 2;
+    const std::size_t tiles_x = (out_width + 1) / 2;
+    const std::size_t sample_tiles = tiles_y * tiles_x;
+    const std::size_t tile_count = sample_tiles * inputs.size();
+
+    shared_float_vec<float_type> res_vec = fplus::make_shared_ref<float_vec<float_type>>();
+    res_vec->resize(out_volume * inputs.size());
+
+    // Read for input positions in the padding.
+    const float_vec<float_type> zeros(depth, 0);
+
+    const std::size_t chunk_tiles = std::max<std::size_t>(1,
+        winograd_chunk_values / (winograd_tile_positions *
+            std::max(depth, filter_count)));
+
+    const auto process_tiles = [&](std::size_t tile_begin, std::size_t tile_end)
+    {
+        const std::size_t chunk_size = std::min(chunk_tiles,
+            tile_end - tile_begin);
+        ColMajorMatrixXf<float_type> v(depth,
+            winograd_tile_positions * chunk_size);
+        ColMajorMatrixXf<float_type> m(filter_count,
+            winograd_tile_positions * chunk_size);
+        // Receives the outputs of tiles exceeding the output shape.
+        float_vec<float_type> discarded(filter_count);
+        std::array<const float_type*, winograd_tile_positions> d;
+        std::array<float_type*, winograd_tile_positions> v_cols;
+        std::array<const float_type*, winograd_tile_positions> m_cols;
+        std::array<float_type*, 4> out;
+        Eigen::Array<float_type, Eigen::Dynamic, Eigen::Dynamic> t_in(
+            depth, winograd_tile_positions);
+        Eigen::Array<float_type, Eigen::Dynamic, Eigen::Dynamic> t_out(
+            filter_count, 8);
+        for (std::size_t chunk_begin = tile_begin; chunk_begin < tile_end;
+            chunk_begin += chunk_size)
+        {
+            const std::size_t chunk_end = std::min(chunk_begin + chunk_size,
+                tile_end);
+            for (std::size_t tile = chunk_begin; tile < chunk_end; ++tile)
+            {
+                const auto& in = *inputs[tile / sample_tiles].as_vector();
+                const std::size_t ty = (tile % sample_tiles) / tiles_x;
+                const std::size_t tx = tile % tiles_x;
+                for (std::size_t y = 0; y < 4; ++y)
+                {
+                    // Positions in the padded input.
+                    const std::size_t py = conv_cfg.offset_y_ + 2 * ty + y;
+                    const bool row_valid = py >= conv_cfg.pad_top_ &&
+                        py - conv_cfg.pad_top_ < input_shape.height_;
+                    for (std::size_t x = 0; x < 4; ++x)
+                    {
+                        const std::size_t px = conv_cfg.offset_x_ + 2 * tx + x;
+                        d[y * 4 + x] = row_valid && px >= conv_cfg.pad_left_ &&
+                            px - conv_cfg.pad_left_ < input_shape.width_
+                            ? in.data() + ((py - conv_cfg.pad_top_) *
+                                input_shape.width_ + px - conv_cfg.pad_left_) *
+                                depth
+                            : zeros.data();
+                    }
+                }
+                for (std::size_t i = 0; i < winograd_tile_positions; ++i)
+                {
+                    v_cols[i] = v.data() +
+                        (i * chunk_size + tile - chunk_begin) * depth;
+                }
+                winograd_transform_input_tile(d, v_cols, depth, t_in);
+            }
+
+            const EigenIndex tiles = static_cast<EigenIndex>(
+                chunk_end - chunk_begin);
+            for (std::size_t i = 0; i < winograd_tile_positions; ++i)
+            {
+                const Eigen::Map<const RowMajorMatrixXf<float_type>,
+                    Eigen::Unaligned> u(
+                    filter_mats.weights_.data() + i * filter_count * depth,
+                    static_cast<EigenIndex>(filter_count),
+                    static_cast<EigenIndex>(depth));
+                const EigenIndex begin = static_cast<EigenIndex>(i * chunk_size);
+                m.middleCols(begin, tiles).noalias() =
+                    u * v.middleCols(begin, tiles);
+            }
+
+            for (std::size_t tile = chunk_begin; tile < chunk_end; ++tile)
+            {
+                float_type* out_sample = res_vec->data() +
+                    (tile / sample_tiles) * out_volume;
+                const std::size_t ty = (tile % sample_tiles) / tiles_x;
+                const std::size_t tx = tile % tiles_x;
+                for (std::size_t y = 0; y < 2; ++y)
+                {
+                    for (std::size_t x = 0; x < 2; ++x)
+                    {
+                        const std::size_t oy = 2 * ty + y;
+                        const std::size_t ox = 2 * tx + x;
+                        out[y * 2 + x] = oy < out_height && ox < out_width
+                            ? out_sample + (oy * out_width + ox) * filter_count
+                            : discarded.data();
+                    }
+                }
+                for (std::size_t i = 0; i < winograd_tile_positions; ++i)
+                {
+                    m_cols[i] = m.data() +
+                        (i * chunk_size + tile - chunk_begin) * filter_count;
+                }
+                winograd_transform_output_tile(m_cols, out,
+                    filter_mats.bias_, t_out);
+            }
+        }
+    };
+
+    thread_pool* pool = current_thread_pool();
+    const std::size_t madds = tile_count * winograd_tile_positions *
+        depth * filter_count;
+    const std::size_t block_count = pool == nullptr ||
+        madds < parallel_convolution_min_madds ? 1 :
+        std::min(pool->thread_count(),
+            tile_count / parallel_convolution_min_block_cols);
+
+    if (block_count <= 1)
+    {
+        process_tiles(0, tile_count);
+    }
+    else
+    {
+        pool->parallel_for(block_count, [&](std::size_t block)
+        {
+            process_tiles(block * tile_count / block_count,
+                (block + 1) * tile_count / block_count);
+        });
+    }
+
+    return split_convolution_results(res_vec,
+        shape5(1, 1, out_height, out_width, filter_count), inputs.size());
+}
+
+template <typename float_type>
+tensor5<float_type> winograd_convolve(
+    const padding& pad_type,
+    bool use_offset,
+    const winograd_filter_matrices<float_type>& filter_mats,
+    const tensor5<float_type>& input)
+{
+    return winograd_convolve_batch(pad_type, use_offset, filter_mats,
+        {input}).front();
+}
+
+} } // namespace fdeep, namespace internal
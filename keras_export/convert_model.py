@@ -6,6 +6,7 @@ import base64
 import datetime
 import hashlib
 import json
+import struct
 import sys
 
 import keras
@@ -22,6 +23,16 @@ __email__ = "editgym@gmail.com"
 
 STORE_FLOATS_HUMAN_READABLE = False
 
+BINARY_MAGIC = b'FDEEPBIN'
+BINARY_FORMAT_VERSION = 2
+BINARY_ALIGNMENT = 64
+
+WEIGHT_FORMATS = ['float16', 'bfloat16']
+
+# Layers frugally-deep can run with int8 weights (see FAQ).
+QUANTIZABLE_LAYER_TYPES = ['Conv1D', 'Conv2D', 'SeparableConv1D', 'SeparableConv2D',
+                           'DepthwiseConv2D', 'Dense']
+
 
 def transform_input_kernel(kernel):
     """Transforms weights of a single CuDNN input kernel into the regular Keras format."""
@@ -178,8 +189,8 @@ def are_embedding_layer_positions_ok_for_testing(model):
     return embedding_layer_names(model) == embedding_layer_names_at_input_nodes(model)
 
 
-def gen_test_data(model):
-    """Generate data for model verification test."""
+def gen_input_data(model):
+    """Generate random data fitting the inputs of a model."""
 
     def set_shape_idx_0_to_1_if_none(shape):
         """Change first element in tuple to 1."""
@@ -208,7 +219,13 @@ def gen_test_data(model):
     assert are_embedding_layer_positions_ok_for_testing(
         model), "Test data can only be generated if embedding layers are positioned directly after input nodes."
 
-    data_in = list(map(generate_input_data, get_model_input_layers(model)))
+    return list(map(generate_input_data, get_model_input_layers(model)))
+
+
+def gen_test_data(model):
+    """Generate data for model verification test."""
+
+    data_in = gen_input_data(model)
 
     warm_up_runs = 3
     test_runs = 5
@@ -241,9 +258,64 @@ def split_every(size, seq):
 
 
 def encode_floats(arr):
-    """Serialize a sequence of floats."""
+    """Mark a sequence of floats for serialization.
+    The actual encoding depends on the output format,
+    see serialize_floats_json and write_binary_model."""
+    return np.asarray(arr, dtype=np.float32).flatten()
+
+
+class HalfFloats:
+    """Float array to be stored with 16 bits per value,
+    either as float16 or as bfloat16 (the upper half of a float32)."""
+
+    def __init__(self, arr, weight_format):
+        assert weight_format in WEIGHT_FORMATS
+        self.weight_format = weight_format
+        if weight_format == 'float16':
+            self.values = arr.astype('<f2')
+        else:
+            # Round to nearest even.
+            bits = arr.astype('<f4').view('<u4').astype(np.uint64)
+            self.values = ((bits + 0x7fff + ((bits >> 16) & 1)) >> 16).astype('<u2')
+
+    def as_float32(self):
+        """The stored values, widened again."""
+        if self.weight_format == 'float16':
+            return self.values.astype(np.float32)
+        return (self.values.astype('<u4') << 16).view('<f4')
+
+
+def store_weights_as_half_floats(trainable_params, weight_format):
+    """Mark the weights (not biases, statistics etc.) of all layers
+    to be stored with 16 bits per value."""
+    for layer_params in trainable_params.values():
+        for key, value in layer_params.items():
+            if key.endswith('weights') and isinstance(value, np.ndarray):
+                layer_params[key] = HalfFloats(value, weight_format)
+
+
+def round_kernels_to_half_floats(model, weight_format):
+    """Round the kernels of the model (in place) to the values
+    they will have when stored with 16 bits per value,
+    so the test data generated afterwards matches the stored model."""
+    for variable in model.weights:
+        name = variable.name.split('/')[-1]
+        if 'kernel' in name or 'embeddings' in name:
+            values = K.get_value(variable)
+            K.set_value(variable, HalfFloats(values, weight_format).as_float32()
+                        .reshape(values.shape))
+
+
+def serialize_floats_json(arr):
+    """Serialize a sequence of floats marked by encode_floats."""
+    if isinstance(arr, HalfFloats):
+        if STORE_FLOATS_HUMAN_READABLE:
+            return arr.as_float32().tolist()
+        return {arr.weight_format: serialize_floats_json(arr.values)}
+    if not isinstance(arr, np.ndarray):
+        raise TypeError('{} is not JSON serializable'.format(type(arr)))
     if STORE_FLOATS_HUMAN_READABLE:
-        return arr.flatten().tolist()
+        return arr.tolist()
     return list(split_every(1024, base64.b64encode(arr).decode('ascii')))
 
 
@@ -771,7 +843,7 @@ def get_shapes(tensor5s):
     return [t['shape'] for t in tensor5s]
 
 
-def calculate_hash(model):
+def calculate_hash(model, weight_format=None):
     layers = model.layers
     hash_m = hashlib.sha256()
     for layer in layers:
@@ -779,6 +851,9 @@ def calculate_hash(model):
             assert isinstance(weights, np.ndarray)
             hash_m.update(weights.tobytes())
         hash_m.update(layer.name.encode('ascii'))
+    # The stored weights differ with it.
+    if weight_format:
+        hash_m.update(weight_format.encode('ascii'))
     return hash_m.hexdigest()
 
 
@@ -789,7 +864,57 @@ def as_list(value_or_values):
     return [value_or_values]
 
 
-def model_to_fdeep_json(model, no_tests=False):
+def get_activation_ranges(model, data_in):
+    """Return the maximum absolute input value of every quantizable layer,
+    which frugally-deep uses to quantize the layer inputs to int8.
+    Nested models are processed recursively."""
+    probes = []
+    for layer in model.layers:
+        layer_type = type(layer).__name__
+        is_nested = layer_type in ['Model', 'Sequential']
+        if is_nested or layer_type in QUANTIZABLE_LAYER_TYPES:
+            # The first inbound node of a nested model is its own input.
+            first_node = 1 if is_nested else 0
+            for node_index in range(first_node, len(layer._inbound_nodes)):
+                probes.append((layer, as_list(layer.get_input_at(node_index))))
+    if not probes:
+        return {}
+
+    probe_model = Model(inputs=model.inputs,
+                        outputs=[tensor for _, tensors in probes for tensor in tensors])
+    values = as_list(probe_model.predict(data_in))
+
+    result = {}
+
+    def update(name, max_abs):
+        result[name] = max(result.get(name, 0.0), max_abs)
+
+    pos = 0
+    for layer, tensors in probes:
+        layer_values = values[pos:pos + len(tensors)]
+        pos += len(tensors)
+        if type(layer).__name__ in ['Model', 'Sequential']:
+            for name, max_abs in get_activation_ranges(layer, layer_values).items():
+                update(name, max_abs)
+        else:
+            update(layer.name, float(np.max(np.abs(layer_values[0]))))
+    return result
+
+
+def load_calibration_data(model, samples_path):
+    """Load the sample inputs stored in an .npy file (single input)
+    or an .npz file (one array per model input, in order).
+    Without a path, random inputs are used."""
+    if samples_path is None:
+        return gen_input_data(model)
+    loaded = np.load(samples_path)
+    if isinstance(loaded, np.ndarray):
+        return [loaded]
+    return [loaded[key] for key in loaded.files]
+
+
+def model_to_fdeep_json(model, no_tests=False, calibrate=False, calibration_samples=None,
+                        weight_format=None):
     """Convert any Keras model to the frugally-deep model format."""
 
     # Force creation of underlying functional model.
@@ -799,6 +924,9 @@ def model_to_fdeep_json(model, no_tests=False):
 
     model = convert_sequential_to_model(model)
 
+    if weight_format:
+        round_kernels_to_half_floats(model, weight_format)
+
     test_data = None if no_tests else gen_test_data(model)
 
     json_output = {}
@@ -832,16 +960,67 @@ def model_to_fdeep_json(model, no_tests=False):
 
     print('Converting model weights.')
     json_output['trainable_params'] = get_all_weights(model)
+    if weight_format:
+        store_weights_as_half_floats(json_output['trainable_params'], weight_format)
     print('Done converting model weights.')
 
+    if calibrate:
+        print('Calibrating activation ranges.')
+        json_output['activation_ranges'] = get_activation_ranges(
+            model, load_calibration_data(model, calibration_samples))
+
     print('Calculating model hash.')
-    json_output['hash'] = calculate_hash(model)
+    json_output['hash'] = calculate_hash(model, weight_format)
     print('Model conversion finished.')
 
     return json_output
 
 
-def convert(in_path, out_path, no_tests=False):
+def write_binary_model(path, json_output):
+    """Write the model in the binary format.
+    It consists of (all numbers little endian):
+    magic bytes, format version (uint32), blob alignment (uint32),
+    header size in bytes (uint64), header, padding, blobs.
+    The header is the JSON model, but with every float array replaced by
+    {"blob_offset": ..., "blob_floats": ...}, the offset being relative
+    to the end of the header padding, and with an additional "blob_format"
+    for arrays stored with 16 bits per value.
+    The blobs hold the raw float32 (or 16-bit) values, each one aligned,
+    so the loader can map them into memory and use them in place."""
+    blobs = []
+    blobs_size = [0]
+
+    def store_blob(arr):
+        blob_ref = {'blob_offset': blobs_size[0]}
+        if isinstance(arr, HalfFloats):
+            blob_ref['blob_format'] = arr.weight_format
+            arr = arr.values
+            data = arr.tobytes()
+        elif isinstance(arr, np.ndarray):
+            data = arr.astype('<f4').tobytes()
+        else:
+            raise TypeError('{} is not serializable'.format(type(arr)))
+        padding = -len(data) % BINARY_ALIGNMENT
+        blob_ref['blob_floats'] = int(arr.size)
+        blobs.append(data + b'\0' * padding)
+        blobs_size[0] += len(data) + padding
+        return blob_ref
+
+    header = json.dumps(json_output, allow_nan=False, sort_keys=True,
+                        default=store_blob).encode('utf-8')
+    prefix = BINARY_MAGIC + struct.pack(
+        '<IIQ', BINARY_FORMAT_VERSION, BINARY_ALIGNMENT, len(header))
+    header_padding = -(len(prefix) + len(header)) % BINARY_ALIGNMENT
+    with open(path, 'wb') as binary_file:
+        binary_file.write(prefix)
+        binary_file.write(header)
+        binary_file.write(b'\0' * header_padding)
+        for blob in blobs:
+            binary_file.write(blob)
+
+
+def convert(in_path, out_path, no_tests=False, binary=False,
+            calibrate=False, calibration_samples=None, weight_format=None):
     """Convert any (h5-)stored Keras model to the frugally-deep model format."""
 
     assert K.backend() == "tensorflow"
@@ -850,34 +1029,50 @@ def convert(in_path, out_path, no_tests=False):
 
     print('loading {}'.format(in_path))
     model = load_model(in_path)
-    json_output = model_to_fdeep_json(model, no_tests)
+    json_output = model_to_fdeep_json(model, no_tests, calibrate, calibration_samples,
+                                      weight_format)
     print('writing {}'.format(out_path))
-    write_text_file(out_path, json.dumps(
-        json_output, allow_nan=False, indent=2, sort_keys=True))
+    if binary:
+        write_binary_model(out_path, json_output)
+    else:
+        write_text_file(out_path, json.dumps(
+            json_output, allow_nan=False, indent=2, sort_keys=True,
+            default=serialize_floats_json))
 
 
 def main():
     """Parse command line and convert model."""
 
-    usage = 'usage: [Keras model in HDF5 format] [output path] (--no-tests)'
+    usage = 'usage: [Keras model in HDF5 format] [output path] (--no-tests) (--binary)' \
+            ' (--calibrate[=samples.npz]) (--weight-format=float16|bfloat16)'
 
     # todo: Use ArgumentParser instead.
-    if len(sys.argv) not in [3, 4]:
+    if len(sys.argv) not in [3, 4, 5, 6, 7]:
         print(usage)
         sys.exit(1)
 
     in_path = sys.argv[1]
     out_path = sys.argv[2]
 
-    no_tests = False
-    if len(sys.argv) == 4:
-        if sys.argv[3] not in ['--no-tests']:
-            print(usage)
-            sys.exit(1)
-        if sys.argv[3] == '--no-tests':
-            no_tests = True
-
-    convert(in_path, out_path, no_tests)
+    options = sys.argv[3:]
+    calibration_options = [option for option in options
+                           if option == '--calibrate' or option.startswith('--calibrate=')]
+    weight_format_options = [option for option in options
+                             if option in ['--weight-format=' + fmt for fmt in WEIGHT_FORMATS]]
+    if len(calibration_options) > 1 or len(weight_format_options) > 1 or any(
+            option not in ['--no-tests', '--binary'] + calibration_options + weight_format_options
+            for option in options):
+        print(usage)
+        sys.exit(1)
+    no_tests = '--no-tests' in options
+    binary = '--binary' in options
+    calibrate = bool(calibration_options)
+    calibration_samples = calibration_options[0].split('=', 1)[1] \
+        if calibrate and '=' in calibration_options[0] else None
+    weight_format = weight_format_options[0].split('=', 1)[1] \
+        if weight_format_options else None
+
+    convert(in_path, out_path, no_tests, binary, calibrate, calibration_samples, weight_format)
 
 
 if __name__ == "__main__":
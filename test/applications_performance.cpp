@@ -64,6 +64,10 @@ int main()
                 duration_sum / static_cast<double>(test_runs);
             std::cout << "Forward pass took "
                 << duration_avg << " s on average." << std::endl;
+            const auto memory = model.test_activation_memory();
+            std::cout << "Activations need " << memory.peak_bytes_
+                << " bytes at peak instead of " << memory.total_bytes_
+                << " bytes." << std::endl;
         }
         catch (const std::exception& e)
         {
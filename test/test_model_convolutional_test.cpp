@@ -10,6 +10,381 @@
 
 #define FDEEP_FLOAT_TYPE double
 
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Deterministic but non-constant values in [-1, 1].
+static fdeep::float_vec generate_test_values(std::size_t count,
+    std::size_t seed)
+{
+    fdeep::float_vec values(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        values[i] = static_cast<fdeep::float_type>(
+            std::sin(static_cast<double>(i * 7 + seed * 131) * 0.37));
+    }
+    return values;
+}
+
+static fdeep::tensor5 generate_test_tensor(const fdeep::shape5& shape,
+    std::size_t seed)
+{
+    return fdeep::tensor5(shape, generate_test_values(shape.volume(), seed));
+}
+
+static fdeep::tensor5s generate_test_inputs(const fdeep::model& model)
+{
+    return fplus::transform([](const fdeep::shape5& shape) -> fdeep::tensor5
+    {
+        return generate_test_tensor(shape, 0);
+    }, model.get_dummy_input_shapes());
+}
+
+static void require_near(const fdeep::tensor5& x, const fdeep::tensor5& y)
+{
+    REQUIRE(x.shape() == y.shape());
+    const auto& xs = *x.as_vector();
+    const auto& ys = *y.as_vector();
+    for (std::size_t i = 0; i < xs.size(); ++i)
+    {
+        REQUIRE(static_cast<double>(xs[i]) ==
+            doctest::Approx(static_cast<double>(ys[i])).epsilon(0.0001));
+    }
+}
+
+static void require_near(const fdeep::tensor5s& xs, const fdeep::tensor5s& ys)
+{
+    REQUIRE(xs.size() == ys.size());
+    for (std::size_t i = 0; i < xs.size(); ++i)
+    {
+        require_near(xs[i], ys[i]);
+    }
+}
+
+// Implicit padding along one dimension, computed as described in
+// https://www.tensorflow.org/api_guides/python/nn#Convolution
+// independently of fdeep::internal::preprocess_convolution.
+struct naive_padding
+{
+    std::size_t out_;
+    std::size_t pad_before_;
+    std::size_t offset_;
+};
+
+static naive_padding compute_naive_padding(std::size_t in,
+    std::size_t extent, std::size_t stride,
+    fdeep::internal::padding pad_type, bool use_offset)
+{
+    const std::size_t out = pad_type == fdeep::internal::padding::same
+        ? (in + stride - 1) / stride
+        : (in - extent) / stride + 1;
+    const std::size_t needed = (out - 1) * stride + extent;
+    const std::size_t pad_total = needed > in ? needed - in : 0;
+    // Input positions at the end not reached by any window
+    // are split evenly before and after when use_offset is set.
+    const std::size_t leftover = in + pad_total - needed;
+    return {out, pad_total / 2, use_offset ? leftover / 2 : 0};
+}
+
+// Reference convolution without any of the optimized kernels.
+// The weights are stored filter after filter, each one row-major
+// over (y, x, depth), like in an im2col_filter_matrix.
+// Input positions outside of the input are skipped.
+static fdeep::tensor5 naive_convolve(
+    const fdeep::internal::shape2& strides,
+    fdeep::internal::padding pad_type,
+    bool use_offset,
+    const fdeep::shape5& filter_shape,
+    const fdeep::internal::shape2& dilation_rate,
+    const fdeep::float_vec& weights,
+    const fdeep::float_vec& bias,
+    const fdeep::tensor5& input)
+{
+    const auto pad_y = compute_naive_padding(input.height(),
+        (filter_shape.height_ - 1) * dilation_rate.height_ + 1,
+        strides.height_, pad_type, use_offset);
+    const auto pad_x = compute_naive_padding(input.width(),
+        (filter_shape.width_ - 1) * dilation_rate.width_ + 1,
+        strides.width_, pad_type, use_offset);
+    const std::size_t k = bias.size();
+    fdeep::tensor5 result(fdeep::shape5(1, 1,
+        pad_y.out_, pad_x.out_, k), 0);
+    for (std::size_t y = 0; y < pad_y.out_; ++y)
+    {
+        for (std::size_t x = 0; x < pad_x.out_; ++x)
+        {
+            for (std::size_t f = 0; f < k; ++f)
+            {
+                double sum = static_cast<double>(bias[f]);
+                for (std::size_t yf = 0; yf < filter_shape.height_; ++yf)
+                {
+                    const int iy = static_cast<int>(pad_y.offset_ +
+                        y * strides.height_ + yf * dilation_rate.height_) -
+                        static_cast<int>(pad_y.pad_before_);
+                    for (std::size_t xf = 0; xf < filter_shape.width_; ++xf)
+                    {
+                        const int ix = static_cast<int>(pad_x.offset_ +
+                            x * strides.width_ + xf * dilation_rate.width_) -
+                            static_cast<int>(pad_x.pad_before_);
+                        if (iy < 0 || iy >= static_cast<int>(input.height()) ||
+                            ix < 0 || ix >= static_cast<int>(input.width()))
+                        {
+                            continue;
+                        }
+                        for (std::size_t z = 0; z < filter_shape.depth_; ++z)
+                        {
+                            sum += static_cast<double>(
+                                weights[f * filter_shape.volume() +
+                                    (yf * filter_shape.width_ + xf) *
+                                    filter_shape.depth_ + z]) *
+                                static_cast<double>(input.get(0, 0,
+                                    static_cast<std::size_t>(iy),
+                                    static_cast<std::size_t>(ix), z));
+                        }
+                    }
+                }
+                result.set(0, 0, y, x, f, static_cast<fdeep::float_type>(sum));
+            }
+        }
+    }
+    return result;
+}
+
+// A convolution to compare with its naive counterpart.
+// k_ is the number of filters, for separable convolutions
+// the one of the pointwise step.
+struct conv_config
+{
+    fdeep::shape5 input_shape_;
+    fdeep::internal::shape2 filter_size_;
+    std::size_t k_;
+    fdeep::internal::shape2 strides_;
+    fdeep::internal::shape2 dilation_rate_;
+};
+
+// Calls check(config, pad_type, use_offset) for every configuration
+// with same and valid padding, with and without offset.
+template <typename F>
+static void for_each_conv_config(const std::vector<conv_config>& configs,
+    F check)
+{
+    for (const auto& config : configs)
+    {
+        for (const auto pad_type :
+            {fdeep::internal::padding::same, fdeep::internal::padding::valid})
+        {
+            for (const bool use_offset : {false, true})
+            {
+                check(config, pad_type, use_offset);
+            }
+        }
+    }
+}
+
+static fdeep::shape5 filter_shape(const conv_config& config)
+{
+    return fdeep::shape5(1, 1, config.filter_size_.height_,
+        config.filter_size_.width_, config.input_shape_.depth_);
+}
+
+static fdeep::float_vec filter_weights(const conv_config& config)
+{
+    return generate_test_values(config.k_ * filter_shape(config).volume(), 2);
+}
+
+static fdeep::float_vec filter_bias(const conv_config& config)
+{
+    return generate_test_values(config.k_, 3);
+}
+
+static fdeep::internal::im2col_filter_matrix<fdeep::float_type>
+generate_filter_matrix(const conv_config& config)
+{
+    return fdeep::internal::im2col_filter_matrix_from_weights(
+        filter_shape(config), config.dilation_rate_, config.k_,
+        fdeep::internal::float_buffer<fdeep::float_type>(
+            filter_weights(config)), filter_bias(config));
+}
+
+// Several samples, so the batched kernels cross sample borders.
+static fdeep::tensor5s generate_test_inputs(const conv_config& config)
+{
+    return {generate_test_tensor(config.input_shape_, 1),
+        generate_test_tensor(config.input_shape_, 4),
+        generate_test_tensor(config.input_shape_, 5)};
+}
+
+static void require_naive_convolve(const conv_config& config,
+    fdeep::internal::padding pad_type, bool use_offset,
+    const fdeep::tensor5s& inputs, const fdeep::tensor5s& results)
+{
+    REQUIRE(results.size() == inputs.size());
+    for (std::size_t i = 0; i < inputs.size(); ++i)
+    {
+        require_near(results[i], naive_convolve(config.strides_,
+            pad_type, use_offset, filter_shape(config), config.dilation_rate_,
+            filter_weights(config), filter_bias(config), inputs[i]));
+    }
+}
+
+static void test_convolve_batch(const conv_config& config,
+    fdeep::internal::padding pad_type, bool use_offset)
+{
+    const auto inputs = generate_test_inputs(config);
+    require_naive_convolve(config, pad_type, use_offset, inputs,
+        fdeep::internal::convolve_batch(config.strides_, pad_type, use_offset,
+            generate_filter_matrix(config), inputs));
+}
+
+static void test_winograd_convolve(const conv_config& config,
+    fdeep::internal::padding pad_type, bool use_offset)
+{
+    REQUIRE(fdeep::internal::winograd_applicable(filter_shape(config),
+        config.k_, config.strides_, config.dilation_rate_));
+    const auto filter_mats = fdeep::internal::generate_winograd_filter_matrices(
+        generate_filter_matrix(config));
+    const auto inputs = generate_test_inputs(config);
+    require_naive_convolve(config, pad_type, use_offset, inputs,
+        fdeep::internal::winograd_convolve_batch(pad_type, use_offset,
+            filter_mats, inputs));
+    require_naive_convolve(config, pad_type, use_offset, {inputs.front()},
+        {fdeep::internal::winograd_convolve(pad_type, use_offset,
+            filter_mats, inputs.front())});
+}
+
+static fdeep::float_vec depthwise_weights(const conv_config& config)
+{
+    return generate_test_values(
+        config.input_shape_.depth_ * config.filter_size_.area(), 6);
+}
+
+static fdeep::float_vec depthwise_bias(const conv_config& config)
+{
+    return generate_test_values(config.input_shape_.depth_, 7);
+}
+
+static fdeep::internal::depthwise_filter_matrix<fdeep::float_type>
+generate_depthwise_filter_matrix(const conv_config& config)
+{
+    return fdeep::internal::generate_depthwise_filter_matrix(
+        fdeep::internal::generate_filters(fdeep::shape5(1, 1,
+                config.filter_size_.height_, config.filter_size_.width_, 1),
+            config.input_shape_.depth_,
+            depthwise_weights(config), depthwise_bias(config)),
+        config.dilation_rate_);
+}
+
+// Reference depthwise convolution, which convolves
+// every channel on its own with naive_convolve.
+static fdeep::tensor5 naive_depthwise_convolve(const conv_config& config,
+    fdeep::internal::padding pad_type, bool use_offset,
+    const fdeep::tensor5& input)
+{
+    const fdeep::shape5 channel_filter_shape(1, 1,
+        config.filter_size_.height_, config.filter_size_.width_, 1);
+    const std::size_t area = config.filter_size_.area();
+    const auto weights = depthwise_weights(config);
+    const auto bias = depthwise_bias(config);
+    fdeep::tensor5s results;
+    for (std::size_t c = 0; c < input.depth(); ++c)
+    {
+        fdeep::tensor5 channel(fdeep::shape5(1, 1,
+            input.height(), input.width(), 1), 0);
+        for (std::size_t y = 0; y < input.height(); ++y)
+        {
+            for (std::size_t x = 0; x < input.width(); ++x)
+            {
+                channel.set(0, 0, y, x, 0, input.get(0, 0, y, x, c));
+            }
+        }
+        results.push_back(naive_convolve(config.strides_, pad_type, use_offset,
+            channel_filter_shape, config.dilation_rate_,
+            fdeep::float_vec(
+                weights.begin() + static_cast<std::ptrdiff_t>(c * area),
+                weights.begin() + static_cast<std::ptrdiff_t>((c + 1) * area)),
+            fdeep::float_vec(1, bias[c]), channel));
+    }
+    const auto& out_shape = results.front().shape();
+    fdeep::tensor5 result(fdeep::shape5(1, 1,
+        out_shape.height_, out_shape.width_, input.depth()), 0);
+    for (std::size_t y = 0; y < out_shape.height_; ++y)
+    {
+        for (std::size_t x = 0; x < out_shape.width_; ++x)
+        {
+            for (std::size_t c = 0; c < input.depth(); ++c)
+            {
+                result.set(0, 0, y, x, c, results[c].get(0, 0, y, x, 0));
+            }
+        }
+    }
+    return result;
+}
+
+static void test_depthwise_convolve(const conv_config& config,
+    fdeep::internal::padding pad_type, bool use_offset)
+{
+    const auto input = generate_test_tensor(config.input_shape_, 1);
+    require_near(fdeep::internal::depthwise_convolve(config.strides_,
+            pad_type, use_offset, generate_depthwise_filter_matrix(config),
+            input),
+        naive_depthwise_convolve(config, pad_type, use_offset, input));
+}
+
+// Compares with naive_depthwise_convolve followed by naive_convolve.
+static void test_separable_convolve(const conv_config& config,
+    fdeep::internal::padding pad_type, bool use_offset)
+{
+    const auto input = generate_test_tensor(config.input_shape_, 1);
+    const auto depthwise_result = naive_depthwise_convolve(
+        config, pad_type, use_offset, input);
+    const conv_config pointwise = {depthwise_result.shape(),
+        fdeep::internal::shape2(1, 1), config.k_,
+        fdeep::internal::shape2(1, 1), fdeep::internal::shape2(1, 1)};
+    require_naive_convolve(pointwise, fdeep::internal::padding::valid, false,
+        {depthwise_result},
+        {fdeep::internal::separable_convolve(config.strides_,
+            pad_type, use_offset, generate_depthwise_filter_matrix(config),
+            generate_filter_matrix(pointwise), input)});
+}
+
+// Loads the model without running its test cases,
+// creating the layers on the pool (if not null).
+// layer_names receives the names of the layers in their final order.
+static fdeep::model load_model_using_pool(fdeep::internal::thread_pool* pool,
+    const fdeep::internal::layer_creators<fdeep::float_type>& custom_layer_creators,
+    std::vector<std::string>& layer_names)
+{
+    std::ifstream in_stream("../test_model_convolutional.json", std::ios::binary);
+    REQUIRE(in_stream.good());
+    std::vector<fdeep::internal::decoded_array> decoded_arrays;
+    auto json_data = fdeep::internal::parse_json_model(in_stream, false, pool,
+        decoded_arrays);
+    const fdeep::internal::weight_blob_reader blob_reader(
+        std::move(decoded_arrays));
+    fdeep::internal::load_logger load_log(fdeep::cout_logger);
+    // Passes run until nothing changes anymore,
+    // so the last call sees the final graph.
+    const fdeep::internal::graph_passes<fdeep::float_type> passes = {
+        {"record_layer_names", [&layer_names]
+            (fdeep::internal::model_graph<fdeep::float_type>& graph) -> bool
+        {
+            layer_names = fplus::transform(
+                [](const fdeep::internal::layer_ptr<fdeep::float_type>& layer)
+                {
+                    return layer->name_;
+                }, graph.layers_);
+            return false;
+        }}};
+    return fdeep::internal::construct_model(json_data, &blob_reader, pool,
+        load_log, fdeep::internal::verification_mode::none,
+        static_cast<fdeep::float_type>(0), custom_layer_creators, passes);
+}
+
 TEST_CASE("test_model_convolutional_test, load_model")
 {
     const auto model = fdeep::load_model("../test_model_convolutional.json",
@@ -20,3 +395,183 @@ TEST_CASE("test_model_convolutional_test, load_model")
     model.predict_multi(multi_inputs, false);
     model.predict_multi(multi_inputs, true);
 }
+
+TEST_CASE("test_model_convolutional_test, set_thread_count")
+{
+    auto model = fdeep::load_model("../test_model_convolutional.json",
+        true, fdeep::cout_logger, static_cast<fdeep::float_type>(0.00001));
+    const auto inputs = generate_test_inputs(model);
+    const auto outputs = model.predict(inputs);
+    model.set_thread_count(3);
+    for (std::size_t run = 0; run < 10; ++run)
+    {
+        require_near(model.predict(inputs), outputs);
+    }
+}
+
+TEST_CASE("test_model_convolutional_test, convolve_split_across_threads")
+{
+    // Large enough to be split into column blocks.
+    fdeep::internal::thread_pool pool(4);
+    const fdeep::internal::thread_pool_scope pool_scope(&pool);
+    for_each_conv_config({
+        {fdeep::shape5(1, 1, 37, 29, 16), fdeep::internal::shape2(3, 3), 24,
+            fdeep::internal::shape2(1, 1), fdeep::internal::shape2(1, 1)},
+        {fdeep::shape5(1, 1, 64, 61, 8), fdeep::internal::shape2(5, 5), 16,
+            fdeep::internal::shape2(2, 2), fdeep::internal::shape2(1, 1)}},
+        test_convolve_batch);
+}
+
+TEST_CASE("test_model_convolutional_test, winograd_convolve")
+{
+    // Odd sizes leave partial 2x2 output tiles at the borders.
+    for_each_conv_config({
+        {fdeep::shape5(1, 1, 3, 3, 8), fdeep::internal::shape2(3, 3), 8,
+            fdeep::internal::shape2(1, 1), fdeep::internal::shape2(1, 1)},
+        {fdeep::shape5(1, 1, 7, 9, 8), fdeep::internal::shape2(3, 3), 9,
+            fdeep::internal::shape2(1, 1), fdeep::internal::shape2(1, 1)},
+        {fdeep::shape5(1, 1, 11, 5, 13), fdeep::internal::shape2(3, 3), 8,
+            fdeep::internal::shape2(1, 1), fdeep::internal::shape2(1, 1)},
+        {fdeep::shape5(1, 1, 16, 12, 8), fdeep::internal::shape2(3, 3), 16,
+            fdeep::internal::shape2(1, 1), fdeep::internal::shape2(1, 1)}},
+        test_winograd_convolve);
+}
+
+TEST_CASE("test_model_convolutional_test, convolve_pointwise")
+{
+    // 1x1 filters with stride 1 are multiplied without im2col.
+    // The largest input is split into column blocks.
+    fdeep::internal::thread_pool pool(4);
+    const fdeep::internal::thread_pool_scope pool_scope(&pool);
+    for_each_conv_config({
+        {fdeep::shape5(1, 1, 5, 7, 1), fdeep::internal::shape2(1, 1), 3,
+            fdeep::internal::shape2(1, 1), fdeep::internal::shape2(1, 1)},
+        {fdeep::shape5(1, 1, 6, 3, 5), fdeep::internal::shape2(1, 1), 1,
+            fdeep::internal::shape2(1, 1), fdeep::internal::shape2(1, 1)},
+        {fdeep::shape5(1, 1, 9, 11, 12), fdeep::internal::shape2(1, 1), 7,
+            fdeep::internal::shape2(1, 1), fdeep::internal::shape2(1, 1)},
+        {fdeep::shape5(1, 1, 40, 33, 16), fdeep::internal::shape2(1, 1), 24,
+            fdeep::internal::shape2(1, 1), fdeep::internal::shape2(1, 1)}},
+        test_convolve_batch);
+}
+
+TEST_CASE("test_model_convolutional_test, depthwise_convolve")
+{
+    // The largest input is split into blocks of rows.
+    fdeep::internal::thread_pool pool(4);
+    const fdeep::internal::thread_pool_scope pool_scope(&pool);
+    for_each_conv_config({
+        {fdeep::shape5(1, 1, 7, 8, 1), fdeep::internal::shape2(3, 3), 0,
+            fdeep::internal::shape2(1, 1), fdeep::internal::shape2(1, 1)},
+        {fdeep::shape5(1, 1, 9, 10, 5), fdeep::internal::shape2(3, 3), 0,
+            fdeep::internal::shape2(2, 2), fdeep::internal::shape2(1, 1)},
+        {fdeep::shape5(1, 1, 12, 11, 6), fdeep::internal::shape2(3, 2), 0,
+            fdeep::internal::shape2(1, 2), fdeep::internal::shape2(2, 3)},
+        {fdeep::shape5(1, 1, 8, 9, 3), fdeep::internal::shape2(4, 4), 0,
+            fdeep::internal::shape2(2, 3), fdeep::internal::shape2(1, 1)},
+        {fdeep::shape5(1, 1, 64, 63, 32), fdeep::internal::shape2(3, 3), 0,
+            fdeep::internal::shape2(1, 1), fdeep::internal::shape2(1, 1)}},
+        test_depthwise_convolve);
+}
+
+TEST_CASE("test_model_convolutional_test, separable_convolve")
+{
+    // With 128 channels, more positions than fit into one tile.
+    for_each_conv_config({
+        {fdeep::shape5(1, 1, 7, 8, 1), fdeep::internal::shape2(3, 3), 4,
+            fdeep::internal::shape2(1, 1), fdeep::internal::shape2(1, 1)},
+        {fdeep::shape5(1, 1, 10, 9, 5), fdeep::internal::shape2(3, 3), 6,
+            fdeep::internal::shape2(2, 2), fdeep::internal::shape2(1, 1)},
+        {fdeep::shape5(1, 1, 13, 11, 4), fdeep::internal::shape2(2, 3), 3,
+            fdeep::internal::shape2(1, 2), fdeep::internal::shape2(3, 2)},
+        {fdeep::shape5(1, 1, 19, 17, 128), fdeep::internal::shape2(3, 3), 5,
+            fdeep::internal::shape2(1, 1), fdeep::internal::shape2(1, 1)}},
+        test_separable_convolve);
+    // Split into blocks of positions, which do not line up with the tiles.
+    fdeep::internal::thread_pool pool(4);
+    const fdeep::internal::thread_pool_scope pool_scope(&pool);
+    for_each_conv_config({
+        {fdeep::shape5(1, 1, 41, 37, 96), fdeep::internal::shape2(3, 3), 16,
+            fdeep::internal::shape2(1, 1), fdeep::internal::shape2(1, 1)}},
+        test_separable_convolve);
+}
+
+TEST_CASE("test_model_convolutional_test, convolve_dilated")
+{
+    for_each_conv_config({
+        {fdeep::shape5(1, 1, 11, 10, 1), fdeep::internal::shape2(3, 3), 2,
+            fdeep::internal::shape2(1, 1), fdeep::internal::shape2(2, 2)},
+        {fdeep::shape5(1, 1, 12, 13, 4), fdeep::internal::shape2(3, 3), 5,
+            fdeep::internal::shape2(1, 1), fdeep::internal::shape2(2, 3)},
+        {fdeep::shape5(1, 1, 14, 9, 3), fdeep::internal::shape2(2, 3), 4,
+            fdeep::internal::shape2(2, 2), fdeep::internal::shape2(3, 1)},
+        {fdeep::shape5(1, 1, 15, 16, 2), fdeep::internal::shape2(3, 2), 3,
+            fdeep::internal::shape2(2, 3), fdeep::internal::shape2(2, 2)}},
+        test_convolve_batch);
+    // The dilated filter is larger than the input.
+    test_convolve_batch({fdeep::shape5(1, 1, 5, 6, 3),
+        fdeep::internal::shape2(3, 3), 4,
+        fdeep::internal::shape2(1, 1), fdeep::internal::shape2(3, 3)},
+        fdeep::internal::padding::same, false);
+}
+
+TEST_CASE("test_model_convolutional_test, convolve_padding")
+{
+    for_each_conv_config({
+        {fdeep::shape5(1, 1, 9, 8, 1), fdeep::internal::shape2(3, 3), 3,
+            fdeep::internal::shape2(2, 2), fdeep::internal::shape2(1, 1)},
+        {fdeep::shape5(1, 1, 10, 11, 4), fdeep::internal::shape2(3, 3), 5,
+            fdeep::internal::shape2(2, 2), fdeep::internal::shape2(1, 1)},
+        {fdeep::shape5(1, 1, 12, 13, 1), fdeep::internal::shape2(4, 2), 2,
+            fdeep::internal::shape2(3, 2), fdeep::internal::shape2(1, 1)},
+        {fdeep::shape5(1, 1, 13, 10, 3), fdeep::internal::shape2(2, 4), 4,
+            fdeep::internal::shape2(2, 3), fdeep::internal::shape2(1, 1)},
+        {fdeep::shape5(1, 1, 7, 7, 2), fdeep::internal::shape2(5, 5), 3,
+            fdeep::internal::shape2(1, 1), fdeep::internal::shape2(1, 1)}},
+        test_convolve_batch);
+}
+
+TEST_CASE("test_model_convolutional_test, load_model_using_pool")
+{
+    std::vector<std::string> layer_names;
+    const auto model = load_model_using_pool(nullptr, {}, layer_names);
+    REQUIRE(!layer_names.empty());
+    const auto inputs = generate_test_inputs(model);
+    const auto outputs = model.predict(inputs);
+
+    // Custom layer creators are never called concurrently.
+    std::atomic<std::size_t> running_creators(0);
+    std::atomic<bool> concurrent_creators(false);
+    const fdeep::internal::layer_creators<fdeep::float_type> custom_creators = {
+        {"Conv2D", [&](const fdeep::internal::get_param_f& get_param,
+            const fdeep::internal::get_global_param_f& get_global_param,
+            const nlohmann::json& data, const std::string& name)
+        {
+            if (++running_creators > 1)
+            {
+                concurrent_creators = true;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            const auto result = fdeep::internal::create_conv_2d_layer<
+                fdeep::float_type>(get_param, get_global_param, data, name);
+            --running_creators;
+            return result;
+        }}};
+
+    fdeep::internal::thread_pool pool(4);
+    for (const auto& creators : {
+        fdeep::internal::layer_creators<fdeep::float_type>(), custom_creators})
+    {
+        std::vector<std::string> pool_layer_names;
+        const auto pool_model =
+            load_model_using_pool(&pool, creators, pool_layer_names);
+        REQUIRE(pool_layer_names == layer_names);
+        const auto pool_outputs = pool_model.predict(inputs);
+        REQUIRE(pool_outputs.size() == outputs.size());
+        for (std::size_t i = 0; i < outputs.size(); ++i)
+        {
+            REQUIRE(*pool_outputs[i].as_vector() == *outputs[i].as_vector());
+        }
+    }
+    REQUIRE(!concurrent_creators);
+}
@@ -8,6 +8,177 @@
 #include "doctest/doctest.h"
 #include <fdeep/fdeep.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+// Deterministic but non-constant values in [-1, 1].
+static fdeep::tensor5 generate_test_tensor(const fdeep::shape5& shape)
+{
+    fdeep::float_vec values(shape.volume());
+    for (std::size_t i = 0; i < values.size(); ++i)
+    {
+        values[i] = static_cast<fdeep::float_type>(
+            std::sin(static_cast<double>(i) * 0.37));
+    }
+    return fdeep::tensor5(shape, std::move(values));
+}
+
+// Converts between (height, width, channels) and (channels, height, width).
+static fdeep::tensor5 channels_last_to_first(const fdeep::tensor5& in)
+{
+    fdeep::tensor5 out(fdeep::shape5(1, 1,
+        in.depth(), in.height(), in.width()), 0);
+    for (std::size_t y = 0; y < in.height(); ++y)
+    {
+        for (std::size_t x = 0; x < in.width(); ++x)
+        {
+            for (std::size_t z = 0; z < in.depth(); ++z)
+            {
+                out.set(0, 0, z, y, x, in.get(0, 0, y, x, z));
+            }
+        }
+    }
+    return out;
+}
+
+static void require_near(const fdeep::tensor5& x, const fdeep::tensor5& y)
+{
+    REQUIRE(x.shape() == y.shape());
+    const auto& xs = *x.as_vector();
+    const auto& ys = *y.as_vector();
+    for (std::size_t i = 0; i < xs.size(); ++i)
+    {
+        REQUIRE(static_cast<double>(xs[i]) ==
+            doctest::Approx(static_cast<double>(ys[i])).epsilon(0.0001));
+    }
+}
+
+// Implicit padding along one dimension, computed as described in
+// https://www.tensorflow.org/api_guides/python/nn#Convolution
+// independently of fdeep::internal::preprocess_convolution.
+struct naive_padding
+{
+    std::size_t out_;
+    std::size_t pad_before_;
+    std::size_t offset_;
+};
+
+static naive_padding compute_naive_padding(std::size_t in,
+    std::size_t extent, std::size_t stride,
+    fdeep::internal::padding pad_type, bool use_offset)
+{
+    const std::size_t out = pad_type == fdeep::internal::padding::same
+        ? (in + stride - 1) / stride
+        : (in - extent) / stride + 1;
+    const std::size_t needed = (out - 1) * stride + extent;
+    const std::size_t pad_total = needed > in ? needed - in : 0;
+    // Input positions at the end not reached by any window
+    // are split evenly before and after when use_offset is set.
+    const std::size_t leftover = in + pad_total - needed;
+    return {out, pad_total / 2, use_offset ? leftover / 2 : 0};
+}
+
+// Reference pooling of a channels_last input,
+// which only takes the window positions inside of the input into account.
+static fdeep::tensor5 naive_pool(bool max,
+    const fdeep::internal::shape2& pool_size,
+    const fdeep::internal::shape2& strides,
+    fdeep::internal::padding pad_type,
+    bool use_offset,
+    const fdeep::tensor5& input)
+{
+    const auto pad_y = compute_naive_padding(input.height(),
+        pool_size.height_, strides.height_, pad_type, use_offset);
+    const auto pad_x = compute_naive_padding(input.width(),
+        pool_size.width_, strides.width_, pad_type, use_offset);
+    fdeep::tensor5 result(fdeep::shape5(1, 1,
+        pad_y.out_, pad_x.out_, input.depth()), 0);
+    for (std::size_t y = 0; y < pad_y.out_; ++y)
+    {
+        for (std::size_t x = 0; x < pad_x.out_; ++x)
+        {
+            for (std::size_t z = 0; z < input.depth(); ++z)
+            {
+                double val = max ? std::numeric_limits<double>::lowest() : 0;
+                std::size_t count = 0;
+                for (std::size_t yf = 0; yf < pool_size.height_; ++yf)
+                {
+                    const int iy = static_cast<int>(pad_y.offset_ +
+                        y * strides.height_ + yf) -
+                        static_cast<int>(pad_y.pad_before_);
+                    for (std::size_t xf = 0; xf < pool_size.width_; ++xf)
+                    {
+                        const int ix = static_cast<int>(pad_x.offset_ +
+                            x * strides.width_ + xf) -
+                            static_cast<int>(pad_x.pad_before_);
+                        if (iy < 0 || iy >= static_cast<int>(input.height()) ||
+                            ix < 0 || ix >= static_cast<int>(input.width()))
+                        {
+                            continue;
+                        }
+                        const auto v = static_cast<double>(input.get(0, 0,
+                            static_cast<std::size_t>(iy),
+                            static_cast<std::size_t>(ix), z));
+                        val = max ? std::max(val, v) : val + v;
+                        ++count;
+                    }
+                }
+                REQUIRE(count > 0);
+                result.set(0, 0, y, x, z, static_cast<fdeep::float_type>(
+                    max ? val : val / static_cast<double>(count)));
+            }
+        }
+    }
+    return result;
+}
+
+// Runs max_pool_2d and average_pool_2d on channels_last
+// and channels_first inputs and compares them with naive_pool,
+// with same and valid padding, with and without offset.
+static void test_pool(
+    const fdeep::shape5& input_shape,
+    const fdeep::internal::shape2& pool_size,
+    const fdeep::internal::shape2& strides)
+{
+    const auto input = generate_test_tensor(input_shape);
+    const auto input_channels_first = channels_last_to_first(input);
+    for (const auto pad_type :
+        {fdeep::internal::padding::same, fdeep::internal::padding::valid})
+    {
+        for (const bool use_offset : {false, true})
+        {
+            const auto max_pool = [&](bool channels_first,
+                const fdeep::tensor5& in) -> fdeep::tensor5
+            {
+                return fdeep::internal::max_pool_2d(
+                    pool_size.height_, pool_size.width_,
+                    strides.height_, strides.width_,
+                    channels_first, pad_type, use_offset, in);
+            };
+            const auto average_pool = [&](bool channels_first,
+                const fdeep::tensor5& in) -> fdeep::tensor5
+            {
+                return fdeep::internal::average_pool_2d(
+                    pool_size.height_, pool_size.width_,
+                    strides.height_, strides.width_,
+                    channels_first, pad_type, use_offset, in);
+            };
+            const auto expected_max = naive_pool(true, pool_size, strides,
+                pad_type, use_offset, input);
+            const auto expected_average = naive_pool(false, pool_size, strides,
+                pad_type, use_offset, input);
+            require_near(max_pool(false, input), expected_max);
+            require_near(max_pool(true, input_channels_first),
+                channels_last_to_first(expected_max));
+            require_near(average_pool(false, input), expected_average);
+            require_near(average_pool(true, input_channels_first),
+                channels_last_to_first(expected_average));
+        }
+    }
+}
+
 TEST_CASE("test_model_pooling_test, load_model")
 {
     const auto model = fdeep::load_model("../test_model_pooling.json",
@@ -18,3 +189,20 @@ TEST_CASE("test_model_pooling_test, load_model")
     model.predict_multi(multi_inputs, false);
     model.predict_multi(multi_inputs, true);
 }
+
+TEST_CASE("test_model_pooling_test, pool_2d")
+{
+    // The layers call the pooling with constant sizes for 2x2 and 4x4.
+    test_pool(fdeep::shape5(1, 1, 8, 8, 1),
+        fdeep::internal::shape2(2, 2), fdeep::internal::shape2(2, 2));
+    test_pool(fdeep::shape5(1, 1, 9, 7, 3),
+        fdeep::internal::shape2(2, 2), fdeep::internal::shape2(2, 2));
+    test_pool(fdeep::shape5(1, 1, 11, 10, 2),
+        fdeep::internal::shape2(4, 4), fdeep::internal::shape2(4, 4));
+    test_pool(fdeep::shape5(1, 1, 10, 13, 5),
+        fdeep::internal::shape2(3, 3), fdeep::internal::shape2(2, 2));
+    test_pool(fdeep::shape5(1, 1, 12, 9, 4),
+        fdeep::internal::shape2(2, 3), fdeep::internal::shape2(3, 1));
+    test_pool(fdeep::shape5(1, 1, 7, 6, 1),
+        fdeep::internal::shape2(3, 2), fdeep::internal::shape2(1, 1));
+}
@@ -8,6 +8,68 @@
 #include "doctest/doctest.h"
 #include <fdeep/fdeep.hpp>
 
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <set>
+#include <string>
+
+// Deterministic but non-constant values in [-1, 1].
+static fdeep::tensor5 generate_test_tensor(const fdeep::shape5& shape,
+    std::size_t seed)
+{
+    fdeep::float_vec values(shape.volume());
+    for (std::size_t i = 0; i < values.size(); ++i)
+    {
+        values[i] = static_cast<fdeep::float_type>(
+            std::sin(static_cast<double>(i * 7 + seed * 131) * 0.37));
+    }
+    return fdeep::tensor5(shape, std::move(values));
+}
+
+static fdeep::tensor5s_vec generate_test_batch(const fdeep::model& model,
+    std::size_t sample_count)
+{
+    fdeep::tensor5s_vec inputs_vec;
+    for (std::size_t sample = 0; sample < sample_count; ++sample)
+    {
+        inputs_vec.push_back(fplus::transform(
+            [sample](const fdeep::shape5& shape) -> fdeep::tensor5
+            {
+                return generate_test_tensor(shape, sample);
+            }, model.get_dummy_input_shapes()));
+    }
+    return inputs_vec;
+}
+
+static void require_near(const fdeep::tensor5s& xs, const fdeep::tensor5s& ys)
+{
+    REQUIRE(xs.size() == ys.size());
+    for (std::size_t i = 0; i < xs.size(); ++i)
+    {
+        REQUIRE(xs[i].shape() == ys[i].shape());
+        const auto& x = *xs[i].as_vector();
+        const auto& y = *ys[i].as_vector();
+        for (std::size_t j = 0; j < x.size(); ++j)
+        {
+            REQUIRE(static_cast<double>(x[j]) ==
+                doctest::Approx(static_cast<double>(y[j])).epsilon(0.0001));
+        }
+    }
+}
+
+// Every sample of a batch must give the same result as predicting it alone.
+static void test_predict_batch(const fdeep::model& model,
+    const fdeep::tensor5s_vec& inputs_vec)
+{
+    const auto outputs_vec = model.predict_batch(inputs_vec);
+    REQUIRE(outputs_vec.size() == inputs_vec.size());
+    for (std::size_t i = 0; i < inputs_vec.size(); ++i)
+    {
+        require_near(outputs_vec[i], model.predict(inputs_vec[i]));
+    }
+}
+
 TEST_CASE("test_model_sequential_test, load_model")
 {
     const auto model = fdeep::load_model("../test_model_sequential.json",
@@ -18,3 +80,179 @@ TEST_CASE("test_model_sequential_test, load_model")
     model.predict_multi(multi_inputs, false);
     model.predict_multi(multi_inputs, true);
 }
+
+TEST_CASE("test_model_sequential_test, load_model_quantized")
+{
+    const auto model = fdeep::load_model_quantized(
+        "../test_model_sequential_int8.json", true, fdeep::cout_logger);
+    const auto report = model.verification().get();
+    REQUIRE(!report.empty());
+    // The outputs of the test cases are the ones of the float model.
+    for (const auto& test_errors : report)
+    {
+        REQUIRE(!test_errors.empty());
+        for (const auto& error : test_errors)
+        {
+            REQUIRE(static_cast<double>(error.max_abs_error_) < 0.1);
+            REQUIRE(static_cast<double>(error.max_rel_error_) < 0.5);
+        }
+    }
+    const auto multi_inputs = fplus::generate<std::vector<fdeep::tensor5s>>(
+        [&]() -> fdeep::tensor5s {return model.generate_dummy_inputs();},
+        10);
+    model.predict_multi(multi_inputs, false);
+    model.predict_multi(multi_inputs, true);
+}
+
+TEST_CASE("test_model_sequential_test, quantize_int8")
+{
+    // Replaces the pass of load_model_quantized
+    // to see which layers are quantized.
+    std::set<std::string> quantizable_layers;
+    std::set<std::string> quantized_layers;
+    const auto quantize = [&](fdeep::internal::model_graph<fdeep::float_type>& graph)
+        -> bool
+    {
+        bool changed = false;
+        for (const auto& ptr : graph.layers_)
+        {
+            if (std::dynamic_pointer_cast<
+                    fdeep::internal::conv_2d_layer<fdeep::float_type>>(ptr) ||
+                std::dynamic_pointer_cast<
+                    fdeep::internal::dense_layer<fdeep::float_type>>(ptr))
+            {
+                quantizable_layers.insert(ptr->name_);
+            }
+            if (ptr->quantize_int8())
+            {
+                quantized_layers.insert(ptr->name_);
+                changed = true;
+            }
+        }
+        return changed;
+    };
+    fdeep::load_model_quantized("../test_model_sequential_int8.json",
+        false, fdeep::cout_logger,
+        std::numeric_limits<fdeep::float_type>::infinity(), {},
+        {{"quantize_layers_int8", quantize}});
+    // All of them have calibrated input ranges.
+    REQUIRE(quantizable_layers.size() >= 2);
+    REQUIRE(quantized_layers == quantizable_layers);
+}
+
+TEST_CASE("test_model_sequential_test, predict_batch")
+{
+    const auto model = fdeep::load_model("../test_model_sequential.json",
+        true, fdeep::cout_logger, static_cast<fdeep::float_type>(0.00001));
+    test_predict_batch(model, generate_test_batch(model, 5));
+}
+
+TEST_CASE("test_model_sequential_test, predict_batch_quantized")
+{
+    const auto model = fdeep::load_model_quantized(
+        "../test_model_sequential_int8.json", true, fdeep::cout_logger);
+    test_predict_batch(model, generate_test_batch(model, 5));
+}
+
+TEST_CASE("test_model_sequential_test, graph_passes")
+{
+    using graph = fdeep::internal::model_graph<fdeep::float_type>;
+    // Passes run until nothing changes anymore,
+    // so the last call sees the final graph.
+    std::size_t layer_count = 0;
+    const auto count_layers = [&layer_count](graph& g) -> bool
+    {
+        layer_count = g.layers_.size();
+        return false;
+    };
+    std::size_t skipped_pass_calls = 0;
+    const auto skip = [&skipped_pass_calls](graph&) -> bool
+    {
+        ++skipped_pass_calls;
+        return false;
+    };
+
+    const auto model = fdeep::load_model("../test_model_sequential.json",
+        true, fdeep::cout_logger, static_cast<fdeep::float_type>(0.00001),
+        fdeep::internal::layer_creators<fdeep::float_type>(),
+        {{"count_layers", count_layers}});
+    const std::size_t optimized_layer_count = layer_count;
+    REQUIRE(skipped_pass_calls == 0);
+
+    // Passes with the names of the default ones replace them.
+    const auto unoptimized_model = fdeep::load_model(
+        "../test_model_sequential.json",
+        true, fdeep::cout_logger, static_cast<fdeep::float_type>(0.00001),
+        fdeep::internal::layer_creators<fdeep::float_type>(),
+        {{"count_layers", count_layers},
+            {"remove_identity_layers", skip},
+            {"merge_activation_layers", skip},
+            {"collapse_reshape_chains", skip}});
+    REQUIRE(skipped_pass_calls == 3);
+    // Dropout and the separate ELU activation are gone
+    // from the optimized graph only.
+    REQUIRE(layer_count > optimized_layer_count);
+
+    const auto inputs_vec = generate_test_batch(model, 3);
+    for (const auto& inputs : inputs_vec)
+    {
+        require_near(model.predict(inputs), unoptimized_model.predict(inputs));
+    }
+}
+
+// Applies the weights to every position on its own.
+static fdeep::tensor5 naive_dense(const fdeep::tensor5& input,
+    const fdeep::float_vec& weights, const fdeep::float_vec& bias)
+{
+    const std::size_t n_in = input.shape().depth_;
+    const std::size_t n_out = bias.size();
+    const std::size_t positions = input.shape().volume() / n_in;
+    const auto& values = *input.as_vector();
+    fdeep::float_vec result(positions * n_out);
+    for (std::size_t p = 0; p < positions; ++p)
+    {
+        for (std::size_t u = 0; u < n_out; ++u)
+        {
+            double sum = static_cast<double>(bias[u]);
+            for (std::size_t i = 0; i < n_in; ++i)
+            {
+                sum += static_cast<double>(values[p * n_in + i]) *
+                    static_cast<double>(weights[i * n_out + u]);
+            }
+            result[p * n_out + u] = static_cast<fdeep::float_type>(sum);
+        }
+    }
+    const auto& shape = input.shape();
+    return fdeep::tensor5(fdeep::shape5(shape.size_dim_5_, shape.size_dim_4_,
+        shape.height_, shape.width_, n_out), std::move(result));
+}
+
+TEST_CASE("test_model_sequential_test, dense_positions")
+{
+    const std::size_t n_in = 13;
+    const std::size_t units = 6;
+    const auto weights =
+        *generate_test_tensor(fdeep::shape5(1, 1, 1, n_in, units), 2).as_vector();
+    const auto bias =
+        *generate_test_tensor(fdeep::shape5(1, 1, 1, 1, units), 3).as_vector();
+    const fdeep::internal::dense_layer<fdeep::float_type> layer("dense", units,
+        fdeep::internal::float_buffer<fdeep::float_type>(fdeep::float_vec(weights)),
+        bias);
+
+    // All positions of a sample are multiplied in one go,
+    // those of a batch even if the samples have different position counts.
+    const fdeep::tensor5s_vec inputs_vec = {
+        {generate_test_tensor(fdeep::shape5(1, 1, 1, 1, n_in), 4)},
+        {generate_test_tensor(fdeep::shape5(1, 1, 3, 4, n_in), 5)},
+        {generate_test_tensor(fdeep::shape5(1, 2, 1, 5, n_in), 6)},
+        {generate_test_tensor(fdeep::shape5(1, 1, 1, 1, n_in), 7)}};
+    const auto outputs_vec = layer.apply_batch(inputs_vec);
+    REQUIRE(outputs_vec.size() == inputs_vec.size());
+    for (std::size_t i = 0; i < inputs_vec.size(); ++i)
+    {
+        const fdeep::tensor5s expected =
+            {naive_dense(inputs_vec[i].front(), weights, bias)};
+        require_near(layer.apply(inputs_vec[i]), expected);
+        require_near(outputs_vec[i], expected);
+    }
+}
@@ -8,6 +8,43 @@
 #include "doctest/doctest.h"
 #include <fdeep/fdeep.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Deterministic but non-constant input values,
+// so that different code paths have something to disagree on.
+static fdeep::tensor5s generate_test_inputs(const fdeep::model& model)
+{
+    return fplus::transform([](const fdeep::shape5& shape) -> fdeep::tensor5
+    {
+        fdeep::float_vec values(shape.volume());
+        for (std::size_t i = 0; i < values.size(); ++i)
+        {
+            values[i] = static_cast<fdeep::float_type>(
+                std::sin(static_cast<double>(i) * 0.7));
+        }
+        return fdeep::tensor5(shape, std::move(values));
+    }, model.get_dummy_input_shapes());
+}
+
+static void require_equal(const fdeep::tensor5s& xs,
+    const fdeep::tensor5s& ys)
+{
+    REQUIRE(xs.size() == ys.size());
+    for (std::size_t i = 0; i < xs.size(); ++i)
+    {
+        REQUIRE(xs[i].shape() == ys[i].shape());
+        REQUIRE(*xs[i].as_vector() == *ys[i].as_vector());
+    }
+}
+
 TEST_CASE("test_model_small_test, load_model")
 {
     const auto model = fdeep::load_model("../test_model_small.json",
@@ -18,3 +55,353 @@ TEST_CASE("test_model_small_test, load_model")
     model.predict_multi(multi_inputs, false);
     model.predict_multi(multi_inputs, true);
 }
+
+TEST_CASE("test_model_small_test, set_thread_count")
+{
+    auto model = fdeep::load_model("../test_model_small.json",
+        true, fdeep::cout_logger, static_cast<fdeep::float_type>(0.00001));
+    const auto inputs = generate_test_inputs(model);
+    const auto outputs = model.predict(inputs);
+    model.set_thread_count(4);
+    REQUIRE(model.thread_count() == 4);
+    // The steps run in a different order every time,
+    // but every one of them computes the same as before.
+    for (std::size_t run = 0; run < 10; ++run)
+    {
+        require_equal(model.predict(inputs), outputs);
+    }
+    model.set_thread_count(1);
+    REQUIRE(model.thread_count() == 1);
+    require_equal(model.predict(inputs), outputs);
+}
+
+TEST_CASE("test_model_small_test, load_model_verify_async")
+{
+    const auto model = fdeep::load_model_verify_async(
+        "../test_model_small.json",
+        fdeep::cout_logger, static_cast<fdeep::float_type>(0.00001));
+    const auto multi_inputs = fplus::generate<std::vector<fdeep::tensor5s>>(
+        [&]() -> fdeep::tensor5s {return model.generate_dummy_inputs();},
+        10);
+    model.predict_multi(multi_inputs, true);
+    const auto report = model.verification().get();
+    REQUIRE(!report.empty());
+}
+
+TEST_CASE("test_model_small_test, load_model_cached")
+{
+    const auto model = fdeep::load_model_cached("../test_model_small.json",
+        ".", true, fdeep::cout_logger,
+        static_cast<fdeep::float_type>(0.00001));
+    const auto cached_model = fdeep::load_model_cached(
+        "../test_model_small.json",
+        ".", true, fdeep::cout_logger,
+        static_cast<fdeep::float_type>(0.00001));
+    REQUIRE(cached_model.hash() == model.hash());
+    const auto inputs = model.generate_dummy_inputs();
+    const auto outputs = model.predict(inputs);
+    const auto cached_outputs = cached_model.predict(inputs);
+    REQUIRE(outputs.size() == cached_outputs.size());
+    for (std::size_t i = 0; i < outputs.size(); ++i)
+    {
+        REQUIRE(*outputs[i].as_vector() == *cached_outputs[i].as_vector());
+    }
+}
+
+TEST_CASE("test_model_small_test, load_model_float16")
+{
+    const auto model = fdeep::load_model("../test_model_small_float16.json",
+        true, fdeep::cout_logger, static_cast<fdeep::float_type>(0.00001));
+    const auto multi_inputs = fplus::generate<std::vector<fdeep::tensor5s>>(
+        [&]() -> fdeep::tensor5s {return model.generate_dummy_inputs();},
+        10);
+    model.predict_multi(multi_inputs, false);
+    model.predict_multi(multi_inputs, true);
+}
+
+TEST_CASE("test_model_small_test, load_model_double")
+{
+    const auto model = fdeep::load_model("../test_model_small.json",
+        true, fdeep::cout_logger, static_cast<fdeep::float_type>(0.00001));
+    const auto model_double = fdeep::load_model<double>(
+        "../test_model_small.json", true, fdeep::cout_logger, 0.00001);
+    const auto outputs = model.predict(model.generate_dummy_inputs());
+    const auto outputs_double = model_double.predict(
+        model_double.generate_dummy_inputs());
+    REQUIRE(outputs.size() == outputs_double.size());
+    for (std::size_t i = 0; i < outputs.size(); ++i)
+    {
+        const auto& values = *outputs[i].as_vector();
+        const auto& values_double = *outputs_double[i].as_vector();
+        REQUIRE(values.size() == values_double.size());
+        for (std::size_t j = 0; j < values.size(); ++j)
+        {
+            REQUIRE(static_cast<double>(values[j]) ==
+                doctest::Approx(values_double[j]).epsilon(0.0001));
+        }
+    }
+}
+
+static const std::string base64_chars =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static std::string base64_encode(const std::vector<std::uint8_t>& bytes)
+{
+    std::string result;
+    for (std::size_t i = 0; i < bytes.size(); i += 3)
+    {
+        const std::size_t n = std::min<std::size_t>(3, bytes.size() - i);
+        std::uint32_t v = 0;
+        for (std::size_t j = 0; j < 3; ++j)
+        {
+            v = (v << 8) | (j < n ? bytes[i + j] : 0u);
+        }
+        for (std::size_t j = 0; j < 4; ++j)
+        {
+            result.push_back(j <= n ? base64_chars[(v >> (18 - 6 * j)) & 63] : '=');
+        }
+    }
+    return result;
+}
+
+// Decodes one character at a time.
+static std::vector<std::uint8_t> base64_decode_scalar(const std::string& str)
+{
+    std::vector<std::uint8_t> result;
+    std::uint32_t v = 0;
+    std::size_t bits = 0;
+    for (const char c : str)
+    {
+        if (c == '=')
+        {
+            break;
+        }
+        v = (v << 6) | static_cast<std::uint32_t>(base64_chars.find(c));
+        bits += 6;
+        if (bits >= 8)
+        {
+            bits -= 8;
+            result.push_back(static_cast<std::uint8_t>(v >> bits));
+            v &= (1u << bits) - 1;
+        }
+    }
+    return result;
+}
+
+// Long enough strings are decoded with SIMD instructions,
+// if available, as long as the chunks consist of complete quads.
+// Otherwise the characters are taken from the chunks one by one.
+TEST_CASE("test_model_small_test, base64_decode")
+{
+    const std::vector<std::size_t> chunk_sizes = {1, 3, 4, 7, 16, 32, 33, 36};
+    for (std::size_t size = 0; size < 300; size += 1 + size / 8)
+    {
+        std::vector<std::uint8_t> bytes(size);
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            bytes[i] = static_cast<std::uint8_t>((i * 151 + size * 7) % 256);
+        }
+        const std::string encoded = base64_encode(bytes);
+        const auto expected = base64_decode_scalar(encoded);
+        REQUIRE(expected == bytes);
+        REQUIRE(fdeep::internal::Base64_decode(encoded) == expected);
+        for (const auto chunk_size : chunk_sizes)
+        {
+            nlohmann::json chunks = nlohmann::json::array();
+            for (std::size_t i = 0; i < encoded.size(); i += chunk_size)
+            {
+                chunks.push_back(encoded.substr(i, chunk_size));
+            }
+            REQUIRE(fdeep::internal::Base64_decoded_size(chunks) == size);
+            REQUIRE(fdeep::internal::Base64_decode(chunks) == expected);
+
+            // Bytes beyond the destination must stay untouched.
+            const std::size_t dest_size = size / 2;
+            std::vector<std::uint8_t> dest(size + 64, 0xab);
+            REQUIRE(fdeep::internal::Base64_decode_into(
+                chunks, dest.data(), dest_size) == size);
+            REQUIRE(std::equal(expected.begin(),
+                expected.begin() + static_cast<std::ptrdiff_t>(dest_size),
+                dest.begin()));
+            REQUIRE(std::all_of(
+                dest.begin() + static_cast<std::ptrdiff_t>(dest_size),
+                dest.end(), [](std::uint8_t b) { return b == 0xab; }));
+        }
+    }
+}
+
+// s = x + y is read by three branches, one of which could overwrite it.
+// Only the tanh at the end may work in place, on the output of g.
+static const std::string fan_out_model_json = R"({
+    "image_data_format": "channels_last",
+    "architecture": {"class_name": "Model", "config": {
+        "name": "fan_out",
+        "layers": [
+            {"class_name": "InputLayer", "name": "x", "inbound_nodes": [],
+                "config": {"name": "x", "batch_input_shape": [null, 4, 5]}},
+            {"class_name": "InputLayer", "name": "y", "inbound_nodes": [],
+                "config": {"name": "y", "batch_input_shape": [null, 4, 5]}},
+            {"class_name": "Add", "name": "s", "config": {"name": "s"},
+                "inbound_nodes": [[["x", 0, 0, {}], ["y", 0, 0, {}]]]},
+            {"class_name": "Activation", "name": "b",
+                "config": {"name": "b", "activation": "relu"},
+                "inbound_nodes": [[["s", 0, 0, {}]]]},
+            {"class_name": "Activation", "name": "c",
+                "config": {"name": "c", "activation": "sigmoid"},
+                "inbound_nodes": [[["s", 0, 0, {}]]]},
+            {"class_name": "Add", "name": "d", "config": {"name": "d"},
+                "inbound_nodes": [[["s", 0, 0, {}], ["c", 0, 0, {}]]]},
+            {"class_name": "Add", "name": "g", "config": {"name": "g"},
+                "inbound_nodes": [[["c", 0, 0, {}], ["d", 0, 0, {}]]]},
+            {"class_name": "Activation", "name": "h",
+                "config": {"name": "h", "activation": "tanh"},
+                "inbound_nodes": [[["g", 0, 0, {}]]]}
+        ],
+        "input_layers": [["x", 0, 0], ["y", 0, 0]],
+        "output_layers": [["b", 0, 0], ["c", 0, 0], ["d", 0, 0], ["h", 0, 0]]
+    }},
+    "input_shapes": [[1, 1, 1, 4, 5], [1, 1, 1, 4, 5]],
+    "output_shapes": [[1, 1, 1, 4, 5], [1, 1, 1, 4, 5],
+        [1, 1, 1, 4, 5], [1, 1, 1, 4, 5]],
+    "trainable_params": {},
+    "hash": "fan_out"
+})";
+
+TEST_CASE("test_model_small_test, donated_buffers_are_not_shared")
+{
+    auto model = fdeep::read_model_from_string(fan_out_model_json,
+        false, fdeep::cout_logger);
+    const auto inputs = generate_test_inputs(model);
+    const auto& xs = *inputs[0].as_vector();
+    const auto& ys = *inputs[1].as_vector();
+    const auto sigmoid = [](double v) { return 1 / (1 + std::exp(-v)); };
+    const auto require_expected = [&](const fdeep::tensor5s& outputs)
+    {
+        REQUIRE(outputs.size() == 4);
+        for (std::size_t i = 0; i < xs.size(); ++i)
+        {
+            const double s =
+                static_cast<double>(xs[i]) + static_cast<double>(ys[i]);
+            const double c = sigmoid(s);
+            const double d = s + c;
+            const auto value = [i, &outputs](std::size_t output) -> double
+            {
+                return static_cast<double>((*outputs[output].as_vector())[i]);
+            };
+            REQUIRE(value(0) == doctest::Approx(std::max(0.0, s)));
+            REQUIRE(value(1) == doctest::Approx(c));
+            REQUIRE(value(2) == doctest::Approx(d));
+            REQUIRE(value(3) == doctest::Approx(std::tanh(c + d)));
+        }
+    };
+    require_expected(model.predict(inputs));
+    model.set_thread_count(4);
+    for (std::size_t run = 0; run < 20; ++run)
+    {
+        require_expected(model.predict(inputs));
+    }
+}
+
+TEST_CASE("test_model_small_test, slots_are_released_after_last_use")
+{
+    // Slots: x, y, s, b, c, d, g, h like in the fan-out model,
+    // and u = relu(b), which is not a model output.
+    using fdeep::internal::tensor_slots;
+    fdeep::internal::execution_plan<float> plan(2);
+    const std::vector<tensor_slots> step_inputs = {
+        {{0, 0}, {1, 0}}, {{2, 0}}, {{2, 0}}, {{2, 0}, {4, 0}},
+        {{4, 0}, {5, 0}}, {{6, 0}}, {{3, 0}}};
+    for (const auto& inputs : step_inputs)
+    {
+        plan.steps_.push_back({nullptr, inputs, {}, {}, 0, {}});
+    }
+    plan.outputs_ = {{3, 0}, {4, 0}, {5, 0}, {7, 0}};
+    fdeep::internal::add_slot_releases(plan);
+    const std::vector<std::vector<std::size_t>> expected = {
+        {0, 1}, {}, {}, {2}, {}, {6}, {8}};
+    REQUIRE(plan.steps_.size() == expected.size());
+    for (std::size_t i = 0; i < expected.size(); ++i)
+    {
+        REQUIRE(plan.steps_[i].released_slots_ == expected[i]);
+    }
+}
+
+TEST_CASE("test_model_small_test, test_activation_memory")
+{
+    const auto model = fdeep::read_model_from_string(fan_out_model_json,
+        false, fdeep::cout_logger);
+    const auto memory = model.test_activation_memory();
+    // Every tensor has 4 * 5 values. The tanh is fused into g,
+    // which leaves seven tensors. x, y and s are released,
+    // so at most four of them are alive at the same time.
+    const std::size_t tensor_bytes = 4 * 5 * sizeof(float);
+    REQUIRE(memory.total_bytes_ == 7 * tensor_bytes);
+    REQUIRE(memory.peak_bytes_ == 4 * tensor_bytes);
+}
+
+static std::string base64_encode_floats(const std::vector<float>& values)
+{
+    std::vector<std::uint8_t> bytes(values.size() * sizeof(float));
+    std::memcpy(bytes.data(), values.data(), bytes.size());
+    return base64_encode(bytes);
+}
+
+TEST_CASE("test_model_small_test, load_model_cached_winograd")
+{
+    // A 3x3 convolution with enough channels to use the Winograd algorithm.
+    const std::size_t depth = 8;
+    const std::size_t filters = 9;
+    std::vector<float> weights(9 * depth * filters);
+    for (std::size_t i = 0; i < weights.size(); ++i)
+    {
+        weights[i] = static_cast<float>(std::sin(static_cast<double>(i) * 0.3));
+    }
+    std::vector<float> bias(filters);
+    for (std::size_t i = 0; i < bias.size(); ++i)
+    {
+        bias[i] = static_cast<float>(std::cos(static_cast<double>(i)));
+    }
+    const nlohmann::json model_json = {
+        {"image_data_format", "channels_last"},
+        {"conv2d_valid_offset_depth_1", false},
+        {"conv2d_same_offset_depth_1", false},
+        {"conv2d_valid_offset_depth_2", false},
+        {"conv2d_same_offset_depth_2", false},
+        {"architecture", {{"class_name", "Model"}, {"config", {
+            {"name", "winograd"},
+            {"layers", {
+                {{"class_name", "InputLayer"}, {"name", "x"},
+                    {"inbound_nodes", nlohmann::json::array()},
+                    {"config", {{"name", "x"},
+                        {"batch_input_shape", {nullptr, 6, 7, depth}}}}},
+                {{"class_name", "Conv2D"}, {"name", "conv"},
+                    {"inbound_nodes", {{{"x", 0, 0, nlohmann::json::object()}}}},
+                    {"config", {{"name", "conv"}, {"filters", filters},
+                        {"kernel_size", {3, 3}}, {"strides", {1, 1}},
+                        {"padding", "same"}, {"dilation_rate", {1, 1}},
+                        {"use_bias", true}, {"activation", "linear"}}}}}},
+            {"input_layers", {{"x", 0, 0}}},
+            {"output_layers", {{"conv", 0, 0}}}}}}},
+        {"trainable_params", {{"conv", {
+            {"weights", {base64_encode_floats(weights)}},
+            {"bias", {base64_encode_floats(bias)}}}}}},
+        {"input_shapes", {{1, 1, 6, 7, depth}}},
+        {"output_shapes", {{1, 1, 6, 7, filters}}},
+        {"hash", "hash_winograd"}};
+    const std::string model_path = "test_model_winograd.json";
+    std::ofstream(model_path) << model_json.dump();
+    const std::string cache_file_path =
+        fdeep::internal::model_cache_file_path<fdeep::float_type>(
+            ".", "hash_winograd");
+    std::remove(cache_file_path.c_str());
+
+    // The transformed filters are stored in the cache file,
+    // so both cached models use the Winograd algorithm like this one.
+    const auto model = fdeep::load_model(model_path, false);
+    const auto filling_model = fdeep::load_model_cached(model_path, ".", false);
+    const auto cached_model = fdeep::load_model_cached(model_path, ".", false);
+    const auto inputs = generate_test_inputs(model);
+    const auto outputs = model.predict(inputs);
+    require_equal(filling_model.predict(inputs), outputs);
+    require_equal(cached_model.predict(inputs), outputs);
+}
@@ -8,6 +8,58 @@
 #include "doctest/doctest.h"
 #include <fdeep/fdeep.hpp>
 
+#include <cmath>
+
+// Deterministic but non-constant values in [-1, 1].
+static fdeep::tensor5 generate_test_tensor(const fdeep::shape5& shape,
+    std::size_t seed)
+{
+    fdeep::float_vec values(shape.volume());
+    for (std::size_t i = 0; i < values.size(); ++i)
+    {
+        values[i] = static_cast<fdeep::float_type>(
+            std::sin(static_cast<double>(i * 7 + seed * 131) * 0.37));
+    }
+    return fdeep::tensor5(shape, std::move(values));
+}
+
+static fdeep::tensor5s generate_test_inputs(std::size_t height,
+    std::size_t width, std::size_t seed)
+{
+    return {
+        generate_test_tensor(fdeep::shape5(1, 1, height, width, 1), seed),
+        generate_test_tensor(fdeep::shape5(1, 1, height, width, 3), seed + 1),
+        generate_test_tensor(fdeep::shape5(1, 1, 1, width, 4), seed + 2)};
+}
+
+static void require_near(const fdeep::tensor5s& xs, const fdeep::tensor5s& ys)
+{
+    REQUIRE(xs.size() == ys.size());
+    for (std::size_t i = 0; i < xs.size(); ++i)
+    {
+        REQUIRE(xs[i].shape() == ys[i].shape());
+        const auto& x = *xs[i].as_vector();
+        const auto& y = *ys[i].as_vector();
+        for (std::size_t j = 0; j < x.size(); ++j)
+        {
+            REQUIRE(static_cast<double>(x[j]) ==
+                doctest::Approx(static_cast<double>(y[j])).epsilon(0.0001));
+        }
+    }
+}
+
+// Every sample of a batch must give the same result as predicting it alone.
+static void test_predict_batch(const fdeep::model& model,
+    const fdeep::tensor5s_vec& inputs_vec)
+{
+    const auto outputs_vec = model.predict_batch(inputs_vec);
+    REQUIRE(outputs_vec.size() == inputs_vec.size());
+    for (std::size_t i = 0; i < inputs_vec.size(); ++i)
+    {
+        require_near(outputs_vec[i], model.predict(inputs_vec[i]));
+    }
+}
+
 TEST_CASE("test_model_variable_test, load_model")
 {
     const auto model = fdeep::load_model("../test_model_variable.json",
@@ -18,3 +70,20 @@ TEST_CASE("test_model_variable_test, load_model")
     model.predict_multi(multi_inputs, false);
     model.predict_multi(multi_inputs, true);
 }
+
+TEST_CASE("test_model_variable_test, predict_batch")
+{
+    const auto model = fdeep::load_model("../test_model_variable.json",
+        true, fdeep::cout_logger, static_cast<fdeep::float_type>(0.00001));
+    // All samples of the same shape are processed as one batch.
+    test_predict_batch(model, {
+        generate_test_inputs(6, 8, 0),
+        generate_test_inputs(6, 8, 1),
+        generate_test_inputs(6, 8, 2)});
+    // Samples of different shapes fall back to one forward pass each.
+    test_predict_batch(model, {
+        generate_test_inputs(6, 8, 0),
+        generate_test_inputs(9, 5, 1),
+        generate_test_inputs(6, 8, 2),
+        generate_test_inputs(4, 4, 3)});
+}